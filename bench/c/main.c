@@ -0,0 +1,406 @@
+/*
+ * C Microbenchmarks
+ * By: Felix Guo
+ * Times the table, memory and data functions the VM leans on, outside of
+ *   any script, and prints the time and allocations each operation takes.
+ *   Built against bin/wendy.a from `make library`, with the same RELEASE
+ *   setting the library was built with.
+ *
+ * eg: ./wendy-bench-c [filter] [--ops n]
+ *   filter keeps the benchmarks with names containing it. --ops sets about
+ *   how many operations each one times, 2^16 by default.
+ */
+
+#include "../../src/codegen.h"
+#include "../../src/data.h"
+#include "../../src/global.h"
+#include "../../src/memory.h"
+#include "../../src/table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Each benchmark is timed this many times and the fastest is reported, the
+//   others are usually slowed by something else on the machine
+#define ROUNDS 5
+
+static const char* filter = 0;
+static size_t target_ops = 1 << 16;
+static struct settings settings;
+static struct source_table sources;
+static bool error_flag;
+static struct memory* memory;
+
+struct timer {
+	uint64_t start;
+	size_t allocations;
+	uint64_t best;
+	size_t best_allocations;
+	size_t ops;
+};
+
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool selected(const char* name) {
+	return !filter || strstr(name, filter);
+}
+
+static void timer_reset(struct timer* timer) {
+	memset(timer, 0, sizeof(struct timer));
+	timer->best = (uint64_t) -1;
+}
+
+// timer_start() and timer_stop(ops) bracket one timed round of ops operations,
+//   setup and teardown between rounds are left out
+static void timer_start(struct timer* timer) {
+	timer->allocations = allocation_count();
+	timer->start = now();
+}
+
+static void timer_stop(struct timer* timer, size_t ops) {
+	uint64_t elapsed = now() - timer->start;
+	size_t allocations = allocation_count() - timer->allocations;
+	// Rounds of the same benchmark can differ in length, compare per op
+	if (!timer->ops || elapsed * timer->ops < timer->best * ops) {
+		timer->best = elapsed;
+		timer->best_allocations = allocations;
+		timer->ops = ops;
+	}
+}
+
+static void report(const char* name, struct timer* timer) {
+	printf("%-40s %12.1f ns/op %10.2f allocs/op\n", name,
+		(double) timer->best / timer->ops,
+		(double) timer->best_allocations / timer->ops);
+}
+
+// rounds_for(ops) is how many times a loop of ops operations runs to make up
+//   about target_ops
+static size_t rounds_for(size_t ops) {
+	return target_ops > ops ? target_ops / ops : 1;
+}
+
+enum key_distribution {
+	// x0, x1, x2, .. like the names of a loop's temporaries
+	KEYS_SEQUENTIAL,
+	// Random lowercase strings of 4 to 12 characters
+	KEYS_RANDOM,
+	// Long names that only differ at the end, like struct members
+	KEYS_PREFIXED,
+	KEY_DISTRIBUTION_COUNT
+};
+
+static const char* key_distribution_string[] = {
+	"sequential", "random", "prefixed"
+};
+
+// make_keys(distribution, n) returns n distinct keys, allocated outside of
+//   safe_malloc so they aren't counted
+static char** make_keys(enum key_distribution distribution, size_t n) {
+	char** keys = malloc(sizeof(char*) * n);
+	for (size_t i = 0; i < n; i++) {
+		char buffer[64];
+		switch (distribution) {
+			case KEYS_SEQUENTIAL:
+				snprintf(buffer, sizeof(buffer), "x%zu", i);
+				break;
+			case KEYS_RANDOM: {
+				int length = 4 + rand() % 9;
+				for (int c = 0; c < length; c++) {
+					buffer[c] = 'a' + rand() % 26;
+				}
+				// Keeps them distinct without changing the spread
+				snprintf(buffer + length, sizeof(buffer) - length, "%zu", i);
+				break;
+			}
+			default:
+				snprintf(buffer, sizeof(buffer), "struct_member_identifier_%zu", i);
+				break;
+		}
+		keys[i] = strdup(buffer);
+	}
+	return keys;
+}
+
+static void free_keys(char** keys, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		free(keys[i]);
+	}
+	free(keys);
+}
+
+// shuffled(keys, n) returns the keys in a random order, so lookups don't
+//   follow insertion order
+static char** shuffled(char** keys, size_t n) {
+	char** order = malloc(sizeof(char*) * n);
+	memcpy(order, keys, sizeof(char*) * n);
+	for (size_t i = n - 1; i > 0; i--) {
+		size_t j = rand() % (i + 1);
+		char* swap = order[i];
+		order[i] = order[j];
+		order[j] = swap;
+	}
+	return order;
+}
+
+static void bench_tables(void) {
+	static const size_t sizes[] = { 8, 64, 1024, 16384 };
+	for (int d = 0; d < KEY_DISTRIBUTION_COUNT; d++) {
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			size_t n = sizes[s];
+			char name[3][64];
+			snprintf(name[0], sizeof(name[0]), "table_insert/%s/%zu", key_distribution_string[d], n);
+			snprintf(name[1], sizeof(name[1]), "table_find/%s/%zu", key_distribution_string[d], n);
+			snprintf(name[2], sizeof(name[2]), "table_delete/%s/%zu", key_distribution_string[d], n);
+			if (!selected(name[0]) && !selected(name[1]) && !selected(name[2])) {
+				continue;
+			}
+			char** keys = make_keys(d, n);
+			char** order = shuffled(keys, n);
+			size_t rounds = rounds_for(n);
+			struct timer insert, find, delete;
+			timer_reset(&insert);
+			timer_reset(&find);
+			timer_reset(&delete);
+			for (int r = 0; r < ROUNDS; r++) {
+				for (size_t round = 0; round < rounds; round++) {
+					struct table* table = table_create();
+					timer_start(&insert);
+					for (size_t i = 0; i < n; i++) {
+						*table_insert(table, keys[i], memory) = make_data(D_NUMBER, data_value_num(i));
+					}
+					timer_stop(&insert, n);
+
+					timer_start(&find);
+					for (size_t i = 0; i < n; i++) {
+						if (!table_find(table, order[i])) {
+							fprintf(stderr, "table_find lost %s!\n", order[i]);
+							exit(1);
+						}
+					}
+					timer_stop(&find, n);
+
+					timer_start(&delete);
+					for (size_t i = 0; i < n; i++) {
+						table_delete(table, order[i], memory);
+					}
+					timer_stop(&delete, n);
+					table_destroy(memory, table);
+				}
+			}
+			for (int b = 0; b < 3; b++) {
+				if (selected(name[b])) {
+					report(name[b], b == 0 ? &insert : b == 1 ? &find : &delete);
+				}
+			}
+			free(order);
+			free_keys(keys, n);
+		}
+	}
+}
+
+static void bench_refcnt(void) {
+	static const size_t counts[] = { 1, 4, 64 };
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		size_t count = counts[c];
+		char name[64];
+		// Freed as soon as it's made, the container list stays empty
+		snprintf(name, sizeof(name), "refcnt_malloc+free/%zu", count);
+		if (selected(name)) {
+			struct timer timer;
+			timer_reset(&timer);
+			for (int r = 0; r < ROUNDS; r++) {
+				timer_start(&timer);
+				for (size_t i = 0; i < target_ops; i++) {
+					refcnt_free(memory, refcnt_malloc(memory, count));
+				}
+				timer_stop(&timer, target_ops);
+			}
+			report(name, &timer);
+		}
+		// Many live at once and freed in a different order than they were
+		//   made, like a script's temporaries
+		snprintf(name, sizeof(name), "refcnt_malloc+free/%zu/held", count);
+		if (selected(name)) {
+			size_t held = 1024;
+			struct data** blocks = malloc(sizeof(struct data*) * held);
+			struct timer timer;
+			timer_reset(&timer);
+			for (int r = 0; r < ROUNDS; r++) {
+				timer_start(&timer);
+				for (size_t round = 0; round < rounds_for(held); round++) {
+					for (size_t i = 0; i < held; i++) {
+						blocks[i] = refcnt_malloc(memory, count);
+					}
+					for (size_t i = 0; i < held; i++) {
+						refcnt_free(memory, blocks[(i * 7) % held]);
+					}
+				}
+				timer_stop(&timer, rounds_for(held) * held);
+			}
+			report(name, &timer);
+			free(blocks);
+		}
+	}
+}
+
+static void bench_copy(const char* type, struct data original) {
+	char name[64];
+	snprintf(name, sizeof(name), "copy_data+destroy/%s", type);
+	if (selected(name)) {
+		struct timer timer;
+		timer_reset(&timer);
+		for (int r = 0; r < ROUNDS; r++) {
+			timer_start(&timer);
+			for (size_t i = 0; i < target_ops; i++) {
+				struct data copy = copy_data_runtime(memory, original);
+				destroy_data_runtime(memory, &copy);
+			}
+			timer_stop(&timer, target_ops);
+		}
+		report(name, &timer);
+	}
+	destroy_data_runtime(memory, &original);
+}
+
+static void bench_data(void) {
+	bench_copy("number", make_data(D_NUMBER, data_value_num(42)));
+	bench_copy("string", make_data(D_STRING, data_value_str("hello world")));
+	bench_copy("list_header", list_header_data(8, 8));
+	struct data* list = wendy_list_malloc(memory, 8);
+	for (size_t i = 1; i <= 8; i++) {
+		list[i] = make_data(D_NUMBER, data_value_num(i));
+	}
+	bench_copy("list", make_data(D_LIST, data_value_ptr(list)));
+}
+
+static void bench_closures(void) {
+	static const size_t depths[] = { 1, 8, 32 };
+	// Each frame declares this many variables
+	static const size_t width = 8;
+	char** keys = make_keys(KEYS_SEQUENTIAL, width);
+	for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+		size_t depth = depths[d];
+		char name[64];
+		snprintf(name, sizeof(name), "create_closure/depth %zu", depth);
+		if (!selected(name)) continue;
+		for (size_t f = 0; f < depth; f++) {
+			push_frame(memory, "frame", 0, 0);
+			for (size_t i = 0; i < width; i++) {
+				*push_stack_entry(memory, keys[i], 0) = make_data(D_NUMBER, data_value_num(i));
+			}
+		}
+		struct timer timer;
+		timer_reset(&timer);
+		size_t ops = rounds_for(depth * width);
+		for (int r = 0; r < ROUNDS; r++) {
+			timer_start(&timer);
+			for (size_t i = 0; i < ops; i++) {
+				refcnt_free(memory, create_closure(memory));
+			}
+			timer_stop(&timer, ops);
+		}
+		report(name, &timer);
+		address ret;
+		for (size_t f = 0; f < depth; f++) {
+			pop_frame(memory, true, &ret);
+		}
+	}
+	free_keys(keys, width);
+}
+
+static void bench_decode(void) {
+	// Instruction addresses and identifiers, as OP_PUSH and OP_DECL carry
+	size_t count = 4096;
+	uint8_t* bytecode = malloc(count * (1 + sizeof(double) + 16));
+	size_t size = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (i % 2) {
+			write_data_at_buffer(make_data(D_INSTRUCTION_ADDRESS, data_value_num(i)), bytecode, size);
+			size += 1 + sizeof(double);
+		}
+		else {
+			bytecode[size++] = D_IDENTIFIER;
+			size += sprintf((char*) bytecode + size, "ident%zu", i) + 1;
+		}
+	}
+	if (selected("get_data")) {
+		struct timer timer;
+		timer_reset(&timer);
+		size_t rounds = rounds_for(count);
+		for (int r = 0; r < ROUNDS; r++) {
+			double sum = 0;
+			timer_start(&timer);
+			for (size_t round = 0; round < rounds; round++) {
+				unsigned int end = 0;
+				while (end < size) {
+					struct data t = get_data(bytecode + end, &end);
+					sum += is_numeric(t) ? t.value.number : 1;
+				}
+			}
+			timer_stop(&timer, rounds * count);
+			if (sum < 0) printf("%f\n", sum);
+		}
+		report("get_data", &timer);
+	}
+	if (selected("get_address")) {
+		for (size_t i = 0; i < count; i++) {
+			write_address_at_buffer(i, bytecode, i * sizeof(address));
+		}
+		struct timer timer;
+		timer_reset(&timer);
+		size_t rounds = rounds_for(count);
+		for (int r = 0; r < ROUNDS; r++) {
+			address sum = 0;
+			timer_start(&timer);
+			for (size_t round = 0; round < rounds; round++) {
+				unsigned int end = 0;
+				for (size_t i = 0; i < count; i++) {
+					sum += get_address(bytecode + end, &end);
+				}
+			}
+			timer_stop(&timer, rounds * count);
+			if (sum == 1) printf("%u\n", sum);
+		}
+		report("get_address", &timer);
+	}
+	free(bytecode);
+}
+
+int main(int argc, char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (streq(argv[i], "--ops") && i + 1 < argc) {
+			target_ops = strtoul(argv[++i], 0, 0);
+		}
+		else if (!filter && argv[i][0] != '-') {
+			filter = argv[i];
+		}
+		else {
+			fprintf(stderr, "usage: wendy-bench-c [filter] [--ops n]\n");
+			return 1;
+		}
+	}
+	if (!target_ops) {
+		target_ops = 1;
+	}
+	determine_endianness();
+	srand(1);
+	settings = get_default_settings();
+	init_source(&sources, 0, "", 0, false);
+	memory = memory_init(&settings, &sources, &error_flag);
+	push_frame(memory, "main", 0, 0);
+
+	bench_tables();
+	bench_refcnt();
+	bench_data();
+	bench_closures();
+	bench_decode();
+
+	memory_destroy(memory);
+	return 0;
+}
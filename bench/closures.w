@@ -0,0 +1,11 @@
+// Making closures and calling them
+let adder => (n) {
+	let add => (x) x + n;
+	ret add;
+};
+let total = 0;
+for i in 0 -> 3000 {
+	let f = adder(i);
+	total += f(1);
+}
+total;
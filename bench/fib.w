@@ -0,0 +1,6 @@
+// Recursive calls: naive Fibonacci
+let fib => (n) {
+	if n < 2 ret n;
+	ret fib(n - 1) + fib(n - 2);
+};
+fib(22);
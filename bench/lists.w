@@ -0,0 +1,15 @@
+// Appending to, slicing and sorting lists
+import list;
+let xs = [];
+for i in 0 -> 1000 {
+	xs += (i * 7919) % 1000;
+}
+let total = 0;
+for i in 0 -> 200 {
+	let part = xs[i -> i + 50];
+	total += part[0] + part.size;
+}
+let sorted = sort(xs[0 -> 200]);
+sorted[0];
+sorted[199];
+total;
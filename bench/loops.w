@@ -0,0 +1,8 @@
+// Counted loops over numbers
+let total = 0;
+for i in 0 -> 300 {
+	for j in 0 -> 300 {
+		total += (i * j) % 7;
+	}
+}
+total;
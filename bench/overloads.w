@@ -0,0 +1,14 @@
+// Dispatching to operator overloads on structs
+struct vec => (x, y);
+let <vec> + <vec> => (a, b) vec(a.x + b.x, a.y + b.y);
+let <vec> == <vec> => (a, b) a.x == b.x and a.y == b.y;
+let sum = vec(0, 0);
+let step = vec(1, 2);
+let same = 0;
+for i in 0 -> 3000 {
+	sum = sum + step;
+	if sum == vec(i + 1, 2 * (i + 1)) same += 1;
+}
+sum.x;
+sum.y;
+same;
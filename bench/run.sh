@@ -0,0 +1,41 @@
+#!/bin/bash
+# Runs every workload in bench/ a number of times and prints the results as
+#   JSON on stdout, to keep or compare against another build. Each workload
+#   reports the median wall time of its runs, and the instructions run,
+#   allocations and peak memory that `wendy --stats` gives for the last one.
+# usage: bench/run.sh [runs] [wendy binary]
+RUNS=${1:-5}
+WENDY=${2:-bin/wendy}
+
+echo "{"
+echo "  \"commit\": \"$(git rev-parse --short HEAD 2> /dev/null)\","
+echo "  \"runs\": $RUNS,"
+echo "  \"benchmarks\": ["
+separator=""
+for f in bench/*.w ; do
+	name=$(basename "${f%.w}")
+	echo Running $name... >&2
+	times=()
+	for ((i = 0; i < RUNS; i++)) ; do
+		start=$(date +%s%N)
+		"$WENDY" "$f" --stats > /dev/null 2> bench.tmp
+		end=$(date +%s%N)
+		times+=($(( (end - start) / 1000 )))
+	done
+	stats=$(tail -n 1 bench.tmp)
+	if [[ "$stats" != "{"* ]] ; then
+		echo Benchmark $name failed: >&2
+		cat bench.tmp >&2
+		rm bench.tmp
+		exit 1
+	fi
+	median=$(printf "%s\n" "${times[@]}" | sort -n | sed -n "$(( (RUNS + 1) / 2 ))p")
+	stats=${stats#\{}
+	printf "%s    {\"name\": \"%s\", \"median_ms\": %d.%03d, %s" \
+		"$separator" "$name" $(( median / 1000 )) $(( median % 1000 )) "${stats%\}}}"
+	separator=$',\n'
+done
+rm -f bench.tmp
+echo
+echo "  ]"
+echo "}"
@@ -0,0 +1,12 @@
+// Building strings a piece at a time and comparing them
+let s = "";
+for i in 0 -> 4000 {
+	s += "x";
+}
+let words = 0;
+for i in 0 -> 4000 {
+	let w = "word" + i;
+	if w != s words += 1;
+}
+s.size;
+words;
@@ -0,0 +1,9 @@
+// Making tables and reading and writing their keys. Tables only take the
+//   keys they're made with, so inserting is making a new one.
+let total = 0;
+for i in 0 -> 2000 {
+	let t = { a: i, b: i + 1, c: i + 2, d: i + 3, e: i + 4 };
+	t.c = t.a + t.e;
+	total += t.b + t.c + t.d;
+}
+total;
@@ -5,22 +5,12 @@ echo Compiling Wendy Library Files
 mkdir -p bin/wendy-lib
 rm -f bin/wendy-lib/*
 
-# Compile Dependency Files
-filestems=()
+# Modules are only rebuilt when they change, unless the compiler itself did
+if [ bin/wendy -nt lib/src/.wendy-build ]; then
+	rm -f lib/src/.wendy-build
+fi
 
-# Dependency Resolver can only work within the directory for now
-cd lib/src/
-for f in *.w ; do
-	../../bin/wendy "$f" --dependencies > ${f%.w}.d
-	filestems+=(${f%.w})
-done
-
-build_order="$(../../bin/dependency-resolve ${filestems[*]})"
-
-while read -r line; do
-	# $line is the stem to build
-	../../bin/wendy $line.w -c
-	cp -R $line.wc ../../bin/wendy-lib/
-done <<< "$build_order"
+bin/wendy --build lib/src || exit 1
+cp lib/src/*.wc bin/wendy-lib/
 
 echo Compiled and Copied
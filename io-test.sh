@@ -4,7 +4,9 @@ for f in tests/*.err ; do
 	rm -f $f
 done
 for f in tests/*.in ; do
-	bin/wendy "$f" > file.tmp
+	# tests/<name>.args holds extra options for that test
+	args=$(cat "${f%.in}.args" 2>/dev/null)
+	bin/wendy "$f" --no-optimize $args > file.tmp
 	if diff "${f%.in}.expect" file.tmp > /dev/null ; then
 		echo Test $(basename $f) passed.
 	else
@@ -16,7 +18,9 @@ for f in tests/*.in ; do
 done
 echo Running Tests with Optimize Flag...
 for f in tests/*.in ; do
-	bin/wendy "$f" --optimize > file.tmp
+	# tests/<name>.args holds extra options for that test
+	args=$(cat "${f%.in}.args" 2>/dev/null)
+	bin/wendy "$f" --optimize $args > file.tmp
 	if diff "${f%.in}.expect" file.tmp > /dev/null ; then
 		echo Test $(basename $f):optimize passed.
 	else
@@ -0,0 +1,49 @@
+/*
+ * bench.w: WendyScript 2.0
+ * Created by Felix Guo
+ * Provides clocks and a micro-benchmark runner, for timing alternative
+ *   implementations from inside a script
+ */
+
+// Times are in nanoseconds, from an arbitrary point that only moves forward
+struct Clock => [now, cpu];
+Clock.now => () native clock_monotonic;
+Clock.cpu => () native clock_cpu;
+
+struct Bench => [counters, summarize, measure];
+
+// Returns { instructions, allocations, liveContainers, liveBytes } so far
+Bench.counters => () native bench_counters;
+
+// Returns { runs, min, max, median, mean, stddev } of a list of numbers
+Bench.summarize => (values) native bench_summary;
+
+// Calls fn iterations times after a tenth as many warmup calls and returns
+//   the summary of the time each call took, in nanoseconds, with the
+//   instructions and allocations of one call. Both include making the call,
+//   the counts have the loop around it taken off.
+Bench.measure => (fn, iterations) {
+	// Results are compared so they aren't printed, even if there are none
+	let discard = none;
+	for i in 0->(iterations \ 10 + 1) discard = fn() == none;
+	let times = [];
+	for i in 0->iterations {
+		let start = Clock.now();
+		discard = fn() == none;
+		times += Clock.now() - start;
+	}
+	let timing = this.summarize(times);
+	let before = this.counters();
+	for i in 0->iterations discard = fn() == none;
+	let middle = this.counters();
+	for i in 0->iterations discard = 0 == none;
+	let after = this.counters();
+	ret {
+		runs: timing.runs, min: timing.min, max: timing.max, median: timing.median,
+		mean: timing.mean, stddev: timing.stddev,
+		instructions: ((middle.instructions - before.instructions) -
+			(after.instructions - middle.instructions)) / iterations,
+		allocations: ((middle.allocations - before.allocations) -
+			(after.allocations - middle.allocations)) / iterations
+	};
+};
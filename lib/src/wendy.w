@@ -4,7 +4,9 @@
  * Provides internal WendyVM functions
  */
 
-struct Wendy => [getRefs, getAt];
+struct Wendy => [getRefs, getAt, memStats, heapSnapshot];
 
 Wendy.getRefs => (ref) native vm_getRefs;
 Wendy.getAt => (ref, index) native vm_getAt;
+Wendy.memStats => () native vm_memStats;
+Wendy.heapSnapshot => (path) native vm_heapSnapshot;
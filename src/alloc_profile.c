@@ -0,0 +1,474 @@
+#define _GNU_SOURCE
+#include "alloc_profile.h"
+#include "vm.h"
+#include "global.h"
+#include "table.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+// Only the sites that allocate the most are shown in the table, the JSON has
+//   everything
+#define ALLOC_PROFILE_TABLE_ROWS 20
+#define ALLOC_PROFILE_START_CAPACITY 256
+
+__thread struct alloc_profiler* active_alloc_profiler = 0;
+
+// Allocations made from one place in C while one place in Wendy ran
+struct alloc_site {
+	// file is 0 if only the address of the caller is known
+	const char* file;
+	int line;
+	void* caller;
+	char* function;
+	int wendy_line;
+	size_t count;
+	size_t bytes;
+	size_t live_bytes;
+};
+
+struct alloc_block {
+	// 0 if the slot is free
+	void* ptr;
+	size_t size;
+	struct alloc_site* site;
+};
+
+// Sites added together by where they are in C or in Wendy
+struct alloc_total {
+	const struct alloc_site* site;
+	size_t count;
+	size_t bytes;
+	size_t live_bytes;
+};
+
+static size_t hash_pointer(const void* ptr) {
+	uint64_t x = (uintptr_t) ptr;
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static size_t site_hash(const char* file, int line, void* caller,
+		const char* function, int wendy_line) {
+	return hash_pointer(file) ^ hash_pointer(caller) ^
+		get_string_hash(function) * 31 ^ (size_t) line * 131 ^ (size_t) wendy_line;
+}
+
+// next_countdown(profiler) returns how many allocations to skip before the
+//   next one recorded, random so allocations repeating with the same period
+//   as the interval still get sampled fairly
+static size_t next_countdown(struct alloc_profiler* profiler) {
+	if (profiler->interval <= 1) {
+		return 1;
+	}
+	static __thread uint64_t state = 88172645463325252ULL;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return 1 + state % (2 * profiler->interval - 1);
+}
+
+struct alloc_profiler* alloc_profiler_create(struct vm* vm, size_t interval) {
+	struct alloc_profiler* profiler = safe_malloc(sizeof(struct alloc_profiler));
+	profiler->vm = vm;
+	profiler->interval = interval ? interval : 1;
+	profiler->countdown = next_countdown(profiler);
+	profiler->busy = false;
+	profiler->site_count = 0;
+	profiler->site_capacity = ALLOC_PROFILE_START_CAPACITY;
+	profiler->sites = safe_calloc(profiler->site_capacity, sizeof(struct alloc_site*));
+	profiler->block_count = 0;
+	profiler->block_capacity = ALLOC_PROFILE_START_CAPACITY;
+	profiler->blocks = safe_calloc(profiler->block_capacity, sizeof(struct alloc_block));
+	return profiler;
+}
+
+// current_function(vm) returns the name of the function running in vm,
+//   automatic frames belong to the function they're in
+static const char* current_function(struct vm* vm) {
+	struct memory* memory = vm->memory;
+	for (size_t i = memory->call_stack_pointer; i > 0; i--) {
+		if (!memory->call_stack[i - 1].is_automatic) {
+			return memory->call_stack[i - 1].fn_name;
+		}
+	}
+	return "<none>";
+}
+
+static void grow_sites(struct alloc_profiler* profiler) {
+	size_t capacity = profiler->site_capacity * 2;
+	struct alloc_site** sites = safe_calloc(capacity, sizeof(struct alloc_site*));
+	for (size_t i = 0; i < profiler->site_capacity; i++) {
+		struct alloc_site* site = profiler->sites[i];
+		if (site) {
+			size_t j = site_hash(site->file, site->line, site->caller,
+				site->function, site->wendy_line) & (capacity - 1);
+			while (sites[j]) {
+				j = (j + 1) & (capacity - 1);
+			}
+			sites[j] = site;
+		}
+	}
+	safe_free(profiler->sites);
+	profiler->sites = sites;
+	profiler->site_capacity = capacity;
+}
+
+static struct alloc_site* find_site(struct alloc_profiler* profiler, const char* file,
+		int line, void* caller) {
+	const char* function = current_function(profiler->vm);
+	int wendy_line = profiler->vm->line;
+	size_t mask = profiler->site_capacity - 1;
+	size_t i = site_hash(file, line, caller, function, wendy_line) & mask;
+	while (profiler->sites[i]) {
+		struct alloc_site* site = profiler->sites[i];
+		if (site->file == file && site->line == line && site->caller == caller &&
+			site->wendy_line == wendy_line && streq(site->function, function)) {
+			return site;
+		}
+		i = (i + 1) & mask;
+	}
+	struct alloc_site* site = safe_calloc(1, sizeof(struct alloc_site));
+	site->file = file;
+	site->line = line;
+	site->caller = caller;
+	site->function = safe_strdup(function);
+	site->wendy_line = wendy_line;
+	profiler->sites[i] = site;
+	profiler->site_count += 1;
+	if (profiler->site_count * 2 >= profiler->site_capacity) {
+		grow_sites(profiler);
+	}
+	return site;
+}
+
+static void insert_block(struct alloc_profiler* profiler, struct alloc_block block);
+
+static void grow_blocks(struct alloc_profiler* profiler) {
+	struct alloc_block* old = profiler->blocks;
+	size_t old_capacity = profiler->block_capacity;
+	profiler->block_capacity *= 2;
+	profiler->blocks = safe_calloc(profiler->block_capacity, sizeof(struct alloc_block));
+	profiler->block_count = 0;
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (old[i].ptr) {
+			insert_block(profiler, old[i]);
+		}
+	}
+	safe_free(old);
+}
+
+static void insert_block(struct alloc_profiler* profiler, struct alloc_block block) {
+	if ((profiler->block_count + 1) * 2 >= profiler->block_capacity) {
+		grow_blocks(profiler);
+	}
+	size_t mask = profiler->block_capacity - 1;
+	size_t i = hash_pointer(block.ptr) & mask;
+	while (profiler->blocks[i].ptr && profiler->blocks[i].ptr != block.ptr) {
+		i = (i + 1) & mask;
+	}
+	if (profiler->blocks[i].ptr) {
+		// Freed while the profiler wasn't watching and handed out again
+		profiler->blocks[i].site->live_bytes -= profiler->blocks[i].size;
+	}
+	else {
+		profiler->block_count += 1;
+	}
+	profiler->blocks[i] = block;
+}
+
+// remove_block(profiler, ptr, removed) takes the block at ptr out of the map
+//   and returns true if it was recorded
+static bool remove_block(struct alloc_profiler* profiler, void* ptr, struct alloc_block* removed) {
+	if (!profiler->block_count) {
+		return false;
+	}
+	size_t mask = profiler->block_capacity - 1;
+	size_t i = hash_pointer(ptr) & mask;
+	while (profiler->blocks[i].ptr && profiler->blocks[i].ptr != ptr) {
+		i = (i + 1) & mask;
+	}
+	if (!profiler->blocks[i].ptr) {
+		return false;
+	}
+	*removed = profiler->blocks[i];
+	profiler->block_count -= 1;
+	// Shift back the blocks that were pushed past this one
+	size_t j = i;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!profiler->blocks[j].ptr) {
+			break;
+		}
+		size_t home = hash_pointer(profiler->blocks[j].ptr) & mask;
+		bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+		if (!stays) {
+			profiler->blocks[i] = profiler->blocks[j];
+			i = j;
+		}
+	}
+	profiler->blocks[i].ptr = 0;
+	return true;
+}
+
+static void add_block(struct alloc_profiler* profiler, struct alloc_site* site,
+		void* ptr, size_t size) {
+	profiler->busy = true;
+	site->count += 1;
+	site->bytes += size;
+	site->live_bytes += size;
+	insert_block(profiler, (struct alloc_block) { ptr, size, site });
+	profiler->busy = false;
+}
+
+// sampled_site(profiler, file, line, caller) returns the site to record the
+//   allocation being made in, or 0 if this one isn't sampled
+static struct alloc_site* sampled_site(struct alloc_profiler* profiler,
+		const char* file, int line, void* caller) {
+	if (--profiler->countdown) {
+		return 0;
+	}
+	profiler->countdown = next_countdown(profiler);
+	profiler->busy = true;
+	struct alloc_site* site = find_site(profiler, file, line, caller);
+	profiler->busy = false;
+	return site;
+}
+
+void alloc_profiler_allocated(struct alloc_profiler* profiler, void* ptr, size_t size,
+		const char* file, int line, void* caller) {
+	if (profiler->busy) {
+		return;
+	}
+	struct alloc_site* site = sampled_site(profiler, file, line, caller);
+	if (site) {
+		add_block(profiler, site, ptr, size);
+	}
+}
+
+struct alloc_site* alloc_profiler_reallocating(struct alloc_profiler* profiler, void* old,
+		const char* file, int line, void* caller) {
+	if (profiler->busy) {
+		return 0;
+	}
+	struct alloc_block block;
+	if (old && remove_block(profiler, old, &block)) {
+		block.site->live_bytes -= block.size;
+		// Keep following a block once it's sampled
+		profiler->busy = true;
+		struct alloc_site* site = find_site(profiler, file, line, caller);
+		profiler->busy = false;
+		return site;
+	}
+	return sampled_site(profiler, file, line, caller);
+}
+
+void alloc_profiler_reallocated(struct alloc_profiler* profiler, struct alloc_site* site,
+		void* ptr, size_t size) {
+	add_block(profiler, site, ptr, size);
+}
+
+void alloc_profiler_freed(struct alloc_profiler* profiler, void* ptr) {
+	if (profiler->busy) {
+		return;
+	}
+	struct alloc_block block;
+	if (remove_block(profiler, ptr, &block)) {
+		block.site->live_bytes -= block.size;
+	}
+}
+
+static int compare_c_site(const struct alloc_site* a, const struct alloc_site* b) {
+	if (a->file != b->file) {
+		if (!a->file || !b->file) {
+			return a->file ? 1 : -1;
+		}
+		int result = strcmp(a->file, b->file);
+		if (result) {
+			return result;
+		}
+	}
+	if (a->line != b->line) {
+		return a->line < b->line ? -1 : 1;
+	}
+	if (a->caller != b->caller) {
+		return (uintptr_t) a->caller < (uintptr_t) b->caller ? -1 : 1;
+	}
+	return 0;
+}
+
+static int compare_wendy_site(const struct alloc_site* a, const struct alloc_site* b) {
+	int result = strcmp(a->function, b->function);
+	if (result) {
+		return result;
+	}
+	return a->wendy_line < b->wendy_line ? -1 : a->wendy_line > b->wendy_line;
+}
+
+static int by_c_site(const void* a, const void* b) {
+	return compare_c_site(((const struct alloc_total*) a)->site,
+		((const struct alloc_total*) b)->site);
+}
+
+static int by_wendy_site(const void* a, const void* b) {
+	return compare_wendy_site(((const struct alloc_total*) a)->site,
+		((const struct alloc_total*) b)->site);
+}
+
+static int by_bytes(const void* a, const void* b) {
+	const struct alloc_total* x = a;
+	const struct alloc_total* y = b;
+	if (x->bytes != y->bytes) {
+		return x->bytes < y->bytes ? 1 : -1;
+	}
+	return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+// totals(profiler, compare, count) returns the sites added together where
+//   compare finds them the same, the most bytes first, or every site if
+//   compare is 0
+// effects: allocates memory, caller must free
+static struct alloc_total* totals(struct alloc_profiler* profiler,
+		int (*compare)(const void*, const void*), size_t* count) {
+	struct alloc_total* totals = safe_malloc(sizeof(struct alloc_total) * (profiler->site_count + 1));
+	size_t found = 0;
+	for (size_t i = 0; i < profiler->site_capacity; i++) {
+		struct alloc_site* site = profiler->sites[i];
+		if (site) {
+			totals[found++] = (struct alloc_total) {
+				site, site->count, site->bytes, site->live_bytes
+			};
+		}
+	}
+	if (compare) {
+		qsort(totals, found, sizeof(struct alloc_total), compare);
+		size_t merged = 0;
+		for (size_t i = 0; i < found; i++) {
+			if (merged && !compare(&totals[merged - 1], &totals[i])) {
+				totals[merged - 1].count += totals[i].count;
+				totals[merged - 1].bytes += totals[i].bytes;
+				totals[merged - 1].live_bytes += totals[i].live_bytes;
+			}
+			else {
+				totals[merged++] = totals[i];
+			}
+		}
+		found = merged;
+	}
+	qsort(totals, found, sizeof(struct alloc_total), by_bytes);
+	*count = found;
+	return totals;
+}
+
+static void write_c_site(FILE* file, const struct alloc_site* site) {
+	if (site->file) {
+		fprintf(file, "%s:%d", site->file, site->line);
+		return;
+	}
+	// Written so addr2line -e <object> <offset> finds the line
+	Dl_info info;
+	if (dladdr(site->caller, &info) && info.dli_fname) {
+		fprintf(file, "%s+%#lx", info.dli_fname,
+			(unsigned long) ((char*) site->caller - (char*) info.dli_fbase));
+		if (info.dli_sname) {
+			fprintf(file, " (%s)", info.dli_sname);
+		}
+		return;
+	}
+	fprintf(file, "%p", site->caller);
+}
+
+static void write_wendy_site(FILE* file, const struct alloc_site* site) {
+	fprintf(file, "%s:%d", site->function, site->wendy_line);
+}
+
+static void write_table(FILE* table, const char* title, struct alloc_total* totals,
+		size_t count, size_t interval, void (*write_site)(FILE*, const struct alloc_site*)) {
+	fprintf(table, "%s\n", title);
+	fprintf(table, "%12s %14s %14s  %s\n", "count", "bytes", "live bytes", "site");
+	for (size_t i = 0; i < count && i < ALLOC_PROFILE_TABLE_ROWS; i++) {
+		fprintf(table, "%12zu %14zu %14zu  ", totals[i].count * interval,
+			totals[i].bytes * interval, totals[i].live_bytes * interval);
+		write_site(table, totals[i].site);
+		fprintf(table, "\n");
+	}
+}
+
+static void write_json_counts(FILE* json, struct alloc_total* total, size_t interval) {
+	fprintf(json, "\"count\": %zu, \"bytes\": %zu, \"live_bytes\": %zu }",
+		total->count * interval, total->bytes * interval, total->live_bytes * interval);
+}
+
+static void write_json(FILE* json, const char* key, struct alloc_total* totals,
+		size_t count, size_t interval, void (*write_site)(FILE*, const struct alloc_site*)) {
+	fprintf(json, "  \"%s\": [", key);
+	for (size_t i = 0; i < count; i++) {
+		fprintf(json, "%s\n    { \"site\": \"", i ? "," : "");
+		write_site(json, totals[i].site);
+		fprintf(json, "\", ");
+		write_json_counts(json, &totals[i], interval);
+	}
+	fprintf(json, "\n  ],\n");
+}
+
+void alloc_profiler_report(struct alloc_profiler* profiler, FILE* table, FILE* json) {
+	profiler->busy = true;
+	size_t c_count, wendy_count, pair_count;
+	struct alloc_total* c_sites = totals(profiler, by_c_site, &c_count);
+	struct alloc_total* wendy_sites = totals(profiler, by_wendy_site, &wendy_count);
+	struct alloc_total* pairs = totals(profiler, 0, &pair_count);
+	struct alloc_total all = { 0, 0, 0, 0 };
+	for (size_t i = 0; i < pair_count; i++) {
+		all.count += pairs[i].count;
+		all.bytes += pairs[i].bytes;
+		all.live_bytes += pairs[i].live_bytes;
+	}
+
+	size_t interval = profiler->interval;
+	fprintf(table, "Allocation profile: %zu allocations, %zu bytes, %zu bytes still live\n",
+		all.count * interval, all.bytes * interval, all.live_bytes * interval);
+	if (interval > 1) {
+		fprintf(table, "Estimated from one in every %zu allocations\n", interval);
+	}
+	write_table(table, "By C call site", c_sites, c_count, interval, write_c_site);
+	write_table(table, "By Wendy function and line", wendy_sites, wendy_count,
+		interval, write_wendy_site);
+
+	if (json) {
+		fprintf(json, "{\n  \"interval\": %zu,\n  \"allocations\": %zu,\n"
+			"  \"bytes\": %zu,\n  \"live_bytes\": %zu,\n", interval,
+			all.count * interval, all.bytes * interval, all.live_bytes * interval);
+		write_json(json, "c_sites", c_sites, c_count, interval, write_c_site);
+		write_json(json, "wendy_sites", wendy_sites, wendy_count, interval, write_wendy_site);
+		fprintf(json, "  \"pairs\": [");
+		for (size_t i = 0; i < pair_count; i++) {
+			fprintf(json, "%s\n    { \"wendy\": \"", i ? "," : "");
+			write_wendy_site(json, pairs[i].site);
+			fprintf(json, "\", \"c\": \"");
+			write_c_site(json, pairs[i].site);
+			fprintf(json, "\", ");
+			write_json_counts(json, &pairs[i], interval);
+		}
+		fprintf(json, "\n  ]\n}\n");
+	}
+	safe_free(c_sites);
+	safe_free(wendy_sites);
+	safe_free(pairs);
+	profiler->busy = false;
+}
+
+void alloc_profiler_destroy(struct alloc_profiler* profiler) {
+	profiler->busy = true;
+	for (size_t i = 0; i < profiler->site_capacity; i++) {
+		if (profiler->sites[i]) {
+			safe_free(profiler->sites[i]->function);
+			safe_free(profiler->sites[i]);
+		}
+	}
+	safe_free(profiler->sites);
+	safe_free(profiler->blocks);
+	safe_free(profiler);
+}
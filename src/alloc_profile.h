@@ -0,0 +1,82 @@
+#ifndef ALLOC_PROFILE_H
+#define ALLOC_PROFILE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// alloc_profile.h - Felix Guo
+// Attributes heap allocations made while the VM runs, for --alloc-profile,
+//   to the C code that made them and to the Wendy function and line running
+//   at the time. Debug builds know the file and line of every allocation.
+//   Release builds only know the address it was made from, and by default
+//   only record one in every ALLOC_PROFILE_RELEASE_INTERVAL allocations so
+//   they run at close to full speed; their counts are estimates scaled up by
+//   the interval.
+
+#ifdef RELEASE
+#define ALLOC_PROFILE_DEFAULT_INTERVAL 64
+#else
+#define ALLOC_PROFILE_DEFAULT_INTERVAL 1
+#endif
+
+struct vm;
+struct alloc_site;
+struct alloc_block;
+
+struct alloc_profiler {
+	struct vm* vm;
+	// One in every interval allocations is recorded
+	size_t interval;
+	size_t countdown;
+	// Set while the profiler allocates for itself
+	bool busy;
+	// Hash set of every pair of C and Wendy site seen
+	struct alloc_site** sites;
+	size_t site_count;
+	size_t site_capacity;
+	// Hash map of the recorded blocks that haven't been freed
+	struct alloc_block* blocks;
+	size_t block_count;
+	size_t block_capacity;
+};
+
+// The profiler the allocation functions report to on this thread, only set
+//   while its VM runs
+extern __thread struct alloc_profiler* active_alloc_profiler;
+
+// alloc_profiler_create(vm, interval) returns a profiler for allocations
+//   made while vm runs, recording one in every interval
+struct alloc_profiler* alloc_profiler_create(struct vm* vm, size_t interval);
+
+// alloc_profiler_allocated(profiler, ptr, size, file, line, caller) records
+//   that size bytes at ptr were allocated from file at line, or from the
+//   address caller if file is 0
+void alloc_profiler_allocated(struct alloc_profiler* profiler, void* ptr, size_t size,
+	const char* file, int line, void* caller);
+
+// alloc_profiler_reallocating(profiler, old, file, line, caller) is called
+//   before old is moved and resized from the site given, while what it
+//   could be holding is still there to look at. It returns the site to pass
+//   to alloc_profiler_reallocated once the block has moved, or 0 if it isn't
+//   recorded.
+struct alloc_site* alloc_profiler_reallocating(struct alloc_profiler* profiler, void* old,
+	const char* file, int line, void* caller);
+
+// alloc_profiler_reallocated(profiler, site, ptr, size) records the block
+//   now at ptr with size bytes
+void alloc_profiler_reallocated(struct alloc_profiler* profiler, struct alloc_site* site,
+	void* ptr, size_t size);
+
+// alloc_profiler_freed(profiler, ptr) records ptr being freed
+void alloc_profiler_freed(struct alloc_profiler* profiler, void* ptr);
+
+// alloc_profiler_report(profiler, table, json) writes the sites that
+//   allocated the most as a table to table, and every site as JSON to json,
+//   which may be 0
+void alloc_profiler_report(struct alloc_profiler* profiler, FILE* table, FILE* json);
+
+// alloc_profiler_destroy(profiler) frees the profiler and what it recorded
+void alloc_profiler_destroy(struct alloc_profiler* profiler);
+
+#endif
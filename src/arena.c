@@ -0,0 +1,63 @@
+#include "arena.h"
+#include "global.h"
+#include <string.h>
+
+// Most sources fit in a handful of blocks; bigger requests get a block of
+//   their own.
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+
+struct arena_block {
+	struct arena_block* next;
+	size_t size;
+	size_t used;
+	_Alignas(ARENA_ALIGNMENT) unsigned char data[];
+};
+
+void arena_init(struct arena* arena) {
+	arena->head = 0;
+}
+
+static struct arena_block* arena_new_block(struct arena* arena, size_t size) {
+	if (size < ARENA_BLOCK_SIZE) {
+		size = ARENA_BLOCK_SIZE;
+	}
+	struct arena_block* block = safe_malloc(sizeof(struct arena_block) + size);
+	block->size = size;
+	block->used = 0;
+	block->next = arena->head;
+	arena->head = block;
+	return block;
+}
+
+void* arena_alloc(struct arena* arena, size_t size) {
+	size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	struct arena_block* block = arena->head;
+	if (!block || block->size - block->used < size) {
+		block = arena_new_block(arena, size);
+	}
+	void* result = block->data + block->used;
+	block->used += size;
+	return result;
+}
+
+char* arena_strndup(struct arena* arena, const char* s, size_t n) {
+	char* result = arena_alloc(arena, n + 1);
+	memcpy(result, s, n);
+	result[n] = 0;
+	return result;
+}
+
+char* arena_strdup(struct arena* arena, const char* s) {
+	return arena_strndup(arena, s, strlen(s));
+}
+
+void arena_release(struct arena* arena) {
+	struct arena_block* block = arena->head;
+	while (block) {
+		struct arena_block* next = block->next;
+		safe_free(block);
+		block = next;
+	}
+	arena->head = 0;
+}
@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// arena.h - Felix Guo
+// A bump allocator for memory that lives exactly as long as a compilation.
+//   Tokens, AST nodes and optimizer bookkeeping are carved out of large
+//   blocks and never freed individually; the whole arena is released at once.
+
+struct arena_block;
+
+struct arena {
+	struct arena_block* head;
+};
+
+// arena_init(arena) prepares an empty arena
+void arena_init(struct arena* arena);
+
+// arena_alloc(arena, size) returns size bytes, suitably aligned for any type,
+//   that stay valid until the arena is released
+void* arena_alloc(struct arena* arena, size_t size);
+
+// arena_strndup(arena, s, n) copies the first n characters of s into the
+//   arena and terminates them
+char* arena_strndup(struct arena* arena, const char* s, size_t n);
+
+// arena_strdup(arena, s) copies s into the arena
+char* arena_strdup(struct arena* arena, const char* s);
+
+// arena_release(arena) frees everything allocated from the arena
+void arena_release(struct arena* arena);
+
+#endif
@@ -6,113 +6,39 @@
 #include <stdarg.h>
 #include <string.h>
 
-#define match(...) fnmatch(sizeof((enum token_type []) {__VA_ARGS__}) / sizeof(enum token_type), __VA_ARGS__)
+// Nodes live in the compilation's arena and are never freed one at a time
+#define ast_alloc(ctx, type) \
+	((type*) memset(arena_alloc(&(ctx)->arena, sizeof(type)), 0, sizeof(type)))
 
-static struct token* tokens = 0;
-static size_t length = 0;
-static size_t curr_index = 0;
-static bool error_thrown = false;
+// Strings in the AST are never freed either, so literals the parser makes up
+//   can point at constants
+#define ast_data_str(type, s) make_data((type), data_value_str_impl(s))
+
+#define match(...) fnmatch(ctx, sizeof((enum token_type []) {__VA_ARGS__}) / sizeof(enum token_type), __VA_ARGS__)
 
 // Forward Declarations
-static struct expr* make_lit_expr(struct token t);
-static struct expr* lit_expr_from_data(struct data d);
-static struct expr* copy_lit_expr(struct expr* from);
-static struct expr* make_bin_expr(struct expr* left, struct token op, struct expr* right);
-static struct expr* make_una_expr(struct token op, struct expr* operand);
-static struct expr* make_call_expr(struct expr* left, struct expr_list* arg_list);
-static struct expr* make_super_call_expr(struct expr_list* arg_list);
-static struct expr* make_list_expr(struct expr_list* list);
-static struct expr* make_func_expr(struct expr_list* parameters, struct statement* body);
-static struct expr* make_table_expr(struct expr_list* keys, struct expr_list* values);
-static struct expr* make_native_func_expr(struct expr_list* parameters, struct token name);
-static struct expr* make_assign_expr(struct expr* left, struct expr* right, struct token op);
-static struct expr* make_if_expr(struct expr* condition, struct expr* if_true, struct expr* if_false);
-static struct statement* parse_statement(void);
-static struct statement_list* parse_statement_list(void);
-static struct expr* expression(void);
-static struct expr* or(void);
-static bool check(enum token_type t);
-static struct token advance(void);
-static struct token previous(void);
+static struct expr* make_lit_expr(struct compiler_ctx* ctx, struct token t);
+static struct expr* lit_expr_from_data(struct compiler_ctx* ctx, struct data d);
+static struct expr* copy_lit_expr(struct compiler_ctx* ctx, struct expr* from);
+static struct expr* make_bin_expr(struct compiler_ctx* ctx, struct expr* left, struct token op, struct expr* right);
+static struct expr* make_una_expr(struct compiler_ctx* ctx, struct token op, struct expr* operand);
+static struct expr* make_call_expr(struct compiler_ctx* ctx, struct expr* left, struct expr_list* arg_list);
+static struct expr* make_super_call_expr(struct compiler_ctx* ctx, struct expr_list* arg_list);
+static struct expr* make_list_expr(struct compiler_ctx* ctx, struct expr_list* list);
+static struct expr* make_func_expr(struct compiler_ctx* ctx, struct expr_list* parameters, struct statement* body);
+static struct expr* make_table_expr(struct compiler_ctx* ctx, struct expr_list* keys, struct expr_list* values);
+static struct expr* make_native_func_expr(struct compiler_ctx* ctx, struct expr_list* parameters, struct token name);
+static struct expr* make_assign_expr(struct compiler_ctx* ctx, struct expr* left, struct expr* right, struct token op);
+static struct expr* make_if_expr(struct compiler_ctx* ctx, struct expr* condition, struct expr* if_true, struct expr* if_false);
+static struct statement* parse_statement(struct compiler_ctx* ctx);
+static struct statement_list* parse_statement_list(struct compiler_ctx* ctx);
+static struct expr* expression(struct compiler_ctx* ctx);
+static struct expr* or(struct compiler_ctx* ctx);
+static bool check(struct compiler_ctx* ctx, enum token_type t);
+static struct token advance(struct compiler_ctx* ctx);
+static struct token previous(struct compiler_ctx* ctx);
 
 // Public Methods
-// Wrapping safe_free macro for use as a function pointer.
-
-// In most cases we want traversal algorithm internals to be private, but these
-// are exposed so optimizer can use them to properly free.
-void ast_safe_free_e(struct expr* ptr, struct traversal_algorithm* algo) {
-    UNUSED(algo);
-    if (ptr->type == E_FUNCTION && ptr->op.func_expr.is_native) {
-        safe_free(ptr->op.func_expr.native_name);
-    } else if (ptr->type == E_LITERAL) {
-        destroy_data(&ptr->op.lit_expr);
-    }
-    safe_free(ptr);
-}
-
-void ast_safe_free_el(struct expr_list* ptr, struct traversal_algorithm* algo) {
-    UNUSED(algo);
-    safe_free(ptr);
-}
-
-void ast_safe_free_s(struct statement* ptr, struct traversal_algorithm* algo) {
-    UNUSED(algo);
-	switch(ptr->type) {
-		case S_IMPORT:
-			if (ptr->op.import_statement) {
-				safe_free(ptr->op.import_statement);
-			}
-			break;
-		case S_LET:
-			if (ptr->op.let_statement.lvalue) {
-				safe_free(ptr->op.let_statement.lvalue);
-			}
-			break;
-		case S_BREAK:
-		case S_CONTINUE:
-			break;
-		case S_BYTECODE:
-			for (size_t i = 0; i < ptr->op.bytecode_statement.size; i++) {
-				destroy_token(ptr->op.bytecode_statement.data[i]);
-			}
-			safe_free(ptr->op.bytecode_statement.data);
-			break;
-		case S_STRUCT:
-			if (ptr->op.struct_statement.name) {
-				safe_free(ptr->op.struct_statement.name);
-			}
-			break;
-		case S_LOOP:
-			if (ptr->op.loop_statement.index_var) {
-				safe_free(ptr->op.loop_statement.index_var);
-			}
-			break;
-		case S_ENUM:
-			if (ptr->op.enum_statement.name) {
-				safe_free(ptr->op.enum_statement.name);
-			}
-			break;
-		case S_BLOCK:
-		case S_EXPR:
-		case S_IF:
-		case S_OPERATION:
-			break;
-	}
-    safe_free(ptr);
-}
-
-void ast_safe_free_sl(struct statement_list* ptr, struct traversal_algorithm* algo) {
-    UNUSED(algo);
-    safe_free(ptr);
-}
-
-struct traversal_algorithm ast_safe_free_impl =
-	TRAVERSAL_ALGO_POST (
-		ast_safe_free_e,
-		ast_safe_free_el,
-		ast_safe_free_s,
-		ast_safe_free_sl
-	);
 
 static void print_e(struct expr*, struct traversal_algorithm*);
 static void print_el(struct expr_list*, struct traversal_algorithm*);
@@ -126,118 +52,113 @@ static struct traversal_algorithm print_ast_impl =
 		print_sl
 	);
 
-static bool is_at_end(void) {
-	return curr_index == length;
+static bool is_at_end(struct compiler_ctx* ctx) {
+	return ctx->parser.curr_index == ctx->parser.length;
 }
 
-struct statement_list* generate_ast(struct token* _tokens, size_t _length) {
-	error_thrown = false;
-	tokens = _tokens;
-	length = _length;
-	curr_index = 0;
-	if (is_at_end()) return 0;
-	return parse_statement_list();
+struct statement_list* generate_ast(struct compiler_ctx* ctx, struct token* _tokens, size_t _length) {
+	ctx->parser.error_thrown = false;
+	ctx->parser.tokens = _tokens;
+	ctx->parser.length = _length;
+	ctx->parser.curr_index = 0;
+	if (is_at_end(ctx)) return 0;
+	return parse_statement_list(ctx);
 }
 
 void print_ast(struct statement_list* ast) {
 	traverse_ast(ast, &print_ast_impl);
 }
 
-void free_ast(struct statement_list* ast) {
-	traverse_ast(ast, &ast_safe_free_impl);
+bool ast_error_flag(struct compiler_ctx* ctx) {
+	return ctx->parser.error_thrown;
 }
 
-bool ast_error_flag(void) {
-	return error_thrown;
-}
-
-static bool fnmatch(int count, ...) {
+static bool fnmatch(struct compiler_ctx* ctx, int count, ...) {
 	va_list a_list;
 	va_start(a_list, count);
 	for (int i = 0; i < count; i++) {
 		enum token_type next = va_arg(a_list, enum token_type);
-		if (check(next)) {
-			advance();
+		if (check(ctx, next)) {
+			advance(ctx);
 			return true;
 		}
 	}
 	return false;
 }
 
-static struct token advance(void) {
-	if (!is_at_end()) curr_index++;
-	return previous();
+static struct token advance(struct compiler_ctx* ctx) {
+	if (!is_at_end(ctx)) ctx->parser.curr_index++;
+	return previous(ctx);
 }
 
-static struct token previous(void) {
-	return tokens[curr_index - 1];
+static struct token previous(struct compiler_ctx* ctx) {
+	return ctx->parser.tokens[ctx->parser.curr_index - 1];
 }
 
-static struct token peek(void) {
-	return tokens[curr_index];
+static struct token peek(struct compiler_ctx* ctx) {
+	return ctx->parser.tokens[ctx->parser.curr_index];
 }
 
-static bool check(enum token_type t) {
-	if (is_at_end()) return false;
-	return peek().t_type == t;
+static bool check(struct compiler_ctx* ctx, enum token_type t) {
+	if (is_at_end(ctx)) return false;
+	return peek(ctx).t_type == t;
 }
 
-static void consume(enum token_type t) {
-	if (check(t)) {
-		advance();
+static void consume(struct compiler_ctx* ctx, enum token_type t) {
+	if (check(ctx, t)) {
+		advance(ctx);
 	}
 	else {
-		struct token tok = previous();
-		error_lexer(tok.t_line, tok.t_col, AST_EXPECTED_TOKEN,
+		struct token tok = previous(ctx);
+		error_lexer(ctx, tok.t_line, tok.t_col, AST_EXPECTED_TOKEN,
 			token_string[t]);
-		advance();
-		error_thrown = true;
+		advance(ctx);
+		ctx->parser.error_thrown = true;
 		return;
 	}
 }
 
-static struct expr_list* identifier_list(void) {
-	struct expr_list* list = safe_malloc(sizeof(struct expr_list));
+static struct expr_list* identifier_list(struct compiler_ctx* ctx) {
+	struct expr_list* list = ast_alloc(ctx, struct expr_list);
 	list->next = 0;
 	struct expr** curr = &list->elem;
 	struct expr_list* curr_list = list;
 	forever {
 		if (match(T_IDENTIFIER)) {
-			*curr = make_lit_expr(previous());
+			*curr = make_lit_expr(ctx, previous(ctx));
 			if (match(T_COMMA)) {
-				curr_list->next = safe_malloc(sizeof(struct expr_list));
+				curr_list->next = ast_alloc(ctx, struct expr_list);
 				curr_list = curr_list->next;
 				curr_list->next = 0;
 				curr = &curr_list->elem;
 			} else break;
 		}
 		else {
-			struct token t = previous();
-			error_lexer(t.t_line, t.t_col, AST_EXPECTED_IDENTIFIER);
-			error_thrown = true;
+			struct token t = previous(ctx);
+			error_lexer(ctx, t.t_line, t.t_col, AST_EXPECTED_IDENTIFIER);
+			ctx->parser.error_thrown = true;
 		}
 	}
 	return list;
 }
 
-static struct expr_list* expression_list(enum token_type end_delimiter) {
-	if (peek().t_type == end_delimiter) return 0;
-	struct expr_list* list = safe_malloc(sizeof(struct expr_list));
+static struct expr_list* expression_list(struct compiler_ctx* ctx, enum token_type end_delimiter) {
+	if (peek(ctx).t_type == end_delimiter) return 0;
+	struct expr_list* list = ast_alloc(ctx, struct expr_list);
 	list->next = 0;
 	struct expr** curr = &list->elem;
 	struct expr_list* curr_list = list;
 	forever {
-		*curr = expression();
+		*curr = expression(ctx);
 		if (match(T_COMMA)) {
-			curr_list->next = safe_malloc(sizeof(struct expr_list));
+			curr_list->next = ast_alloc(ctx, struct expr_list);
 			curr_list = curr_list->next;
 			curr_list->next = 0;
 			curr = &curr_list->elem;
 		} else break;
 	}
-	if (error_thrown) {
-		// rollback
-		traverse_expr_list(list, &ast_safe_free_impl);
+	if (ctx->parser.error_thrown) {
+		// rollback, the arena reclaims the nodes
 		return 0;
 	}
 	else {
@@ -245,41 +166,41 @@ static struct expr_list* expression_list(enum token_type end_delimiter) {
 	}
 }
 
-static struct expr* lvalue(void) {
-	struct expr* exp = or();
+static struct expr* lvalue(struct compiler_ctx* ctx) {
+	struct expr* exp = or(ctx);
 	return exp;
 }
 
-static struct expr* primary(void) {
+static struct expr* primary(struct compiler_ctx* ctx) {
 	if (match(T_STRING, T_NUMBER, T_TRUE, T_FALSE, T_NONE, T_IDENTIFIER,
 			T_OBJ_TYPE)) {
-		return make_lit_expr(previous());
+		return make_lit_expr(ctx, previous(ctx));
 	}
 	else if (match(T_LEFT_BRACK)) {
-		struct expr_list* list = expression_list(T_RIGHT_BRACK);
-		struct expr* list_expr = make_list_expr(list);
-		consume(T_RIGHT_BRACK);
+		struct expr_list* list = expression_list(ctx, T_RIGHT_BRACK);
+		struct expr* list_expr = make_list_expr(ctx, list);
+		consume(ctx, T_RIGHT_BRACK);
 		return list_expr;
 	}
 	else if (match(T_LEFT_PAREN)) {
-		struct expr* left = expression();
-		consume(T_RIGHT_PAREN);
+		struct expr* left = expression(ctx);
+		consume(ctx, T_RIGHT_PAREN);
 		return left;
 	}
 	else if (match(T_LAMBDA)) {
-		consume(T_LEFT_PAREN);
-		struct expr_list* list = expression_list(T_RIGHT_PAREN);
-		consume(T_RIGHT_PAREN);
-		struct statement* fn_body = parse_statement();
-		return make_func_expr(list, fn_body);
+		consume(ctx, T_LEFT_PAREN);
+		struct expr_list* list = expression_list(ctx, T_RIGHT_PAREN);
+		consume(ctx, T_RIGHT_PAREN);
+		struct statement* fn_body = parse_statement(ctx);
+		return make_func_expr(ctx, list, fn_body);
 	}
 	else if (match(T_LEFT_BRACE)) {
-		if (peek().t_type == T_RIGHT_BRACE) {
-			consume(T_RIGHT_BRACE);
-			return make_table_expr(NULL, NULL);
+		if (peek(ctx).t_type == T_RIGHT_BRACE) {
+			consume(ctx, T_RIGHT_BRACE);
+			return make_table_expr(ctx, NULL, NULL);
 		}
-		struct expr_list* keys = safe_malloc(sizeof(struct expr_list));
-		struct expr_list* values = safe_malloc(sizeof(struct expr_list));
+		struct expr_list* keys = ast_alloc(ctx, struct expr_list);
+		struct expr_list* values = ast_alloc(ctx, struct expr_list);
 		keys->next = 0;
 		values->next = 0;
 		struct expr** curr_keys = &keys->elem;
@@ -287,39 +208,39 @@ static struct expr* primary(void) {
 		struct expr_list* curr_key_list = keys;
 		struct expr_list* curr_val_list = values;
 		forever {
-			consume(T_IDENTIFIER);
-			*curr_keys = make_lit_expr(previous());
-			consume(T_COLON);
-			*curr_values = expression();
+			consume(ctx, T_IDENTIFIER);
+			*curr_keys = make_lit_expr(ctx, previous(ctx));
+			consume(ctx, T_COLON);
+			*curr_values = expression(ctx);
 			if (match(T_COMMA)) {
-				curr_key_list->next = safe_malloc(sizeof(struct expr_list));
+				curr_key_list->next = ast_alloc(ctx, struct expr_list);
 				curr_key_list = curr_key_list->next;
 				curr_key_list->next = 0;
 				curr_keys = &curr_key_list->elem;
 
-				curr_val_list->next = safe_malloc(sizeof(struct expr_list));
+				curr_val_list->next = ast_alloc(ctx, struct expr_list);
 				curr_val_list = curr_val_list->next;
 				curr_val_list->next = 0;
 				curr_values = &curr_val_list->elem;
 			} else break;
 		}
-		consume(T_RIGHT_BRACE);
-		return make_table_expr(keys, values);
+		consume(ctx, T_RIGHT_BRACE);
+		return make_table_expr(ctx, keys, values);
 	}
 	else if (match(T_IF)) {
-		struct expr* condition = expression();
-		struct expr* run_if_true = expression();
+		struct expr* condition = expression(ctx);
+		struct expr* run_if_true = expression(ctx);
 		struct expr* run_if_false = 0;
 		if (match(T_ELSE, T_COLON)) {
-			run_if_false = expression();
+			run_if_false = expression(ctx);
 		}
-		return make_if_expr(condition, run_if_true, run_if_false);
+		return make_if_expr(ctx, condition, run_if_true, run_if_false);
 	}
 	else {
-		struct token t = previous();
-		error_lexer(t.t_line, t.t_col, AST_EXPECTED_PRIMARY);
-		advance();
-		error_thrown = true;
+		struct token t = previous(ctx);
+		error_lexer(ctx, t.t_line, t.t_col, AST_EXPECTED_PRIMARY);
+		advance(ctx);
+		ctx->parser.error_thrown = true;
 		return 0;
 	}
 }
@@ -330,9 +251,9 @@ static bool is_literal_identifier(struct expr *e) {
 		 e->op.lit_expr.type == D_MEMBER_IDENTIFIER);
 }
 
-static void validate_member_access(struct expr* bin_expr) {
+static void validate_member_access(struct compiler_ctx* ctx, struct expr* bin_expr) {
 	if (!is_literal_identifier(bin_expr->op.bin_expr.right)) {
-		error_lexer(bin_expr->line, bin_expr->col,
+		error_lexer(ctx, bin_expr->line, bin_expr->col,
 			CODEGEN_MEMBER_ACCESS_RIGHT_NOT_LITERAL_IDENTIFIER,
 			data_string[bin_expr->op.bin_expr.right->op.lit_expr.type]);
 		return;
@@ -340,159 +261,161 @@ static void validate_member_access(struct expr* bin_expr) {
 	bin_expr->op.bin_expr.right->op.lit_expr.type = D_MEMBER_IDENTIFIER;
 }
 
-static struct expr* access(void) {
-	struct expr* left = primary();
+static struct expr* access(struct compiler_ctx* ctx) {
+	struct expr* left = primary(ctx);
+	if (!left) {
+		// Already reported, the caller rolls back
+		return 0;
+	}
 	if (left->type == E_LITERAL &&
 		left->op.lit_expr.type == D_IDENTIFIER &&
 		streq(left->op.lit_expr.value.string, "super")) {
 
-		consume(T_LEFT_PAREN);
-		struct expr_list* args = expression_list(T_RIGHT_PAREN);
-		traverse_expr(left, &ast_safe_free_impl);
+		consume(ctx, T_LEFT_PAREN);
+		struct expr_list* args = expression_list(ctx, T_RIGHT_PAREN);
 
-		left = make_super_call_expr(args);
-		consume(T_RIGHT_PAREN);
+		left = make_super_call_expr(ctx, args);
+		consume(ctx, T_RIGHT_PAREN);
 		return left;
 	}
 
 	while (match(T_LEFT_BRACK, T_DOT, T_LEFT_PAREN, T_SAFE_CALL, T_SAFE_NAVIGATE)) {
-		struct token op = previous();
+		struct token op = previous(ctx);
 		struct expr* right = 0;
 		if (op.t_type == T_LEFT_BRACK) {
-			right = expression();
-			consume(T_RIGHT_BRACK);
-			left = make_bin_expr(left, op, right);
+			right = expression(ctx);
+			consume(ctx, T_RIGHT_BRACK);
+			left = make_bin_expr(ctx, left, op, right);
 		}
 		else if (op.t_type == T_LEFT_PAREN || op.t_type == T_SAFE_CALL) {
-			struct expr_list* args = expression_list(T_RIGHT_PAREN);
-			left = make_call_expr(left, args);
+			struct expr_list* args = expression_list(ctx, T_RIGHT_PAREN);
+			left = make_call_expr(ctx, left, args);
 			left->op.call_expr.is_safe = (op.t_type == T_SAFE_CALL);
-			consume(T_RIGHT_PAREN);
+			consume(ctx, T_RIGHT_PAREN);
 		}
 		else {
-			right = primary();
-			left = make_bin_expr(left, op, right);
+			right = primary(ctx);
+			left = make_bin_expr(ctx, left, op, right);
 			// T_DOT case
-			validate_member_access(left);
+			validate_member_access(ctx, left);
 		}
 	}
 	return left;
 }
 
-static struct expr* unary(void) {
+static struct expr* unary(struct compiler_ctx* ctx) {
 	if (match(T_MINUS, T_NOT, T_TILDE, T_DOT_DOT_DOT)) {
-		struct token op = previous();
-		struct expr* right = unary();
-		return make_una_expr(op, right);
+		struct token op = previous(ctx);
+		struct expr* right = unary(ctx);
+		return make_una_expr(ctx, op, right);
 	}
-	return access();
+	return access(ctx);
 }
-static struct expr* exponent(void) {
-	struct expr* left = unary();
+static struct expr* exponent(struct compiler_ctx* ctx) {
+	struct expr* left = unary(ctx);
 	while (match(T_CARET)) {
-		struct token op = previous();
-		struct expr* right = unary();
-		left = make_bin_expr(left, op, right);
+		struct token op = previous(ctx);
+		struct expr* right = unary(ctx);
+		left = make_bin_expr(ctx, left, op, right);
 	}
 	return left;
 }
-static struct expr* factor(void) {
-	struct expr* left = exponent();
+static struct expr* factor(struct compiler_ctx* ctx) {
+	struct expr* left = exponent(ctx);
 	while (match(T_STAR, T_SLASH, T_INTSLASH, T_PERCENT, T_MOD_EQUAL)) {
-		struct token op = previous();
-		struct expr* right = exponent();
-		left = make_bin_expr(left, op, right);
+		struct token op = previous(ctx);
+		struct expr* right = exponent(ctx);
+		left = make_bin_expr(ctx, left, op, right);
 	}
 	return left;
 }
-static struct expr* term(void) {
-	struct expr* left = factor();
+static struct expr* term(struct compiler_ctx* ctx) {
+	struct expr* left = factor(ctx);
 	while (match(T_PLUS, T_MINUS)) {
-		struct token op = previous();
-		struct expr* right = factor();
-		left = make_bin_expr(left, op, right);
+		struct token op = previous(ctx);
+		struct expr* right = factor(ctx);
+		left = make_bin_expr(ctx, left, op, right);
 	}
 	return left;
 }
-static struct expr* range(void) {
-	struct expr* left = term();
+static struct expr* range(struct compiler_ctx* ctx) {
+	struct expr* left = term(ctx);
 	while (match(T_RANGE_OP)) {
-		struct token op = previous();
-		struct expr* right = term();
-		left = make_bin_expr(left, op, right);
+		struct token op = previous(ctx);
+		struct expr* right = term(ctx);
+		left = make_bin_expr(ctx, left, op, right);
 	}
 	return left;
 }
-static struct expr* elvis(void) {
-	struct expr* left = range();
+static struct expr* elvis(struct compiler_ctx* ctx) {
+	struct expr* left = range(ctx);
 	while (match(T_ELVIS)) {
-		struct token op = previous();
-		struct expr* right = range();
-		left = make_bin_expr(left, op, right);
+		struct token op = previous(ctx);
+		struct expr* right = range(ctx);
+		left = make_bin_expr(ctx, left, op, right);
 	}
 	return left;
 }
-static struct expr* comparison(void) {
-	struct expr* left = elvis();
+static struct expr* comparison(struct compiler_ctx* ctx) {
+	struct expr* left = elvis(ctx);
 	while (match(T_NOT_EQUAL, T_EQUAL_EQUAL, T_LESS, T_GREATER, T_LESS_EQUAL,
 					T_GREATER_EQUAL, T_TILDE)) {
-		struct token op = previous();
+		struct token op = previous(ctx);
 		struct expr* right = elvis
-		();
-		left = make_bin_expr(left, op, right);
+		(ctx);
+		left = make_bin_expr(ctx, left, op, right);
 	}
 	return left;
 }
-static struct expr* and(void) {
-	struct expr* left = comparison();
+static struct expr* and(struct compiler_ctx* ctx) {
+	struct expr* left = comparison(ctx);
 	while (match(T_AND)) {
-		struct token op = previous();
-		struct expr* right = comparison();
-		left = make_bin_expr(left, op, right);
+		struct token op = previous(ctx);
+		struct expr* right = comparison(ctx);
+		left = make_bin_expr(ctx, left, op, right);
 	}
 	return left;
 }
-static struct expr* or(void) {
-	struct expr* left = and();
+static struct expr* or(struct compiler_ctx* ctx) {
+	struct expr* left = and(ctx);
 	while (match(T_OR)) {
-		struct token op = previous();
-		struct expr* right = and();
-		left = make_bin_expr(left, op, right);
+		struct token op = previous(ctx);
+		struct expr* right = and(ctx);
+		left = make_bin_expr(ctx, left, op, right);
 	}
 	return left;
 }
-static struct expr* assignment(void) {
-	struct expr* left = lvalue();
+static struct expr* assignment(struct compiler_ctx* ctx) {
+	struct expr* left = lvalue(ctx);
 	if (match(T_EQUAL, T_ASSIGN_PLUS, T_ASSIGN_MINUS,
 		T_ASSIGN_STAR, T_ASSIGN_SLASH, T_ASSIGN_INTSLASH)) {
-		struct token op = previous();
-		struct expr* right = or();
-		left = make_assign_expr(left, right, op);
+		struct token op = previous(ctx);
+		struct expr* right = or(ctx);
+		left = make_assign_expr(ctx, left, right, op);
 	}
 	else if (match(T_DEFFN)) {
-        struct token op = previous();
-		consume(T_LEFT_PAREN);
-		struct expr_list* parameters = expression_list(T_RIGHT_PAREN);
-		consume(T_RIGHT_PAREN);
+        struct token op = previous(ctx);
+		consume(ctx, T_LEFT_PAREN);
+		struct expr_list* parameters = expression_list(ctx, T_RIGHT_PAREN);
+		consume(ctx, T_RIGHT_PAREN);
 		struct expr* rvalue;
 		if (match(T_NATIVE)) {
 			// Native Binding
-			consume(T_IDENTIFIER);
-			rvalue = make_native_func_expr(parameters, previous());
+			consume(ctx, T_IDENTIFIER);
+			rvalue = make_native_func_expr(ctx, parameters, previous(ctx));
 		}
 		else {
-			struct statement* fnbody = parse_statement();
-			rvalue = make_func_expr(parameters, fnbody);
+			struct statement* fnbody = parse_statement(ctx);
+			rvalue = make_func_expr(ctx, parameters, fnbody);
 		}
-		left = make_assign_expr(left, rvalue, op);
+		left = make_assign_expr(ctx, left, rvalue, op);
 	}
 	return left;
 }
-static struct expr* expression(void) {
-	struct expr* res = assignment();
-	if (error_thrown) {
+static struct expr* expression(struct compiler_ctx* ctx) {
+	struct expr* res = assignment(ctx);
+	if (ctx->parser.error_thrown) {
 		// Rollback
-		traverse_expr(res, &ast_safe_free_impl);
 		return 0;
 	}
 	else {
@@ -502,7 +425,7 @@ static struct expr* expression(void) {
 
 // Validates that the declaration is correct, i.e. init function calls
 //   super as the first entry
-static void validate_struct_declaration_statement(struct statement* sm) {
+static void validate_struct_declaration_statement(struct compiler_ctx* ctx, struct statement* sm) {
 	if (sm->op.struct_statement.parent_struct) {
 		// First line of init function must be super()
 		struct expr* init_fn = sm->op.struct_statement.init_fn;
@@ -518,55 +441,61 @@ static void validate_struct_declaration_statement(struct statement* sm) {
 		}
 
 		if (!first_stmt) {
-			error_lexer(init_fn->line, init_fn->col, "Struct initialization must call super-class constructor first");
+			error_lexer(ctx, init_fn->line, init_fn->col, "Struct initialization must call super-class constructor first");
 			return;
 		}
 
 		if (first_stmt->type != S_EXPR) {
-			error_lexer(init_fn->line, init_fn->col, "Struct initialization must call super-class constructor first");
+			error_lexer(ctx, init_fn->line, init_fn->col, "Struct initialization must call super-class constructor first");
 			return;
 		}
 
 		struct expr* call_expr = first_stmt->op.expr_statement;
 		if (call_expr->type != E_SUPER_CALL) {
-			error_lexer(init_fn->line, init_fn->col, "Struct initialization must call super-class constructor first");
+			error_lexer(ctx, init_fn->line, init_fn->col, "Struct initialization must call super-class constructor first");
 			return;
 		}
 	}
 }
 
-static struct statement* parse_statement(void) {
-	struct token first = advance();
-	struct statement* sm = safe_malloc(sizeof(struct statement));
+static struct statement* parse_statement(struct compiler_ctx* ctx) {
+	if (is_at_end(ctx) || ctx->parser.error_thrown) {
+		// Without strict errors parsing carries on after an error, so we
+		//   stop here rather than read past the tokens.
+		if (!ctx->parser.error_thrown) {
+			struct token last = previous(ctx);
+			error_lexer(ctx, last.t_line, last.t_col, AST_UNEXPECTED_END);
+			ctx->parser.error_thrown = true;
+		}
+		return 0;
+	}
+	struct token first = advance(ctx);
+	struct statement* sm = ast_alloc(ctx, struct statement);
 	sm->src_line = first.t_line;
 	switch (first.t_type) {
 		case T_DOLLAR_SIGN: {
-			consume(T_LEFT_BRACE);
+			consume(ctx, T_LEFT_BRACE);
 			sm->type = S_BYTECODE;
-			size_t start = curr_index;
-			while (curr_index < length &&
-				   tokens[curr_index].t_type != T_RIGHT_BRACE) {
-				curr_index++;
+			size_t start = ctx->parser.curr_index;
+			while (ctx->parser.curr_index < ctx->parser.length &&
+				   ctx->parser.tokens[ctx->parser.curr_index].t_type != T_RIGHT_BRACE) {
+				ctx->parser.curr_index++;
 			}
-			size_t end = curr_index;
-			consume(T_RIGHT_BRACE);
-			struct token* bytecode_list = safe_malloc((end - start) * sizeof(struct token));
-			for (size_t i = start; i < end; i++) {
-				bytecode_list[i - start] = copy_token(tokens[i]);
-			}
-			sm->op.bytecode_statement.data = bytecode_list;
+			size_t end = ctx->parser.curr_index;
+			consume(ctx, T_RIGHT_BRACE);
+			// The tokens outlive the AST, so the statement refers to them
+			sm->op.bytecode_statement.data = &ctx->parser.tokens[start];
 			sm->op.bytecode_statement.size = end - start;
 			break;
 		}
 		case T_LEFT_BRACE: {
-			if (peek().t_type == T_RIGHT_BRACE) {
+			if (peek(ctx).t_type == T_RIGHT_BRACE) {
 				// Non-Empty struct statement Block
-				consume(T_RIGHT_BRACE);
-				safe_free(sm);
+				consume(ctx, T_RIGHT_BRACE);
 				return 0;
 			}
-			struct statement_list* sl = parse_statement_list();
-			consume(T_RIGHT_BRACE);
+			struct statement_list* sl = parse_statement_list(ctx);
+			consume(ctx, T_RIGHT_BRACE);
 			sm->type = S_BLOCK;
 			sm->op.block_statement = sl;
 			break;
@@ -575,26 +504,27 @@ static struct statement* parse_statement(void) {
 			// Read an expression for a LVALUE
 			char* lvalue = 0;
 			if (match(T_IDENTIFIER)) {
-                struct token prev = previous();
-				lvalue = safe_strdup(prev.t_data.string);
+                struct token prev = previous(ctx);
+				lvalue = prev.t_data.string;
 			}
 			else {
                 size_t alloc_size = strlen(OPERATOR_OVERLOAD_PREFIX);
                 bool is_binary = false;
                 struct token lhs;
 				if (match(T_OBJ_TYPE)) {
-                    lhs = previous();
+                    lhs = previous(ctx);
                     is_binary = true;
                     alloc_size += strlen(lhs.t_data.string);
                 }
-                struct token op = advance();
+                struct token op = advance(ctx);
                 struct token operand;
                 if (precedence(op) || op.t_type == T_AT) {
                     alloc_size += strlen(op.t_data.string);
-                    consume(T_OBJ_TYPE);
-                    operand = previous();
+                    consume(ctx, T_OBJ_TYPE);
+                    operand = previous(ctx);
                     alloc_size += strlen(operand.t_data.string);
-					lvalue = safe_calloc(alloc_size + 1, sizeof(char));
+					lvalue = arena_alloc(&ctx->arena, alloc_size + 1);
+					lvalue[0] = 0;
 					strcat(lvalue, OPERATOR_OVERLOAD_PREFIX);
 					if (is_binary) {
 						strcat(lvalue, lhs.t_data.string);
@@ -603,32 +533,30 @@ static struct statement* parse_statement(void) {
 					strcat(lvalue, operand.t_data.string);
                 }
                 else {
-					error_lexer(op.t_line, op.t_col,
+					error_lexer(ctx, op.t_line, op.t_col,
 						AST_OPERATOR_OVERLOAD_NO_OPERATOR);
 				}
 			}
 			struct expr* rvalue = 0;
 			if (match(T_EQUAL)) {
-				rvalue = expression();
+				rvalue = expression(ctx);
 			}
 			else if (match(T_DEFFN)) {
-				consume(T_LEFT_PAREN);
-				struct expr_list* parameters = expression_list(T_RIGHT_PAREN);
-				consume(T_RIGHT_PAREN);
+				consume(ctx, T_LEFT_PAREN);
+				struct expr_list* parameters = expression_list(ctx, T_RIGHT_PAREN);
+				consume(ctx, T_RIGHT_PAREN);
 				if (match(T_NATIVE)) {
 					// Native Binding
-					consume(T_IDENTIFIER);
-					rvalue = make_native_func_expr(parameters, previous());
+					consume(ctx, T_IDENTIFIER);
+					rvalue = make_native_func_expr(ctx, parameters, previous(ctx));
 				}
 				else {
-					struct statement* fnbody = parse_statement();
-					rvalue = make_func_expr(parameters, fnbody);
+					struct statement* fnbody = parse_statement(ctx);
+					rvalue = make_func_expr(ctx, parameters, fnbody);
 				}
 			}
 			else {
-				struct token none_tk = none_token();
-				rvalue = make_lit_expr(none_tk);
-				destroy_token(none_tk);
+				rvalue = make_lit_expr(ctx, none_token());
 			}
 			sm->type = S_LET;
 			sm->op.let_statement.lvalue = lvalue;
@@ -636,11 +564,11 @@ static struct statement* parse_statement(void) {
 			break;
 		}
 		case T_IF: {
-			struct expr* condition = expression();
-			struct statement* run_if_true = parse_statement();
+			struct expr* condition = expression(ctx);
+			struct statement* run_if_true = parse_statement(ctx);
 			struct statement* run_if_false = 0;
 			if (match(T_ELSE, T_COLON)) {
-				run_if_false = parse_statement();
+				run_if_false = parse_statement(ctx);
 			}
 			sm->type = S_IF;
 			sm->op.if_statement.condition = condition;
@@ -657,25 +585,24 @@ static struct statement* parse_statement(void) {
 			break;
 		}
 		case T_LOOP: {
-			struct expr* index_var = expression();
+			struct expr* index_var = expression(ctx);
 			char* a_index;
 			struct expr* condition;
 			if (match(T_COLON, T_IN)) {
-				condition = expression();
+				condition = expression(ctx);
 				if (index_var->type != E_LITERAL ||
 						index_var->op.lit_expr.type != D_IDENTIFIER) {
-					struct token t = previous();
-					error_lexer(t.t_line, t.t_col, AST_EXPECTED_IDENTIFIER_LOOP);
+					struct token t = previous(ctx);
+					error_lexer(ctx, t.t_line, t.t_col, AST_EXPECTED_IDENTIFIER_LOOP);
 				}
-				a_index = safe_strdup(index_var->op.lit_expr.value.string);
-		        traverse_expr(index_var, &ast_safe_free_impl);
+				a_index = index_var->op.lit_expr.value.string;
 			}
 			else {
 				condition = index_var;
 				index_var = 0;
 				a_index = 0;
 			}
-			struct statement* run_if_true = parse_statement();
+			struct statement* run_if_true = parse_statement(ctx);
 			sm->type = S_LOOP;
 			sm->op.loop_statement.condition = condition;
 			sm->op.loop_statement.index_var = a_index;
@@ -684,219 +611,212 @@ static struct statement* parse_statement(void) {
 		}
 		case T_ENUM: {
 			if (!match(T_IDENTIFIER)) {
-				error_lexer(first.t_line, first.t_col,
+				error_lexer(ctx, first.t_line, first.t_col,
 					AST_ENUM_NAME_IDENTIFIER);
 			}
-			struct token name = previous();
-			consume(T_DEFFN);
+			struct token name = previous(ctx);
+			consume(ctx, T_DEFFN);
 			struct expr_list* values = 0;
 			match(T_LEFT_BRACE);
 			if (!match(T_RIGHT_BRACE)) {
-				values = identifier_list();
-				consume(T_RIGHT_BRACE);
+				values = identifier_list(ctx);
+				consume(ctx, T_RIGHT_BRACE);
 			}
 
 			// Default Initiation Function, which is just "ret this"
-			struct statement_list* init_fn = safe_malloc(sizeof(struct statement_list));
+			struct statement_list* init_fn = ast_alloc(ctx, struct statement_list);
 			struct statement_list* curr = init_fn;
 			struct statement_list* prev = 0;
 
 			// Simulate this._num = _num;
-			curr->elem = safe_malloc(sizeof(struct statement));
+			curr->elem = ast_alloc(ctx, struct statement);
 			curr->elem->type = S_EXPR;
-			curr->elem->op.expr_statement = safe_malloc(sizeof(struct expr));
+			curr->elem->op.expr_statement = ast_alloc(ctx, struct expr);
 			curr->elem->op.expr_statement->type = E_ASSIGN;
 			struct expr* ass_expr = curr->elem->op.expr_statement;
 			ass_expr->op.assign_expr.vm_operator = O_ASSIGN;
 			struct token num_token = make_token(T_IDENTIFIER, make_data_str("_num"));
-			ass_expr->op.assign_expr.rvalue = make_lit_expr(num_token);
+			ass_expr->op.assign_expr.rvalue = make_lit_expr(ctx, num_token);
 			// Binary Dot struct expr
-			struct expr* left = lit_expr_from_data(make_data(D_IDENTIFIER,
-							data_value_str("this")));
-			struct expr* right = make_lit_expr(num_token);
+			struct expr* left = lit_expr_from_data(ctx, ast_data_str(D_IDENTIFIER, "this"));
+			struct expr* right = make_lit_expr(ctx, num_token);
 
 			struct token op = make_token(T_DOT, make_data_str("."));
 			// This isn't very clean, having to make a fake token to
 			// construct the expression.
-			ass_expr->op.assign_expr.lvalue = make_bin_expr(left, op, right);
-			destroy_token(op);
+			ass_expr->op.assign_expr.lvalue = make_bin_expr(ctx, left, op, right);
 
 			prev = curr;
-			curr = safe_malloc(sizeof(struct statement_list));
+			curr = ast_alloc(ctx, struct statement_list);
 
-			curr->elem = safe_malloc(sizeof(struct statement));
+			curr->elem = ast_alloc(ctx, struct statement);
 			prev->next = curr;
 			curr->next = 0;
 			curr->elem->type = S_OPERATION;
 			curr->elem->op.operation_statement.vm_operator = OP_RET;
 			curr->elem->op.operation_statement.operand =
-                lit_expr_from_data(make_data(D_IDENTIFIER,
-								data_value_str("this")));
+                lit_expr_from_data(ctx, ast_data_str(D_IDENTIFIER, "this"));
 
-			struct statement* function_body = safe_malloc(sizeof(struct statement));
+			struct statement* function_body = ast_alloc(ctx, struct statement);
 			function_body->type = S_BLOCK;
 			function_body->op.block_statement = init_fn;
 			// init_fn is now the list of statements, to make it a function
-			struct expr_list* param_list = safe_malloc(sizeof(struct expr_list));
+			struct expr_list* param_list = ast_alloc(ctx, struct expr_list);
 			param_list->next = 0;
-			param_list->elem = make_lit_expr(num_token);
-			struct expr* function_const = make_func_expr(param_list, function_body);
+			param_list->elem = make_lit_expr(ctx, num_token);
+			struct expr* function_const = make_func_expr(ctx, param_list, function_body);
 			function_const->op.func_expr.is_struct_init = true;
 
 			sm->type = S_ENUM;
-			sm->op.enum_statement.name = safe_strdup(name.t_data.string);
+			sm->op.enum_statement.name = name.t_data.string;
 			sm->op.enum_statement.values = values;
 			sm->op.enum_statement.init_fn = function_const;
-			destroy_token(num_token);
 			break;
 		}
 		case T_STRUCT: {
 			if (!match(T_IDENTIFIER)) {
-				error_lexer(first.t_line, first.t_col,
+				error_lexer(ctx, first.t_line, first.t_col,
 					AST_STRUCT_NAME_IDENTIFIER);
 			}
-			struct token name = previous();
+			struct token name = previous(ctx);
 			struct expr_list* static_members = 0;
 			struct expr_list* instance_members = 0;
 			struct expr* parent_struct = 0;
 
 			if (match(T_COLON)) {
 				// Ignore all the math expression stuff
-				parent_struct = access();
+				parent_struct = access(ctx);
 			}
 
-			consume(T_DEFFN);
+			consume(ctx, T_DEFFN);
 			int saved_before_iden = 0;
 
 			struct expr* custom_init_fn = NULL;
 
 			while (match(T_LEFT_PAREN, T_LEFT_BRACK, T_LEFT_BRACE)) {
-				if (previous().t_type == T_LEFT_PAREN) {
-					saved_before_iden = curr_index;
+				if (previous(ctx).t_type == T_LEFT_PAREN) {
+					saved_before_iden = ctx->parser.curr_index;
 					if (match(T_RIGHT_PAREN)) continue;
-					instance_members = identifier_list();
-					consume(T_RIGHT_PAREN);
+					instance_members = identifier_list(ctx);
+					consume(ctx, T_RIGHT_PAREN);
 				}
-				else if (previous().t_type == T_LEFT_BRACK) {
+				else if (previous(ctx).t_type == T_LEFT_BRACK) {
 					if (match(T_RIGHT_BRACK)) continue;
-					static_members = expression_list(T_RIGHT_BRACK);
-					consume(T_RIGHT_BRACK);
+					static_members = expression_list(ctx, T_RIGHT_BRACK);
+					consume(ctx, T_RIGHT_BRACK);
 				}
-				else if (previous().t_type == T_LEFT_BRACE) {
+				else if (previous(ctx).t_type == T_LEFT_BRACE) {
 					if (match(T_RIGHT_BRACE)) continue;
 					// Struct functions:
 					//   fn => (params) { function };
 					// Write this into static member list as
 					//   as an assign_expression
 					while (match(T_IDENTIFIER, T_INIT)) {
-						if (previous().t_type == T_IDENTIFIER) {
-							struct token fn_name = previous();
+						if (previous(ctx).t_type == T_IDENTIFIER) {
+							struct token fn_name = previous(ctx);
 							struct expr* assigned_value = NULL;
 
 							if (match(T_DEFFN)) {
-								consume(T_LEFT_PAREN);
-								struct expr_list* parameters = expression_list(T_RIGHT_PAREN);
-								consume(T_RIGHT_PAREN);
-								struct statement* fnbody = parse_statement();
-								assigned_value = make_func_expr(parameters, fnbody);
+								consume(ctx, T_LEFT_PAREN);
+								struct expr_list* parameters = expression_list(ctx, T_RIGHT_PAREN);
+								consume(ctx, T_RIGHT_PAREN);
+								struct statement* fnbody = parse_statement(ctx);
+								assigned_value = make_func_expr(ctx, parameters, fnbody);
 							}
 							else if (match(T_EQUAL)) {
-								assigned_value = expression();
+								assigned_value = expression(ctx);
 								while (match(T_SEMICOLON)) { }
 							}
 							else {
-								error_lexer(fn_name.t_line, fn_name.t_col,
+								error_lexer(ctx, fn_name.t_line, fn_name.t_col,
 									"Expected = or =>");
 							}
 
-							struct expr* lvalue = make_lit_expr(fn_name);
-							struct expr_list* new_static = safe_malloc(sizeof(struct expr_list));
+							struct expr* lvalue = make_lit_expr(ctx, fn_name);
+							struct expr_list* new_static = ast_alloc(ctx, struct expr_list);
 							new_static->next = static_members;
 							static_members = new_static;
-							new_static->elem = make_assign_expr(lvalue, assigned_value,
+							new_static->elem = make_assign_expr(ctx, lvalue, assigned_value,
 								make_token(T_EQUAL, make_data_num(0)));
 						}
 						else {
 							if (custom_init_fn) {
-								error_lexer(previous().t_line, previous().t_col,
+								error_lexer(ctx, previous(ctx).t_line, previous(ctx).t_col,
 									"redeclaration of init function");
 								continue;
 							}
-							consume(T_DEFFN);
-							consume(T_LEFT_PAREN);
-							struct expr_list* parameters = expression_list(T_RIGHT_PAREN);
-							consume(T_RIGHT_PAREN);
-							struct statement* fnbody = parse_statement();
-							custom_init_fn = make_func_expr(parameters, fnbody);
+							consume(ctx, T_DEFFN);
+							consume(ctx, T_LEFT_PAREN);
+							struct expr_list* parameters = expression_list(ctx, T_RIGHT_PAREN);
+							consume(ctx, T_RIGHT_PAREN);
+							struct statement* fnbody = parse_statement(ctx);
+							custom_init_fn = make_func_expr(ctx, parameters, fnbody);
 						}
 					}
-					consume(T_RIGHT_BRACE);
+					consume(ctx, T_RIGHT_BRACE);
 				}
 			}
 			// Default Initiation Function
 			if (!custom_init_fn) {
-				struct statement_list* init_fn = safe_malloc(sizeof(struct statement_list));
+				struct statement_list* init_fn = ast_alloc(ctx, struct statement_list);
 				struct statement_list* curr = init_fn;
 				struct statement_list* prev = 0;
 
 				struct expr_list* tmp_ins = instance_members;
 				while (tmp_ins) {
-					curr->elem = safe_malloc(sizeof(struct statement));
+					curr->elem = ast_alloc(ctx, struct statement);
 					curr->elem->type = S_EXPR;
-					curr->elem->op.expr_statement = safe_malloc(sizeof(struct expr));
+					curr->elem->op.expr_statement = ast_alloc(ctx, struct expr);
 					curr->elem->op.expr_statement->type = E_ASSIGN;
 					struct expr* ass_expr = curr->elem->op.expr_statement;
 					ass_expr->op.assign_expr.vm_operator = O_ASSIGN;
-					ass_expr->op.assign_expr.rvalue = copy_lit_expr(tmp_ins->elem);
+					ass_expr->op.assign_expr.rvalue = copy_lit_expr(ctx, tmp_ins->elem);
 					// Binary Dot struct expr
-					struct expr* left = lit_expr_from_data(make_data(D_IDENTIFIER,
-									data_value_str("this")));
-					struct expr* right = copy_lit_expr(tmp_ins->elem);
+					struct expr* left = lit_expr_from_data(ctx, ast_data_str(D_IDENTIFIER, "this"));
+					struct expr* right = copy_lit_expr(ctx, tmp_ins->elem);
 
 					struct token op = make_token(T_DOT, make_data_str("."));
 					// This isn't very clean, having to make a fake token to
 					// construct the expression.
-					ass_expr->op.assign_expr.lvalue = make_bin_expr(left, op, right);
-					destroy_token(op);
+					ass_expr->op.assign_expr.lvalue = make_bin_expr(ctx, left, op, right);
 
 					if (prev) prev->next = curr;
 					prev = curr;
-					curr = safe_malloc(sizeof(struct statement_list));
+					curr = ast_alloc(ctx, struct statement_list);
 
 					tmp_ins = tmp_ins->next;
 				}
 				// Return This Operation
-				curr->elem = safe_malloc(sizeof(struct statement));
+				curr->elem = ast_alloc(ctx, struct statement);
 				if(prev) prev->next = curr;
 				curr->next = 0;
 				curr->elem->type = S_OPERATION;
 				curr->elem->op.operation_statement.vm_operator = OP_RET;
 				curr->elem->op.operation_statement.operand =
-					lit_expr_from_data(make_data(D_IDENTIFIER,
-									data_value_str("this")));
+					lit_expr_from_data(ctx, ast_data_str(D_IDENTIFIER, "this"));
 
 				struct expr_list* parameters = 0;
 				if (instance_members) {
-					size_t saved_before_pop = curr_index;
-					curr_index = saved_before_iden;
-					parameters = identifier_list();
-					curr_index = saved_before_pop;
+					size_t saved_before_pop = ctx->parser.curr_index;
+					ctx->parser.curr_index = saved_before_iden;
+					parameters = identifier_list(ctx);
+					ctx->parser.curr_index = saved_before_pop;
 				}
-				struct statement* function_body = safe_malloc(sizeof(struct statement));
+				struct statement* function_body = ast_alloc(ctx, struct statement);
 				function_body->type = S_BLOCK;
 				function_body->op.block_statement = init_fn;
 				// init_fn is now the list of statements, to make it a function
-				custom_init_fn = make_func_expr(parameters, function_body);
+				custom_init_fn = make_func_expr(ctx, parameters, function_body);
 			}
 
 			sm->type = S_STRUCT;
-			sm->op.struct_statement.name = safe_strdup(name.t_data.string);
+			sm->op.struct_statement.name = name.t_data.string;
 			custom_init_fn->op.func_expr.is_struct_init = true;
 			sm->op.struct_statement.init_fn = custom_init_fn;
 			sm->op.struct_statement.instance_members = instance_members;
 			sm->op.struct_statement.static_members = static_members;
 			sm->op.struct_statement.parent_struct = parent_struct;
-			validate_struct_declaration_statement(sm);
+			validate_struct_declaration_statement(ctx, sm);
 			break;
 		}
 		case T_INC:
@@ -915,71 +835,67 @@ static struct statement* parse_statement(void) {
                 default: break;
             }
 			sm->op.operation_statement.vm_operator = code;
-			sm->op.operation_statement.operand = expression();
+			sm->op.operation_statement.operand = expression(ctx);
 			break;
 		}
 		case T_REQ: {
 			sm->type = S_IMPORT;
 			if (match(T_IDENTIFIER, T_STRING)) {
-				// Don't actually need to do anything if it's a string, but we
-				//   delegate that task to codegen to decide.
-                struct token p = previous();
-                if (p.t_type == T_IDENTIFIER) {
-				    sm->op.import_statement = safe_strdup(p.t_data.string);
-                } else {
-                    sm->op.import_statement = 0;
-                }
+				// Identifiers name compiled libraries, strings name source
+				//   files which codegen compiles as their own unit.
+				struct token p = previous(ctx);
+				sm->op.import_statement.name = p.t_data.string;
+				sm->op.import_statement.is_file = p.t_type == T_STRING;
 			}
 			else {
-				error_lexer(first.t_line, first.t_col, AST_UNRECOGNIZED_IMPORT);
+				error_lexer(ctx, first.t_line, first.t_col, AST_UNRECOGNIZED_IMPORT);
 			}
 			break;
 		}
 		case T_RET: {
 			sm->type = S_OPERATION;
 			sm->op.operation_statement.vm_operator = OP_RET;
-			if (peek().t_type != T_SEMICOLON && peek().t_type != T_RIGHT_BRACE) {
-				sm->op.operation_statement.operand = expression();
+			if (peek(ctx).t_type != T_SEMICOLON && peek(ctx).t_type != T_RIGHT_BRACE) {
+				sm->op.operation_statement.operand = expression(ctx);
 			}
 			else {
-				sm->op.operation_statement.operand = lit_expr_from_data(noneret_data());
+				sm->op.operation_statement.operand = lit_expr_from_data(ctx, ast_data_str(D_NONERET, "<noneret>"));
 			}
 			break;
 		}
 		default: {
 			// We advanced it so we gotta roll back.
-			curr_index--;
+			ctx->parser.curr_index--;
 			// Handle as expression.
 			sm->type = S_EXPR;
-			sm->op.expr_statement = expression();
+			sm->op.expr_statement = expression(ctx);
 		}
 	}
 	match(T_SEMICOLON);
-	if (error_thrown) {
+	if (ctx->parser.error_thrown) {
 		// Rollback
-		traverse_statement(sm, &ast_safe_free_impl);
 		return 0;
 	}
 	return sm;
 }
 
-static struct statement_list* parse_statement_list(void) {
-	struct statement_list* ast = safe_malloc(sizeof(struct statement_list));
+static struct statement_list* parse_statement_list(struct compiler_ctx* ctx) {
+	struct statement_list* ast = ast_alloc(ctx, struct statement_list);
 	ast->next = 0;
 	struct statement** curr = &ast->elem;
 	struct statement_list* curr_ast = ast;
 	while (true) {
-		*curr = parse_statement();
-		if (!is_at_end() && peek().t_type != T_RIGHT_BRACE) {
-			curr_ast->next = safe_malloc(sizeof(struct statement_list));
+		*curr = parse_statement(ctx);
+		if (!is_at_end(ctx) && !ctx->parser.error_thrown &&
+			peek(ctx).t_type != T_RIGHT_BRACE) {
+			curr_ast->next = ast_alloc(ctx, struct statement_list);
 			curr_ast = curr_ast->next;
 			curr_ast->next = 0;
 			curr = &curr_ast->elem;
 		} else break;
 	}
-	if (error_thrown) {
+	if (ctx->parser.error_thrown) {
 		// Rollback
-		traverse_statement_list(ast, &ast_safe_free_impl);
 		return 0;
 	}
 	else {
@@ -1265,39 +1181,39 @@ void traverse_ast(struct statement_list* list, struct traversal_algorithm* algo)
 	traverse_statement_list(list, algo);
 }
 
-/* Consumes d */
-static struct expr* lit_expr_from_data(struct data d) {
-    struct expr* node = safe_malloc(sizeof(struct expr));
+/* d's string must live as long as the AST */
+static struct expr* lit_expr_from_data(struct compiler_ctx* ctx, struct data d) {
+    struct expr* node = ast_alloc(ctx, struct expr);
     node->type = E_LITERAL;
     node->op.lit_expr = d;
     return node;
 }
 
-static struct expr* copy_lit_expr(struct expr* from) {
-    struct expr* node = lit_expr_from_data(copy_data(from->op.lit_expr));
+static struct expr* copy_lit_expr(struct compiler_ctx* ctx, struct expr* from) {
+    struct expr* node = lit_expr_from_data(ctx, from->op.lit_expr);
 	node->line = from->line;
 	node->col = from->col;
 	return node;
 }
-static struct expr* make_lit_expr(struct token t) {
-	struct expr* node = lit_expr_from_data(literal_to_data(t));
+static struct expr* make_lit_expr(struct compiler_ctx* ctx, struct token t) {
+	struct expr* node = lit_expr_from_data(ctx, literal_to_data_ref(t));
 	node->line = t.t_line;
 	node->col = t.t_col;
 	return node;
 }
-static struct expr* make_bin_expr(struct expr* left, struct token op, struct expr* right) {
-	struct expr* node = safe_malloc(sizeof(struct expr));
+static struct expr* make_bin_expr(struct compiler_ctx* ctx, struct expr* left, struct token op, struct expr* right) {
+	struct expr* node = ast_alloc(ctx, struct expr);
 	node->line = op.t_line;
 	node->col = op.t_col;
 	node->type = E_BINARY;
-	node->op.bin_expr.vm_operator = token_operator_binary(op);
+	node->op.bin_expr.vm_operator = token_operator_binary(ctx, op);
 	node->op.bin_expr.left = left;
 	node->op.bin_expr.right = right;
 	return node;
 }
-static struct expr* make_if_expr(struct expr* condition, struct expr* if_true, struct expr* if_false) {
-	struct token t = tokens[curr_index];
-	struct expr* node = safe_malloc(sizeof(struct expr));
+static struct expr* make_if_expr(struct compiler_ctx* ctx, struct expr* condition, struct expr* if_true, struct expr* if_false) {
+	struct token t = ctx->parser.tokens[ctx->parser.curr_index];
+	struct expr* node = ast_alloc(ctx, struct expr);
 	node->line = t.t_line;
 	node->col = t.t_col;
 	node->type = E_IF;
@@ -1306,18 +1222,18 @@ static struct expr* make_if_expr(struct expr* condition, struct expr* if_true, s
 	node->op.if_expr.expr_false = if_false;
 	return node;
 }
-static struct expr* make_una_expr(struct token op, struct expr* operand) {
-	struct expr* node = safe_malloc(sizeof(struct expr));
+static struct expr* make_una_expr(struct compiler_ctx* ctx, struct token op, struct expr* operand) {
+	struct expr* node = ast_alloc(ctx, struct expr);
 	node->type = E_UNARY;
-	node->op.una_expr.vm_operator = token_operator_unary(op);
+	node->op.una_expr.vm_operator = token_operator_unary(ctx, op);
 	node->op.una_expr.operand = operand;
 	node->line = op.t_line;
 	node->col = op.t_col;
 	return node;
 }
-static struct expr* make_call_expr(struct expr* left, struct expr_list* arg_list) {
-	struct token t = tokens[curr_index];
-	struct expr* node = safe_malloc(sizeof(struct expr));
+static struct expr* make_call_expr(struct compiler_ctx* ctx, struct expr* left, struct expr_list* arg_list) {
+	struct token t = ctx->parser.tokens[ctx->parser.curr_index];
+	struct expr* node = ast_alloc(ctx, struct expr);
 	node->type = E_CALL;
 	node->op.call_expr.function = left;
 	node->op.call_expr.arguments = arg_list;
@@ -1325,18 +1241,18 @@ static struct expr* make_call_expr(struct expr* left, struct expr_list* arg_list
 	node->col = t.t_col;
 	return node;
 }
-static struct expr* make_super_call_expr(struct expr_list* arg_list) {
-	struct token t = tokens[curr_index];
-	struct expr* node = safe_malloc(sizeof(struct expr));
+static struct expr* make_super_call_expr(struct compiler_ctx* ctx, struct expr_list* arg_list) {
+	struct token t = ctx->parser.tokens[ctx->parser.curr_index];
+	struct expr* node = ast_alloc(ctx, struct expr);
 	node->type = E_SUPER_CALL;
 	node->op.super_call_expr.arguments = arg_list;
 	node->line = t.t_line;
 	node->col = t.t_col;
 	return node;
 }
-static struct expr* make_list_expr(struct expr_list* list) {
-	struct token t = tokens[curr_index];
-	struct expr* node = safe_malloc(sizeof(struct expr));
+static struct expr* make_list_expr(struct compiler_ctx* ctx, struct expr_list* list) {
+	struct token t = ctx->parser.tokens[ctx->parser.curr_index];
+	struct expr* node = ast_alloc(ctx, struct expr);
 	node->type = E_LIST;
 	int size = 0;
 	struct expr_list* start = list;
@@ -1350,8 +1266,8 @@ static struct expr* make_list_expr(struct expr_list* list) {
 	node->col = t.t_col;
 	return node;
 }
-static struct expr* make_assign_expr(struct expr* left, struct expr* right, struct token op) {
-	struct expr* node = safe_malloc(sizeof(struct expr));
+static struct expr* make_assign_expr(struct compiler_ctx* ctx, struct expr* left, struct expr* right, struct token op) {
+	struct expr* node = ast_alloc(ctx, struct expr);
 	node->type = E_ASSIGN;
 	node->op.assign_expr.lvalue = left;
 	node->op.assign_expr.rvalue = right;
@@ -1381,9 +1297,9 @@ static struct expr* make_assign_expr(struct expr* left, struct expr* right, stru
 	node->col = op.t_col;
 	return node;
 }
-static struct expr* make_func_expr(struct expr_list* parameters, struct statement* body) {
-	struct token t = tokens[curr_index];
-	struct expr* node = safe_malloc(sizeof(struct expr));
+static struct expr* make_func_expr(struct compiler_ctx* ctx, struct expr_list* parameters, struct statement* body) {
+	struct token t = ctx->parser.tokens[ctx->parser.curr_index];
+	struct expr* node = ast_alloc(ctx, struct expr);
 	node->type = E_FUNCTION;
 	node->op.func_expr.parameters = parameters;
 	node->op.func_expr.body = body;
@@ -1393,16 +1309,16 @@ static struct expr* make_func_expr(struct expr_list* parameters, struct statemen
 	node->col = t.t_col;
 	return node;
 }
-static struct expr* make_table_expr(struct expr_list* keys, struct expr_list* values) {
-	struct expr* node = safe_malloc(sizeof(struct expr));
+static struct expr* make_table_expr(struct compiler_ctx* ctx, struct expr_list* keys, struct expr_list* values) {
+	struct expr* node = ast_alloc(ctx, struct expr);
 	node->type = E_TABLE;
 	node->op.table_expr.keys = keys;
 	node->op.table_expr.values = values;
 	return node;
 }
-static struct expr* make_native_func_expr(struct expr_list* parameters, struct token name) {
-	struct expr* node = make_func_expr(parameters, 0);
+static struct expr* make_native_func_expr(struct compiler_ctx* ctx, struct expr_list* parameters, struct token name) {
+	struct expr* node = make_func_expr(ctx, parameters, 0);
 	node->op.func_expr.is_native = true;
-	node->op.func_expr.native_name = safe_strdup(name.t_data.string);
+	node->op.func_expr.native_name = name.t_data.string;
 	return node;
 }
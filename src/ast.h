@@ -4,6 +4,7 @@
 #include "token.h"
 #include "operators.h"
 #include "codegen.h"
+#include "compiler.h"
 #include <stdbool.h>
 
 // ast.h - Felix Guo
@@ -30,6 +31,9 @@
 //                      "#:" "(" identifier_list ")" "{" struct statement_list "}"
 // Inspired by https://lambda.uta.edu/cse5317/notes/node26.html
 
+// Types the inference pass can prove an expression always has
+enum static_type { ST_UNKNOWN, ST_NUMBER, ST_BOOL, ST_STRING, ST_LIST };
+
 struct expr {
 	enum { E_LITERAL, E_BINARY, E_UNARY, E_FUNCTION, E_LIST, E_CALL, E_SUPER_CALL, E_ASSIGN, E_IF, E_TABLE }
 		type;
@@ -69,6 +73,12 @@ struct expr {
 		} op;
 	int col;
 	int line;
+
+	// Filled in by [infer]: the proven type of the expression, and whether a
+	//   binary or compound assignment has operands of proven types with no
+	//   overload, so codegen can emit the specialized opcode
+	enum static_type static_type;
+	bool operands_typed;
 };
 
 struct expr_list {
@@ -100,7 +110,8 @@ struct statement {
 						struct expr_list*  values;
 						struct expr*       init_fn;        }   enum_statement;
 			struct statement_list*                             block_statement;
-			char*                                              import_statement;
+			struct {    char*              name;
+						bool               is_file;        }   import_statement;
 			struct {   struct token*       data;
 			           size_t              size;           }   bytecode_statement;
 	} op;
@@ -125,26 +136,26 @@ struct traversal_algorithm {
 
 	// Internal tracker of which level of traversal
 	int level;
-};
-
-#define TRAVERSAL_ALGO_PRE(a, b, c, d) { a, b, c, d, 0, 0, 0, 0, 0 }
-#define TRAVERSAL_ALGO_POST(a, b, c, d) { 0, 0, 0, 0, a, b, c, d, 0 }
-#define TRAVERSAL_ALGO(a, b, c, d, e, f, g, h) { a, b, c, d, e, f, g, h, 0 }
 
-extern struct traversal_algorithm ast_safe_free_impl;
+	// Passed along untouched for handlers that need their own state
+	void* data;
+};
 
-// generate_ast(tokens, length) generates an ast based on the tokens/length
-struct statement_list* generate_ast(struct token* tokens, size_t length);
+#define TRAVERSAL_ALGO_PRE(a, b, c, d) { a, b, c, d, 0, 0, 0, 0, 0, 0 }
+#define TRAVERSAL_ALGO_POST(a, b, c, d) { 0, 0, 0, 0, a, b, c, d, 0, 0 }
+#define TRAVERSAL_ALGO(a, b, c, d, e, f, g, h) { a, b, c, d, e, f, g, h, 0, 0 }
 
-// free_ast(ast) frees all the memory associated with the AST module
-void free_ast(struct statement_list* ast);
+// generate_ast(ctx, tokens, length) generates an ast based on the
+//   tokens/length, the tree lives in the arena of ctx and refers to the
+//   strings of the tokens
+struct statement_list* generate_ast(struct compiler_ctx* ctx, struct token* tokens, size_t length);
 
 // print_ast(ast) prints the tree in post order
 void print_ast(struct statement_list* ast);
 
-// ast_error_flag() returns true if the AST module encountered an error, and
+// ast_error_flag(ctx) returns true if parsing in ctx encountered an error, and
 //   false otherwise
-bool ast_error_flag(void);
+bool ast_error_flag(struct compiler_ctx* ctx);
 
 void traverse_ast(struct statement_list*, struct traversal_algorithm*);
 void traverse_expr(struct expr*, struct traversal_algorithm*);
@@ -152,8 +163,4 @@ void traverse_expr_list(struct expr_list*, struct traversal_algorithm*);
 void traverse_statement_list(struct statement_list*, struct traversal_algorithm*);
 void traverse_statement(struct statement*, struct traversal_algorithm*);
 
-void ast_safe_free_e(struct expr* ptr, struct traversal_algorithm* algo);
-void ast_safe_free_el(struct expr_list* ptr, struct traversal_algorithm* algo);
-void ast_safe_free_s(struct statement* ptr, struct traversal_algorithm* algo);
-void ast_safe_free_sl(struct statement_list* ptr, struct traversal_algorithm* algo);
 #endif
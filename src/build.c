@@ -0,0 +1,511 @@
+#include "build.h"
+#include "compiler.h"
+#include "scanner.h"
+#include "ast.h"
+#include "optimizer.h"
+#include "codegen.h"
+#include "dependencies.h"
+#include "source.h"
+#include "error.h"
+#include "global.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Implementation of the Build Driver
+// A build runs in two phases on the same worker pool. The first scans every
+//   module for its imports, which gives the dependency graph. The second
+//   compiles a module once everything it imports has finished.
+
+enum module_state {
+	MODULE_PENDING,
+	MODULE_BUILT,
+	MODULE_UP_TO_DATE,
+	MODULE_FAILED,
+	MODULE_SKIPPED
+};
+
+struct module {
+	// The file stem, which is also the name other modules import it by
+	char* name;
+	char* source_path;
+	char* output_path;
+
+	// Hash of the options that change the output, the source and the files
+	//   it imports, combined with the hashes of every dependency
+	uint64_t hash;
+	uint64_t previous_hash;
+	bool has_previous_hash;
+
+	struct import_node* imports;
+	struct module** dependencies;
+	size_t dependency_count;
+	struct module** dependents;
+	size_t dependent_count;
+
+	// Dependencies that have not finished compiling yet
+	size_t pending;
+	enum module_state state;
+};
+
+struct build {
+	const char* dir;
+	const struct settings* settings;
+	struct module* modules;
+	size_t count;
+
+	// Work queue shared by the worker threads of a phase
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	struct module** queue;
+	size_t queue_start;
+	size_t queue_end;
+	size_t remaining;
+	bool follow_dependents;
+	void (*work)(struct build*, struct module*);
+};
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t fnv_hash(uint64_t hash, const void* data, size_t length) {
+	const unsigned char* bytes = data;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+// settings_hash(settings) hashes the settings that change the code a module
+//   compiles to, so changing one rebuilds everything
+static uint64_t settings_hash(const struct settings* settings) {
+	bool optimize = settings->flags[SETTINGS_OPTIMIZE];
+	return fnv_hash(FNV_OFFSET_BASIS, &optimize, sizeof(optimize));
+}
+
+static int compare_modules(const void* a, const void* b) {
+	return strcmp(((struct module*)a)->name, ((struct module*)b)->name);
+}
+
+static struct module* find_module(struct build* b, const char* name) {
+	struct module key;
+	key.name = (char*)name;
+	return bsearch(&key, b->modules, b->count, sizeof(struct module),
+		compare_modules);
+}
+
+static bool find_modules(struct build* b) {
+	DIR* dir = opendir(b->dir);
+	if (!dir) {
+		error_general(0, "Could not open build directory %s.", b->dir);
+		return false;
+	}
+	size_t capacity = 16;
+	b->modules = safe_malloc(capacity * sizeof(struct module));
+	b->count = 0;
+	struct dirent* entry;
+	while ((entry = readdir(dir))) {
+		size_t length = strlen(entry->d_name);
+		if (length < 3 || !streq(entry->d_name + length - 2, ".w")) {
+			continue;
+		}
+		if (b->count == capacity) {
+			capacity *= 2;
+			b->modules = safe_realloc(b->modules,
+				capacity * sizeof(struct module));
+		}
+		struct module* m = &b->modules[b->count++];
+		memset(m, 0, sizeof(struct module));
+		m->name = safe_strdup(entry->d_name);
+		m->name[length - 2] = 0;
+		m->source_path = safe_concat(b->dir, "/", entry->d_name);
+		m->output_path = safe_concat(m->source_path, "c");
+	}
+	closedir(dir);
+	qsort(b->modules, b->count, sizeof(struct module), compare_modules);
+	return true;
+}
+
+static void read_manifest(struct build* b) {
+	char* path = safe_concat(b->dir, "/", BUILD_MANIFEST);
+	FILE* f = fopen(path, "r");
+	safe_free(path);
+	if (!f) return;
+	unsigned long long hash;
+	char name[INPUT_BUFFER_SIZE];
+	while (fscanf(f, "%llx %1023s", &hash, name) == 2) {
+		struct module* m = find_module(b, name);
+		if (m) {
+			m->previous_hash = hash;
+			m->has_previous_hash = true;
+		}
+	}
+	fclose(f);
+}
+
+static void write_manifest(struct build* b) {
+	char* path = safe_concat(b->dir, "/", BUILD_MANIFEST);
+	FILE* f = fopen(path, "w");
+	safe_free(path);
+	if (!f) {
+		error_general(0, "Could not write build manifest in %s.", b->dir);
+		return;
+	}
+	for (size_t i = 0; i < b->count; i++) {
+		struct module* m = &b->modules[i];
+		if (m->state == MODULE_BUILT || m->state == MODULE_UP_TO_DATE) {
+			fprintf(f, "%016llx %s\n", (unsigned long long)m->hash, m->name);
+		}
+	}
+	fclose(f);
+}
+
+// open_source(m, sources) loads the module into sources, so errors are
+//   reported against it, and returns the text
+static char* open_source(struct module* m, struct source_table* sources) {
+	FILE* f = fopen(m->source_path, "r");
+	if (!f) {
+		error_general(0, "Could not read %s.", m->source_path);
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	init_source(sources, f, m->source_path, length, true);
+	fclose(f);
+	return get_source_buffer(sources);
+}
+
+// hash_file_imports(ctx, ast, hash, seen) folds the path and text of every
+//   file ast imports into hash, and of the files those import, as they're
+//   compiled into the module. Returns false if one doesn't parse or there
+//   are too many, which has been reported. A file that can't be read is
+//   left for compiling to report.
+static bool hash_file_imports(struct compiler_ctx* ctx, struct statement_list* ast,
+		uint64_t* hash, struct import_node** seen) {
+	struct import_node* files = collect_file_imports(ast);
+	bool ok = true;
+	for (struct import_node* curr = files; curr && ok; curr = curr->next) {
+		if (has_already_imported_library(*seen, curr->name)) {
+			continue;
+		}
+		add_imported_library(seen, curr->name);
+		*hash = fnv_hash(*hash, curr->name, strlen(curr->name) + 1);
+		FILE* f = fopen(curr->name, "r");
+		if (!f) {
+			continue;
+		}
+		fseek(f, 0, SEEK_END);
+		long length = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		char* buffer = safe_malloc(length + 1);
+		length = fread(buffer, sizeof(char), length, f);
+		buffer[length] = 0;
+		fclose(f);
+		*hash = fnv_hash(*hash, buffer, length);
+		int first_line = add_source_unit(ctx->sources, curr->name, buffer);
+		if (first_line < 0) {
+			error_general(ctx, CODEGEN_TOO_MANY_FILE_IMPORTS, curr->name,
+				MAX_SOURCE_UNITS - 1);
+			safe_free(buffer);
+			ok = false;
+			break;
+		}
+
+		struct compiler_ctx child;
+		compiler_ctx_init_child(&child, ctx);
+		size_t alloc_size = 0;
+		struct token* tokens;
+		size_t tokens_count = scan_tokens_from_line(&child, buffer, &tokens,
+			&alloc_size, first_line + 1);
+		struct statement_list* unit_ast = generate_ast(&child, tokens, tokens_count);
+		ok = !ast_error_flag(&child) && !child.error_flag &&
+			hash_file_imports(&child, unit_ast, hash, seen);
+		compiler_ctx_destroy(&child);
+		safe_free(buffer);
+	}
+	free_imported_libraries_ll(&files);
+	return ok;
+}
+
+static void scan_module(struct build* b, struct module* m) {
+	struct source_table sources;
+	char* buffer = open_source(m, &sources);
+	if (!buffer) {
+		m->state = MODULE_FAILED;
+		return;
+	}
+	m->hash = fnv_hash(settings_hash(b->settings), buffer, strlen(buffer));
+
+	struct compiler_ctx ctx;
+	compiler_ctx_init(&ctx, b->settings, &sources);
+	size_t alloc_size = 0;
+	struct token* tokens;
+	size_t tokens_count = scan_tokens(&ctx, buffer, &tokens, &alloc_size);
+	struct statement_list* ast = generate_ast(&ctx, tokens, tokens_count);
+	if (ast_error_flag(&ctx) || ctx.error_flag) {
+		m->state = MODULE_FAILED;
+	}
+	else {
+		m->imports = collect_dependencies(ast);
+		struct import_node* seen = 0;
+		if (!hash_file_imports(&ctx, ast, &m->hash, &seen)) {
+			m->state = MODULE_FAILED;
+		}
+		free_imported_libraries_ll(&seen);
+	}
+	compiler_ctx_destroy(&ctx);
+	free_source(&sources);
+}
+static void compile_module(struct build* b, struct module* m) {
+	if (m->state == MODULE_FAILED) {
+		// Already reported while scanning
+		return;
+	}
+	for (size_t i = 0; i < m->dependency_count; i++) {
+		enum module_state state = m->dependencies[i]->state;
+		if (state == MODULE_FAILED || state == MODULE_SKIPPED) {
+			fprintf(stderr, "Skipped %s, %s failed to build.\n", m->name,
+				m->dependencies[i]->name);
+			m->state = MODULE_SKIPPED;
+			return;
+		}
+	}
+	if (m->has_previous_hash && m->previous_hash == m->hash) {
+		FILE* output = fopen(m->output_path, "r");
+		if (output) {
+			fclose(output);
+			m->state = MODULE_UP_TO_DATE;
+			return;
+		}
+	}
+
+	struct source_table sources;
+	char* buffer = open_source(m, &sources);
+	if (!buffer) {
+		m->state = MODULE_FAILED;
+		return;
+	}
+	struct compiler_ctx ctx;
+	compiler_ctx_init(&ctx, b->settings, &sources);
+	// Modules import each other's output before it is installed anywhere
+	ctx.library_dir = b->dir;
+	size_t alloc_size = 0;
+	struct token* tokens;
+	size_t tokens_count = scan_tokens(&ctx, buffer, &tokens, &alloc_size);
+	struct statement_list* ast = generate_ast(&ctx, tokens, tokens_count);
+	if (ctx.settings.flags[SETTINGS_OPTIMIZE]) {
+		// Importers use the top level bindings of every module
+		ast = optimize_unit_ast(&ctx, ast);
+	}
+	m->state = MODULE_FAILED;
+	if (!ast_error_flag(&ctx)) {
+		size_t size;
+		uint8_t* bytecode = generate_code(&ctx, ast, &size, true);
+		if (!ctx.error_flag) {
+			FILE* output = fopen(m->output_path, "w");
+			if (output) {
+				write_bytecode(bytecode, size, output);
+				fclose(output);
+				m->state = MODULE_BUILT;
+				printf("Compiled %s\n", m->name);
+			}
+			else {
+				error_general(0, "Could not write %s.", m->output_path);
+			}
+		}
+		safe_free(bytecode);
+	}
+	if (m->state == MODULE_FAILED) {
+		fprintf(stderr, "Failed to compile %s.\n", m->name);
+	}
+	compiler_ctx_destroy(&ctx);
+	free_source(&sources);
+}
+
+static void* build_worker(void* arg) {
+	struct build* b = arg;
+	pthread_mutex_lock(&b->lock);
+	while (b->remaining) {
+		if (b->queue_start == b->queue_end) {
+			pthread_cond_wait(&b->changed, &b->lock);
+			continue;
+		}
+		struct module* m = b->queue[b->queue_start++];
+		pthread_mutex_unlock(&b->lock);
+		b->work(b, m);
+		pthread_mutex_lock(&b->lock);
+		b->remaining--;
+		if (b->follow_dependents) {
+			for (size_t i = 0; i < m->dependent_count; i++) {
+				struct module* dependent = m->dependents[i];
+				if (--dependent->pending == 0) {
+					b->queue[b->queue_end++] = dependent;
+				}
+			}
+		}
+		pthread_cond_broadcast(&b->changed);
+	}
+	pthread_mutex_unlock(&b->lock);
+	return 0;
+}
+
+// run_phase(b, jobs, work, follow_dependents, count) runs work over count
+//   modules, starting with those already queued
+static void run_phase(struct build* b, int jobs,
+		void (*work)(struct build*, struct module*), bool follow_dependents,
+		size_t count) {
+	b->work = work;
+	b->follow_dependents = follow_dependents;
+	b->remaining = count;
+	if (!count) {
+		return;
+	}
+	if ((size_t)jobs > count) {
+		jobs = count;
+	}
+	pthread_t threads[jobs];
+	int started = 0;
+	for (int i = 0; i < jobs; i++) {
+		if (pthread_create(&threads[started], 0, build_worker, b) == 0) {
+			started++;
+		}
+	}
+	if (!started) {
+		// No threads to be had, so this thread does the work itself
+		build_worker(b);
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], 0);
+	}
+}
+
+static void link_modules(struct build* b) {
+	// Imports not found in the directory are resolved from the standard
+	//   library when compiled, so they aren't part of the graph.
+	for (size_t i = 0; i < b->count; i++) {
+		struct module* m = &b->modules[i];
+		for (struct import_node* curr = m->imports; curr; curr = curr->next) {
+			struct module* dependency = find_module(b, curr->name);
+			if (dependency) {
+				m->dependency_count++;
+				dependency->dependent_count++;
+			}
+		}
+	}
+	for (size_t i = 0; i < b->count; i++) {
+		struct module* m = &b->modules[i];
+		m->dependencies = safe_malloc(sizeof(struct module*) * (m->dependency_count + 1));
+		m->dependents = safe_malloc(sizeof(struct module*) * (m->dependent_count + 1));
+		m->dependency_count = 0;
+		m->dependent_count = 0;
+	}
+	for (size_t i = 0; i < b->count; i++) {
+		struct module* m = &b->modules[i];
+		for (struct import_node* curr = m->imports; curr; curr = curr->next) {
+			struct module* dependency = find_module(b, curr->name);
+			if (dependency) {
+				m->dependencies[m->dependency_count++] = dependency;
+				dependency->dependents[dependency->dependent_count++] = m;
+			}
+		}
+	}
+}
+
+// order_modules(b) queues the modules that are ready to compile and hashes
+//   every module in dependency order, returns how many can be compiled. The
+//   rest are in, or depend on, an import cycle.
+static size_t order_modules(struct build* b) {
+	struct module** order = safe_malloc(sizeof(struct module*) * (b->count + 1));
+	size_t order_start = 0;
+	size_t order_end = 0;
+	for (size_t i = 0; i < b->count; i++) {
+		struct module* m = &b->modules[i];
+		m->pending = m->dependency_count;
+		if (!m->pending) {
+			order[order_end++] = m;
+			b->queue[b->queue_end++] = m;
+		}
+	}
+	while (order_start < order_end) {
+		struct module* m = order[order_start++];
+		for (size_t i = 0; i < m->dependency_count; i++) {
+			m->hash = fnv_hash(m->hash, &m->dependencies[i]->hash,
+				sizeof(uint64_t));
+		}
+		for (size_t i = 0; i < m->dependent_count; i++) {
+			if (--m->dependents[i]->pending == 0) {
+				order[order_end++] = m->dependents[i];
+			}
+		}
+	}
+	safe_free(order);
+	for (size_t i = 0; i < b->count; i++) {
+		b->modules[i].pending = b->modules[i].dependency_count;
+	}
+	return order_end;
+}
+
+bool build_directory(const char* dir, int jobs, const struct settings* settings) {
+	struct build b;
+	memset(&b, 0, sizeof(struct build));
+	b.dir = dir;
+	b.settings = settings;
+	if (!find_modules(&b)) {
+		return false;
+	}
+	if (jobs < 1) {
+		jobs = 1;
+	}
+	pthread_mutex_init(&b.lock, 0);
+	pthread_cond_init(&b.changed, 0);
+	b.queue = safe_malloc(sizeof(struct module*) * (b.count + 1));
+	read_manifest(&b);
+
+	// Every module can be scanned at once
+	for (size_t i = 0; i < b.count; i++) {
+		b.queue[b.queue_end++] = &b.modules[i];
+	}
+	run_phase(&b, jobs, scan_module, false, b.count);
+
+	link_modules(&b);
+	b.queue_start = 0;
+	b.queue_end = 0;
+	size_t ordered = order_modules(&b);
+	run_phase(&b, jobs, compile_module, true, ordered);
+
+	size_t built = 0, up_to_date = 0, failed = 0;
+	for (size_t i = 0; i < b.count; i++) {
+		struct module* m = &b.modules[i];
+		if (m->state == MODULE_PENDING) {
+			// Never became ready, so it is stuck behind a cycle
+			fprintf(stderr, "Failed to compile %s, it is part of or depends "
+				"on an import cycle.\n", m->name);
+			m->state = MODULE_FAILED;
+		}
+		if (m->state == MODULE_BUILT) built++;
+		else if (m->state == MODULE_UP_TO_DATE) up_to_date++;
+		else failed++;
+	}
+	write_manifest(&b);
+	printf("Built %zu, %zu up to date, %zu failed.\n", built, up_to_date, failed);
+
+	for (size_t i = 0; i < b.count; i++) {
+		struct module* m = &b.modules[i];
+		safe_free(m->name);
+		safe_free(m->source_path);
+		safe_free(m->output_path);
+		free_imported_libraries_ll(&m->imports);
+		safe_free(m->dependencies);
+		safe_free(m->dependents);
+	}
+	safe_free(b.modules);
+	safe_free(b.queue);
+	pthread_mutex_destroy(&b.lock);
+	pthread_cond_destroy(&b.changed);
+	return !failed;
+}
@@ -0,0 +1,21 @@
+#ifndef BUILD_H
+#define BUILD_H
+
+#include "global.h"
+#include <stdbool.h>
+
+// build.h - Felix Guo
+// Compiles every source file in a directory, ordered by the libraries they
+//   import of each other. Modules that don't depend on each other compile at
+//   the same time on a pool of worker threads. A module is only rebuilt when
+//   its source, the source of anything it imports, or the options that change
+//   its output, like --no-optimize, have changed since the last build.
+
+#define BUILD_MANIFEST ".wendy-build"
+
+// build_directory(dir, jobs, settings) compiles each .w file in dir into a .wc
+//   file next to it using up to jobs threads, returns true if every module
+//   built
+bool build_directory(const char* dir, int jobs, const struct settings* settings);
+
+#endif
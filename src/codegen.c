@@ -8,11 +8,15 @@
 #include "source.h"
 #include "data.h"
 #include "imports.h"
+#include "infer.h"
+#include "scanner.h"
+#include "optimizer.h"
+#include "compiler.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
-#define write_byte(op) do { bytecode[size++] = op; } while(0)
+#define write_byte(op) do { ctx->codegen.bytecode[ctx->codegen.size++] = op; } while(0)
 
 // Implementation of Wendy ByteCode Generator
 const char* opcode_string[] = {
@@ -32,14 +36,6 @@ struct loop_context {
 	struct loop_context *parent;
 };
 
-struct loop_context *current_loop_context = 0;
-int scope_level = 0;
-
-static uint8_t* bytecode = 0;
-static size_t capacity = 0;
-static size_t size = 0;
-static size_t global_loop_id = 0;
-// static size_t global_member_call_id = 0;
 
 int verify_header(uint8_t* bytecode, size_t length) {
 	char* start = (char*)bytecode;
@@ -48,47 +44,55 @@ int verify_header(uint8_t* bytecode, size_t length) {
 		return strlen(WENDY_VM_HEADER) + 1;
 	}
 	else {
-		error_general(GENERAL_INVALID_HEADER);
+		error_general(0, GENERAL_INVALID_HEADER);
 	}
 	return 0;
 }
 
-static void guarantee_size(size_t desired_additional) {
-	if (size + desired_additional + CODEGEN_PAD_SIZE > capacity) {
-		capacity += desired_additional + CODEGEN_PAD_SIZE;
-		uint8_t* re = safe_realloc(bytecode, capacity * sizeof(uint8_t));
-		bytecode = re;
+static void guarantee_size(struct compiler_ctx* ctx, size_t desired_additional) {
+	if (ctx->codegen.size + desired_additional + CODEGEN_PAD_SIZE > ctx->codegen.capacity) {
+		ctx->codegen.capacity += desired_additional + CODEGEN_PAD_SIZE;
+		uint8_t* re = safe_realloc(ctx->codegen.bytecode, ctx->codegen.capacity * sizeof(uint8_t));
+		ctx->codegen.bytecode = re;
 	}
 }
 
-static void write_string(char* string) {
+static void write_string(struct compiler_ctx* ctx, char* string) {
 	if (!string) {
 		return;
 	}
-	guarantee_size(strlen(string) + 1);
+	guarantee_size(ctx, strlen(string) + 1);
 	for (size_t i = 0; string[i]; i++) {
 		write_byte(string[i]);
 	}
 	write_byte(0);
 }
 
-static void write_address(address a) {
-	guarantee_size(sizeof(address));
-	size_t pos = size;
+static void write_address(struct compiler_ctx* ctx, address a) {
+	guarantee_size(ctx, sizeof(address));
+	size_t pos = ctx->codegen.size;
 	if (!is_big_endian) pos += sizeof(a);
-	size += sizeof(a);
+	ctx->codegen.size += sizeof(a);
 	uint8_t* first = (void*)&a;
 	for (size_t i = 0; i < sizeof(address); i++) {
-		bytecode[is_big_endian ? pos++ : --pos] = first[i];
+		ctx->codegen.bytecode[is_big_endian ? pos++ : --pos] = first[i];
 	}
 }
 
-static void write_address_at(address a, address pos) {
+// write_integer_at(ctx, a, pos) fills in an operand written earlier
+static void write_integer_at(struct compiler_ctx* ctx, address a, address pos) {
 	if (!is_big_endian) pos += sizeof(address);
 	uint8_t* first = (void*)&a;
 	for (size_t i = 0; i < sizeof(address); i++) {
-		bytecode[is_big_endian ? pos++ : --pos] = first[i];
+		ctx->codegen.bytecode[is_big_endian ? pos++ : --pos] = first[i];
+	}
+}
+
+static void write_address_at(struct compiler_ctx* ctx, address a, address pos) {
+	if (a > ctx->codegen.last_jump_target) {
+		ctx->codegen.last_jump_target = a;
 	}
+	write_integer_at(ctx, a, pos);
 }
 
 // static void write_double_at(double a, address pos) {
@@ -99,81 +103,209 @@ static void write_address_at(address a, address pos) {
 // 	}
 // }
 
-static void write_double(double a) {
-	guarantee_size(sizeof(double));
-	size_t pos = size;
+static void write_double(struct compiler_ctx* ctx, double a) {
+	guarantee_size(ctx, sizeof(double));
+	size_t pos = ctx->codegen.size;
 	if (!is_big_endian) pos += sizeof(a);
-	size += sizeof(double);
+	ctx->codegen.size += sizeof(double);
 	uint8_t* p = (void*)&a;
 	for (size_t i = 0; i < sizeof(double); i++) {
-		bytecode[is_big_endian ? pos++ : --pos] = p[i];
+		ctx->codegen.bytecode[is_big_endian ? pos++ : --pos] = p[i];
 	}
 }
 
-static void write_integer(int a) {
-	write_address(a);
+static void write_integer(struct compiler_ctx* ctx, int a) {
+	write_address(ctx, a);
 }
 
 // writes data to stream, destroys data
-static void write_data(struct data t) {
+static void write_data(struct compiler_ctx* ctx, struct data t) {
 	write_byte(t.type);
 	if (is_numeric(t)) {
 		// Writing a double
-		write_double(t.value.number);
+		write_double(ctx, t.value.number);
 	}
 	else {
-		write_string(t.value.string);
+		write_string(ctx, t.value.string);
 	}
 	destroy_data(&t);
 }
 
-static inline void write_opcode(enum opcode op) {
-	guarantee_size(1);
+// set_stack_depth(ctx, depth) records that depth values are on the working
+//   stack at this point
+static void set_stack_depth(struct compiler_ctx* ctx, int depth) {
+	ctx->codegen.stack_depth = depth;
+	if (depth > ctx->codegen.max_stack_depth) {
+		ctx->codegen.max_stack_depth = depth;
+	}
+}
+
+// stack_effect(op) returns how much op grows the working stack. Opcodes that
+//   take a number of values given by their operands count as 0, and the code
+//   generating them sets the depth after.
+static int stack_effect(enum opcode op) {
+	switch (op) {
+		case OP_PUSH:
+		case OP_DECL:
+		case OP_WHERE:
+		case OP_CLOSURE:
+		case OP_DUPTOP:
+		case OP_NATIVE:
+			return 1;
+		case OP_BIN:
+		case OP_BINNUM:
+		case OP_BINSTR:
+		case OP_INDEX:
+		case OP_RET:
+		case OP_IN:
+		case OP_OUT:
+		case OP_OUTL:
+		case OP_JIF:
+		case OP_NTHPTR:
+		case OP_INC:
+		case OP_DEC:
+		case OP_POP:
+			return -1;
+		case OP_WRITE:
+			return -2;
+		default:
+			return 0;
+	}
+}
+
+static inline void write_opcode(struct compiler_ctx* ctx, enum opcode op) {
+	guarantee_size(ctx, 1);
+	ctx->codegen.last_opcode_at = ctx->codegen.size;
 	write_byte(op);
+	set_stack_depth(ctx, ctx->codegen.stack_depth + stack_effect(op));
+}
+
+// write_reserve(ctx) starts code that reserves the working stack it needs,
+//   returns where to fill in the amount once it's known
+static address write_reserve(struct compiler_ctx* ctx) {
+	write_opcode(ctx, OP_RESERVE);
+	address at = ctx->codegen.size;
+	write_address(ctx, 0);
+	set_stack_depth(ctx, 0);
+	ctx->codegen.max_stack_depth = 0;
+	return at;
 }
 
-static void make_scope(void) {
-	write_opcode(OP_FRM);
-	scope_level += 1;
+// ends_with_return(ctx) returns true if the code so far ends in a RET that
+//   no jump goes past, so nothing runs off the end
+static bool ends_with_return(struct compiler_ctx* ctx) {
+	return ctx->codegen.size &&
+		ctx->codegen.last_opcode_at == ctx->codegen.size - 1 &&
+		(ctx->codegen.bytecode[ctx->codegen.last_opcode_at] == OP_RET ||
+		ctx->codegen.bytecode[ctx->codegen.last_opcode_at] == OP_TCALL) &&
+		ctx->codegen.last_jump_target < ctx->codegen.size;
+}
+
+enum opcode specialized_opcode(enum vm_operator op, enum data_type a, enum data_type b) {
+	if (a == D_NUMBER && b == D_NUMBER) {
+		switch (op) {
+			case O_ADD: case O_SUB: case O_MUL: case O_DIV: case O_IDIV:
+			case O_REM: case O_POWER: case O_LT: case O_GT: case O_LTE:
+			case O_GTE: case O_EQ: case O_NEQ:
+				return OP_BINNUM;
+			default: break;
+		}
+	}
+	else if (a == D_STRING && b == D_STRING &&
+		(op == O_ADD || op == O_EQ || op == O_NEQ)) {
+		return OP_BINSTR;
+	}
+	else if (a == D_LIST && b == D_NUMBER && op == O_SUBSCRIPT) {
+		return OP_INDEX;
+	}
+	return OP_BIN;
 }
 
-static void end_scope(void) {
-	write_opcode(OP_END);
-	scope_level -= 1;
-	if (scope_level < 0) {
-		error_general("Scope level below 0! make_scope and end_scope not aligned!");
+// binary_opcode(expression, op, a, b) returns the opcode for the binary
+//   operation in expression, specialized if inference proved the types of a
+//   and b
+static enum opcode binary_opcode(struct expr* expression, enum vm_operator op,
+		struct expr* a, struct expr* b) {
+	if (!expression->operands_typed) {
+		return OP_BIN;
 	}
+	return specialized_opcode(op, static_data_type(a->static_type),
+		static_data_type(b->static_type));
 }
 
-static void codegen_expr(void* expre);
-static void codegen_statement(void* expre);
-static void codegen_statement_list(void* expre);
+static void make_scope(struct compiler_ctx* ctx) {
+	write_opcode(ctx, OP_FRM);
+	ctx->codegen.scope_level += 1;
+}
 
-static void codegen_lvalue_expr(struct expr* expression) {
+static void end_scope(struct compiler_ctx* ctx) {
+	write_opcode(ctx, OP_END);
+	ctx->codegen.scope_level -= 1;
+	if (ctx->codegen.scope_level < 0) {
+		error_general(ctx, "Scope level below 0! make_scope and end_scope not aligned!");
+	}
+}
+
+// declares_names(state) returns true if state binds names in the scope it
+//   runs in, blocks, branches and loops bind theirs in a scope of their own
+static bool declares_names(struct statement* state) {
+	if (!state) return false;
+	switch (state->type) {
+		case S_LET:
+		case S_STRUCT:
+		case S_ENUM:
+		case S_IMPORT:
+		case S_BYTECODE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// needs_scope(ctx, list) returns true if the statements in list need a scope,
+//   when optimizing one that nothing is declared in is left out
+static bool needs_scope(struct compiler_ctx* ctx, struct statement_list* list) {
+	if (!ctx->settings.flags[SETTINGS_OPTIMIZE]) {
+		return true;
+	}
+	for (; list; list = list->next) {
+		if (declares_names(list->elem)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void codegen_expr(struct compiler_ctx* ctx, void* expre);
+static void codegen_call(struct compiler_ctx* ctx, struct expr* expression, bool tail);
+static void codegen_statement(struct compiler_ctx* ctx, void* expre);
+static void codegen_statement_list(struct compiler_ctx* ctx, void* expre);
+
+static void codegen_lvalue_expr(struct compiler_ctx* ctx, struct expr* expression) {
 	if (expression->type == E_LITERAL) {
 		// Better be a identifier eh
 		if (expression->op.lit_expr.type != D_IDENTIFIER) {
-			error_lexer(expression->line, expression->col,
+			error_lexer(ctx, expression->line, expression->col,
 				CODEGEN_LVALUE_EXPECTED_IDENTIFIER);
 			return;
 		}
-		write_opcode(OP_WHERE);
-		write_string(expression->op.lit_expr.value.string);
+		write_opcode(ctx, OP_WHERE);
+		write_string(ctx, expression->op.lit_expr.value.string);
 	}
 	else if (expression->type == E_BINARY) {
 		// Left side in memory reg
-		codegen_expr(expression->op.bin_expr.left);
+		codegen_expr(ctx, expression->op.bin_expr.left);
 
 		if (expression->op.bin_expr.vm_operator == O_MEMBER) {
-			write_opcode(OP_MEMPTR);
-			write_string(expression->op.bin_expr.right->op.lit_expr.value.string);
+			write_opcode(ctx, OP_MEMPTR);
+			write_string(ctx, expression->op.bin_expr.right->op.lit_expr.value.string);
 		}
 		else if (expression->op.bin_expr.vm_operator == O_SUBSCRIPT) {
-			codegen_expr(expression->op.bin_expr.right);
-			write_opcode(OP_NTHPTR);
+			codegen_expr(ctx, expression->op.bin_expr.right);
+			write_opcode(ctx, OP_NTHPTR);
 		}
 		else {
-			error_lexer(expression->line, expression->col,
+			error_lexer(ctx, expression->line, expression->col,
 					CODEGEN_INVALID_LVALUE_BINOP);
 		}
 	}
@@ -181,62 +313,62 @@ static void codegen_lvalue_expr(struct expr* expression) {
 	// 	codegen_expr(expression);
 	// }
 	else {
-		error_lexer(expression->line, expression->col, CODEGEN_INVALID_LVALUE);
+		error_lexer(ctx, expression->line, expression->col, CODEGEN_INVALID_LVALUE);
 	}
 }
 
-static inline void codegen_end_marker(void) {
-	write_opcode(OP_PUSH);
-	write_data(make_data(D_END_OF_ARGUMENTS,
+static inline void codegen_end_marker(struct compiler_ctx* ctx) {
+	write_opcode(ctx, OP_PUSH);
+	write_data(ctx, make_data(D_END_OF_ARGUMENTS,
 		data_value_num(0)));
 }
 
-static void codegen_expr_list_for_call_named(struct expr_list* list) {
+static void codegen_expr_list_for_call_named(struct compiler_ctx* ctx, struct expr_list* list) {
 	if (!list) {
-		codegen_end_marker();
+		codegen_end_marker(ctx);
 		return;
 	}
 	if (list->elem->type != E_ASSIGN) {
-		error_lexer(list->elem->line, list->elem->col,
+		error_lexer(ctx, list->elem->line, list->elem->col,
 			CODEGEN_NAMED_ARGUMENT_MUST_COME_AFTER_POSITIONAL);
 		return;
 	}
-	codegen_expr_list_for_call_named(list->next);
+	codegen_expr_list_for_call_named(ctx, list->next);
 	// Named Argument
 	struct expr* assign_expr = list->elem;
 	if (assign_expr->op.assign_expr.lvalue->type != E_LITERAL ||
 		assign_expr->op.assign_expr.lvalue->op.lit_expr.type != D_IDENTIFIER) {
-		error_lexer(assign_expr->line,
+		error_lexer(ctx, assign_expr->line,
 					assign_expr->col,
 					CODEGEN_NAMED_ARGUMENT_NOT_LITERAL);
 		return;
 	}
 
-	codegen_expr(assign_expr->op.assign_expr.rvalue);
-	write_opcode(OP_PUSH);
-	write_data(make_data(D_NAMED_ARGUMENT_NAME,
+	codegen_expr(ctx, assign_expr->op.assign_expr.rvalue);
+	write_opcode(ctx, OP_PUSH);
+	write_data(ctx, make_data(D_NAMED_ARGUMENT_NAME,
 		data_value_str(assign_expr->op.assign_expr.lvalue->op.lit_expr.value.string)));
 }
 
-static void codegen_expr_list_for_call(struct expr_list* list) {
+static void codegen_expr_list_for_call(struct compiler_ctx* ctx, struct expr_list* list) {
 	// Let the recursion handle the reversing of the generation.
 	if (!list) {
 		// Write end marker first.
-		codegen_end_marker();
+		codegen_end_marker(ctx);
 		return;
 	}
 	if (list->elem->type != E_ASSIGN) {
 		// Simple Case
-		codegen_expr_list_for_call(list->next);
-		codegen_expr(list->elem);
+		codegen_expr_list_for_call(ctx, list->next);
+		codegen_expr(ctx, list->elem);
 		return;
 	}
-	codegen_expr_list_for_call_named(list);
+	codegen_expr_list_for_call_named(ctx, list);
 }
 
-static void assert_one(size_t size, size_t *ptr) {
+static void assert_one(struct compiler_ctx* ctx, size_t size, size_t *ptr) {
 	if (*ptr >= size) {
-		error_general("Expected argument (1 more token) in inline bytecode!");
+		error_general(ctx, "Expected argument (1 more token) in inline bytecode!");
 	}
 }
 
@@ -251,78 +383,82 @@ static int is_data_type(struct token t) {
 }
 
 // _size because global size taken; oops
-static bool codegen_one_instruction(struct token *tokens, size_t _size, size_t * ptr) {
+static bool codegen_one_instruction(struct compiler_ctx* ctx, struct token *tokens, size_t _size, size_t * ptr) {
 	if (*ptr >= _size) return false;
 	bool found = false;
 	enum opcode op;
 	for (size_t j = 0; opcode_string[j]; j++) {
 		if (streq(tokens[*ptr].t_data.string, opcode_string[j])) {
 			op = (enum opcode) j;
-			write_opcode(op);
+			write_opcode(ctx, op);
 			found = true;
 			break;
 		}
 	}
 	if (!found) {
-		error_general("Unrecognized Instruction %s", tokens[*ptr].t_data.string);
+		error_general(ctx, "Unrecognized Instruction %s", tokens[*ptr].t_data.string);
 		return false;
 	}
 	*ptr += 1;
 	switch (op) {
 		case OP_PUSH: {
-			assert_one(_size, ptr);
+			assert_one(ctx, _size, ptr);
 			struct token arg = tokens[(*ptr)++];
 			int maybe_data_type = is_data_type(arg);
 			if (maybe_data_type >= 0) {
-				assert_one(_size, ptr);
+				assert_one(ctx, _size, ptr);
 				struct token arg2 = tokens[(*ptr)++];
 				if (arg2.t_type == T_NUMBER) {
-					write_data(make_data((enum data_type) maybe_data_type,
+					write_data(ctx, make_data((enum data_type) maybe_data_type,
 						data_value_num(arg2.t_data.number)));
 				}
 				else if (arg2.t_type == T_STRING) {
-					write_data(make_data((enum data_type) maybe_data_type,
+					write_data(ctx, make_data((enum data_type) maybe_data_type,
 						data_value_str(arg2.t_data.string)));
 				}
 				else {
-					error_general("Invalid second arg to PUSH");
+					error_general(ctx, "Invalid second arg to PUSH");
 				}
 			}
 			else if (arg.t_type == T_NUMBER || arg.t_type == T_STRING ||
 				arg.t_type == T_IDENTIFIER) {
-				write_data(literal_to_data(arg));
+				write_data(ctx, literal_to_data(arg));
 			}
 			else {
-				error_general("Invalid arg(s) to PUSH");
+				error_general(ctx, "Invalid arg(s) to PUSH");
 			}
 			break;
 		}
 		case OP_BIN:
+		case OP_BINNUM:
+		case OP_BINSTR:
+		case OP_INDEX:
 		case OP_UNA: {
-			assert_one(_size, ptr);
+			assert_one(ctx, _size, ptr);
 			struct token op_t = tokens[(*ptr)++];
-			if (op == OP_BIN) {
-				enum vm_operator op_e = token_operator_binary(op_t);
+			if (op != OP_UNA) {
+				enum vm_operator op_e = token_operator_binary(ctx, op_t);
 				write_byte(op_e);
 			}
 			else {
-				enum vm_operator op_e = token_operator_unary(op_t);
+				enum vm_operator op_e = token_operator_unary(ctx, op_t);
 				write_byte(op_e);
 			}
 			break;
 		}
 		case OP_CALL:
+		case OP_TCALL:
 		case OP_RET:
 			// NO ARGS
 			break;
 		case OP_DECL: {
-			assert_one(_size, ptr);
+			assert_one(ctx, _size, ptr);
 			struct token arg = tokens[(*ptr)++];
 			if (arg.t_type == T_IDENTIFIER) {
-				write_string(arg.t_data.string);
+				write_string(ctx, arg.t_data.string);
 			}
 			else {
-				error_general("Invalid args to DECL");
+				error_general(ctx, "Invalid args to DECL");
 			}
 			break;
 		}
@@ -335,14 +471,14 @@ static bool codegen_one_instruction(struct token *tokens, size_t _size, size_t *
 		case OP_JMP:
 		case OP_JIF:
 		case OP_SRC: {
-			assert_one(_size, ptr);
+			assert_one(ctx, _size, ptr);
 			struct token arg = tokens[(*ptr)++];
 			if (arg.t_type == T_NUMBER) {
 				address a = (address) arg.t_data.number;
-				write_address(a);
+				write_address(ctx, a);
 			}
 			else {
-				error_general("Invalid args to JMP or JIF");
+				error_general(ctx, "Invalid args to JMP or JIF");
 			}
 			break;
 		}
@@ -353,33 +489,33 @@ static bool codegen_one_instruction(struct token *tokens, size_t _size, size_t *
 		case OP_HALT:
 			break;
 		case OP_NATIVE: {
-			assert_one(_size, ptr);
+			assert_one(ctx, _size, ptr);
 			struct token arg = tokens[(*ptr)++];
 			if (arg.t_type == T_NUMBER) {
-				write_address((address) arg.t_data.number);
-				assert_one(_size, ptr);
+				write_address(ctx, (address) arg.t_data.number);
+				assert_one(ctx, _size, ptr);
 				struct token arg2 = tokens[(*ptr)++];
 				if (arg2.t_type == T_IDENTIFIER) {
-					write_string(arg2.t_data.string);
+					write_string(ctx, arg2.t_data.string);
 				}
 				else {
-					error_general("Invalid arg2 for NATIVE");
+					error_general(ctx, "Invalid arg2 for NATIVE");
 				}
 			}
 			else {
-				error_general("Invalid args for NATIVE");
+				error_general(ctx, "Invalid args for NATIVE");
 			}
 			break;
 		}
 		case OP_WHERE:
 		case OP_IMPORT: {
-			assert_one(_size, ptr);
+			assert_one(ctx, _size, ptr);
 			struct token arg = tokens[(*ptr)++];
 			if (arg.t_type == T_IDENTIFIER) {
-				write_string(arg.t_data.string);
+				write_string(ctx, arg.t_data.string);
 			}
 			else {
-				error_general("Invalid args for IMPORT");
+				error_general(ctx, "Invalid args for IMPORT");
 			}
 			break;
 		}
@@ -388,33 +524,44 @@ static bool codegen_one_instruction(struct token *tokens, size_t _size, size_t *
 			// NO ARGS
 			break;
 		case OP_MKREF: {
-			assert_one(_size, ptr);
+			assert_one(ctx, _size, ptr);
 			struct token arg = tokens[(*ptr)++];
 			int maybe_data_type = is_data_type(arg);
 			if (maybe_data_type >= 0) {
 				write_byte(maybe_data_type);
-				assert_one(_size, ptr);
+				assert_one(ctx, _size, ptr);
 				struct token arg2 = tokens[(*ptr)++];
 				if (arg2.t_type == T_NUMBER) {
-					write_double(arg2.t_data.number);
+					write_double(ctx, arg2.t_data.number);
 				}
 				else {
-					error_general("Invalid arg2 for MKREF");
+					error_general(ctx, "Invalid arg2 for MKREF");
 				}
 			}
 			else {
-				error_general("Invalid arg for MKREF");
+				error_general(ctx, "Invalid arg for MKREF");
 			}
 			break;
 		}
 		case OP_MKTBL: {
-			assert_one(_size, ptr);
+			assert_one(ctx, _size, ptr);
+			struct token arg = tokens[(*ptr)++];
+			if (arg.t_type == T_NUMBER) {
+				write_address(ctx, arg.t_data.number);
+			}
+			else {
+				error_general(ctx, "Invalid arg2 for MKTABLE");
+			}
+			break;
+		}
+		case OP_RESERVE: {
+			assert_one(ctx, _size, ptr);
 			struct token arg = tokens[(*ptr)++];
 			if (arg.t_type == T_NUMBER) {
-				write_address(arg.t_data.number);
+				write_address(ctx, arg.t_data.number);
 			}
 			else {
-				error_general("Invalid arg2 for MKTABLE");
+				error_general(ctx, "Invalid arg for RESERVE");
 			}
 			break;
 		}
@@ -426,170 +573,305 @@ static bool codegen_one_instruction(struct token *tokens, size_t _size, size_t *
 		case OP_INC:
 		case OP_DEC:
 			break;
+		case OP_PUSH2:
+		case OP_DECLW:
+		case OP_STORE:
+		case OP_BRNUM:
+		case OP_PUSHB:
+			// They assume the instruction after them, only the optimizer
+			//   makes them
+			error_general(ctx, "Superinstruction %s in inline bytecode", opcode_string[op]);
+			return false;
 	}
 	return true;
 }
 
-static void codegen_inline_bytecode(struct token *tokens, size_t size) {
+static void codegen_inline_bytecode(struct compiler_ctx* ctx, struct token *tokens, size_t size) {
 	size_t curr = 0;
-	while (codegen_one_instruction(tokens, size, &curr)) {}
+	while (codegen_one_instruction(ctx, tokens, size, &curr)) {}
+}
+
+uint8_t* read_library(struct compiler_ctx* ctx, const char* name, long* length) {
+	// Could either be in local directory or in standard
+	// library location. Local directory prevails.
+	static char *extension = ".wc";
+	char* local_path = safe_concat(name, extension);
+	FILE *f = fopen(local_path, "r");
+	safe_free(local_path);
+	if (!f && ctx->library_dir) {
+		char* dir_path = safe_concat(ctx->library_dir, "/", name, extension);
+		f = fopen(dir_path, "r");
+		safe_free(dir_path);
+	}
+	if (!f) {
+		// Not found, try standard library.
+		char* path = get_path();
+		strcat(path, "wendy-lib/");
+		strcat(path, name);
+		strcat(path, extension);
+		f = fopen(path, "r");
+		safe_free(path);
+	}
+	if (!f) {
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	*length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t* buffer = safe_malloc(*length);
+	fread(buffer, sizeof(uint8_t), *length, f);
+	fclose(f);
+	return buffer;
+}
+
+struct import_unit* compile_import_unit(struct compiler_ctx* ctx, char* path, int line) {
+	struct import_unit* unit = find_import_unit(*ctx->import_units, path);
+	if (unit) {
+		if (unit->compiling) {
+			// Still being compiled further up, so it has no bytecode yet
+			error_lexer(ctx, line, 0, CODEGEN_CIRCULAR_IMPORT, path);
+		}
+		return unit;
+	}
+	unit = add_import_unit(ctx->import_units, path);
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		error_lexer(ctx, line, 0, CODEGEN_REQ_FILE_READ_ERR);
+		return unit;
+	}
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char* buffer = safe_malloc(length + 1);
+	length = fread(buffer, sizeof(char), length, f);
+	buffer[length] = 0;
+	fclose(f);
+	int first_line = add_source_unit(ctx->sources, path, buffer);
+	if (first_line < 0) {
+		error_lexer(ctx, line, 0, CODEGEN_TOO_MANY_FILE_IMPORTS, path, MAX_SOURCE_UNITS - 1);
+		safe_free(buffer);
+		return unit;
+	}
+
+	// Marks the unit so an import of it from inside reports the cycle
+	unit->compiling = true;
+	struct compiler_ctx child;
+	compiler_ctx_init_child(&child, ctx);
+	size_t alloc_size = 0;
+	struct token* tokens;
+	size_t tokens_count = scan_tokens_from_line(&child, buffer, &tokens,
+		&alloc_size, first_line + 1);
+	struct statement_list* ast = generate_ast(&child, tokens, tokens_count);
+	if (child.settings.flags[SETTINGS_OPTIMIZE]) {
+		ast = optimize_unit_ast(&child, ast);
+	}
+	if (!ast_error_flag(&child)) {
+		unit->bytecode = generate_code(&child, ast, &unit->size, false);
+	}
+	if (child.error_flag) {
+		// The importer is broken too, and must not run
+		ctx->error_flag = true;
+	}
+	safe_free(buffer);
+	compiler_ctx_destroy(&child);
+	unit->compiling = false;
+	return unit;
+}
+
+// codegen_import_unit(ctx, path, line) links in the bytecode of a compiled
+//   unit, guarded by OP_IMPORT so it only runs once just like a library.
+static void codegen_import_unit(struct compiler_ctx* ctx, char* path, int line) {
+	if (has_already_imported_library(ctx->codegen.imported_libraries, path)) {
+		return;
+	}
+	struct import_unit* unit = compile_import_unit(ctx, path, line);
+	if (!unit->bytecode) {
+		// Failed to compile, or a circular import that was reported.
+		return;
+	}
+	add_imported_library(&ctx->codegen.imported_libraries, path);
+	write_opcode(ctx, OP_IMPORT);
+	write_string(ctx, path);
+	int jumpLoc = ctx->codegen.size;
+	ctx->codegen.size += sizeof(address);
+
+	// Units end in OP_HALT, which we drop.
+	size_t length = unit->size - 1;
+	guarantee_size(ctx, length);
+	memcpy(ctx->codegen.bytecode + ctx->codegen.size, unit->bytecode, length);
+	offset_addresses(ctx->codegen.bytecode + ctx->codegen.size, length, ctx->codegen.size);
+	ctx->codegen.size += length;
+	write_address_at(ctx, ctx->codegen.size, jumpLoc);
+}
+
+// is_tail_call(ctx, expression) returns true if returning expression can
+//   replace the current frame with the call instead
+static bool is_tail_call(struct compiler_ctx* ctx, struct expr* expression) {
+	return ctx->settings.flags[SETTINGS_OPTIMIZE] &&
+		ctx->codegen.function_depth > 0 &&
+		expression && expression->type == E_CALL &&
+		!expression->op.call_expr.is_safe;
 }
 
-static void codegen_statement(void* expre) {
+// codegen_return(ctx, expression) returns the value of expression from the
+//   current function
+static void codegen_return(struct compiler_ctx* ctx, struct expr* expression) {
+	if (is_tail_call(ctx, expression)) {
+		codegen_call(ctx, expression, true);
+		return;
+	}
+	codegen_expr(ctx, expression);
+	write_opcode(ctx, OP_RET);
+}
+
+// codegen_branch(ctx, state) generates a branch of an if statement in its
+//   own scope
+static void codegen_branch(struct compiler_ctx* ctx, struct statement* state) {
+	struct statement_list only = { state, 0 };
+	bool scoped = needs_scope(ctx, state ? &only : 0);
+	if (scoped) {
+		make_scope(ctx);
+	}
+	codegen_statement(ctx, state);
+	if (scoped) {
+		end_scope(ctx);
+	}
+}
+
+static void codegen_statement(struct compiler_ctx* ctx, void* expre) {
 	if (!expre) return;
 	struct statement* state = (struct statement*) expre;
+	// Statements leave the working stack as they found it
+	int stack_depth = ctx->codegen.stack_depth;
 
-	if (!get_settings_flag(SETTINGS_COMPILE)) {
-		write_opcode(OP_SRC);
-		write_integer(state->src_line);
+	if (!ctx->settings.flags[SETTINGS_COMPILE]) {
+		write_opcode(ctx, OP_SRC);
+		write_integer(ctx, state->src_line);
 	}
 	switch (state->type) {
 		case S_LET: {
-			codegen_expr(state->op.let_statement.rvalue);
+			codegen_expr(ctx, state->op.let_statement.rvalue);
 			// Request Memory
-			write_opcode(OP_DECL);
-			write_string(state->op.let_statement.lvalue);
-			write_opcode(OP_WRITE);
+			write_opcode(ctx, OP_DECL);
+			write_string(ctx, state->op.let_statement.lvalue);
+			write_opcode(ctx, OP_WRITE);
 			break;
 		}
 		case S_OPERATION: {
 			if (state->op.operation_statement.vm_operator == OP_RET) {
-				codegen_expr(state->op.operation_statement.operand);
+				codegen_return(ctx, state->op.operation_statement.operand);
+				break;
 			}
 			else if (state->op.operation_statement.vm_operator == OP_OUTL) {
-				codegen_expr(state->op.operation_statement.operand);
+				codegen_expr(ctx, state->op.operation_statement.operand);
 			}
 			else {
-				codegen_lvalue_expr(state->op.operation_statement.operand);
+				codegen_lvalue_expr(ctx, state->op.operation_statement.operand);
 			}
-			write_opcode(state->op.operation_statement.vm_operator);
+			write_opcode(ctx, state->op.operation_statement.vm_operator);
 			break;
 		}
 		case S_EXPR: {
-			codegen_expr(state->op.expr_statement);
+			codegen_expr(ctx, state->op.expr_statement);
 			// Only output if it's not an assignment struct statement.
 			if (state->op.expr_statement &&
 				state->op.expr_statement->type != E_ASSIGN)
-				write_opcode(OP_OUT);
+				write_opcode(ctx, OP_OUT);
 			break;
 		}
 		case S_BYTECODE: {
-			codegen_inline_bytecode(state->op.bytecode_statement.data,
+			codegen_inline_bytecode(ctx, state->op.bytecode_statement.data,
 				state->op.bytecode_statement.size);
 			break;
 		}
 		case S_BREAK: {
-			if (!current_loop_context) {
-				error_lexer(state->src_line, 0, CODEGEN_BREAK_NOT_IN_LOOP);
+			if (!ctx->codegen.current_loop_context) {
+				error_lexer(ctx, state->src_line, 0, CODEGEN_BREAK_NOT_IN_LOOP);
 				break;
 			}
-			if (scope_level < current_loop_context->scope) {
-				error_general("Internal error, scope (%d) < current loop (%d)!",
-					scope_level, current_loop_context->scope);
+			if (ctx->codegen.scope_level < ctx->codegen.current_loop_context->scope) {
+				error_general(ctx, "Internal error, scope (%d) < current loop (%d)!",
+					ctx->codegen.scope_level, ctx->codegen.current_loop_context->scope);
 			}
-			for (int j = scope_level; j != current_loop_context->scope; j--) {
-				write_opcode(OP_END);
+			for (int j = ctx->codegen.scope_level; j != ctx->codegen.current_loop_context->scope; j--) {
+				write_opcode(ctx, OP_END);
 			}
-			write_opcode(OP_JMP);
+			write_opcode(ctx, OP_JMP);
 
-			current_loop_context->break_locations[
-				current_loop_context->break_count++] = size;
+			ctx->codegen.current_loop_context->break_locations[
+				ctx->codegen.current_loop_context->break_count++] = ctx->codegen.size;
 
-			size += sizeof(address);
+			ctx->codegen.size += sizeof(address);
 			break;
 		}
 		case S_CONTINUE: {
-			if (!current_loop_context) {
-				error_lexer(state->src_line, 0, CODEGEN_CONTINUE_NOT_IN_LOOP);
+			if (!ctx->codegen.current_loop_context) {
+				error_lexer(ctx, state->src_line, 0, CODEGEN_CONTINUE_NOT_IN_LOOP);
 				break;
 			}
-			if (scope_level < current_loop_context->scope) {
-				error_general("Internal error, scope (%d) < current loop (%d)!",
-					scope_level, current_loop_context->scope);
+			if (ctx->codegen.scope_level < ctx->codegen.current_loop_context->scope) {
+				error_general(ctx, "Internal error, scope (%d) < current loop (%d)!",
+					ctx->codegen.scope_level, ctx->codegen.current_loop_context->scope);
 			}
-			for (int j = scope_level; j != current_loop_context->scope; j--) {
-				write_opcode(OP_END);
+			for (int j = ctx->codegen.scope_level; j != ctx->codegen.current_loop_context->scope; j--) {
+				write_opcode(ctx, OP_END);
 			}
-			write_opcode(OP_JMP);
+			write_opcode(ctx, OP_JMP);
 
-			current_loop_context->continue_locations[
-				current_loop_context->continue_count++] = size;
+			ctx->codegen.current_loop_context->continue_locations[
+				ctx->codegen.current_loop_context->continue_count++] = ctx->codegen.size;
 
-			size += sizeof(address);
+			ctx->codegen.size += sizeof(address);
 			break;
 		}
 		case S_BLOCK: {
-			if (state->op.block_statement) {
-				make_scope();
-				codegen_statement_list(state->op.block_statement);
-				if (bytecode[size - 1] != OP_RET) {
+			if (state->op.block_statement &&
+				!needs_scope(ctx, state->op.block_statement)) {
+				codegen_statement_list(ctx, state->op.block_statement);
+			}
+			else if (state->op.block_statement) {
+				make_scope(ctx);
+				codegen_statement_list(ctx, state->op.block_statement);
+				if (!ends_with_return(ctx)) {
 					/* Don't need to end the block if we immediately RET */
-					end_scope();
+					end_scope(ctx);
 				}
 				else {
-					scope_level -= 1;
+					ctx->codegen.scope_level -= 1;
 				}
 			}
 			break;
 		}
 		case S_IMPORT: {
-			if (!state->op.import_statement) {
-				// Already handled by the scanner class.
-				return;
+			char* library_name = state->op.import_statement.name;
+			if (state->op.import_statement.is_file) {
+				codegen_import_unit(ctx, library_name, state->src_line);
+				break;
 			}
-			char* library_name = state->op.import_statement;
-			// Has to be identifier now.
-			if (!has_already_imported_library(library_name)) {
-				add_imported_library(library_name);
-				write_opcode(OP_IMPORT);
-				write_string(library_name);
-				int jumpLoc = size;
-				size += sizeof(address);
-
-				// Could either be in local directory or in standard
-				// library location. Local directory prevails.
-				static char *extension = ".wc";
-				char *local_path = safe_malloc(strlen(library_name) +
-								strlen(extension) + 1);
-				local_path[0] = 0;
-				strcat(local_path, library_name);
-				strcat(local_path, extension);
-				FILE *f = fopen(local_path, "r");
-				safe_free(local_path);
-				if (f) {
-					goto file_found;
-				}
-				// Not found, try standard library.
-				char* path = get_path();
+			if (!has_already_imported_library(ctx->codegen.imported_libraries, library_name)) {
+				add_imported_library(&ctx->codegen.imported_libraries, library_name);
+				write_opcode(ctx, OP_IMPORT);
+				write_string(ctx, library_name);
+				int jumpLoc = ctx->codegen.size;
+				ctx->codegen.size += sizeof(address);
+
 				long length = 0;
-				uint8_t* buffer;
-				strcat(path, "wendy-lib/");
-				strcat(path, library_name);
-				strcat(path, extension);
-				f = fopen(path, "r");
-				safe_free(path);
-				if (f) {
-				file_found:
-					fseek (f, 0, SEEK_END);
-					length = ftell(f);
-					fseek (f, 0, SEEK_SET);
-					buffer = safe_malloc(length);
-					fread (buffer, sizeof(uint8_t), length, f);
-					int offset = size - strlen(WENDY_VM_HEADER) - 1;
+				uint8_t* buffer = read_library(ctx, library_name, &length);
+				if (buffer) {
+					int offset = ctx->codegen.size - strlen(WENDY_VM_HEADER) - 1;
 					offset_addresses(buffer, length, offset);
-					guarantee_size(length);
+					guarantee_size(ctx, length);
 					for (long i = verify_header(buffer, length); i < length; i++) {
 						if (i == length - 1 && buffer[i] == OP_HALT) break;
 						write_byte(buffer[i]);
 					}
 					safe_free(buffer);
-					fclose (f);
 				}
 				else {
-					error_lexer(state->src_line, 0,
+					error_lexer(ctx, state->src_line, 0,
 								CODEGEN_REQ_FILE_READ_ERR);
 				}
-				write_address_at(size, jumpLoc);
+				write_address_at(ctx, ctx->codegen.size, jumpLoc);
 			}
 			break;
 		}
@@ -600,15 +882,15 @@ static void codegen_statement(void* expre) {
 			// First, we make the struct prototype.
 			char* enum_name = state->op.enum_statement.name;
 
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_STRUCT_HEADER, data_value_num(3)));
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_STRUCT_NAME, data_value_str(enum_name)));
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_STRUCT_HEADER, data_value_num(3)));
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_STRUCT_NAME, data_value_str(enum_name)));
 
 			// Static Table
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_TABLE_KEY, data_value_str("init")));
-			codegen_expr(state->op.enum_statement.init_fn);
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_TABLE_KEY, data_value_str("init")));
+			codegen_expr(ctx, state->op.enum_statement.init_fn);
 
 			size_t static_members = 1; // init
 			struct expr_list* curr = state->op.enum_statement.values;
@@ -617,42 +899,45 @@ static void codegen_statement(void* expre) {
 
 				if (elem->type != E_LITERAL
 					|| elem->op.lit_expr.type != D_IDENTIFIER) {
-					error_lexer(elem->line, elem->col, CODEGEN_EXPECTED_IDENTIFIER);
+					error_lexer(ctx, elem->line, elem->col, CODEGEN_EXPECTED_IDENTIFIER);
 				}
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_TABLE_KEY,
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_TABLE_KEY,
 					data_value_str(elem->op.lit_expr.value.string)));
 
 				// None for now, we will construct these after
-				write_opcode(OP_PUSH);
-				write_data(none_data());
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, none_data());
 
 				static_members += 1;
 				curr = curr->next;
 			}
 
-			write_opcode(OP_MKTBL);
-			write_address(static_members);
+			write_opcode(ctx, OP_MKTBL);
+			write_address(ctx, static_members);
+			set_stack_depth(ctx, stack_depth + 3);
 
 			// Table for instance members
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_TABLE_KEY, data_value_str("_num")));
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_NUMBER, data_value_num(0)));
-			write_opcode(OP_MKTBL);
-			write_address(1);
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_TABLE_KEY, data_value_str("_num")));
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_NUMBER, data_value_num(0)));
+			write_opcode(ctx, OP_MKTBL);
+			write_address(ctx, 1);
+			set_stack_depth(ctx, stack_depth + 4);
 
 			// Parent pointer
-			write_opcode(OP_PUSH);
-			write_data(none_data());
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, none_data());
 
-			write_opcode(OP_MKREF);
+			write_opcode(ctx, OP_MKREF);
 			write_byte(D_STRUCT);
-			write_integer(5);
+			write_integer(ctx, 5);
+			set_stack_depth(ctx, stack_depth + 1);
 
-			write_opcode(OP_DECL);
-			write_string(enum_name);
-			write_opcode(OP_WRITE);
+			write_opcode(ctx, OP_DECL);
+			write_string(ctx, enum_name);
+			write_opcode(ctx, OP_WRITE);
 
 			// Now we assign each one.
 			curr = state->op.enum_statement.values;
@@ -660,47 +945,48 @@ static void codegen_statement(void* expre) {
 
 			while (curr) {
 				// Call Constructor
-				codegen_end_marker();
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_NUMBER, data_value_num(internal_num)));
+				codegen_end_marker(ctx);
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_NUMBER, data_value_num(internal_num)));
 				internal_num += 1;
 
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_IDENTIFIER, data_value_str(enum_name)));
-				write_opcode(OP_CALL);
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_IDENTIFIER, data_value_str(enum_name)));
+				write_opcode(ctx, OP_CALL);
+				set_stack_depth(ctx, stack_depth + 1);
 
 				// Get LValue of Enum
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_IDENTIFIER, data_value_str(enum_name)));
-				write_opcode(OP_MEMPTR);
-				write_string(curr->elem->op.lit_expr.value.string);
-				write_opcode(OP_WRITE);
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_IDENTIFIER, data_value_str(enum_name)));
+				write_opcode(ctx, OP_MEMPTR);
+				write_string(ctx, curr->elem->op.lit_expr.value.string);
+				write_opcode(ctx, OP_WRITE);
 				curr = curr->next;
 			}
 
 			// Reset Constructor to be None
-			write_opcode(OP_PUSH);
-			write_data(none_data());
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_IDENTIFIER, data_value_str(enum_name)));
-			write_opcode(OP_MEMPTR);
-			write_string("init");
-			write_opcode(OP_WRITE);
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, none_data());
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_IDENTIFIER, data_value_str(enum_name)));
+			write_opcode(ctx, OP_MEMPTR);
+			write_string(ctx, "init");
+			write_opcode(ctx, OP_WRITE);
 			break;
 		}
 		case S_STRUCT: {
 			char* struct_name = state->op.struct_statement.name;
 
 			// Push Header and Name
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_STRUCT_HEADER, data_value_num(4)));
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_STRUCT_NAME, data_value_str(struct_name)));
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_STRUCT_HEADER, data_value_num(4)));
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_STRUCT_NAME, data_value_str(struct_name)));
 
 			// Table for shared parameters
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_TABLE_KEY, data_value_str("init")));
-			codegen_expr(state->op.struct_statement.init_fn);
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_TABLE_KEY, data_value_str("init")));
+			codegen_expr(ctx, state->op.struct_statement.init_fn);
 
 			size_t shared_param_table_size = 1;
 			struct expr_list* curr = state->op.struct_statement.static_members;
@@ -716,22 +1002,23 @@ static void codegen_statement(void* expre) {
 
 				if (elem->type != E_LITERAL
 					|| elem->op.lit_expr.type != D_IDENTIFIER) {
-					error_lexer(elem->line, elem->col, CODEGEN_EXPECTED_IDENTIFIER);
+					error_lexer(ctx, elem->line, elem->col, CODEGEN_EXPECTED_IDENTIFIER);
 				}
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_TABLE_KEY, data_value_str(elem->op.lit_expr.value.string)));
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_TABLE_KEY, data_value_str(elem->op.lit_expr.value.string)));
 				if (rvalue) {
-					codegen_expr(rvalue);
+					codegen_expr(ctx, rvalue);
 				}
 				else {
-					write_opcode(OP_PUSH);
-					write_data(none_data());
+					write_opcode(ctx, OP_PUSH);
+					write_data(ctx, none_data());
 				}
 				shared_param_table_size += 1;
 				curr = curr->next;
 			}
-			write_opcode(OP_MKTBL);
-			write_address(shared_param_table_size);
+			write_opcode(ctx, OP_MKTBL);
+			write_address(ctx, shared_param_table_size);
+			set_stack_depth(ctx, stack_depth + 3);
 
 			size_t instance_table_size = 0;
 			curr = state->op.struct_statement.instance_members;
@@ -739,396 +1026,466 @@ static void codegen_statement(void* expre) {
 				struct expr* elem = curr->elem;
 				if (elem->type != E_LITERAL
 					|| elem->op.lit_expr.type != D_IDENTIFIER) {
-					error_lexer(elem->line, elem->col, CODEGEN_EXPECTED_IDENTIFIER);
+					error_lexer(ctx, elem->line, elem->col, CODEGEN_EXPECTED_IDENTIFIER);
 				}
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_TABLE_KEY,
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_TABLE_KEY,
 					data_value_str(elem->op.lit_expr.value.string)));
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_NUMBER, data_value_num(instance_table_size)));
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_NUMBER, data_value_num(instance_table_size)));
 				instance_table_size++;
 				curr = curr->next;
 			}
-			write_opcode(OP_MKTBL);
-			write_address(instance_table_size);
+			write_opcode(ctx, OP_MKTBL);
+			write_address(ctx, instance_table_size);
+			set_stack_depth(ctx, stack_depth + 4);
 
 			if (state->op.struct_statement.parent_struct) {
-				codegen_expr(state->op.struct_statement.parent_struct);
+				codegen_expr(ctx, state->op.struct_statement.parent_struct);
 			}
 			else {
-				write_opcode(OP_PUSH);
-				write_data(none_data());
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, none_data());
 			}
 
-			write_opcode(OP_MKREF);
+			write_opcode(ctx, OP_MKREF);
 			write_byte(D_STRUCT);
-			write_integer(5);
+			write_integer(ctx, 5);
+			set_stack_depth(ctx, stack_depth + 1);
 
-			write_opcode(OP_DECL);
-			write_string(struct_name);
-			write_opcode(OP_WRITE);
+			write_opcode(ctx, OP_DECL);
+			write_string(ctx, struct_name);
+			write_opcode(ctx, OP_WRITE);
 			break;
 		}
 		case S_IF: {
-			codegen_expr(state->op.if_statement.condition);
-			write_opcode(OP_JIF);
-			int falseJumpLoc = size;
-			size += sizeof(address);
-
-			make_scope();
-			codegen_statement(state->op.if_statement.statement_true);
-			end_scope();
+			codegen_expr(ctx, state->op.if_statement.condition);
+			write_opcode(ctx, OP_JIF);
+			int falseJumpLoc = ctx->codegen.size;
+			ctx->codegen.size += sizeof(address);
+
+			codegen_branch(ctx, state->op.if_statement.statement_true);
+			if (!state->op.if_statement.statement_false &&
+				ctx->settings.flags[SETTINGS_OPTIMIZE]) {
+				// Nothing to jump over
+				write_address_at(ctx, ctx->codegen.size, falseJumpLoc);
+				break;
+			}
 
-			write_opcode(OP_JMP);
-			int doneJumpLoc = size;
-			size += sizeof(address);
-			write_address_at(size, falseJumpLoc);
+			write_opcode(ctx, OP_JMP);
+			int doneJumpLoc = ctx->codegen.size;
+			ctx->codegen.size += sizeof(address);
+			write_address_at(ctx, ctx->codegen.size, falseJumpLoc);
 
-			make_scope();
-			codegen_statement(state->op.if_statement.statement_false);
-			end_scope();
+			codegen_branch(ctx, state->op.if_statement.statement_false);
 
-			write_address_at(size, doneJumpLoc);
+			write_address_at(ctx, ctx->codegen.size, doneJumpLoc);
 			break;
 		}
 		case S_LOOP: {
 			if (!state->op.loop_statement.statement_true) {
 				// Don't generate if empty loop body
-				return;
+				break;
+			}
+			bool is_iterating_loop = state->op.loop_statement.index_var;
+			// Iterating loops keep their counters in the scope, other loops
+			//   only need one if their body binds names directly
+			struct statement_list body = { state->op.loop_statement.statement_true, 0 };
+			bool scoped = is_iterating_loop || needs_scope(ctx, &body);
+			if (scoped) {
+				make_scope(ctx);
 			}
-			make_scope();
 			struct loop_context *new_ctx = safe_malloc(sizeof(struct loop_context));
-			new_ctx->scope = scope_level;
+			new_ctx->scope = ctx->codegen.scope_level;
 			new_ctx->break_count = 0;
 			new_ctx->continue_count = 0;
-			new_ctx->parent = current_loop_context;
-			current_loop_context = new_ctx;
-
-			bool is_iterating_loop = state->op.loop_statement.index_var;
+			new_ctx->parent = ctx->codegen.current_loop_context;
+			ctx->codegen.current_loop_context = new_ctx;
 
 			char loop_index_name[30];
 			char loop_container_name[30];
 			char loop_size_name[30];
 
 			if (is_iterating_loop) {
-				size_t loop_id = global_loop_id++;
+				size_t loop_id = ctx->codegen.global_loop_id++;
 				sprintf(loop_index_name, LOOP_COUNTER_PREFIX "index_%zd", loop_id);
 				sprintf(loop_container_name, LOOP_COUNTER_PREFIX "container_%zd", loop_id);
 				sprintf(loop_size_name, LOOP_COUNTER_PREFIX "size_%zd", loop_id);
 
 				// index = 0
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_NUMBER, data_value_num(0)));
-				write_opcode(OP_DECL);
-				write_string(loop_index_name);
-				write_opcode(OP_WRITE);
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_NUMBER, data_value_num(0)));
+				write_opcode(ctx, OP_DECL);
+				write_string(ctx, loop_index_name);
+				write_opcode(ctx, OP_WRITE);
 
 				// container = <struct expr>
-				codegen_expr(state->op.loop_statement.condition);
-				write_opcode(OP_DECL);
-				write_string(loop_container_name);
-				write_opcode(OP_WRITE);
+				codegen_expr(ctx, state->op.loop_statement.condition);
+				write_opcode(ctx, OP_DECL);
+				write_string(ctx, loop_container_name);
+				write_opcode(ctx, OP_WRITE);
 
 				// size = container.size
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_MEMBER_IDENTIFIER, data_value_str("size")));
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_IDENTIFIER, data_value_str(loop_container_name)));
-				write_opcode(OP_BIN);
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_MEMBER_IDENTIFIER, data_value_str("size")));
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_IDENTIFIER, data_value_str(loop_container_name)));
+				write_opcode(ctx, OP_BIN);
 				write_byte(O_MEMBER);
-				write_opcode(OP_DECL);
-				write_string(loop_size_name);
-				write_opcode(OP_WRITE);
+				write_opcode(ctx, OP_DECL);
+				write_string(ctx, loop_size_name);
+				write_opcode(ctx, OP_WRITE);
 
 				// <ident> = none
-				write_opcode(OP_PUSH);
-				write_data(none_data());
-				write_opcode(OP_DECL);
-				write_string(state->op.loop_statement.index_var);
-				write_opcode(OP_WRITE);
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, none_data());
+				write_opcode(ctx, OP_DECL);
+				write_string(ctx, state->op.loop_statement.index_var);
+				write_opcode(ctx, OP_WRITE);
 			}
 
-			address loop_start_addr = size;
+			address loop_start_addr = ctx->codegen.size;
 			if (is_iterating_loop) {
 				// internalCounter < size
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_IDENTIFIER, data_value_str(loop_size_name)));
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_IDENTIFIER, data_value_str(loop_index_name)));
-				write_opcode(OP_BIN);
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_IDENTIFIER, data_value_str(loop_size_name)));
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_IDENTIFIER, data_value_str(loop_index_name)));
+				// Both are always numbers unless size is overloaded, which the
+				//   VM checks for anyway
+				write_opcode(ctx, ctx->settings.flags[SETTINGS_OPTIMIZE] ?
+					OP_BINNUM : OP_BIN);
 				write_byte(O_LT);
 			}
 			else {
-				codegen_expr(state->op.loop_statement.condition);
+				codegen_expr(ctx, state->op.loop_statement.condition);
 			}
-			write_opcode(OP_JIF);
-			int loop_skip_loc = size;
-			size += sizeof(address);
+			write_opcode(ctx, OP_JIF);
+			int loop_skip_loc = ctx->codegen.size;
+			ctx->codegen.size += sizeof(address);
 			if (is_iterating_loop) {
 				// <ident> = container[internalCounter]
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_IDENTIFIER, data_value_str(loop_index_name)));
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_IDENTIFIER, data_value_str(loop_container_name)));
-				write_opcode(OP_BIN);
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_IDENTIFIER, data_value_str(loop_index_name)));
+				write_opcode(ctx, OP_PUSH);
+				write_data(ctx, make_data(D_IDENTIFIER, data_value_str(loop_container_name)));
+				write_opcode(ctx, OP_BIN);
 				write_byte(O_SUBSCRIPT);
-				write_opcode(OP_WHERE);
-				write_string(state->op.loop_statement.index_var);
-				write_opcode(OP_WRITE);
+				write_opcode(ctx, OP_WHERE);
+				write_string(ctx, state->op.loop_statement.index_var);
+				write_opcode(ctx, OP_WRITE);
 			}
-			codegen_statement(state->op.loop_statement.statement_true);
-			address continue_addr = size;
+			codegen_statement(ctx, state->op.loop_statement.statement_true);
+			address continue_addr = ctx->codegen.size;
 			if (is_iterating_loop) {
-				write_opcode(OP_WHERE);
-				write_string(loop_index_name);
-				write_opcode(OP_INC);
+				write_opcode(ctx, OP_WHERE);
+				write_string(ctx, loop_index_name);
+				write_opcode(ctx, OP_INC);
 			}
-			write_opcode(OP_JMP);
-			write_address(loop_start_addr);
-			write_address_at(size, loop_skip_loc);
+			write_opcode(ctx, OP_JMP);
+			write_address(ctx, loop_start_addr);
+			write_address_at(ctx, ctx->codegen.size, loop_skip_loc);
 
 			for (size_t i = 0; i < new_ctx->break_count; i++) {
-				write_address_at(size, new_ctx->break_locations[i]);
+				write_address_at(ctx, ctx->codegen.size, new_ctx->break_locations[i]);
 			}
 
 			for (size_t i = 0; i < new_ctx->continue_count; i++) {
-				write_address_at(continue_addr, new_ctx->continue_locations[i]);
+				write_address_at(ctx, continue_addr, new_ctx->continue_locations[i]);
 			}
 
-			current_loop_context = new_ctx->parent;
+			ctx->codegen.current_loop_context = new_ctx->parent;
 			safe_free(new_ctx);
-			end_scope();
+			if (scoped) {
+				end_scope(ctx);
+			}
 			break;
 		}
 	}
+	set_stack_depth(ctx, stack_depth);
+}
+
+// call_values(expression) returns how many values a call leaves for OP_CALL:
+//   the end marker, the arguments with the names of named ones, the function
+//   and for a member call the instance it's called on
+static int call_values(struct expr* expression) {
+	int count = 2;
+	for (struct expr_list* l = expression->op.call_expr.arguments; l; l = l->next) {
+		count += l->elem->type == E_ASSIGN ? 2 : 1;
+	}
+	if (expression->op.call_expr.function->type == E_BINARY &&
+		expression->op.call_expr.function->op.bin_expr.vm_operator == O_MEMBER) {
+		count += 1;
+	}
+	return count;
+}
+
+// codegen_call(ctx, expression, tail) generates a call, tail calls are only
+//   made in tail position of a function body and take the place of its RET
+static void codegen_call(struct compiler_ctx* ctx, struct expr* expression, bool tail) {
+	int stack_depth = ctx->codegen.stack_depth;
+	codegen_expr_list_for_call(ctx, expression->op.call_expr.arguments);
+	
+	if (expression->op.call_expr.function->type == E_BINARY &&
+		expression->op.call_expr.function->op.bin_expr.vm_operator == O_MEMBER) {
+		// Struct Member Call, we will generate an extra "argument" that is the
+		//   reference to the LHS
+
+		codegen_expr(ctx, expression->op.call_expr.function->op.bin_expr.left);
+		write_opcode(ctx, OP_DUPTOP);
+		codegen_expr(ctx, expression->op.call_expr.function->op.bin_expr.right);
+		write_opcode(ctx, OP_ROTTWO);
+		write_opcode(ctx, OP_BIN);
+		write_byte(O_MEMBER);
+	}
+	else {
+		codegen_expr(ctx, expression->op.call_expr.function);
+	}
+	
+	if (expression->op.call_expr.is_safe) {
+		write_opcode(ctx, OP_DUPTOP);
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, none_data());
+		write_opcode(ctx, OP_BIN);
+		write_byte(O_NEQ);
+		write_opcode(ctx, OP_JIF);
+		int falseJumpLoc = ctx->codegen.size;
+		ctx->codegen.size += sizeof(address);
+		write_opcode(ctx, OP_CALL);
+		write_opcode(ctx, OP_JMP);
+		int doneJumpLoc = ctx->codegen.size;
+		ctx->codegen.size += sizeof(address);
+
+		// Not calling none, so drop the arguments and leave none instead
+		write_address_at(ctx, ctx->codegen.size, falseJumpLoc);
+		for (int i = call_values(expression); i > 0; i--) {
+			write_opcode(ctx, OP_POP);
+		}
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, none_data());
+		write_address_at(ctx, ctx->codegen.size, doneJumpLoc);
+	}
+	else {
+		write_opcode(ctx, tail ? OP_TCALL : OP_CALL);
+	}
+	set_stack_depth(ctx, stack_depth + 1);
 }
 
-static void codegen_statement_list(void* expre) {
+static void codegen_statement_list(struct compiler_ctx* ctx, void* expre) {
 	struct statement_list* list = (struct statement_list*) expre;
 	while (list) {
-		codegen_statement(list->elem);
+		codegen_statement(ctx, list->elem);
 		list = list->next;
 	}
 }
 
-static void codegen_expr(void* expre) {
+static void codegen_expr(struct compiler_ctx* ctx, void* expre) {
 	if (!expre) return;
 	struct expr* expression = (struct expr*)expre;
 	if (expression->type == E_LITERAL) {
 		// Literal Expression, we push to the stack.
-		write_opcode(OP_PUSH);
-		write_data(copy_data(expression->op.lit_expr));
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, copy_data(expression->op.lit_expr));
 	}
 	else if (expression->type == E_BINARY) {
 		if (expression->op.bin_expr.vm_operator == O_MOD_EQUAL) {
 			/* Special vm_operator just for Dhruvit, first we calculate the remainder */
-			codegen_expr(expression->op.bin_expr.right);
-			codegen_expr(expression->op.bin_expr.left);
-			write_opcode(OP_BIN);
+			codegen_expr(ctx, expression->op.bin_expr.right);
+			codegen_expr(ctx, expression->op.bin_expr.left);
+			write_opcode(ctx, OP_BIN);
 			write_byte(O_REM);
 
 			/* Then we simulate a div_equals operation */
-			codegen_expr(expression->op.bin_expr.right);
-			codegen_expr(expression->op.bin_expr.left);
-			write_opcode(OP_BIN);
+			codegen_expr(ctx, expression->op.bin_expr.right);
+			codegen_expr(ctx, expression->op.bin_expr.left);
+			write_opcode(ctx, OP_BIN);
 			write_byte(O_IDIV);
 
-			codegen_lvalue_expr(expression->op.bin_expr.left);
-			write_opcode(OP_WRITE);
+			codegen_lvalue_expr(ctx, expression->op.bin_expr.left);
+			write_opcode(ctx, OP_WRITE);
 			/* Skip the default OP_BIN */
 			return;
 		}
 		else if (expression->op.bin_expr.vm_operator == O_MEMBER) {
-			write_opcode(OP_PUSH);
-			write_data(copy_data(
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, copy_data(
                 expression->op.bin_expr.right->op.lit_expr));
-			codegen_expr(expression->op.bin_expr.left);
+			codegen_expr(ctx, expression->op.bin_expr.left);
 		}
 		/* Short Circuiting for Boolean Operators. Boolean operators
 		 * are commutative, so we can generate the left first. */
 		else if (expression->op.bin_expr.vm_operator == O_AND ||
 				 expression->op.bin_expr.vm_operator == O_OR) {
-			codegen_expr(expression->op.bin_expr.left);
+			codegen_expr(ctx, expression->op.bin_expr.left);
 			bool is_or = expression->op.bin_expr.vm_operator == O_OR;
 			/* We want to negate for OR, so the JIF is accurate */
 			if (is_or) {
-				write_opcode(OP_UNA);
+				write_opcode(ctx, OP_UNA);
 				write_byte(O_NOT);
 			}
-			write_opcode(OP_JIF);
-			address short_circuit_loc = size;
-			size += sizeof(address);
+			write_opcode(ctx, OP_JIF);
+			address short_circuit_loc = ctx->codegen.size;
+			ctx->codegen.size += sizeof(address);
+			int stack_depth = ctx->codegen.stack_depth;
 			/* LHS is True (or False for or), since we didn't short circuit */
-			write_opcode(OP_PUSH);
-			write_data(is_or ? false_data() : true_data());
-			codegen_expr(expression->op.bin_expr.right);
-			write_opcode(OP_BIN);
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, is_or ? false_data() : true_data());
+			codegen_expr(ctx, expression->op.bin_expr.right);
+			write_opcode(ctx, OP_BIN);
 			write_byte(expression->op.bin_expr.vm_operator);
-			write_opcode(OP_JMP);
-			address fine_loc = size;
-			size += sizeof(address);
+			write_opcode(ctx, OP_JMP);
+			address fine_loc = ctx->codegen.size;
+			ctx->codegen.size += sizeof(address);
 
 			/* Jump to Here if we short circuit */
-			write_address_at(size, short_circuit_loc);
-			write_opcode(OP_PUSH);
-			write_data(is_or ? true_data() : false_data());
+			write_address_at(ctx, ctx->codegen.size, short_circuit_loc);
+			set_stack_depth(ctx, stack_depth);
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, is_or ? true_data() : false_data());
 
 			/* Jump to Here if everything is fine */
-			write_address_at(size, fine_loc);
+			write_address_at(ctx, ctx->codegen.size, fine_loc);
 			/* Skip the default OP_BIN */
 			return;
 		}
 		else {
-			codegen_expr(expression->op.bin_expr.right);
-			codegen_expr(expression->op.bin_expr.left);
+			codegen_expr(ctx, expression->op.bin_expr.right);
+			codegen_expr(ctx, expression->op.bin_expr.left);
+			write_opcode(ctx, binary_opcode(expression,
+				expression->op.bin_expr.vm_operator,
+				expression->op.bin_expr.left, expression->op.bin_expr.right));
+			write_byte(expression->op.bin_expr.vm_operator);
+			return;
 		}
-		write_opcode(OP_BIN);
+		write_opcode(ctx, OP_BIN);
 		write_byte(expression->op.bin_expr.vm_operator);
 	}
 	else if (expression->type == E_IF) {
-		codegen_expr(expression->op.if_expr.condition);
-		write_opcode(OP_JIF);
-		int falseJumpLoc = size;
-		size += sizeof(address);
-		codegen_expr(expression->op.if_expr.expr_true);
-		write_opcode(OP_JMP);
-		int doneJumpLoc = size;
-		size += sizeof(address);
-		write_address_at(size, falseJumpLoc);
+		codegen_expr(ctx, expression->op.if_expr.condition);
+		write_opcode(ctx, OP_JIF);
+		int falseJumpLoc = ctx->codegen.size;
+		ctx->codegen.size += sizeof(address);
+		int stack_depth = ctx->codegen.stack_depth;
+		codegen_expr(ctx, expression->op.if_expr.expr_true);
+		write_opcode(ctx, OP_JMP);
+		int doneJumpLoc = ctx->codegen.size;
+		ctx->codegen.size += sizeof(address);
+		write_address_at(ctx, ctx->codegen.size, falseJumpLoc);
+		set_stack_depth(ctx, stack_depth);
 		if (expression->op.if_expr.expr_false) {
-			codegen_expr(expression->op.if_expr.expr_false);
+			codegen_expr(ctx, expression->op.if_expr.expr_false);
 		}
 		else {
-			write_opcode(OP_PUSH);
-			write_data(none_data());
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, none_data());
 		}
-		write_address_at(size, doneJumpLoc);
+		write_address_at(ctx, ctx->codegen.size, doneJumpLoc);
 	}
 	else if (expression->type == E_ASSIGN) {
         enum vm_operator op = expression->op.assign_expr.vm_operator;
 
-		codegen_expr(expression->op.assign_expr.rvalue);
+		codegen_expr(ctx, expression->op.assign_expr.rvalue);
 
 		if (op != O_ASSIGN) {
-			codegen_expr(expression->op.assign_expr.lvalue);
+			codegen_expr(ctx, expression->op.assign_expr.lvalue);
 		}
 
         // O_ASSIGN is the default =
 		if (op != O_ASSIGN) {
-			write_opcode(OP_BIN);
+			write_opcode(ctx, binary_opcode(expression, op,
+				expression->op.assign_expr.lvalue, expression->op.assign_expr.rvalue));
 			write_byte(op);
 		}
 
-		codegen_lvalue_expr(expression->op.assign_expr.lvalue);
-		write_opcode(OP_WRITE);
+		codegen_lvalue_expr(ctx, expression->op.assign_expr.lvalue);
+		write_opcode(ctx, OP_WRITE);
 	}
 	else if (expression->type == E_UNARY) {
-		codegen_expr(expression->op.una_expr.operand);
-		write_opcode(OP_UNA);
+		codegen_expr(ctx, expression->op.una_expr.operand);
+		write_opcode(ctx, OP_UNA);
 		write_byte(expression->op.una_expr.vm_operator);
 	}
 	else if (expression->type == E_SUPER_CALL) {
-		codegen_expr_list_for_call(expression->op.super_call_expr.arguments);
+		int stack_depth = ctx->codegen.stack_depth;
+		codegen_expr_list_for_call(ctx, expression->op.super_call_expr.arguments);
 		// "this" instance passed to parent
 
 		// Do *Class.__super_init__(this, *Class.super)
 
 		// *Class.super
-		write_opcode(OP_PUSH);
-		write_data(make_data(D_MEMBER_IDENTIFIER, data_value_str("super")));
-		write_opcode(OP_PUSH);
-		write_data(make_data(D_IDENTIFIER, data_value_str("*Class")));
-		write_opcode(OP_BIN);
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, make_data(D_MEMBER_IDENTIFIER, data_value_str("super")));
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, make_data(D_IDENTIFIER, data_value_str("*Class")));
+		write_opcode(ctx, OP_BIN);
 		write_byte(O_MEMBER);
 
-		write_opcode(OP_PUSH);
-		write_data(make_data(D_IDENTIFIER, data_value_str("this")));
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, make_data(D_IDENTIFIER, data_value_str("this")));
 
-		write_opcode(OP_PUSH);
-		write_data(make_data(D_MEMBER_IDENTIFIER, data_value_str("__super_init__")));
-		write_opcode(OP_PUSH);
-		write_data(make_data(D_IDENTIFIER, data_value_str("*Class")));
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, make_data(D_MEMBER_IDENTIFIER, data_value_str("__super_init__")));
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, make_data(D_IDENTIFIER, data_value_str("*Class")));
 		
-		write_opcode(OP_BIN);
+		write_opcode(ctx, OP_BIN);
 		write_byte(O_MEMBER);
-		write_opcode(OP_CALL);
+		write_opcode(ctx, OP_CALL);
+		set_stack_depth(ctx, stack_depth + 1);
 
 		// Discard Output
-		write_opcode(OP_POP);
-		write_opcode(OP_PUSH);
-		write_data(noneret_data());
+		write_opcode(ctx, OP_POP);
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, noneret_data());
 	}
 	else if (expression->type == E_CALL) {
-		codegen_expr_list_for_call(expression->op.call_expr.arguments);
-		
-		if (expression->op.call_expr.function->type == E_BINARY &&
-			expression->op.call_expr.function->op.bin_expr.vm_operator == O_MEMBER) {
-			// Struct Member Call, we will generate an extra "argument" that is the
-			//   reference to the LHS
-
-			codegen_expr(expression->op.call_expr.function->op.bin_expr.left);
-			write_opcode(OP_DUPTOP);
-			codegen_expr(expression->op.call_expr.function->op.bin_expr.right);
-			write_opcode(OP_ROTTWO);
-			write_opcode(OP_BIN);
-			write_byte(O_MEMBER);
-		}
-		else {
-			codegen_expr(expression->op.call_expr.function);
-		}
-		
-		if (expression->op.call_expr.is_safe) {
-			write_opcode(OP_DUPTOP);
-			write_opcode(OP_PUSH);
-			write_data(none_data());
-			write_opcode(OP_BIN);
-			write_byte(O_NEQ);
-			write_opcode(OP_JIF);
-			int falseJumpLoc = size;
-			size += sizeof(address);
-			write_opcode(OP_CALL);
-			write_address_at(size, falseJumpLoc);
-		}
-		else {
-			write_opcode(OP_CALL);
-		}
+		codegen_call(ctx, expression, false);
 	}
 	else if (expression->type == E_LIST) {
+		int stack_depth = ctx->codegen.stack_depth;
 		int count = expression->op.list_expr.length;
-		write_opcode(OP_PUSH);
+		write_opcode(ctx, OP_PUSH);
 		// Push the size of the list here, VM will create correct list header
 		// D_LIST_HEADER
-		write_data(make_data(D_NUMBER, data_value_num(count)));
+		write_data(ctx, make_data(D_NUMBER, data_value_num(count)));
 		struct expr_list* param = expression->op.list_expr.contents;
 		while (param) {
-			codegen_expr(param->elem);
+			codegen_expr(ctx, param->elem);
 			param = param->next;
 		}
-		write_opcode(OP_MKREF);
+		write_opcode(ctx, OP_MKREF);
 		write_byte(D_LIST);
-		write_integer(count + 1);
+		write_integer(ctx, count + 1);
+		set_stack_depth(ctx, stack_depth + 1);
 	}
 	else if (expression->type == E_TABLE) {
+		int stack_depth = ctx->codegen.stack_depth;
 		struct expr_list* key = expression->op.table_expr.keys;
 		struct expr_list* val = expression->op.table_expr.values;
 		size_t count = 0;
 		while (key && val) {
 			// key should be a Literal Identifier
-			write_opcode(OP_PUSH);
-			write_data(make_data(D_TABLE_KEY, data_value_str(key->elem->op.lit_expr.value.string)));
-			codegen_expr(val->elem);
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_TABLE_KEY, data_value_str(key->elem->op.lit_expr.value.string)));
+			codegen_expr(ctx, val->elem);
 			count += 1;
 			key = key->next;
 			val = val->next;
 		}
-		write_opcode(OP_MKTBL);
-		write_address(count);
+		write_opcode(ctx, OP_MKTBL);
+		write_address(ctx, count);
+		set_stack_depth(ctx, stack_depth + 1);
 	}
 	else if (expression->type == E_FUNCTION) {
-		write_opcode(OP_JMP);
-		int writeSizeLoc = size;
-		size += sizeof(address);
-		int startAddr = size;
+		write_opcode(ctx, OP_JMP);
+		int writeSizeLoc = ctx->codegen.size;
+		ctx->codegen.size += sizeof(address);
+		int startAddr = ctx->codegen.size;
+
+		// The body counts its stack from the arguments it's called with
+		int stack_depth = ctx->codegen.stack_depth;
+		int max_stack_depth = ctx->codegen.max_stack_depth;
+		address reserveLoc = write_reserve(ctx);
 
 		/* Count parameters */
 		int count = 0;
@@ -1140,10 +1497,10 @@ static void codegen_expr(void* expre) {
 		char** param_names = safe_malloc(sizeof(*param_names) * count);
 
 		if (expression->op.func_expr.is_native) {
-			write_opcode(OP_NATIVE);
-			write_integer(count);
-			write_string(expression->op.func_expr.native_name);
-			write_opcode(OP_RET);
+			write_opcode(ctx, OP_NATIVE);
+			write_integer(ctx, count);
+			write_string(ctx, expression->op.func_expr.native_name);
+			write_opcode(ctx, OP_RET);
 
 			struct expr_list* param = expression->op.func_expr.parameters;
 			int i = 0;
@@ -1152,7 +1509,7 @@ static void codegen_expr(void* expre) {
 					param_names[i++] = param->elem->op.lit_expr.value.string;
 				}
 				else {
-					error_lexer(param->elem->line,
+					error_lexer(ctx, param->elem->line,
 						param->elem->col,
 						CODEGEN_UNEXPECTED_FUNCTION_PARAMETER);
 				}
@@ -1162,9 +1519,9 @@ static void codegen_expr(void* expre) {
 		else {
 			if (expression->op.func_expr.is_struct_init) {
 				// The first argument into an init is always the implicit *Class (after the implicit this)
-				write_opcode(OP_DECL);
-				write_string("*Class");
-				write_opcode(OP_WRITE);
+				write_opcode(ctx, OP_DECL);
+				write_string(ctx, "*Class");
+				write_opcode(ctx, OP_WRITE);
 			}
 			struct expr_list* param = expression->op.func_expr.parameters;
 			bool has_encountered_default = false;
@@ -1172,123 +1529,131 @@ static void codegen_expr(void* expre) {
 			while (param) {
 				if (param->elem->type == E_LITERAL) {
 					if (has_encountered_default) {
-						error_lexer(param->elem->line,
+						error_lexer(ctx, param->elem->line,
 							param->elem->col,
 							CODEGEN_FUNCTION_DEFAULT_VALUES_AT_END);
 					}
 					if (param->elem->op.lit_expr.type != D_IDENTIFIER) {
-						error_lexer(param->elem->line,
+						error_lexer(ctx, param->elem->line,
 							param->elem->col,
 							CODEGEN_UNEXPECTED_FUNCTION_PARAMETER);
 					}
 					struct data t = param->elem->op.lit_expr;
-					write_opcode(OP_DECL);
-					write_string(t.value.string);
-					write_opcode(OP_WRITE);
+					write_opcode(ctx, OP_DECL);
+					write_string(ctx, t.value.string);
+					write_opcode(ctx, OP_WRITE);
 					param_names[i++] = t.value.string;
 				}
 				else if (param->elem->type == E_ASSIGN) {
 					has_encountered_default = true;
 					// Bind Default Value First
-					codegen_expr(param->elem->op.assign_expr.rvalue);
-					write_opcode(OP_DECL);
+					codegen_expr(ctx, param->elem->op.assign_expr.rvalue);
+					write_opcode(ctx, OP_DECL);
 					// TODO: Check if assign struct expr is literal identifier.
-					write_string(param->elem->op.assign_expr.lvalue->
+					write_string(ctx, param->elem->op.assign_expr.lvalue->
 						op.lit_expr.value.string);
 					// If the top of the stack is marker, this is no-op.
-					write_opcode(OP_WRITE);
+					write_opcode(ctx, OP_WRITE);
 
-					write_opcode(OP_WHERE);
-					write_string(param->elem->op.assign_expr.lvalue->
+					write_opcode(ctx, OP_WHERE);
+					write_string(ctx, param->elem->op.assign_expr.lvalue->
 						op.lit_expr.value.string);
-					write_opcode(OP_WRITE);
+					write_opcode(ctx, OP_WRITE);
 					param_names[i++] = param->elem->op.assign_expr.lvalue->
 						op.lit_expr.value.string;
 				}
 				else {
-					error_lexer(param->elem->line,
+					error_lexer(ctx, param->elem->line,
 						param->elem->col,
 						CODEGEN_UNEXPECTED_FUNCTION_PARAMETER);
 				}
 				param = param->next;
 			}
 			// Process named arguments.
-			write_opcode(OP_ARGCLN);
+			write_opcode(ctx, OP_ARGCLN);
+			// Everything the caller pushed is off the stack now
+			set_stack_depth(ctx, 0);
 
+			ctx->codegen.function_depth += 1;
 			if (expression->op.func_expr.body &&
 				expression->op.func_expr.body->type == S_EXPR) {
-				codegen_expr(expression->op.func_expr.body->op.expr_statement);
-				write_opcode(OP_RET);
+				codegen_return(ctx, expression->op.func_expr.body->op.expr_statement);
 			}
 			else {
-				codegen_statement(expression->op.func_expr.body);
-				if (bytecode[size - 1] != OP_RET) {
+				codegen_statement(ctx, expression->op.func_expr.body);
+				if (!ends_with_return(ctx)) {
 					// Function has no explicit Return
 
 					// If it's a init function we default return this
 					if (expression->op.func_expr.is_struct_init) {
-						write_opcode(OP_PUSH);
-						write_data(make_data(D_IDENTIFIER, data_value_str("this")));
-						write_opcode(OP_RET);
+						write_opcode(ctx, OP_PUSH);
+						write_data(ctx, make_data(D_IDENTIFIER, data_value_str("this")));
+						write_opcode(ctx, OP_RET);
 					}
 					else {
-						write_opcode(OP_PUSH);
-						write_data(noneret_data());
-						write_opcode(OP_RET);
+						write_opcode(ctx, OP_PUSH);
+						write_data(ctx, noneret_data());
+						write_opcode(ctx, OP_RET);
 					}
 				}
 			}
+			ctx->codegen.function_depth -= 1;
 		}
-		write_address_at(size, writeSizeLoc);
-		write_opcode(OP_PUSH);
-		write_data(make_data(D_INSTRUCTION_ADDRESS, data_value_num(startAddr)));
-		write_opcode(OP_CLOSURE);
-		write_opcode(OP_PUSH);
-		write_data(make_data(D_STRING, data_value_str("self")));
-
-		/* Make a list of parameters names */
-		if (!get_settings_flag(SETTINGS_OPTIMIZE)) {
-			write_opcode(OP_PUSH);
-			// Push the size of the list here, VM will create correct list header
-			// D_LIST_HEADER
-			write_data(make_data(D_NUMBER, data_value_num(count)));
-			for (int i = 0; i < count; i++) {
-				write_opcode(OP_PUSH);
-				write_data(make_data(D_STRING, data_value_str(param_names[i])));
-			}
-			write_opcode(OP_MKREF);
-			write_byte(D_LIST);
-			write_integer(count + 1);
-		}
-		else {
-			write_opcode(OP_PUSH);
-			write_data(none_data());
+		write_integer_at(ctx, ctx->codegen.max_stack_depth, reserveLoc);
+		ctx->codegen.stack_depth = stack_depth;
+		ctx->codegen.max_stack_depth = max_stack_depth;
+		write_address_at(ctx, ctx->codegen.size, writeSizeLoc);
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, make_data(D_INSTRUCTION_ADDRESS, data_value_num(startAddr)));
+		write_opcode(ctx, OP_CLOSURE);
+		write_opcode(ctx, OP_PUSH);
+		write_data(ctx, make_data(D_STRING, data_value_str("self")));
+
+		/* Make a list of parameters names, printing the function and stack
+		 *   dumps show them */
+		write_opcode(ctx, OP_PUSH);
+		// Push the size of the list here, VM will create correct list header
+		// D_LIST_HEADER
+		write_data(ctx, make_data(D_NUMBER, data_value_num(count)));
+		for (int i = 0; i < count; i++) {
+			write_opcode(ctx, OP_PUSH);
+			write_data(ctx, make_data(D_STRING, data_value_str(param_names[i])));
 		}
+		write_opcode(ctx, OP_MKREF);
+		write_byte(D_LIST);
+		write_integer(ctx, count + 1);
+		set_stack_depth(ctx, stack_depth + 4);
 
 		safe_free(param_names);
-		write_opcode(OP_MKREF);
+		write_opcode(ctx, OP_MKREF);
 		write_byte(D_FUNCTION);
-		write_integer(4);
+		write_integer(ctx, 4);
+		set_stack_depth(ctx, stack_depth + 1);
 	}
 }
 
-uint8_t* generate_code(struct statement_list* _ast, size_t* size_ptr, bool include_header) {
-	if (current_loop_context) {
-		error_general("Loop context exists already going into code generation!");
+uint8_t* generate_code(struct compiler_ctx* ctx, struct statement_list* _ast, size_t* size_ptr, bool include_header) {
+	if (ctx->codegen.current_loop_context) {
+		error_general(ctx, "Loop context exists already going into code generation!");
 	}
-	scope_level = 0;
-	capacity = CODEGEN_START_SIZE;
-	bytecode = safe_calloc(capacity, sizeof(uint8_t));
-	size = 0;
+	ctx->codegen.scope_level = 0;
+	ctx->codegen.function_depth = 0;
+	ctx->codegen.capacity = CODEGEN_START_SIZE;
+	ctx->codegen.bytecode = safe_calloc(ctx->codegen.capacity, sizeof(uint8_t));
+	ctx->codegen.size = 0;
+	ctx->codegen.last_opcode_at = 0;
+	ctx->codegen.last_jump_target = 0;
 	if (include_header) {
-		write_string(WENDY_VM_HEADER);
-	}
-	free_imported_libraries_ll();
-	codegen_statement_list(_ast);
-	free_imported_libraries_ll();
-	write_opcode(OP_HALT);
-	*size_ptr = size;
-	return bytecode;
+		write_string(ctx, WENDY_VM_HEADER);
+	}
+	address reserveLoc = write_reserve(ctx);
+	free_imported_libraries_ll(&ctx->codegen.imported_libraries);
+	codegen_statement_list(ctx, _ast);
+	free_imported_libraries_ll(&ctx->codegen.imported_libraries);
+	write_opcode(ctx, OP_HALT);
+	write_integer_at(ctx, ctx->codegen.max_stack_depth, reserveLoc);
+	*size_ptr = ctx->codegen.size;
+	return ctx->codegen.bytecode;
 }
 
 // CANNOT FREE OR DESTROY THIS ONE!
@@ -1314,7 +1679,7 @@ struct data get_data(uint8_t* bytecode, unsigned int* end) {
 	return t;
 }
 
-void write_bytecode(uint8_t* bytecode, FILE* buffer) {
+void write_bytecode(uint8_t* bytecode, size_t size, FILE* buffer) {
 	fwrite(bytecode, sizeof(uint8_t), size, buffer);
 }
 
@@ -1336,16 +1701,99 @@ address get_address(uint8_t* bytecode, unsigned int* end) {
 	return result;
 }
 
-void print_bytecode(uint8_t* bytecode, size_t length, FILE* buffer) {
+int print_instruction(uint8_t* bytecode, unsigned int* i, FILE* buffer) {
+	int max_len = 20;
+	int p = 0;
+	enum opcode op = bytecode[(*i)++];
+	p += fprintf(buffer, YEL "%10s " RESET, opcode_string[op]);
+
+	switch (op) {
+		case OP_PUSH:
+		case OP_PUSH2:
+		case OP_PUSHB: {
+			struct data t = get_data(&bytecode[*i], i);
+			if (t.type == D_STRING) {
+				p += fprintf(buffer, "%.*s ", max_len, t.value.string);
+				if (strlen(t.value.string) > (size_t) max_len) {
+					p += fprintf(buffer, ">");
+				}
+			}
+			else {
+				p += print_data_inline(&t, buffer);
+			}
+			break;
+		}
+		case OP_BIN:
+		case OP_BINNUM:
+		case OP_BINSTR:
+		case OP_INDEX:
+		case OP_BRNUM:
+		case OP_UNA: {
+			enum vm_operator o = bytecode[(*i)++];
+			p += fprintf(buffer, "%s", operator_string[o]);
+			break;
+		}
+		case OP_DECL:
+		case OP_DECLW:
+		case OP_WHERE:
+		case OP_STORE:
+		case OP_IMPORT:
+		case OP_MEMPTR: {
+			char* c = get_string(bytecode + *i, i);
+			p += fprintf(buffer, "%.*s ", max_len, c);
+			if (strlen(c) > (size_t) max_len) {
+				p += fprintf(buffer, ">");
+			}
+			if (op == OP_IMPORT) {
+				// i is at null term
+				p += fprintf(buffer, "0x%X", get_address(bytecode + *i, i));
+			}
+			break;
+		}
+		case OP_MKREF: {
+			enum data_type t = bytecode[(*i)++];
+			p += fprintf(buffer, "%s", data_string[t]);
+			address a = get_address(bytecode + *i, i);
+			p += fprintf(buffer, " %d", a);
+			break;
+		}
+		case OP_MKTBL:
+		case OP_RESERVE: {
+			address a = get_address(bytecode + *i, i);
+			p += fprintf(buffer, "%d", a);
+			break;
+		}
+		case OP_SRC: {
+			address a = get_address(bytecode + *i, i);
+			p += fprintf(buffer, "%d", a);
+			break;
+		}
+		case OP_JMP:
+		case OP_JIF: {
+			p += fprintf(buffer, "0x%X", get_address(bytecode + *i, i));
+			break;
+		}
+		case OP_NATIVE: {
+			p += fprintf(buffer, "%d ", get_address(bytecode + *i, i));
+			char* c = get_string(bytecode + *i, i);
+			p += fprintf(buffer, "%.*s", max_len, c);
+			break;
+		}
+		default: break;
+	}
+return p;
+}
+
+void print_bytecode(uint8_t* bytecode, size_t length, bool repl,
+	const struct source_table* sources, FILE* buffer) {
 	fprintf(buffer, RED "WendyVM ByteCode Disassembly\n" GRN ".header\n");
 	fprintf(buffer, MAG "  <%p> " BLU "<+%04X>: ", &bytecode[0], 0);
 	fprintf(buffer, YEL WENDY_VM_HEADER);
 	fprintf(buffer, GRN "\n.code\n");
-	int max_len = 20;
 	int baseaddr = 0;
 	UNUSED(baseaddr);
 	unsigned int i = 0;
-	if (!get_settings_flag(SETTINGS_REPL)) {
+	if (!repl) {
 		i = verify_header(bytecode, length);
 	}
 	forever {
@@ -1357,80 +1805,13 @@ void print_bytecode(uint8_t* bytecode, size_t length, FILE* buffer) {
 		if (op == OP_SRC) {
 			i++;
 			address a = get_address(bytecode + i, &i);
-			p += fprintf(buffer, MAG BLU YEL RESET RESET "        Source Line %d", a);
+			p += fprintf(buffer, MAG BLU YEL RESET RESET "        Source Line %d",
+				source_line_number(a));
 			printSourceLine = a;
 		}
 		else {
 			p += fprintf(buffer, MAG "  <%p> " BLU "<+%04X>: " RESET, &bytecode[i], i);
-			i++;
-			p += fprintf(buffer, YEL "%10s " RESET, opcode_string[op]);
-
-			switch (op) {
-				case OP_PUSH: {
-					struct data t = get_data(&bytecode[i], &i);
-					if (t.type == D_STRING) {
-						p += fprintf(buffer, "%.*s ", max_len, t.value.string);
-						if (strlen(t.value.string) > (size_t) max_len) {
-							p += fprintf(buffer, ">");
-						}
-					}
-					else {
-						p += print_data_inline(&t, buffer);
-					}
-					break;
-				}
-				case OP_BIN:
-				case OP_UNA: {
-					enum vm_operator o = bytecode[i++];
-					p += fprintf(buffer, "%s", operator_string[o]);
-					break;
-				}
-				case OP_DECL:
-				case OP_WHERE:
-				case OP_IMPORT:
-				case OP_MEMPTR: {
-					char* c = get_string(bytecode + i, &i);
-					p += fprintf(buffer, "%.*s ", max_len, c);
-					if (strlen(c) > (size_t) max_len) {
-						p += fprintf(buffer, ">");
-					}
-					if (op == OP_IMPORT) {
-						// i is at null term
-						p += fprintf(buffer, "0x%X", get_address(bytecode + i, &i));
-					}
-					break;
-				}
-				case OP_MKREF: {
-					enum data_type t = bytecode[i++];
-					p += fprintf(buffer, "%s", data_string[t]);
-					address a = get_address(bytecode + i, &i);
-					p += fprintf(buffer, " %d", a);
-					break;
-				}
-				case OP_MKTBL: {
-					address a = get_address(bytecode + i, &i);
-					p += fprintf(buffer, "%d", a);
-					break;
-				}
-				case OP_SRC: {
-					address a = get_address(bytecode + i, &i);
-					p += fprintf(buffer, "%d", a);
-					printSourceLine = a;
-					break;
-				}
-				case OP_JMP:
-				case OP_JIF: {
-					p += fprintf(buffer, "0x%X", get_address(bytecode + i, &i));
-					break;
-				}
-				case OP_NATIVE: {
-					p += fprintf(buffer, "%d ", get_address(bytecode + i, &i));
-					char* c = get_string(bytecode + i, &i);
-					p += fprintf(buffer, "%.*s", max_len, c);
-					break;
-				}
-				default: break;
-			}
+			p += print_instruction(bytecode, &i, buffer);
 		}
 		while (p++ < 80) {
 			fprintf(buffer, " ");
@@ -1448,8 +1829,8 @@ void print_bytecode(uint8_t* bytecode, size_t length, FILE* buffer) {
 		// 		break;
 		// 	}
 		// }
-		if (printSourceLine > 0 && !get_settings_flag(SETTINGS_REPL)) {
-			printf(RESET " %s", get_source_line(printSourceLine));
+		if (printSourceLine > 0 && !repl) {
+			printf(RESET " %s", get_source_line(sources, printSourceLine));
 		}
 		fprintf(buffer, "\n" RESET);
 		if (op == OP_HALT) {
@@ -1458,7 +1839,7 @@ void print_bytecode(uint8_t* bytecode, size_t length, FILE* buffer) {
 	}
 }
 
-static void write_address_at_buffer(address a, uint8_t* buffer, size_t loc) {
+void write_address_at_buffer(address a, uint8_t* buffer, size_t loc) {
 	if (!is_big_endian) loc += sizeof(address);
 	unsigned char * p = (void*)&a;
 	for (size_t i = 0; i < sizeof(address); i++) {
@@ -1466,7 +1847,7 @@ static void write_address_at_buffer(address a, uint8_t* buffer, size_t loc) {
 	}
 }
 
-static void write_data_at_buffer(struct data t, uint8_t* buffer, size_t loc) {
+void write_data_at_buffer(struct data t, uint8_t* buffer, size_t loc) {
 	buffer[loc++] = t.type;
 	if (t.type == D_INSTRUCTION_ADDRESS) {
 		if (!is_big_endian) loc += sizeof(double);
@@ -1487,7 +1868,9 @@ void offset_addresses(uint8_t* buffer, size_t length, int offset) {
 	while (i < length) {
 		enum opcode op = buffer[i++];
 		switch (op) {
-			case OP_PUSH: {
+			case OP_PUSH:
+			case OP_PUSH2:
+			case OP_PUSHB: {
 				size_t tokLoc = i;
 				struct data t = get_data(buffer + i, &i);
 				if (t.type == D_INSTRUCTION_ADDRESS) {
@@ -1497,7 +1880,9 @@ void offset_addresses(uint8_t* buffer, size_t length, int offset) {
 				break;
 			}
 			case OP_DECL:
+			case OP_DECLW:
 			case OP_WHERE:
+			case OP_STORE:
 			case OP_MEMPTR: {
 				get_string(buffer + i, &i);
 				break;
@@ -1532,11 +1917,16 @@ void offset_addresses(uint8_t* buffer, size_t length, int offset) {
 				get_address(buffer + i, &i);
 				break;
 			}
-			case OP_MKTBL: {
+			case OP_MKTBL:
+			case OP_RESERVE: {
 				get_address(buffer + i, &i);
 				break;
 			}
 			case OP_BIN:
+			case OP_BINNUM:
+			case OP_BINSTR:
+			case OP_INDEX:
+			case OP_BRNUM:
 			case OP_UNA: {
 				i++;
 				break;
@@ -2,6 +2,7 @@
 #define CODEGEN_H
 
 #include "memory.h"
+#include "operators.h"
 #include <stdint.h>
 
 // codegen.h - Felix Guo
@@ -51,8 +52,42 @@
 	OP(OP_MKTBL) \
 	OP(OP_DUPTOP) \
 	OP(OP_ROTTWO) \
-	OP(OP_POP)
-
+	OP(OP_POP) \
+	OP(OP_BINNUM) \
+	OP(OP_BINSTR) \
+	OP(OP_INDEX) \
+	OP(OP_PUSH2) \
+	OP(OP_DECLW) \
+	OP(OP_STORE) \
+	OP(OP_BRNUM) \
+	OP(OP_TCALL) \
+	OP(OP_RESERVE) \
+	OP(OP_PUSHB)
+
+// OP_BINNUM, OP_BINSTR and OP_INDEX are OP_BIN specialized for two numbers,
+//   two strings, or a list and a number, and carry the same operator byte.
+//   Codegen emits them where type inference proved the operand types, and the
+//   VM quickens OP_BIN into them in place once a site has run with them.
+//   Either way the VM checks the operands and falls back to OP_BIN.
+// OP_PUSH2, OP_DECLW, OP_STORE and OP_BRNUM are superinstructions: the first
+//   instruction of a common pair with its opcode replaced, so one dispatch
+//   runs both. The second instruction stays in place and still runs on its
+//   own if something jumps to it. OP_PUSH2 is a PUSH followed by a PUSH,
+//   OP_DECLW a DECL followed by a WRITE, OP_STORE a WHERE followed by a
+//   WRITE and OP_BRNUM an OP_BINNUM comparison followed by a JIF. Only the
+//   bytecode optimizer and the VM make them.
+// OP_TCALL is an OP_CALL in tail position: the calling function's frame is
+//   replaced by the callee's instead of kept for it to return into.
+// OP_RESERVE starts every program, unit and function body with the most
+//   values the code after it keeps on the working stack at once, so the VM
+//   grows the stack once up front instead of checking on every push. Calls
+//   take care of the one at the start of the function they call.
+// OP_PUSHB is an OP_PUSH of a variable right before the binary operation
+//   that takes it as its left operand. It pushes the variable's value without
+//   a copy of its own, saving the reference count and string copies, and the
+//   operation reads it without destroying it. Binary operations only ever
+//   copy out of their operands, and one that calls an overload copies the
+//   value before passing it on. Only the bytecode optimizer makes them.
 enum opcode {
 	FOREACH_OPCODE(ENUM)
 };
@@ -61,28 +96,58 @@ enum opcode {
 	"push", "bin", "una", "call", "ret", "decl", "write", "in",\
 	"out", "outl", "jmp", "jif", "frm", "end", "src", "halt",\
 	"native", "import", "argcln", "closure", "mkref", "where", "nthptr", "memptr",\
-	"inc", "dec", "mktbl", "duptop", "rottwo", "pop"
+	"inc", "dec", "mktbl", "duptop", "rottwo", "pop", "binnum", "binstr",\
+	"index", "push2", "declw", "store", "brnum", "tcall", "reserve", "pushb"
 
 extern const char* opcode_string[];
 
 // Forward Declaration
 struct statement_list;
+struct compiler_ctx;
+struct import_unit;
+
+// specialized_opcode(op, a, b) returns the opcode specialized for op applied
+//   to values of type a and b, or OP_BIN if there isn't one
+enum opcode specialized_opcode(enum vm_operator op, enum data_type a, enum data_type b);
 
-// generate_code(ast) generates Wendy ByteCode based on the ast and
+// generate_code(ctx, ast) generates Wendy ByteCode based on the ast and
 //   returns the ByteArray
 // effects: allocates memory, caller must free
-uint8_t* generate_code(struct statement_list* ast, size_t* size, bool include_header);
+uint8_t* generate_code(struct compiler_ctx* ctx, struct statement_list* ast, size_t* size, bool include_header);
+
+// print_bytecode(bytecode, length, repl, sources, buffer) prints the given
+//   bytecode into a readable format into the buffer. REPL bytecode has no
+//   header, otherwise each source line is shown from sources.
+void print_bytecode(uint8_t* bytecode, size_t length, bool repl,
+	const struct source_table* sources, FILE* buffer);
+
+// print_instruction(bytecode, i, buffer) prints the instruction at *i into
+//   buffer, moves *i past it and returns how many characters it printed
+int print_instruction(uint8_t* bytecode, unsigned int* i, FILE* buffer);
 
-// print_bytecode(bytecode, length, buffer) prints the given bytecode into
-//   a readable format into the buffer.
-void print_bytecode(uint8_t* bytecode, size_t length, FILE* buffer);
+// read_library(ctx, name, length) reads the compiled library name from the
+//   working directory, the library directory of ctx, or the standard library,
+//   in that order. Returns 0 if it wasn't found, the caller frees the buffer.
+uint8_t* read_library(struct compiler_ctx* ctx, const char* name, long* length);
+
+// compile_import_unit(ctx, path, line) scans, parses and generates the source
+//   file at path as its own unit in a child context. Units are cached by path
+//   so each file is only compiled once per program.
+struct import_unit* compile_import_unit(struct compiler_ctx* ctx, char* path, int line);
 
 // offset_addresses(buffer, length, offset) offsets all instructions
 //   that require an address by the given offset
 void offset_addresses(uint8_t* buffer, size_t length, int offset);
 
-// write_bytecode(bytecode, buffer) writes the bytecode into binary file
-void write_bytecode(uint8_t* bytecode, FILE* buffer);
+// write_address_at_buffer(a, buffer, loc) encodes the address a at loc
+void write_address_at_buffer(address a, uint8_t* buffer, size_t loc);
+
+// write_data_at_buffer(t, buffer, loc) rewrites the instruction address data
+//   at loc, other data is left alone
+void write_data_at_buffer(struct data t, uint8_t* buffer, size_t loc);
+
+// write_bytecode(bytecode, size, buffer) writes the bytecode into binary file
+void write_bytecode(uint8_t* bytecode, size_t size, FILE* buffer);
 
 // get_token(bytecode, end) gets a token from the bytecode stream
 struct data get_data(uint8_t* bytecode, unsigned int* end);
@@ -0,0 +1,26 @@
+#include "compiler.h"
+#include "global.h"
+#include "imports.h"
+#include <string.h>
+
+void compiler_ctx_init(struct compiler_ctx* ctx, const struct settings* settings,
+	struct source_table* sources) {
+	memset(ctx, 0, sizeof(struct compiler_ctx));
+	ctx->settings = *settings;
+	ctx->sources = sources;
+	ctx->import_units = &ctx->own_import_units;
+}
+
+void compiler_ctx_init_child(struct compiler_ctx* ctx, struct compiler_ctx* parent) {
+	memset(ctx, 0, sizeof(struct compiler_ctx));
+	ctx->settings = parent->settings;
+	ctx->sources = parent->sources;
+	ctx->import_units = parent->import_units;
+	ctx->library_dir = parent->library_dir;
+}
+
+void compiler_ctx_destroy(struct compiler_ctx* ctx) {
+	arena_release(&ctx->arena);
+	free_imported_libraries_ll(&ctx->codegen.imported_libraries);
+	free_import_units(&ctx->own_import_units);
+}
@@ -0,0 +1,113 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "global.h"
+#include "token.h"
+#include "imports.h"
+#include "arena.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// compiler.h - Felix Guo
+// Holds every piece of state used while compiling a program, from scanning
+//   through code generation. Each compilation gets its own context so several
+//   can run at once, including on different threads.
+
+struct loop_context;
+struct statement_block;
+struct overload_node;
+struct binding_count;
+struct source_table;
+
+struct scanner_state {
+	char* source;
+	size_t source_len;
+	size_t current;
+	size_t start;
+	struct token* tokens;
+	size_t tokens_alloc_size;
+	size_t t_curr;
+	size_t line;
+	size_t col;
+	bool ignore_next;
+};
+
+struct parser_state {
+	struct token* tokens;
+	size_t length;
+	size_t curr_index;
+	bool error_thrown;
+};
+
+struct codegen_state {
+	uint8_t* bytecode;
+	size_t capacity;
+	size_t size;
+	size_t global_loop_id;
+	int scope_level;
+	// Number of function bodies being generated around the current code
+	int function_depth;
+	// Values the code so far leaves on the working stack, counted from the
+	//   start of the program or function body, and the most it ever holds
+	int stack_depth;
+	int max_stack_depth;
+	// Where the last opcode was written, and the furthest address a jump
+	//   was pointed at
+	size_t last_opcode_at;
+	size_t last_jump_target;
+	struct loop_context* current_loop_context;
+	// Libraries already linked into this program
+	struct import_node* imported_libraries;
+};
+
+struct optimizer_state {
+	struct statement_block* curr_statement_block;
+	// Set while optimizing a unit whose top level bindings are used by
+	//   importers
+	bool keep_top_level;
+	// Operator overloads declared by the unit or anything it imports
+	struct overload_node* overloads;
+	// Number of temporaries introduced for hoisted and shared expressions
+	size_t temp_count;
+	// Number of times each name is bound or written anywhere in the unit
+	struct binding_count* bindings;
+};
+
+struct compiler_ctx {
+	struct settings settings;
+	// Set once an error is reported while compiling in this context
+	bool error_flag;
+	// Errors are reported against this, units compiled separately are added
+	//   to it, shared with child contexts
+	struct source_table* sources;
+	struct scanner_state scanner;
+	struct parser_state parser;
+	struct codegen_state codegen;
+	struct optimizer_state optimizer;
+
+	// Owns the tokens, the AST and the optimizer's scratch for this
+	//   compilation
+	struct arena arena;
+
+	// Source files compiled as their own unit, shared with child contexts
+	struct import_unit** import_units;
+	struct import_unit* own_import_units;
+
+	// Searched for compiled libraries after the working directory and before
+	//   the standard library, may be 0
+	const char* library_dir;
+};
+
+// compiler_ctx_init(ctx, settings, sources) prepares a context with a copy of
+//   settings that reports errors against sources
+void compiler_ctx_init(struct compiler_ctx* ctx, const struct settings* settings,
+	struct source_table* sources);
+
+// compiler_ctx_init_child(ctx, parent) prepares a context for compiling a unit
+//   imported by parent, sharing its settings, sources and cache of units
+void compiler_ctx_init_child(struct compiler_ctx* ctx, struct compiler_ctx* parent);
+
+// compiler_ctx_destroy(ctx) releases everything owned by the context
+void compiler_ctx_destroy(struct compiler_ctx* ctx);
+
+#endif
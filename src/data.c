@@ -25,7 +25,7 @@ struct data copy_data(struct data d) {
 		return list_header_data(header->size, header->capacity);
 	}
 	else if (d.type == D_TABLE_INTERNAL_POINTER) {
-		error_general("Can't copy a D_TABLE_INTERNAL_POINTER!\n");
+		error_general(0, "Can't copy a D_TABLE_INTERNAL_POINTER!\n");
 		return none_data();
 		// return make_data(d.type, data_value_ptr((struct data*) table_copy(
 		// 	(struct table*) d.value.reference
@@ -35,14 +35,22 @@ struct data copy_data(struct data d) {
 		return make_data(d.type, data_value_num(d.value.number));
 	}
 	else if (is_reference(d)) {
-		return make_data(d.type, data_value_ptr(
-			refcnt_copy(d.value.reference)));
+		error_general(0, "Tried to copy a reference data type without a memory instance!");
+		return none_data();
 	}
 	else {
 		return make_data(d.type, data_value_str(d.value.string));
 	}
 }
 
+struct data copy_data_runtime(struct memory* memory, struct data d) {
+	if (is_reference(d)) {
+		return make_data(d.type, data_value_ptr(
+			refcnt_copy(memory, d.value.reference)));
+	}
+	return copy_data(d);
+}
+
 bool data_equal(struct data* a, struct data* b) {
 	if (a->type != b->type) {
 		return false;
@@ -98,10 +106,10 @@ void destroy_data(struct data* d) {
 		safe_free(d->value.reference);
 	}
 	else if (d->type == D_TABLE_INTERNAL_POINTER) {
-		error_general("Tried to destroy a table without a memory instance!");
+		error_general(0, "Tried to destroy a table without a memory instance!");
 	}
 	else if (is_reference(*d)) {
-		error_general("Tried to destroy a reference data type without a memory instance!");
+		error_general(0, "Tried to destroy a reference data type without a memory instance!");
 	}
 	else if (!is_numeric(*d)) {
 		safe_free(d->value.string);
@@ -347,3 +355,11 @@ struct data literal_to_data(struct token literal) {
 	return make_data(literal_type_to_data_type(literal.t_type),
 		data_value_str(literal.t_data.string));
 }
+
+struct data literal_to_data_ref(struct token literal) {
+	if (literal.t_type == T_NUMBER) {
+		return make_data(D_NUMBER, data_value_num(literal.t_data.number));
+	}
+	return make_data(literal_type_to_data_type(literal.t_type),
+		data_value_str_impl(literal.t_data.string));
+}
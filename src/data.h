@@ -50,6 +50,10 @@ enum data_type {
 	FOREACH_DATA(ENUM)
 };
 
+#define COUNT_DATA_TYPE(x) + 1
+enum { DATA_TYPE_COUNT = 0 FOREACH_DATA(COUNT_DATA_TYPE) };
+#undef COUNT_DATA_TYPE
+
 extern const char* data_string[];
 
 struct data;
@@ -73,6 +77,7 @@ struct list_header {
 
 struct data make_data(enum data_type type, union data_value value);
 struct data copy_data(struct data d);
+struct data copy_data_runtime(struct memory* memory, struct data d);
 void destroy_data(struct data* d);
 void destroy_data_runtime(struct memory* memory, struct data* d);
 void destroy_data_runtime_no_ref(struct memory* memory, struct data* d);
@@ -103,6 +108,10 @@ void print_data(const struct data *t);
 bool data_equal(struct data *a, struct data *b);
 
 struct data literal_to_data(struct token literal);
+
+// literal_to_data_ref(literal) is literal_to_data, but the data refers to the
+//   token's string instead of owning a copy
+struct data literal_to_data_ref(struct token literal);
 unsigned int print_data_inline(const struct data *t, FILE *buf);
 
 #endif
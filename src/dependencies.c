@@ -5,18 +5,63 @@ static void do_nothing_e(struct expr* e, struct traversal_algorithm* algo) { UNU
 static void do_nothing_el(struct expr_list* e, struct traversal_algorithm* algo) { UNUSED(e); UNUSED(algo); }
 static void do_nothing_sl(struct statement_list* e, struct traversal_algorithm* algo) { UNUSED(e); UNUSED(algo); }
 static void handle_statement(struct statement* s, struct traversal_algorithm* algo) {
-	UNUSED(algo);
-	if (s->type == S_IMPORT) {
+	struct import_node** list = algo->data;
+	if (s->type == S_IMPORT && !s->op.import_statement.is_file &&
+		!has_already_imported_library(*list, s->op.import_statement.name)) {
 		// Log Dependency
-		printf("%s\n", s->op.import_statement);
+		add_imported_library(list, s->op.import_statement.name);
 	}
 }
 
-struct traversal_algorithm dependency_print_impl =
+struct traversal_algorithm dependency_collect_impl =
 	TRAVERSAL_ALGO_PRE(do_nothing_e, do_nothing_el,
 		handle_statement, do_nothing_sl);
 
-void print_dependencies(struct statement_list* ast) {
-	traverse_ast(ast, &dependency_print_impl);
+static void handle_file_statement(struct statement* s, struct traversal_algorithm* algo) {
+	struct import_node** list = algo->data;
+	if (s->type == S_IMPORT && s->op.import_statement.is_file &&
+		!has_already_imported_library(*list, s->op.import_statement.name)) {
+		add_imported_library(list, s->op.import_statement.name);
+	}
+}
+
+static struct traversal_algorithm file_import_collect_impl =
+	TRAVERSAL_ALGO_PRE(do_nothing_e, do_nothing_el,
+		handle_file_statement, do_nothing_sl);
+
+// reverse_imports(list) returns list with its nodes in the opposite order
+static struct import_node* reverse_imports(struct import_node* list) {
+	struct import_node* reversed = 0;
+	while (list) {
+		struct import_node* next = list->next;
+		list->next = reversed;
+		reversed = list;
+		list = next;
+	}
+	return reversed;
 }
 
+struct import_node* collect_dependencies(struct statement_list* ast) {
+	struct import_node* list = 0;
+	struct traversal_algorithm algo = dependency_collect_impl;
+	algo.data = &list;
+	traverse_ast(ast, &algo);
+	// Nodes were pushed on the front, restore source order
+	return reverse_imports(list);
+}
+
+struct import_node* collect_file_imports(struct statement_list* ast) {
+	struct import_node* list = 0;
+	struct traversal_algorithm algo = file_import_collect_impl;
+	algo.data = &list;
+	traverse_ast(ast, &algo);
+	return reverse_imports(list);
+}
+
+void print_dependencies(struct statement_list* ast) {
+	struct import_node* list = collect_dependencies(ast);
+	for (struct import_node* curr = list; curr; curr = curr->next) {
+		printf("%s\n", curr->name);
+	}
+	free_imported_libraries_ll(&list);
+}
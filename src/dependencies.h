@@ -2,9 +2,20 @@
 #define DEPENDENCIES_H
 
 #include "ast.h"
+#include "imports.h"
 
 // dependencies.h - Felix Guo
-// Function that analyzes an AST and prints the dependencies
+// Functions that analyze an AST for the libraries it depends on
+
+// collect_dependencies(ast) returns the libraries imported by ast, each once
+//   and in the order they first appear
+// effects: allocates memory, free with free_imported_libraries_ll
+struct import_node* collect_dependencies(struct statement_list* ast);
+
+// collect_file_imports(ast) is collect_dependencies for the files ast
+//   imports with import "path", which are compiled into it
+// effects: allocates memory, free with free_imported_libraries_ll
+struct import_node* collect_file_imports(struct statement_list* ast);
 
 // print_dependencies(ast) analyzes an AST and prints the dependencies
 void print_dependencies(struct statement_list* ast);
@@ -3,30 +3,20 @@
 #include "memory.h"
 #include "source.h"
 #include "vm.h"
+#include "compiler.h"
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
-static bool error_flag = false;
-
-void reset_error_flag() {
-	error_flag = false;
-}
-
-bool get_error_flag() {
-	return error_flag;
-}
-
 char* error_message(const char* message, va_list args) {
 	char* result;
 	vasprintf(&result, message, args);
 	return result;
 }
 
-void error_general(char* message, ...) {
-	error_flag = true;
+void error_general(struct compiler_ctx* ctx, char* message, ...) {
 	va_list args;
 	va_start(args, message);
 
@@ -35,56 +25,61 @@ void error_general(char* message, ...) {
 
 	// Cannot be safe, because vasprintf uses malloc!
 	free(msg);
-	if (get_settings_flag(SETTINGS_STRICT_ERROR)) {
+	if (!ctx) {
+		return;
+	}
+	ctx->error_flag = true;
+	if (ctx->settings.flags[SETTINGS_STRICT_ERROR]) {
 		safe_exit(1);
 	}
 }
 
-void error_lexer(int line, int col, char* message, ...) {
-	error_flag = true;
+void error_lexer(struct compiler_ctx* ctx, int line, int col, char* message, ...) {
+	ctx->error_flag = true;
 	va_list args;
 	va_start(args, message);
 
 	char* msg = error_message(message, args);
 	fprintf(stderr, RED "Parser Error" RESET " on line " YEL "%d" RESET ": %s\n",
-		line, msg);
+		source_line_number(line), msg);
 
-	if (has_source()) {
+	if (has_source_at(ctx->sources, line)) {
 		fprintf(stderr, "==========================\n%5s %s (%s)\n", "Line", "Source",
-			get_source_name());
-		fprintf(stderr, "%5d " RED "%s\n" RESET, line, get_source_line(line));
+			get_source_name_at(ctx->sources, line));
+		fprintf(stderr, "%5d " RED "%s\n" RESET, source_line_number(line),
+			get_source_line(ctx->sources, line));
 		fprintf(stderr, "      %*c^\n", col, ' ');
 	}
 	free(msg);
-	if (get_settings_flag(SETTINGS_STRICT_ERROR)) {
+	if (ctx->settings.flags[SETTINGS_STRICT_ERROR]) {
 		safe_exit(1);
 	}
 }
 
-void error_compile(int line, int col, char* message, ...) {
-	error_flag = true;
+void error_compile(struct compiler_ctx* ctx, int line, int col, char* message, ...) {
+	ctx->error_flag = true;
 	va_list args;
 	va_start(args, message);
 
 	char* msg = error_message(message, args);
 	fprintf(stderr, RED "Compile Error" RESET " on line " YEL "%d" RESET ": %s\n",
-		line, msg);
+		source_line_number(line), msg);
 
-	if (has_source()) {
+	if (has_source_at(ctx->sources, line)) {
 		fprintf(stderr, "==========================\n%5s %s (%s)\n", "Line", "Source",
-			get_source_name());
-		fprintf(stderr, "%5d " RED "%s\n" RESET, line, get_source_line(line));
+			get_source_name_at(ctx->sources, line));
+		fprintf(stderr, "%5d " RED "%s\n" RESET, source_line_number(line),
+			get_source_line(ctx->sources, line));
 		fprintf(stderr, "      %*c^\n", col, ' ');
 	}
 	free(msg);
-	if (get_settings_flag(SETTINGS_STRICT_ERROR)) {
+	if (ctx->settings.flags[SETTINGS_STRICT_ERROR]) {
 		safe_exit(1);
 	}
 }
 
 void assert_impl(bool condition, const char* condition_str, const char* filename, size_t line_number, const char* message, ...) {
 	if (!condition) {
-		error_flag = true;
 		va_list args;
 		va_start(args, message);
 		char* msg = error_message(message, args);
@@ -96,29 +91,34 @@ void assert_impl(bool condition, const char* condition_str, const char* filename
 }
 
 void error_runtime(struct memory* memory, int line, char* message, ...) {
-	error_flag = true;
+	*memory->error_flag = true;
 	va_list args;
 	va_start(args, message);
 
 	char* msg = error_message(message, args);
-	fprintf(stderr, RED "Runtime Error" RESET " on line " YEL "%d" RESET ": %s\n", line, msg);
+	fprintf(stderr, RED "Runtime Error" RESET " on line " YEL "%d" RESET ": %s\n",
+		source_line_number(line), msg);
 
-	if (has_source()) {
-		if (!is_source_accurate()) {
+	if (has_source_at(memory->sources, line)) {
+		if (!is_source_accurate(memory->sources)) {
 			fprintf(stderr, YEL "Note: " RESET "Source was automatically loaded "
 			"and may not reflect the actual source of the compiled code.\n");
 		}
 		fprintf(stderr, DIVIDER "\n%5s %s (%s)\n", "Line", "Source",
-			get_source_name());
-		int start_line = (line - 2 > 0) ? (line - 2) : 1;
+			get_source_name_at(memory->sources, line));
+		// Lines within the same unit, so the encoding bits carry through
+		int unit = line - source_line_number(line);
+		int start_line = (line - 2 > unit) ? (line - 2) : unit + 1;
 		int end_line = start_line + 5;
 		for (int i = start_line; i < end_line; i++) {
-			if (is_valid_line_num(i)) {
+			if (is_valid_line_num(memory->sources, i)) {
 				if (i == line) {
-					fprintf(stderr, "%5d " RED "%s\n" RESET, i, get_source_line(i));
+					fprintf(stderr, "%5d " RED "%s\n" RESET, source_line_number(i),
+						get_source_line(memory->sources, i));
 				}
 				else {
-					fprintf(stderr, "%5d %s\n" RESET, i, get_source_line(i));
+					fprintf(stderr, "%5d %s\n" RESET, source_line_number(i),
+						get_source_line(memory->sources, i));
 				}
 			}
 		}
@@ -126,9 +126,9 @@ void error_runtime(struct memory* memory, int line, char* message, ...) {
 	}
 	free(msg);
 	// REPL Don't print call stack unless verbose is on!
-	if (!get_settings_flag(SETTINGS_REPL) || get_settings_flag(SETTINGS_VERBOSE)) {
+	if (!memory->settings->flags[SETTINGS_REPL] || memory->settings->flags[SETTINGS_VERBOSE]) {
 		print_call_stack(memory, stderr, -1);
-		if (get_settings_flag(SETTINGS_VERBOSE)) {
+		if (memory->settings->flags[SETTINGS_VERBOSE]) {
 			fprintf(stderr, RED "VERBOSE ERROR DUMP\n" RESET);
 			fprintf(stderr, GRN "Limits\n" RESET);
 			fprintf(stderr, "Call Stack Size %zu\n", memory->call_stack_size);
@@ -139,7 +139,7 @@ void error_runtime(struct memory* memory, int line, char* message, ...) {
 		}
 	}
 	fflush(stdout);
-	if (get_settings_flag(SETTINGS_STRICT_ERROR)) {
+	if (memory->settings->flags[SETTINGS_STRICT_ERROR]) {
 		safe_exit(1);
 	}
 }
@@ -11,28 +11,30 @@
 // There are different types of error messages. All error message display calls
 //   can be provided with a formatted string and arguments, like printf.
 //
-// General Error: error_general(message) -> All
-//   No source displayed, allocation errors, etc.
+// General Error: error_general(ctx, message) -> All
+//   No source displayed, allocation errors, etc. ctx is the compilation the
+//   error happened in, or 0 outside of one, where only the message is shown.
 //
-// Scanner/Parser Error: error_lexer(message) -> Scanner / AST
+// Scanner/Parser Error: error_lexer(ctx, message) -> Scanner / AST
 //   Source displayed with column and line number.
 //
-// Runtime Error: error_runtime(message) -> VM
+// Runtime Error: error_runtime(memory, message) -> VM
 //   Source displayed with line number, and stack frame as well.
+//
+// Errors set the error flag of the compiler context or VM they are reported
+//   to, and exit if its settings ask for strict errors.
+
+struct compiler_ctx;
 
-void error_general(char* message, ...);
+void error_general(struct compiler_ctx* ctx, char* message, ...);
 
-void error_lexer(int line, int col, char* message, ...);
+void error_lexer(struct compiler_ctx* ctx, int line, int col, char* message, ...);
 
 // TODO: this probably needs to be synchronised, otherwise printing stuff
 //   will not print properly
 void error_runtime(struct memory* memory, int line, char* message, ...);
 
-void error_compile(int line, int col, char* message, ...);
-
-void reset_error_flag(void);
-
-bool get_error_flag(void);
+void error_compile(struct compiler_ctx* ctx, int line, int col, char* message, ...);
 
 #ifdef RELEASE 
 #define wendy_assert(...) 
@@ -56,6 +58,7 @@ void assert_impl(bool condition, const char* condition_str, const char* filename
 #define AST_EXPECTED_TOKEN SCAN_EXPECTED_TOKEN
 #define AST_EXPECTED_IDENTIFIER "Expected identifier in identifier list!"
 #define AST_EXPECTED_PRIMARY "Expected primary expression!"
+#define AST_UNEXPECTED_END "Unexpected end of input!"
 #define AST_EXPECTED_IDENTIFIER_LOOP "Expected identifier in place of loop variable."
 #define AST_STRUCT_NAME_IDENTIFIER "Struct name must be an identifier!"
 #define AST_STRUCT_EXPECTED_EXTENDS_IDENTIFIER "Struct extends expected identifier!"
@@ -83,6 +86,8 @@ void assert_impl(bool condition, const char* condition_str, const char* filename
 	"Named argument must come after positional arguments."
 #define CODEGEN_EXPECTED_IDENTIFIER AST_EXPECTED_IDENTIFIER
 #define CODEGEN_REQ_FILE_READ_ERR SCAN_REQ_FILE_READ_ERR
+#define CODEGEN_CIRCULAR_IMPORT "Circular import, \"%s\" imports itself through this import."
+#define CODEGEN_TOO_MANY_FILE_IMPORTS "Can't import \"%s\", a program can import at most %d files."
 
 #define CODEGEN_BREAK_NOT_IN_LOOP "Break statement not in loop!"
 #define CODEGEN_CONTINUE_NOT_IN_LOOP "Continue statement not in loop!"
@@ -107,6 +112,7 @@ void assert_impl(bool condition, const char* condition_str, const char* filename
 #define MEMORY_STACK_UNDERFLOW "Internal stack underflow! Did you call a function with less arguments than required?"
 #define MEMORY_ID_NOT_FOUND "Identifier '%s' not found! Did you declare it?"
 #define MEMORY_REGISTER_STACK_OVERFLOW "Internal memory stack overflowed."
+#define MEMORY_HEAP_LIMIT "Heap limit of %zu bytes reached!"
 
 // VM Errors:
 #define VM_RET_FROM_MAIN "Illegal return statement called at the top level."
@@ -140,6 +146,10 @@ void assert_impl(bool condition, const char* condition_str, const char* filename
 #define VM_SPREAD_NOT_ITERABLE "Spread vm_operator can only be called on List or Range."
 #define VM_STRING_DUPLICATION_NEGATIVE "Attempted to multiply string with negative integer."
 #define VM_LIST_DUPLICATION_NEGATIVE "Attempted to multiply list with negative integer."
+#define VM_INSTRUCTION_LIMIT "Instruction limit of %zu reached!"
+#define VM_TIME_LIMIT "Time limit of %gs reached!"
+#define VM_CPU_TIME_LIMIT "CPU time limit of %gs reached!"
+#define VM_CALL_DEPTH_LIMIT "Call depth limit of %zu frames reached!"
 
 #define VM_INTERNAL_ERROR "An internal VM error occured: %s"
 
@@ -1,15 +1,20 @@
 #include "global.h"
+#include "alloc_profile.h"
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <pthread.h>
 
+// The allocation list is shared by every thread compiling or running code
 static struct malloc_node* malloc_node_start = 0;
 static struct malloc_node* malloc_node_end = 0;
-static bool settings_data[SETTINGS_COUNT] = { false };
+static pthread_mutex_t malloc_list_lock = PTHREAD_MUTEX_INITIALIZER;
+// Counted per thread so allocating doesn't need the lock
+static __thread struct allocator_calls calls = { 0, 0, 0, 0 };
 bool is_big_endian = true;
-bool last_printed_newline = false;
+__thread bool last_printed_newline = false;
 
 char* safe_strdup_impl(const char* s, char* allocated) {
 	strcpy(allocated, s);
@@ -45,12 +50,9 @@ void determine_endianness() {
 	is_big_endian = ((*(char*)&i) == 0);
 }
 
-void set_settings_flag(enum settings_flags flag) {
-	settings_data[flag] = true;
-}
-
-bool get_settings_flag(enum settings_flags flag) {
-	return settings_data[flag];
+struct settings get_default_settings() {
+	struct settings settings = { .flags = { [SETTINGS_OPTIMIZE] = true } };
+	return settings;
 }
 
 static void attach_to_list(struct malloc_node* new_node) {
@@ -95,12 +97,19 @@ void* safe_malloc_impl(size_t size, const char* filename, int line_num) {
 		safe_exit(2);
 		return NULL;
 	}
+	calls.mallocs += 1;
 	new_node->filename = filename;
 	new_node->line_num = line_num;
 	new_node->size = size;
 	/* Cast to void to avoid implicit pointer arithmetic */
 	new_node->ptr = (void *)new_node + sizeof(struct malloc_node);
+	pthread_mutex_lock(&malloc_list_lock);
 	attach_to_list(new_node);
+	pthread_mutex_unlock(&malloc_list_lock);
+	if (active_alloc_profiler) {
+		alloc_profiler_allocated(active_alloc_profiler, new_node->ptr, size,
+			filename, line_num, 0);
+	}
 	return new_node->ptr;
 }
 
@@ -113,17 +122,30 @@ void* safe_calloc_impl(size_t num, size_t size, const char* filename, int line_n
 		safe_exit(2);
 		return NULL;
 	}
+	calls.callocs += 1;
 	new_node->filename = filename;
 	new_node->line_num = line_num;
 	new_node->size = size;
 	new_node->ptr = (void *)new_node + sizeof(struct malloc_node);
+	pthread_mutex_lock(&malloc_list_lock);
 	attach_to_list(new_node);
+	pthread_mutex_unlock(&malloc_list_lock);
+	if (active_alloc_profiler) {
+		alloc_profiler_allocated(active_alloc_profiler, new_node->ptr, size,
+			filename, line_num, 0);
+	}
 	return new_node->ptr;
 }
 
 void* safe_realloc_impl(void* ptr, size_t size, const char* filename, int line_num) {
 	struct malloc_node* core_ptr = ptr - sizeof(*core_ptr);
 
+	calls.reallocs += 1;
+	// The block may hold the call stack the profiler reads, so it looks
+	//   before the block moves
+	struct alloc_site* profiled = active_alloc_profiler ? alloc_profiler_reallocating(
+		active_alloc_profiler, ptr, filename, line_num, 0) : 0;
+	pthread_mutex_lock(&malloc_list_lock);
 	void* new_ptr = realloc(core_ptr, size + sizeof(*core_ptr));
 	if (!new_ptr) {
 		fprintf(stderr, "SafeRealloc: Couldn't reallocate memory! %s at"
@@ -144,6 +166,10 @@ void* safe_realloc_impl(void* ptr, size_t size, const char* filename, int line_n
 
 	moved_node->ptr = new_ptr + sizeof(struct malloc_node);
 	moved_node->size = size;
+	pthread_mutex_unlock(&malloc_list_lock);
+	if (profiled) {
+		alloc_profiler_reallocated(active_alloc_profiler, profiled, moved_node->ptr, size);
+	}
 	return moved_node->ptr;
 }
 
@@ -154,12 +180,26 @@ void safe_free_impl(void* ptr, const char* filename, int line_num) {
 		fprintf(stderr, "Free Error: Attempted to free a null pointer.\n");
 		return;
 	}
+	calls.frees += 1;
+	if (active_alloc_profiler) {
+		alloc_profiler_freed(active_alloc_profiler, ptr);
+	}
 	struct malloc_node* node_ptr = ptr - sizeof(struct malloc_node);
+	pthread_mutex_lock(&malloc_list_lock);
 	remove_from_list(node_ptr);
+	pthread_mutex_unlock(&malloc_list_lock);
 	free(node_ptr);
 	return;
 }
 
+size_t allocation_count(void) {
+	return calls.mallocs + calls.callocs;
+}
+
+struct allocator_calls allocator_call_count(void) {
+	return calls;
+}
+
 void check_leak() {
 	struct malloc_node* curr = malloc_node_start;
 	if (!curr) return;
@@ -198,6 +238,11 @@ void* safe_release_malloc(size_t size) {
 		safe_exit(2);
 		return NULL;
 	}
+	calls.mallocs += 1;
+	if (active_alloc_profiler) {
+		alloc_profiler_allocated(active_alloc_profiler, ptr, size, 0, 0,
+			__builtin_return_address(0));
+	}
 	return ptr;
 }
 
@@ -208,15 +253,34 @@ void* safe_release_calloc(size_t num, size_t size) {
 		safe_exit(2);
 		return NULL;
 	}
+	calls.callocs += 1;
+	if (active_alloc_profiler) {
+		alloc_profiler_allocated(active_alloc_profiler, ptr, num * size, 0, 0,
+			__builtin_return_address(0));
+	}
 	return ptr;
 }
 
 void* safe_release_realloc(void* ptr, size_t size) {
+	struct alloc_site* profiled = active_alloc_profiler ? alloc_profiler_reallocating(
+		active_alloc_profiler, ptr, 0, 0, __builtin_return_address(0)) : 0;
 	void* new_ptr = realloc(ptr, size);
 	if (!new_ptr) {
 		fprintf(stderr, "Could not realloc memory! Out of memory?");
 		safe_exit(2);
 		return NULL;
 	}
+	calls.reallocs += 1;
+	if (profiled) {
+		alloc_profiler_reallocated(active_alloc_profiler, profiled, new_ptr, size);
+	}
 	return new_ptr;
 }
+
+void safe_release_free(void* ptr) {
+	calls.frees += 1;
+	if (active_alloc_profiler) {
+		alloc_profiler_freed(active_alloc_profiler, ptr);
+	}
+	free(ptr);
+}
@@ -52,10 +52,21 @@ enum settings_flags {
 	SETTINGS_TRACE_VM,
 	SETTINGS_TRACE_REFCNT,
     SETTINGS_DRY_RUN,
+	SETTINGS_STATS,
+	SETTINGS_PROFILE,
+	SETTINGS_VM_STATS,
+	SETTINGS_MEM_STATS,
+	SETTINGS_ALLOC_PROFILE,
 	SETTINGS_COUNT };
 
-void set_settings_flag(enum settings_flags flag);
-bool get_settings_flag(enum settings_flags flag);
+// Each compiler context and VM keeps its own copy of the settings, taken
+//   from whoever creates it.
+struct settings {
+	bool flags[SETTINGS_COUNT];
+};
+
+// get_default_settings() returns the settings before any option changes them
+struct settings get_default_settings(void);
 
 struct malloc_node {
 	const char* filename;
@@ -70,7 +81,7 @@ void determine_endianness(void);
 bool streq(const char* a, const char* b);
 
 extern bool is_big_endian;
-extern bool last_printed_newline;
+extern __thread bool last_printed_newline;
 
 char* safe_strdup_impl(const char* s, char* allocated);
 
@@ -94,7 +105,7 @@ char* safe_concat_impl(const char* first, ...);
 
 // Regular Malloc Implementations
 #define safe_malloc(size) safe_release_malloc(size)
-#define safe_free(ptr) free(ptr)
+#define safe_free(ptr) safe_release_free(ptr)
 #define safe_calloc(num, size) safe_release_calloc(num, size)
 #define safe_realloc(ptr, size) safe_release_realloc(ptr, size)
 
@@ -108,6 +119,22 @@ void safe_free_impl(void* ptr, const char* filename, int line_num);
 void* safe_release_malloc(size_t size);
 void* safe_release_calloc(size_t num, size_t size);
 void* safe_release_realloc(void* ptr, size_t size);
+void safe_release_free(void* ptr);
+
+// allocation_count() returns how many blocks the calling thread has
+//   allocated so far
+size_t allocation_count(void);
+
+// How many times the calling thread has called each allocator function
+struct allocator_calls {
+	size_t mallocs;
+	size_t callocs;
+	size_t reallocs;
+	size_t frees;
+};
+
+// allocator_call_count() returns the calls the calling thread has made so far
+struct allocator_calls allocator_call_count(void);
 
 void free_alloc(void);
 void check_leak(void);
@@ -0,0 +1,137 @@
+#include "heap_snapshot.h"
+#include "mem_stats.h"
+#include "memory.h"
+#include "global.h"
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+volatile sig_atomic_t heap_snapshot_requested = 0;
+
+static struct data* container_values(struct refcnt_container* container) {
+	return (struct data*)(container + 1);
+}
+
+static struct refcnt_container* container_of(struct data* data) {
+	return (struct refcnt_container*) data->value.reference - 1;
+}
+
+static void write_node(FILE* file, struct refcnt_container* container) {
+	enum data_type type = container_type(container_values(container), container->count);
+	fprintf(file, "node %p %s %zu %zu %zu\n", (void*) container,
+		type == D_EMPTY ? "OTHER" : data_string[type] + 2, container->count,
+		sizeof(struct refcnt_container) + container->count * sizeof(struct data),
+		container->refs);
+}
+
+static void write_edges(FILE* file, struct refcnt_container* container) {
+	struct data* values = container_values(container);
+	for (size_t i = 0; i < container->count; i++) {
+		if (is_reference(values[i])) {
+			fprintf(file, "edge %p %p [%zu]\n", (void*) container,
+				(void*) container_of(&values[i]), i);
+		}
+		else if (values[i].type == D_TABLE_INTERNAL_POINTER) {
+			struct table* table = (struct table*) values[i].value.reference;
+			for (size_t b = 0; b < table->bucket_count; b++) {
+				for (struct entry* entry = table->buckets[b]; entry; entry = entry->next) {
+					if (is_reference(entry->value)) {
+						fprintf(file, "edge %p %p %s\n", (void*) container,
+							(void*) container_of(&entry->value), entry->key);
+					}
+				}
+			}
+		}
+	}
+}
+
+static void write_frame_roots(FILE* file, struct table* table, size_t depth,
+		const char* function) {
+	for (size_t b = 0; b < table->bucket_count; b++) {
+		for (struct entry* entry = table->buckets[b]; entry; entry = entry->next) {
+			if (is_reference(entry->value)) {
+				fprintf(file, "root %p %zu %s %s\n", (void*) container_of(&entry->value),
+					depth, function, entry->key);
+			}
+		}
+	}
+}
+
+void heap_snapshot_write(struct memory* memory, FILE* file) {
+	fprintf(file, "wendy-heap 1\n");
+	struct refcnt_container* container = memory->all_containers_start;
+	while (container) {
+		write_node(file, container);
+		container = container->next;
+		if (container == memory->all_containers_start) {
+			break;
+		}
+	}
+	container = memory->all_containers_start;
+	while (container) {
+		write_edges(file, container);
+		container = container->next;
+		if (container == memory->all_containers_start) {
+			break;
+		}
+	}
+	for (size_t i = 0; i < memory->call_stack_pointer; i++) {
+		struct stack_frame* frame = &memory->call_stack[i];
+		write_frame_roots(file, frame->variables, i, frame->fn_name);
+		if (frame->closure) {
+			write_frame_roots(file, frame->closure, i, frame->fn_name);
+		}
+	}
+	for (size_t i = 0; i < memory->working_stack_pointer; i++) {
+		if (is_reference(memory->working_stack[i])) {
+			fprintf(file, "root %p - <stack> %zu\n",
+				(void*) container_of(&memory->working_stack[i]), i);
+		}
+	}
+}
+
+bool heap_snapshot_save(struct memory* memory, const char* path) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+	heap_snapshot_write(memory, file);
+	fclose(file);
+	return true;
+}
+
+#ifndef _WIN32
+static void request_snapshot(int signal) {
+	UNUSED(signal);
+	heap_snapshot_requested = 1;
+}
+#endif
+
+void heap_snapshot_install_signal(void) {
+#ifndef _WIN32
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = request_snapshot;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &action, NULL);
+#endif
+}
+
+void heap_snapshot_take_requested(struct memory* memory) {
+	static size_t taken = 0;
+	heap_snapshot_requested = 0;
+	char path[64];
+#ifndef _WIN32
+	snprintf(path, sizeof(path), "wendy-%ld-%zu.heap", (long) getpid(), ++taken);
+#else
+	snprintf(path, sizeof(path), "wendy-%zu.heap", ++taken);
+#endif
+	if (heap_snapshot_save(memory, path)) {
+		fprintf(stderr, "Heap snapshot written to %s\n", path);
+	}
+	else {
+		fprintf(stderr, "Error opening %s to write the heap snapshot.\n", path);
+	}
+}
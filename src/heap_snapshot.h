@@ -0,0 +1,54 @@
+#ifndef HEAP_SNAPSHOT_H
+#define HEAP_SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+
+// heap_snapshot.h - Felix Guo
+// Writes the reference counted heap out as a graph, from Wendy.heapSnapshot
+//   or when the process gets SIGUSR2, for tools/heap_analyze to find what
+//   keeps memory alive. The file is text, one record per line, with fields
+//   split by single spaces and the last field running to the end of the
+//   line:
+//
+//   wendy-heap 1
+//   node <id> <type> <values> <bytes> <refs>
+//   edge <from> <to> <label>
+//   root <to> <depth> <function> <name>
+//
+//   Every container alive gets a node, its id is its address so snapshots
+//   of the same run can be compared. type is what refers to it: LIST (lists
+//   and closures), TABLE, FUNCTION, STRUCT, STRUCT_INSTANCE or OTHER. values
+//   is how many values it holds, bytes what it takes on the heap and refs
+//   its reference count.
+//
+//   An edge is a value in one container referring to another. label is the
+//   key for tables and [i] for the ith value of anything else.
+//
+//   A root is a variable in a stack frame referring to a container. depth
+//   counts frames from 0 at the bottom of the call stack, and function is
+//   the name of the frame. Values on the working stack are roots with a
+//   depth of - and a function of <stack>, named by where they are.
+
+struct memory;
+
+// Set by the SIGUSR2 handler, the VM writes a snapshot when it sees it
+extern volatile sig_atomic_t heap_snapshot_requested;
+
+// heap_snapshot_write(memory, file) writes the heap of memory to file
+void heap_snapshot_write(struct memory* memory, FILE* file);
+
+// heap_snapshot_save(memory, path) writes the heap of memory to a new file
+//   at path, returns false if it couldn't be opened
+bool heap_snapshot_save(struct memory* memory, const char* path);
+
+// heap_snapshot_install_signal() makes SIGUSR2 request a snapshot instead
+//   of ending the process
+void heap_snapshot_install_signal(void);
+
+// heap_snapshot_take_requested(memory) writes the snapshot SIGUSR2 asked for
+//   to wendy-<pid>-<n>.heap in the working directory
+void heap_snapshot_take_requested(struct memory* memory);
+
+#endif
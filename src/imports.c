@@ -5,29 +5,27 @@
 #include <stdbool.h>
 #include <string.h>
 
-struct import_node* imported_libraries = 0;
-
-void add_imported_library(const char* name) {
+void add_imported_library(struct import_node** list, const char* name) {
 	struct import_node* new_node = safe_malloc(sizeof(struct import_node));
 	new_node->name = safe_malloc(sizeof(char) * (strlen(name) + 1));
 	strcpy(new_node->name, name);
-	new_node->next = imported_libraries;
-	imported_libraries = new_node;
+	new_node->next = *list;
+	*list = new_node;
 }
 
-void free_imported_libraries_ll() {
-	struct import_node* curr = imported_libraries;
+void free_imported_libraries_ll(struct import_node** list) {
+	struct import_node* curr = *list;
 	while (curr) {
 		safe_free(curr->name);
 		struct import_node* next = curr->next;
 		safe_free(curr);
 		curr = next;
 	}
-	imported_libraries = 0;
+	*list = 0;
 }
 
-bool has_already_imported_library(const char* name) {
-	struct import_node* curr = imported_libraries;
+bool has_already_imported_library(struct import_node* list, const char* name) {
+	struct import_node* curr = list;
 	while (curr) {
 		if (streq(curr->name, name)) {
 			return true;
@@ -36,3 +34,36 @@ bool has_already_imported_library(const char* name) {
 	}
 	return false;
 }
+
+struct import_unit* find_import_unit(struct import_unit* units, const char* path) {
+	struct import_unit* curr = units;
+	while (curr) {
+		if (streq(curr->path, path)) {
+			return curr;
+		}
+		curr = curr->next;
+	}
+	return 0;
+}
+
+struct import_unit* add_import_unit(struct import_unit** units, const char* path) {
+	struct import_unit* unit = safe_calloc(1, sizeof(struct import_unit));
+	unit->path = safe_strdup(path);
+	unit->next = *units;
+	*units = unit;
+	return unit;
+}
+
+void free_import_units(struct import_unit** units) {
+	struct import_unit* curr = *units;
+	while (curr) {
+		struct import_unit* next = curr->next;
+		safe_free(curr->path);
+		if (curr->bytecode) {
+			safe_free(curr->bytecode);
+		}
+		safe_free(curr);
+		curr = next;
+	}
+	*units = 0;
+}
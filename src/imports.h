@@ -2,20 +2,42 @@
 #define IMPORTS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // imports.h - Felix Guo
 // Tracks a linked list of imported libraries both during codegen
-//   and VM execution
+//   and VM execution, as well as the cache of source files that were
+//   compiled as their own unit.
 
 struct import_node {
     char* name;
     struct import_node* next;
 };
 
-extern struct import_node* imported_libraries;
+// Lists are owned by whoever is importing, either a compiler context or a VM
 
-void add_imported_library(const char *name);
-void free_imported_libraries_ll(void);
-bool has_already_imported_library(const char *name);
+void add_imported_library(struct import_node** list, const char *name);
+void free_imported_libraries_ll(struct import_node** list);
+bool has_already_imported_library(struct import_node* list, const char *name);
+
+// A source file imported by path, compiled once per process. The bytecode
+//   has no header and its addresses start at 0.
+struct import_unit {
+	char* path;
+	uint8_t* bytecode;
+	size_t size;
+	bool compiling;
+	struct import_unit* next;
+};
+
+// find_import_unit(units, path) returns the cached unit for path, or 0
+struct import_unit* find_import_unit(struct import_unit* units, const char* path);
+
+// add_import_unit(units, path) adds an empty unit for path to the cache
+struct import_unit* add_import_unit(struct import_unit** units, const char* path);
+
+// free_import_units(units) releases every cached unit
+void free_import_units(struct import_unit** units);
 
 #endif
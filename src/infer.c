@@ -0,0 +1,634 @@
+#include "infer.h"
+#include "compiler.h"
+#include "codegen.h"
+#include "operators.h"
+#include "optimizer.h"
+#include "global.h"
+#include <string.h>
+
+// Implementation of Type Inference
+// The environment is a list of bindings, innermost first. Leaving a scope
+//   restores the head, so the bindings below any node never change shape and
+//   a state is just the types from that node down, which is what branches
+//   and loops snapshot and join.
+
+struct type_binding {
+	const char* name;
+	enum static_type type;
+	struct type_binding* next;
+};
+
+struct name_list {
+	const char* name;
+	struct name_list* next;
+};
+
+struct infer_loop {
+	// Bindings that exist for the whole loop, states below cover these
+	struct type_binding* base;
+	size_t count;
+	// Joined states at each continue and break, 0 if there were none
+	enum static_type* at_continue;
+	enum static_type* at_break;
+};
+
+struct infer_state {
+	struct compiler_ctx* ctx;
+	struct type_binding* env;
+	struct infer_loop* loop;
+	// Names assigned inside some function body
+	struct name_list* volatile_names;
+};
+
+static void infer_expr(struct infer_state* state, struct expr* expression);
+static void infer_statement(struct infer_state* state, struct statement* statement);
+static void infer_statement_list(struct infer_state* state, struct statement_list* list);
+
+enum data_type static_data_type(enum static_type type) {
+	switch (type) {
+		case ST_NUMBER: return D_NUMBER;
+		case ST_STRING: return D_STRING;
+		case ST_LIST: return D_LIST;
+		default: return D_EMPTY;
+	}
+}
+
+static const char* static_type_name(enum static_type type) {
+	switch (type) {
+		case ST_NUMBER: return "number";
+		case ST_BOOL: return "bool";
+		case ST_STRING: return "string";
+		case ST_LIST: return "list";
+		default: return "unknown";
+	}
+}
+
+static enum static_type join_type(enum static_type a, enum static_type b) {
+	return a == b ? a : ST_UNKNOWN;
+}
+
+static bool in_name_list(struct name_list* list, const char* name) {
+	for (; list; list = list->next) {
+		if (streq(list->name, name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void add_name(struct compiler_ctx* ctx, struct name_list** list, const char* name) {
+	if (in_name_list(*list, name)) {
+		return;
+	}
+	struct name_list* node = arena_alloc(&ctx->arena, sizeof(struct name_list));
+	node->name = name;
+	node->next = *list;
+	*list = node;
+}
+
+static bool is_identifier(struct expr* expression) {
+	return expression && expression->type == E_LITERAL &&
+		expression->op.lit_expr.type == D_IDENTIFIER;
+}
+
+// Environment
+
+static struct type_binding* lookup(struct infer_state* state, const char* name) {
+	for (struct type_binding* b = state->env; b; b = b->next) {
+		if (streq(b->name, name)) {
+			return b;
+		}
+	}
+	return 0;
+}
+
+static void bind(struct infer_state* state, const char* name, enum static_type type) {
+	struct type_binding* b = arena_alloc(&state->ctx->arena, sizeof(struct type_binding));
+	b->name = name;
+	b->type = in_name_list(state->volatile_names, name) ? ST_UNKNOWN : type;
+	b->next = state->env;
+	state->env = b;
+}
+
+static void assign(struct infer_state* state, const char* name, enum static_type type) {
+	struct type_binding* b = lookup(state, name);
+	if (b) {
+		b->type = in_name_list(state->volatile_names, name) ? ST_UNKNOWN : type;
+	}
+}
+
+// forget_lvalue(state, lvalue) drops what is known about every name the
+//   lvalue writes
+static void forget_lvalue(struct infer_state* state, struct expr* lvalue) {
+	if (is_identifier(lvalue)) {
+		assign(state, lvalue->op.lit_expr.value.string, ST_UNKNOWN);
+	}
+	else if (lvalue && lvalue->type == E_LIST) {
+		for (struct expr_list* l = lvalue->op.list_expr.contents; l; l = l->next) {
+			forget_lvalue(state, l->elem);
+		}
+	}
+}
+
+static void forget_all(struct infer_state* state) {
+	for (struct type_binding* b = state->env; b; b = b->next) {
+		b->type = ST_UNKNOWN;
+	}
+}
+
+// States
+
+static size_t count_bindings(struct type_binding* from) {
+	size_t count = 0;
+	for (; from; from = from->next) {
+		count++;
+	}
+	return count;
+}
+
+static enum static_type* snapshot(struct type_binding* from, size_t count) {
+	enum static_type* types = safe_malloc(sizeof(enum static_type) * (count + 1));
+	for (size_t i = 0; from; from = from->next, i++) {
+		types[i] = from->type;
+	}
+	return types;
+}
+
+static void restore(struct type_binding* from, enum static_type* types) {
+	for (size_t i = 0; from; from = from->next, i++) {
+		from->type = types[i];
+	}
+}
+
+static void free_state(enum static_type** types) {
+	if (*types) {
+		safe_free(*types);
+		*types = 0;
+	}
+}
+
+// join_with(from, types) joins the state in types into the bindings
+static void join_with(struct type_binding* from, enum static_type* types) {
+	for (size_t i = 0; from; from = from->next, i++) {
+		from->type = join_type(from->type, types[i]);
+	}
+}
+
+// join_into(from, types) joins the bindings into the state in types, returns
+//   true if that changed it
+static bool join_into(struct type_binding* from, enum static_type* types) {
+	bool changed = false;
+	for (size_t i = 0; from; from = from->next, i++) {
+		enum static_type joined = join_type(from->type, types[i]);
+		changed |= joined != types[i];
+		types[i] = joined;
+	}
+	return changed;
+}
+
+// Collects the names functions assign before the main pass
+struct collect_state {
+	struct infer_state* state;
+	int function_depth;
+};
+
+static void collect_expr_pre(struct expr* expression, struct traversal_algorithm* algo) {
+	struct collect_state* collect = algo->data;
+	if (expression->type == E_FUNCTION) {
+		collect->function_depth++;
+	}
+	if (!collect->function_depth) {
+		return;
+	}
+	struct expr* lvalue = 0;
+	if (expression->type == E_ASSIGN) {
+		lvalue = expression->op.assign_expr.lvalue;
+	}
+	else if (expression->type == E_BINARY &&
+		expression->op.bin_expr.vm_operator == O_MOD_EQUAL) {
+		lvalue = expression->op.bin_expr.left;
+	}
+	if (is_identifier(lvalue)) {
+		add_name(collect->state->ctx, &collect->state->volatile_names,
+			lvalue->op.lit_expr.value.string);
+	}
+	else if (lvalue && lvalue->type == E_LIST) {
+		for (struct expr_list* l = lvalue->op.list_expr.contents; l; l = l->next) {
+			if (is_identifier(l->elem)) {
+				add_name(collect->state->ctx, &collect->state->volatile_names,
+					l->elem->op.lit_expr.value.string);
+			}
+		}
+	}
+}
+
+static void collect_expr_post(struct expr* expression, struct traversal_algorithm* algo) {
+	struct collect_state* collect = algo->data;
+	if (expression->type == E_FUNCTION) {
+		collect->function_depth--;
+	}
+}
+
+static void collect_statement_pre(struct statement* statement, struct traversal_algorithm* algo) {
+	struct collect_state* collect = algo->data;
+	struct compiler_ctx* ctx = collect->state->ctx;
+	if (collect->function_depth && statement->type == S_OPERATION &&
+		is_identifier(statement->op.operation_statement.operand)) {
+		enum opcode op = statement->op.operation_statement.vm_operator;
+		if (op == OP_INC || op == OP_DEC || op == OP_IN) {
+			add_name(ctx, &collect->state->volatile_names,
+				statement->op.operation_statement.operand->op.lit_expr.value.string);
+		}
+	}
+}
+
+// binary_type(state, expression, op, a, b) returns the type of op applied to
+//   values of type a and b, and marks expression if its opcode can be
+//   specialized
+static enum static_type binary_type(struct infer_state* state,
+		struct expr* expression, enum vm_operator op, enum static_type a,
+		enum static_type b) {
+	expression->operands_typed = false;
+	if (a == ST_UNKNOWN || b == ST_UNKNOWN ||
+		has_binary_overload(state->ctx, static_type_name(a), op, static_type_name(b))) {
+		return ST_UNKNOWN;
+	}
+	expression->operands_typed =
+		specialized_opcode(op, static_data_type(a), static_data_type(b)) != OP_BIN;
+	if (a == ST_NUMBER && b == ST_NUMBER) {
+		switch (op) {
+			case O_ADD: case O_SUB: case O_MUL: case O_DIV: case O_IDIV:
+			case O_REM: case O_POWER:
+				return ST_NUMBER;
+			case O_LT: case O_GT: case O_LTE: case O_GTE: case O_EQ: case O_NEQ:
+				return ST_BOOL;
+			default: break;
+		}
+	}
+	else if (a == ST_STRING && b == ST_STRING) {
+		if (op == O_ADD) return ST_STRING;
+		if (op == O_EQ || op == O_NEQ) return ST_BOOL;
+	}
+	else if (a == ST_BOOL && b == ST_BOOL) {
+		if (op == O_EQ || op == O_NEQ || op == O_AND || op == O_OR) return ST_BOOL;
+	}
+	else if (a == ST_STRING && b == ST_NUMBER && op == O_SUBSCRIPT) {
+		return ST_STRING;
+	}
+	else if (a == ST_LIST && b == ST_LIST && op == O_ADD) {
+		return ST_LIST;
+	}
+	return ST_UNKNOWN;
+}
+
+// Expressions
+
+static void infer_expr_list(struct infer_state* state, struct expr_list* list) {
+	for (; list; list = list->next) {
+		infer_expr(state, list->elem);
+	}
+}
+
+// infer_arguments(state, list) infers call arguments, named arguments only
+//   evaluate their value
+static void infer_arguments(struct infer_state* state, struct expr_list* list) {
+	for (; list; list = list->next) {
+		if (list->elem->type == E_ASSIGN) {
+			infer_expr(state, list->elem->op.assign_expr.rvalue);
+		}
+		else {
+			infer_expr(state, list->elem);
+		}
+	}
+}
+
+static enum static_type literal_type(struct infer_state* state, struct data literal) {
+	switch (literal.type) {
+		case D_NUMBER: return ST_NUMBER;
+		case D_STRING: return ST_STRING;
+		case D_TRUE: case D_FALSE: return ST_BOOL;
+		case D_IDENTIFIER: {
+			struct type_binding* b = lookup(state, literal.value.string);
+			return b ? b->type : ST_UNKNOWN;
+		}
+		default: return ST_UNKNOWN;
+	}
+}
+
+static enum static_type infer_binary(struct infer_state* state, struct expr* expression) {
+	enum vm_operator op = expression->op.bin_expr.vm_operator;
+	struct expr* left = expression->op.bin_expr.left;
+	struct expr* right = expression->op.bin_expr.right;
+	if (op == O_MOD_EQUAL) {
+		infer_expr(state, right);
+		infer_expr(state, left);
+		forget_lvalue(state, left);
+		return ST_UNKNOWN;
+	}
+	if (op == O_MEMBER) {
+		infer_expr(state, left);
+		if ((left->static_type == ST_LIST || left->static_type == ST_STRING) &&
+			right->type == E_LITERAL &&
+			right->op.lit_expr.type == D_MEMBER_IDENTIFIER &&
+			streq(right->op.lit_expr.value.string, "size")) {
+			return ST_NUMBER;
+		}
+		return ST_UNKNOWN;
+	}
+	if (op == O_AND || op == O_OR) {
+		// The right side might not run
+		infer_expr(state, left);
+		size_t count = count_bindings(state->env);
+		enum static_type* before = snapshot(state->env, count);
+		infer_expr(state, right);
+		join_with(state->env, before);
+		safe_free(before);
+		enum static_type result = binary_type(state, expression, op, ST_BOOL,
+			right->static_type);
+		// Short circuiting keeps the generic opcode
+		expression->operands_typed = false;
+		return result;
+	}
+	// Same order as codegen
+	infer_expr(state, right);
+	infer_expr(state, left);
+	return binary_type(state, expression, op, left->static_type, right->static_type);
+}
+
+static enum static_type infer_assign(struct infer_state* state, struct expr* expression) {
+	enum vm_operator op = expression->op.assign_expr.vm_operator;
+	struct expr* lvalue = expression->op.assign_expr.lvalue;
+	struct expr* rvalue = expression->op.assign_expr.rvalue;
+	infer_expr(state, rvalue);
+	enum static_type result = rvalue->static_type;
+	expression->operands_typed = false;
+	if (op != O_ASSIGN) {
+		infer_expr(state, lvalue);
+		result = binary_type(state, expression, op, lvalue->static_type,
+			rvalue->static_type);
+	}
+	if (is_identifier(lvalue)) {
+		assign(state, lvalue->op.lit_expr.value.string, result);
+	}
+	else {
+		forget_lvalue(state, lvalue);
+	}
+	return ST_UNKNOWN;
+}
+
+static void infer_expr(struct infer_state* state, struct expr* expression) {
+	if (!expression) return;
+	enum static_type type = ST_UNKNOWN;
+	switch (expression->type) {
+		case E_LITERAL: {
+			type = literal_type(state, expression->op.lit_expr);
+			break;
+		}
+		case E_BINARY: {
+			type = infer_binary(state, expression);
+			break;
+		}
+		case E_ASSIGN: {
+			type = infer_assign(state, expression);
+			break;
+		}
+		case E_UNARY: {
+			enum vm_operator op = expression->op.una_expr.vm_operator;
+			infer_expr(state, expression->op.una_expr.operand);
+			enum static_type operand = expression->op.una_expr.operand->static_type;
+			if (((op == O_NEG && operand == ST_NUMBER) ||
+				(op == O_NOT && operand == ST_BOOL)) &&
+				!has_unary_overload(state->ctx, op, static_type_name(operand))) {
+				type = operand;
+			}
+			break;
+		}
+		case E_IF: {
+			infer_expr(state, expression->op.if_expr.condition);
+			size_t count = count_bindings(state->env);
+			enum static_type* before = snapshot(state->env, count);
+			infer_expr(state, expression->op.if_expr.expr_true);
+			enum static_type* after_true = snapshot(state->env, count);
+			restore(state->env, before);
+			infer_expr(state, expression->op.if_expr.expr_false);
+			join_with(state->env, after_true);
+			safe_free(before);
+			safe_free(after_true);
+			// A missing false branch gives none
+			if (expression->op.if_expr.expr_false) {
+				type = join_type(expression->op.if_expr.expr_true->static_type,
+					expression->op.if_expr.expr_false->static_type);
+			}
+			break;
+		}
+		case E_CALL: {
+			infer_arguments(state, expression->op.call_expr.arguments);
+			infer_expr(state, expression->op.call_expr.function);
+			break;
+		}
+		case E_SUPER_CALL: {
+			infer_arguments(state, expression->op.super_call_expr.arguments);
+			break;
+		}
+		case E_LIST: {
+			infer_expr_list(state, expression->op.list_expr.contents);
+			type = ST_LIST;
+			break;
+		}
+		case E_TABLE: {
+			infer_expr_list(state, expression->op.table_expr.keys);
+			infer_expr_list(state, expression->op.table_expr.values);
+			break;
+		}
+		case E_FUNCTION: {
+			// Bodies run later with their own frame, nothing outside is known
+			struct type_binding* saved_env = state->env;
+			struct infer_loop* saved_loop = state->loop;
+			state->env = 0;
+			state->loop = 0;
+			infer_statement(state, expression->op.func_expr.body);
+			state->env = saved_env;
+			state->loop = saved_loop;
+			break;
+		}
+	}
+	expression->static_type = type;
+}
+
+// Statements
+
+// join_loop_state(state, types) joins the current state into the loop state
+//   in types, allocating it on first use
+static void join_loop_state(struct infer_state* state, enum static_type** types) {
+	struct infer_loop* loop = state->loop;
+	if (!*types) {
+		*types = snapshot(loop->base, loop->count);
+	}
+	else {
+		join_into(loop->base, *types);
+	}
+}
+
+static void infer_loop(struct infer_state* state, struct statement* statement) {
+	struct type_binding* saved_env = state->env;
+	struct infer_loop* saved_loop = state->loop;
+	bool is_iterating_loop = statement->op.loop_statement.index_var;
+	if (is_iterating_loop) {
+		// The container is evaluated once, each element is unknown
+		infer_expr(state, statement->op.loop_statement.condition);
+		bind(state, statement->op.loop_statement.index_var, ST_UNKNOWN);
+	}
+
+	struct infer_loop loop;
+	loop.base = state->env;
+	loop.count = count_bindings(loop.base);
+	loop.at_continue = 0;
+	loop.at_break = 0;
+	state->loop = &loop;
+
+	// Run the body until the state at the top of the loop stops changing, the
+	//   annotations of the last run are the ones that hold
+	enum static_type* head = snapshot(loop.base, loop.count);
+	enum static_type* exit = 0;
+	bool changed = true;
+	while (changed) {
+		restore(loop.base, head);
+		if (!is_iterating_loop) {
+			infer_expr(state, statement->op.loop_statement.condition);
+		}
+		free_state(&exit);
+		free_state(&loop.at_continue);
+		free_state(&loop.at_break);
+		exit = snapshot(loop.base, loop.count);
+
+		infer_statement(state, statement->op.loop_statement.statement_true);
+		state->env = loop.base;
+		if (loop.at_continue) {
+			join_with(loop.base, loop.at_continue);
+		}
+		changed = join_into(loop.base, head);
+	}
+
+	restore(loop.base, exit);
+	if (loop.at_break) {
+		join_with(loop.base, loop.at_break);
+	}
+	free_state(&head);
+	free_state(&exit);
+	free_state(&loop.at_continue);
+	free_state(&loop.at_break);
+	state->loop = saved_loop;
+	state->env = saved_env;
+}
+
+static void infer_statement(struct infer_state* state, struct statement* statement) {
+	if (!statement) return;
+	switch (statement->type) {
+		case S_EXPR: {
+			infer_expr(state, statement->op.expr_statement);
+			break;
+		}
+		case S_LET: {
+			infer_expr(state, statement->op.let_statement.rvalue);
+			enum static_type type = statement->op.let_statement.rvalue ?
+				statement->op.let_statement.rvalue->static_type : ST_UNKNOWN;
+			bind(state, statement->op.let_statement.lvalue, type);
+			break;
+		}
+		case S_OPERATION: {
+			enum opcode op = statement->op.operation_statement.vm_operator;
+			struct expr* operand = statement->op.operation_statement.operand;
+			if (op == OP_RET || op == OP_OUTL) {
+				infer_expr(state, operand);
+			}
+			else if (op == OP_IN) {
+				forget_lvalue(state, operand);
+			}
+			else if (is_identifier(operand)) {
+				// INC and DEC keep a number or stop with an error
+				struct type_binding* b = lookup(state, operand->op.lit_expr.value.string);
+				if (b && b->type != ST_NUMBER) {
+					b->type = ST_UNKNOWN;
+				}
+			}
+			break;
+		}
+		case S_STRUCT: {
+			infer_expr(state, statement->op.struct_statement.parent_struct);
+			// Static members are written into the struct, not the scope
+			for (struct expr_list* l = statement->op.struct_statement.static_members;
+				l; l = l->next) {
+				if (l->elem->type == E_ASSIGN) {
+					infer_expr(state, l->elem->op.assign_expr.rvalue);
+				}
+			}
+			infer_expr(state, statement->op.struct_statement.init_fn);
+			bind(state, statement->op.struct_statement.name, ST_UNKNOWN);
+			break;
+		}
+		case S_ENUM: {
+			infer_expr(state, statement->op.enum_statement.init_fn);
+			bind(state, statement->op.enum_statement.name, ST_UNKNOWN);
+			break;
+		}
+		case S_IF: {
+			infer_expr(state, statement->op.if_statement.condition);
+			struct type_binding* saved_env = state->env;
+			size_t count = count_bindings(state->env);
+			enum static_type* before = snapshot(state->env, count);
+			infer_statement(state, statement->op.if_statement.statement_true);
+			state->env = saved_env;
+			enum static_type* after_true = snapshot(state->env, count);
+			restore(state->env, before);
+			infer_statement(state, statement->op.if_statement.statement_false);
+			state->env = saved_env;
+			join_with(state->env, after_true);
+			safe_free(before);
+			safe_free(after_true);
+			break;
+		}
+		case S_BLOCK: {
+			struct type_binding* saved_env = state->env;
+			infer_statement_list(state, statement->op.block_statement);
+			state->env = saved_env;
+			break;
+		}
+		case S_LOOP: {
+			infer_loop(state, statement);
+			break;
+		}
+		case S_BREAK: {
+			if (state->loop) {
+				join_loop_state(state, &state->loop->at_break);
+			}
+			break;
+		}
+		case S_CONTINUE: {
+			if (state->loop) {
+				join_loop_state(state, &state->loop->at_continue);
+			}
+			break;
+		}
+		case S_IMPORT:
+		case S_BYTECODE: {
+			forget_all(state);
+			break;
+		}
+	}
+}
+
+static void infer_statement_list(struct infer_state* state, struct statement_list* list) {
+	for (; list; list = list->next) {
+		infer_statement(state, list->elem);
+	}
+}
+
+void infer_types(struct compiler_ctx* ctx, struct statement_list* ast) {
+	struct infer_state state = { ctx, 0, 0, 0 };
+	struct collect_state collect = { &state, 0 };
+	struct traversal_algorithm algo = TRAVERSAL_ALGO(collect_expr_pre, 0,
+		collect_statement_pre, 0, collect_expr_post, 0, 0, 0);
+	algo.data = &collect;
+	traverse_ast(ast, &algo);
+	infer_statement_list(&state, ast);
+}
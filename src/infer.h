@@ -0,0 +1,27 @@
+#ifndef INFER_H
+#define INFER_H
+
+#include "ast.h"
+#include "data.h"
+
+// infer.h - Felix Guo
+// Flow sensitive type inference over a single unit. Tracks the types of local
+//   bindings through assignments, branches and loops, and marks the binary
+//   operations whose operands are proven to be numbers, strings or a list and
+//   an index, so codegen can emit the specialized opcodes directly instead of
+//   waiting for the VM to quicken the site.
+// Anything the pass can't see is unknown: names assigned inside a function
+//   (calls may change them at any time), imports, inline bytecode, and shapes
+//   the unit or its imports overload. The VM still checks the operands of a
+//   specialized opcode, so an overload it couldn't see, like one from an
+//   earlier REPL line, only costs the fast path.
+
+// infer_types(ctx, ast) annotates the expressions of ast with their static
+//   types, using the overloads optimize_ast collected into ctx
+void infer_types(struct compiler_ctx* ctx, struct statement_list* ast);
+
+// static_data_type(type) returns the data type every value of static type has,
+//   or D_EMPTY if there isn't a single one
+enum data_type static_data_type(enum static_type type);
+
+#endif
@@ -12,8 +12,19 @@
 #include "data.h"
 #include "dependencies.h"
 #include "imports.h"
+#include "compiler.h"
+#include "build.h"
+#include "profile.h"
+#include "vm_stats.h"
+#include "mem_stats.h"
+#include "alloc_profile.h"
+#include "heap_snapshot.h"
+#include "vm_trace.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
 
 #ifdef _WIN32
 char* readline(char* prompt) {
@@ -51,10 +62,20 @@ void invalid_usage(void) {
 	printf("Options:\n");
 	printf("    -h, --help        : shows this message.\n");
 	printf("    --nogc            : disables garbage-collection.\n");
-	printf("    --optimize        : enables optimization algorithm (this will destroy overloaded primitive operators).\n");
+	printf("    --optimize        : enables optimization algorithm (the default).\n");
+	printf("    --no-optimize     : disables optimization algorithm.\n");
 	printf("    --trace-vm        : traces each VM instruction.\n");
 	printf("    --trace-refcnt    : traces each ref-count action.\n");
     printf("    --dry-run         : compiles but does not write to a file or invoke the VM.\n");
+	printf("    --profile <file>  : prints the time spent in each function to stderr on exit, and writes it to file as folded stacks for flame graphs.\n");
+	printf("    --vm-stats <file> : prints the most frequent opcodes, opcode pairs and operand types to stderr on exit, and writes all of them to file as JSON.\n");
+	printf("    --mem-stats <file>: prints container, table and allocator counts to stderr on exit, and writes them to file as JSON.\n");
+	printf("    --alloc-profile <file>: prints the C call sites and Wendy lines that allocate the most to stderr on exit, and writes all of them to file as JSON.\n");
+	printf("    --alloc-sample <n>: records one in every n allocations for --alloc-profile, defaults to 1, or %d in release builds.\n", ALLOC_PROFILE_DEFAULT_INTERVAL);
+	printf("    --trace-ring <file>: records each VM instruction into a binary ring buffer in file, read it with bin/trace-decode.\n");
+	printf("    --trace-size <n>  : number of instructions --trace-ring keeps, defaults to %d.\n", VM_TRACE_DEFAULT_CAPACITY);
+	printf("    --trace-time      : adds a timestamp to each --trace-ring record.\n");
+	printf("    --stats           : prints instructions run, allocations and peak memory as JSON to stderr on exit.\n");
 	printf("    -c, --compile     : compiles the given file but does not run.\n");
 	printf("    -v, --verbose     : displays information about memory state on error.\n");
 	printf("    --ast             : prints out the constructed AST.\n");
@@ -62,10 +83,47 @@ void invalid_usage(void) {
 	printf("    -d --disassemble  : prints out the disassembled bytecode.\n");
 	printf("    --dependencies    : prints out the module dependencies of the file.\n");
 	printf("    --sandbox         : runs the VM in sandboxed mode, ie. no file access and no native execution calls.\n");
+	printf("    --max-instructions <n>: stops the program with an error after n instructions.\n");
+	printf("    --max-time <s>    : stops the program with an error after s seconds.\n");
+	printf("    --max-cpu <s>     : stops the program with an error after s seconds of CPU time.\n");
+	printf("    --max-heap <bytes>: stops the program with an error when its lists, structs and closures take more than bytes, or a string it builds doesn't fit in what's left, which takes a K, M or G suffix. Strings the program holds aren't counted.\n");
+	printf("    --max-depth <n>   : stops the program with an error when a call is made with n calls on the call stack, counting the top level.\n");
+	printf("    --build <dir>     : compiles every source file in dir, rebuilding only what changed.\n");
+	printf("    -j <jobs>         : number of modules --build compiles at once, defaults to the number of processors.\n");
 	printf("\nWendy will enter REPL mode if no parameters are supplied.\n");
 	safe_exit(1);
 }
 
+// print_stats(vm) writes what running the program cost to stderr as one line
+//   of JSON, read by the benchmark harness
+static void print_stats(struct vm* vm) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(stderr, "{\"instructions\": %zu, \"allocations\": %zu, "
+		"\"peak_rss_kb\": %ld}\n", vm->instructions_run, allocation_count(),
+		usage.ru_maxrss);
+}
+
+// Set by --build and -j
+static char* build_dir = NULL;
+static int build_jobs = 0;
+// Set by --profile, --vm-stats, --mem-stats, --alloc-profile, --alloc-sample,
+//   --trace-ring, --trace-size and --trace-time
+static char* profile_path = NULL;
+static char* vm_stats_path = NULL;
+static char* mem_stats_path = NULL;
+static char* alloc_profile_path = NULL;
+static int alloc_sample_interval = ALLOC_PROFILE_DEFAULT_INTERVAL;
+static char* trace_path = NULL;
+static long trace_size = VM_TRACE_DEFAULT_CAPACITY;
+static bool trace_time = false;
+// Set by --max-instructions, --max-time, --max-cpu, --max-heap and --max-depth
+static struct vm_limits limits;
+// Set by every other option, compiler contexts and the VM take a copy
+static struct settings settings;
+// The program being run, errors are reported against it
+static struct source_table sources;
+
 // The first non-valid option is typically the file name / source string.
 // The other non-valid options are the arguments.
 // Returns true if user prompted for help.
@@ -74,45 +132,99 @@ bool process_options(char** options, int len, char** source) {
 	bool has_encountered_invalid = false;
 	*source = NULL;
 	for (i = 0; i < len; i++) {
+		if (i + 1 < len && vm_limits_option(&limits, options[i], options[i + 1])) {
+			i++;
+			continue;
+		}
+		if (streq("--build", options[i]) || streq("-j", options[i]) ||
+			streq("--profile", options[i]) || streq("--vm-stats", options[i]) ||
+			streq("--mem-stats", options[i]) || streq("--alloc-profile", options[i]) ||
+			streq("--alloc-sample", options[i]) || streq("--trace-ring", options[i]) ||
+			streq("--trace-size", options[i])) {
+			if (i + 1 == len) {
+				return true;
+			}
+			if (streq("--build", options[i])) {
+				build_dir = options[++i];
+			}
+			else if (streq("--profile", options[i])) {
+				settings.flags[SETTINGS_PROFILE] = true;
+				profile_path = options[++i];
+			}
+			else if (streq("--vm-stats", options[i])) {
+				settings.flags[SETTINGS_VM_STATS] = true;
+				vm_stats_path = options[++i];
+			}
+			else if (streq("--mem-stats", options[i])) {
+				settings.flags[SETTINGS_MEM_STATS] = true;
+				mem_stats_path = options[++i];
+			}
+			else if (streq("--alloc-profile", options[i])) {
+				settings.flags[SETTINGS_ALLOC_PROFILE] = true;
+				alloc_profile_path = options[++i];
+			}
+			else if (streq("--alloc-sample", options[i])) {
+				alloc_sample_interval = atoi(options[++i]);
+			}
+			else if (streq("--trace-ring", options[i])) {
+				trace_path = options[++i];
+			}
+			else if (streq("--trace-size", options[i])) {
+				trace_size = atol(options[++i]);
+			}
+			else {
+				build_jobs = atoi(options[++i]);
+			}
+			continue;
+		}
 		if (streq("-c", options[i]) ||
 			streq("--compile", options[i])) {
-			set_settings_flag(SETTINGS_COMPILE);
+			settings.flags[SETTINGS_COMPILE] = true;
 		}
 		else if (streq("-v", options[i]) ||
 			streq("--verbose", options[i])) {
-			set_settings_flag(SETTINGS_VERBOSE);
+			settings.flags[SETTINGS_VERBOSE] = true;
 		}
 		else if (streq("--nogc", options[i])) {
-			set_settings_flag(SETTINGS_NOGC);
+			settings.flags[SETTINGS_NOGC] = true;
 		}
 		else if (streq("--optimize", options[i])) {
-			set_settings_flag(SETTINGS_OPTIMIZE);
+			settings.flags[SETTINGS_OPTIMIZE] = true;
+		}
+		else if (streq("--no-optimize", options[i])) {
+			settings.flags[SETTINGS_OPTIMIZE] = false;
 		}
 		else if (streq("--trace-vm", options[i])) {
-			set_settings_flag(SETTINGS_TRACE_VM);
+			settings.flags[SETTINGS_TRACE_VM] = true;
 		}
 		else if (streq("--trace-refcnt", options[i])) {
-			set_settings_flag(SETTINGS_TRACE_REFCNT);
+			settings.flags[SETTINGS_TRACE_REFCNT] = true;
 		}
         else if (streq("--dry-run", options[i])) {
-            set_settings_flag(SETTINGS_DRY_RUN);
+            settings.flags[SETTINGS_DRY_RUN] = true;
         }
+		else if (streq("--trace-time", options[i])) {
+			trace_time = true;
+		}
+		else if (streq("--stats", options[i])) {
+			settings.flags[SETTINGS_STATS] = true;
+		}
 		else if (streq("--ast", options[i])) {
-			set_settings_flag(SETTINGS_ASTPRINT);
+			settings.flags[SETTINGS_ASTPRINT] = true;
 		}
 		else if (streq("--dependencies", options[i])) {
-			set_settings_flag(SETTINGS_OUTPUT_DEPENDENCIES);
+			settings.flags[SETTINGS_OUTPUT_DEPENDENCIES] = true;
 		}
 		else if (streq("--sandbox", options[i])) {
-			set_settings_flag(SETTINGS_SANDBOXED);
+			settings.flags[SETTINGS_SANDBOXED] = true;
 		}
 		else if (streq("-t", options[i]) ||
 				 streq("--token-list", options[i])) {
-			set_settings_flag(SETTINGS_TOKEN_LIST_PRINT);
+			settings.flags[SETTINGS_TOKEN_LIST_PRINT] = true;
 		}
 		else if (streq("-d", options[i]) ||
 				 streq("--disassemble", options[i])) {
-			set_settings_flag(SETTINGS_DISASSEMBLE);
+			settings.flags[SETTINGS_DISASSEMBLE] = true;
 		}
 		else if (streq("-h", options[i]) ||
 				 streq("--help", options[i])) {
@@ -137,33 +249,41 @@ void run(char* input_string, struct vm * vm) {
 	size_t alloc_size = 0;
 	struct token* tokens;
 	size_t tokens_count;
-	reset_error_flag();
-	tokens_count = scan_tokens(input_string, &tokens, &alloc_size);
-	if (get_settings_flag(SETTINGS_TOKEN_LIST_PRINT)) {
+	struct compiler_ctx ctx;
+	compiler_ctx_init(&ctx, &settings, &sources);
+	tokens_count = scan_tokens(&ctx, input_string, &tokens, &alloc_size);
+	if (settings.flags[SETTINGS_TOKEN_LIST_PRINT]) {
 		print_token_list(tokens, tokens_count);
 	}
 
-	struct statement_list* ast = generate_ast(tokens, tokens_count);
-	if (get_settings_flag(SETTINGS_OPTIMIZE)) {
-		ast = optimize_ast(ast);
+	struct statement_list* ast = generate_ast(&ctx, tokens, tokens_count);
+	// Each REPL line is compiled on its own, and can't see the bindings or
+	//   overloads of the lines before it
+	if (settings.flags[SETTINGS_OPTIMIZE] &&
+		!settings.flags[SETTINGS_REPL]) {
+		ast = optimize_ast(&ctx, ast);
 	}
-	if (get_settings_flag(SETTINGS_ASTPRINT)) {
+	if (settings.flags[SETTINGS_ASTPRINT]) {
 		print_ast(ast);
 	}
-	if(!ast_error_flag()) {
+	if(!ast_error_flag(&ctx)) {
 		size_t size;
-		uint8_t* bytecode = generate_code(ast, &size, !get_settings_flag(SETTINGS_REPL));
-		if (get_settings_flag(SETTINGS_DISASSEMBLE)) {
-			print_bytecode(bytecode, size, stdout);
+		uint8_t* bytecode = generate_code(&ctx, ast, &size, !settings.flags[SETTINGS_REPL]);
+		if (settings.flags[SETTINGS_OPTIMIZE] &&
+			!settings.flags[SETTINGS_REPL]) {
+			// Later REPL input could refer to anything, so only whole programs.
+			size = optimize_bytecode(bytecode, size);
 		}
-		if (!get_error_flag()) {
-			vm_set_instruction_pointer(vm, vm_load_code(vm, bytecode, size, get_settings_flag(SETTINGS_REPL)));
+		if (settings.flags[SETTINGS_DISASSEMBLE]) {
+			print_bytecode(bytecode, size, settings.flags[SETTINGS_REPL], &sources, stdout);
+		}
+		if (!ctx.error_flag) {
+			vm_set_instruction_pointer(vm, vm_load_code(vm, bytecode, size, settings.flags[SETTINGS_REPL]));
 			vm_run(vm);
 		}
 		safe_free(bytecode);
 	}
-	free_ast(ast);
-	free_token_list(tokens, tokens_count);
+	compiler_ctx_destroy(&ctx);
 }
 
 bool bracket_check(char* source) {
@@ -197,7 +317,7 @@ bool bracket_check(char* source) {
 }
 
 int repl(struct vm* vm) {
-	init_source(0, "", 0, false);
+	init_source(&sources, 0, "", 0, false);
 	printf("Welcome to " WENDY_VERSION " created by: Felix Guo\n");
 	printf(BUILD_VERSION " (" GIT_COMMIT ")\n");
 	printf("Run `wendy --help` to get help.\n");
@@ -208,8 +328,6 @@ int repl(struct vm* vm) {
 	safe_free(path);
 	char* input_buffer;
 	char* source_to_run = safe_malloc(1 * sizeof(char));
-	// ENTER REPL MODE
-	set_settings_flag(SETTINGS_REPL);
 	push_frame(vm->memory, "main", 0, 0);
 	bool has_run = false;
 	forever {
@@ -242,7 +360,6 @@ int repl(struct vm* vm) {
 	}
 
 cleanup:
-	free_imported_libraries_ll();
 	safe_free(source_to_run);
 	if (has_run) {
 		vm_cleanup_if_repl(vm);
@@ -253,16 +370,41 @@ cleanup:
 
 int main(int argc, char** argv) {
 	determine_endianness();
-	struct vm* vm = vm_init();
+	settings = get_default_settings();
 	char *option_result;
 	if (process_options(&argv[1], argc - 1, &option_result)) {
 		// User asked for -h / --help
 		invalid_usage();
 	}
+	// Settings are final from here on, the VM takes a copy of them
+	if (build_dir) {
+		settings.flags[SETTINGS_COMPILE] = true;
+		if (build_jobs <= 0) {
+			build_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		}
+		bool success = build_directory(build_dir, build_jobs, &settings);
+		check_leak();
+		return success ? 0 : 1;
+	}
 	if (!option_result) {
+		// ENTER REPL MODE
+		settings.flags[SETTINGS_REPL] = true;
+		struct vm* vm = vm_init(&settings, &sources);
+		vm_set_limits(vm, &limits);
 		return repl(vm);
 	}
-	set_settings_flag(SETTINGS_STRICT_ERROR);
+	settings.flags[SETTINGS_STRICT_ERROR] = true;
+	heap_snapshot_install_signal();
+	init_source(&sources, 0, "", 0, false);
+	struct vm* vm = vm_init(&settings, &sources);
+	vm_set_limits(vm, &limits);
+	if (settings.flags[SETTINGS_ALLOC_PROFILE]) {
+		vm->alloc_profiler = alloc_profiler_create(vm,
+			alloc_sample_interval > 0 ? alloc_sample_interval : 1);
+	}
+	if (trace_path) {
+		vm->trace = vm_trace_create(trace_path, trace_size > 0 ? trace_size : 1, trace_time);
+	}
 	// FILE READ MODE
 	long length = 0;
 	int file_name_length = strlen(option_result);
@@ -291,42 +433,44 @@ int main(int argc, char** argv) {
 	uint8_t* bytecode_stream;
 	size_t size;
 	if (!is_compiled) {
-		init_source(file, option_result, length, true);
+		init_source(&sources, file, option_result, length, true);
 		// Text Source
-		char* buffer = get_source_buffer();
+		char* buffer = get_source_buffer(&sources);
 		// Begin Processing the File
 		size_t alloc_size = 0;
 		struct token* tokens;
 		size_t tokens_count;
+		struct compiler_ctx ctx;
+		compiler_ctx_init(&ctx, &settings, &sources);
 
 		// Scanning and Tokenizing
-		tokens_count = scan_tokens(buffer, &tokens, &alloc_size);
-		if (get_settings_flag(SETTINGS_TOKEN_LIST_PRINT)) {
+		tokens_count = scan_tokens(&ctx, buffer, &tokens, &alloc_size);
+		if (settings.flags[SETTINGS_TOKEN_LIST_PRINT]) {
 			print_token_list(tokens, tokens_count);
 		}
 
 		// Build AST
-		struct statement_list* ast = generate_ast(tokens, tokens_count);
-		if (get_settings_flag(SETTINGS_OPTIMIZE)) {
-			ast = optimize_ast(ast);
+		struct statement_list* ast = generate_ast(&ctx, tokens, tokens_count);
+		if (settings.flags[SETTINGS_OPTIMIZE]) {
+			// Compiled output is a library to others, its bindings are kept
+			ast = settings.flags[SETTINGS_COMPILE] ?
+				optimize_unit_ast(&ctx, ast) : optimize_ast(&ctx, ast);
 		}
-		if (get_settings_flag(SETTINGS_ASTPRINT)) {
+		if (settings.flags[SETTINGS_ASTPRINT]) {
 			print_ast(ast);
 		}
 
-		if (get_settings_flag(SETTINGS_OUTPUT_DEPENDENCIES)) {
+		if (settings.flags[SETTINGS_OUTPUT_DEPENDENCIES]) {
 			// Perform static analysis to output dependencies
 			print_dependencies(ast);
-			free_token_list(tokens, tokens_count);
-			free_ast(ast);
+			compiler_ctx_destroy(&ctx);
 			goto wendy_exit;
 		}
 		else {
 			// Generate Bytecode
-			bytecode_stream = generate_code(ast, &size, !get_settings_flag(SETTINGS_REPL));
+			bytecode_stream = generate_code(&ctx, ast, &size, !settings.flags[SETTINGS_REPL]);
 		}
-		free_token_list(tokens, tokens_count);
-		free_ast(ast);
+		compiler_ctx_destroy(&ctx);
 	}
 	else {
 		// Compiled Source
@@ -342,11 +486,11 @@ int main(int argc, char** argv) {
 			fseek(source_file, 0, SEEK_END);
 			long length = ftell(source_file);
 			fseek (source_file, 0, SEEK_SET);
-			init_source(source_file, search_name, length, false);
+			init_source(&sources, source_file, search_name, length, false);
 			fclose(source_file);
 		}
 		else {
-			init_source(0, "", 0, false);
+			init_source(&sources, 0, "", 0, false);
 		}
 		safe_free(search_name);
 		bytecode_stream = safe_malloc(sizeof(uint8_t) * length);
@@ -354,10 +498,16 @@ int main(int argc, char** argv) {
 		fread(bytecode_stream, sizeof(uint8_t), length, file);
 	}
 	fclose(file);
-	if (get_settings_flag(SETTINGS_DISASSEMBLE)) {
-		print_bytecode(bytecode_stream, length, stdout);
+	if (settings.flags[SETTINGS_OPTIMIZE] &&
+		!settings.flags[SETTINGS_COMPILE]) {
+		// Compiled output is a library to others, everything in it is kept.
+		size = optimize_bytecode(bytecode_stream, size);
+	}
+	if (settings.flags[SETTINGS_DISASSEMBLE]) {
+		print_bytecode(bytecode_stream, length, settings.flags[SETTINGS_REPL],
+			&sources, stdout);
 	}
-	if (get_settings_flag(SETTINGS_COMPILE)) {
+	if (settings.flags[SETTINGS_COMPILE]) {
 		if (is_compiled) {
 			printf("Compile flag set, but input file was already compiled.\n");
 		}
@@ -370,7 +520,7 @@ int main(int argc, char** argv) {
 
 			FILE* compile_file = fopen(compile_path, "w");
 			if (compile_file) {
-				write_bytecode(bytecode_stream, compile_file);
+				write_bytecode(bytecode_stream, size, compile_file);
 				printf("Successfully compiled into %s.\n", compile_path);
 			}
 			else {
@@ -382,8 +532,16 @@ int main(int argc, char** argv) {
 	else {
 		push_frame(vm->memory, "main", 0, 0);
 		
-		vm_set_instruction_pointer(vm, vm_load_code(vm, bytecode_stream, size, get_settings_flag(SETTINGS_REPL)));
+		vm_set_instruction_pointer(vm, vm_load_code(vm, bytecode_stream, size, settings.flags[SETTINGS_REPL]));
+		if (vm->trace) {
+			// Written up front so a run that crashes still decodes
+			vm_trace_write_code(vm->trace, vm->bytecode, vm->bytecode_size, &sources);
+		}
 		vm_run(vm);
+		if (vm->trace) {
+			// Again for the code imports added, the bytecode is freed below
+			vm_trace_finish(vm->trace, vm->bytecode, vm->bytecode_size, &sources);
+		}
 
 		if (!last_printed_newline) {
 			printf("\n");
@@ -392,8 +550,51 @@ int main(int argc, char** argv) {
 	safe_free(bytecode_stream);
 
 wendy_exit:
-	free_imported_libraries_ll();
-	free_source();
+	if (settings.flags[SETTINGS_STATS]) {
+		print_stats(vm);
+	}
+	if (vm->profiler) {
+		FILE* folded = fopen(profile_path, "w");
+		if (!folded) {
+			fprintf(stderr, "Error opening %s to write the profile.\n", profile_path);
+		}
+		profiler_report(vm->profiler, stderr, folded);
+		if (folded) {
+			fclose(folded);
+		}
+	}
+	if (vm->stats) {
+		FILE* json = fopen(vm_stats_path, "w");
+		if (!json) {
+			fprintf(stderr, "Error opening %s to write the VM stats.\n", vm_stats_path);
+		}
+		vm_stats_report(vm->stats, stderr, json);
+		if (json) {
+			fclose(json);
+		}
+	}
+	if (vm->alloc_profiler) {
+		FILE* json = fopen(alloc_profile_path, "w");
+		if (!json) {
+			fprintf(stderr, "Error opening %s to write the allocation profile.\n",
+				alloc_profile_path);
+		}
+		alloc_profiler_report(vm->alloc_profiler, stderr, json);
+		if (json) {
+			fclose(json);
+		}
+	}
+	if (settings.flags[SETTINGS_MEM_STATS]) {
+		FILE* json = fopen(mem_stats_path, "w");
+		if (!json) {
+			fprintf(stderr, "Error opening %s to write the memory stats.\n", mem_stats_path);
+		}
+		mem_stats_report(vm->memory, stderr, json);
+		if (json) {
+			fclose(json);
+		}
+	}
+	free_source(&sources);
 	vm_destroy(vm);
 	check_leak();
 	return 0;
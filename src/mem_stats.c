@@ -0,0 +1,245 @@
+#include "mem_stats.h"
+#include "memory.h"
+#include "global.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Containers found but not yet looked into while marking
+struct mark_list {
+	struct refcnt_container** containers;
+	size_t size;
+	size_t capacity;
+};
+
+enum data_type container_type(const struct data* values, size_t count) {
+	if (count == 0) {
+		return D_EMPTY;
+	}
+	switch (values[0].type) {
+		// Closures are stored as lists too
+		case D_LIST_HEADER: return D_LIST;
+		case D_TABLE_INTERNAL_POINTER: return D_TABLE;
+		case D_INSTRUCTION_ADDRESS: return D_FUNCTION;
+		case D_STRUCT_HEADER: return D_STRUCT;
+		case D_STRUCT_INSTANCE_HEADER: return D_STRUCT_INSTANCE;
+		default: return D_EMPTY;
+	}
+}
+
+static size_t container_bytes(struct refcnt_container* container) {
+	return sizeof(struct refcnt_container) + container->count * sizeof(struct data);
+}
+
+static void mark_table(struct table* table, struct mark_list* list);
+
+static void mark_data(struct data* data, struct mark_list* list) {
+	if (data->type == D_TABLE_INTERNAL_POINTER) {
+		mark_table((struct table*) data->value.reference, list);
+		return;
+	}
+	if (!is_reference(*data)) {
+		return;
+	}
+	struct refcnt_container* container =
+		(struct refcnt_container*) data->value.reference - 1;
+	if (container->touched) {
+		return;
+	}
+	container->touched = true;
+	if (list->size == list->capacity) {
+		list->capacity *= 2;
+		list->containers = safe_realloc(list->containers,
+			sizeof(struct refcnt_container*) * list->capacity);
+	}
+	list->containers[list->size++] = container;
+}
+
+static void mark_table(struct table* table, struct mark_list* list) {
+	for (size_t i = 0; i < table->bucket_count; i++) {
+		for (struct entry* entry = table->buckets[i]; entry; entry = entry->next) {
+			mark_data(&entry->value, list);
+		}
+	}
+}
+
+// mark_reachable(memory) touches every container the working stack and the
+//   call stack can reach
+static void mark_reachable(struct memory* memory) {
+	struct mark_list list;
+	list.size = 0;
+	list.capacity = 64;
+	list.containers = safe_malloc(sizeof(struct refcnt_container*) * list.capacity);
+	for (size_t i = 0; i < memory->working_stack_pointer; i++) {
+		mark_data(&memory->working_stack[i], &list);
+	}
+	for (size_t i = 0; i < memory->call_stack_pointer; i++) {
+		mark_table(memory->call_stack[i].variables, &list);
+		if (memory->call_stack[i].closure) {
+			mark_table(memory->call_stack[i].closure, &list);
+		}
+	}
+	while (list.size) {
+		struct refcnt_container* container = list.containers[--list.size];
+		struct data* values = (struct data*)(container + 1);
+		for (size_t i = 0; i < container->count; i++) {
+			mark_data(&values[i], &list);
+		}
+	}
+	safe_free(list.containers);
+}
+
+static void measure_table(struct table* table, struct mem_snapshot* snapshot) {
+	snapshot->tables += 1;
+	snapshot->table_sizes[mem_stats_bucket(table->size)] += 1;
+	for (size_t i = 0; i < table->bucket_count; i++) {
+		size_t length = 0;
+		for (struct entry* entry = table->buckets[i]; entry; entry = entry->next) {
+			length++;
+		}
+		snapshot->chain_lengths[mem_stats_bucket(length)] += 1;
+	}
+}
+
+void mem_stats_snapshot(struct memory* memory, struct mem_snapshot* snapshot) {
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->counts = memory->stats;
+	snapshot->allocator = allocator_call_count();
+
+	mark_reachable(memory);
+	struct refcnt_container* container = memory->all_containers_start;
+	while (container) {
+		struct data* values = (struct data*)(container + 1);
+		snapshot->live[container_type(values, container->count)] += 1;
+		if (!container->touched) {
+			snapshot->unreachable += 1;
+			snapshot->unreachable_bytes += container_bytes(container);
+		}
+		container->touched = false;
+		if (container->count && values[0].type == D_TABLE_INTERNAL_POINTER) {
+			measure_table((struct table*) values[0].value.reference, snapshot);
+		}
+		container = container->next;
+		if (container == memory->all_containers_start) {
+			break;
+		}
+	}
+	for (size_t i = 0; i < memory->call_stack_pointer; i++) {
+		measure_table(memory->call_stack[i].variables, snapshot);
+		if (memory->call_stack[i].closure) {
+			measure_table(memory->call_stack[i].closure, snapshot);
+		}
+	}
+}
+
+static void bucket_name(char* buffer, size_t bucket) {
+	if (bucket <= 2) {
+		sprintf(buffer, "%zu", bucket);
+	}
+	else if (bucket == MEM_STATS_BUCKETS - 1) {
+		sprintf(buffer, "%zu+", ((size_t) 1 << (bucket - 2)) + 1);
+	}
+	else {
+		sprintf(buffer, "%zu-%zu", ((size_t) 1 << (bucket - 2)) + 1,
+			(size_t) 1 << (bucket - 1));
+	}
+}
+
+static const char* type_name(size_t type) {
+	// Skip the D_
+	return type == D_EMPTY ? "OTHER" : data_string[type] + 2;
+}
+
+static void write_histogram(FILE* table, const char* title, const size_t* counts) {
+	fprintf(table, "%s\n", title);
+	char name[64];
+	for (size_t i = 0; i < MEM_STATS_BUCKETS; i++) {
+		if (counts[i]) {
+			bucket_name(name, i);
+			fprintf(table, "%14zu  %s\n", counts[i], name);
+		}
+	}
+}
+
+static void write_json_histogram(FILE* json, const char* key, const size_t* counts) {
+	fprintf(json, "  \"%s\": {", key);
+	char name[64];
+	bool first = true;
+	for (size_t i = 0; i < MEM_STATS_BUCKETS; i++) {
+		if (counts[i]) {
+			bucket_name(name, i);
+			fprintf(json, "%s\n    \"%s\": %zu", first ? "" : ",", name, counts[i]);
+			first = false;
+		}
+	}
+	fprintf(json, "\n  },\n");
+}
+
+void mem_stats_report(struct memory* memory, FILE* table, FILE* json) {
+	struct mem_snapshot snapshot;
+	mem_stats_snapshot(memory, &snapshot);
+	struct mem_stats* counts = &snapshot.counts;
+
+	size_t allocated = 0;
+	size_t freed = 0;
+	for (size_t i = 0; i < MEM_STATS_BUCKETS; i++) {
+		allocated += counts->allocated_sizes[i];
+		freed += counts->freed_sizes[i];
+	}
+
+	fprintf(table, "Memory Stats: %zu containers allocated, %zu freed, "
+		"%zu references dropped\n", allocated, freed, counts->dropped);
+	fprintf(table, "Live: %zu containers (%zu bytes), peak: %zu containers "
+		"(%zu bytes)\n", counts->live_containers, counts->live_bytes,
+		counts->peak_containers, counts->peak_bytes);
+	fprintf(table, "Unreachable (cycles): %zu containers (%zu bytes)\n",
+		snapshot.unreachable, snapshot.unreachable_bytes);
+	fprintf(table, "By type\n%14s %14s %14s  %s\n", "allocated", "freed", "live", "");
+	for (size_t i = 0; i < DATA_TYPE_COUNT; i++) {
+		// Everything allocated is either freed or still alive
+		if (counts->freed[i] || snapshot.live[i]) {
+			fprintf(table, "%14zu %14zu %14zu  %s\n", counts->freed[i] + snapshot.live[i],
+				counts->freed[i], snapshot.live[i], type_name(i));
+		}
+	}
+	write_histogram(table, "Containers allocated by number of values",
+		counts->allocated_sizes);
+	fprintf(table, "Tables: %zu\n", snapshot.tables);
+	write_histogram(table, "Tables by number of entries", snapshot.table_sizes);
+	write_histogram(table, "Table buckets by chain length", snapshot.chain_lengths);
+	fprintf(table, "Allocator calls: %zu malloc, %zu calloc, %zu realloc, %zu free\n",
+		snapshot.allocator.mallocs, snapshot.allocator.callocs,
+		snapshot.allocator.reallocs, snapshot.allocator.frees);
+
+	if (json) {
+		fprintf(json, "{\n  \"allocated\": %zu,\n  \"freed\": %zu,\n"
+			"  \"references_dropped\": %zu,\n", allocated, freed, counts->dropped);
+		fprintf(json, "  \"live_containers\": %zu,\n  \"live_bytes\": %zu,\n"
+			"  \"peak_containers\": %zu,\n  \"peak_bytes\": %zu,\n",
+			counts->live_containers, counts->live_bytes,
+			counts->peak_containers, counts->peak_bytes);
+		fprintf(json, "  \"unreachable_containers\": %zu,\n"
+			"  \"unreachable_bytes\": %zu,\n",
+			snapshot.unreachable, snapshot.unreachable_bytes);
+		fprintf(json, "  \"types\": {");
+		bool first = true;
+		for (size_t i = 0; i < DATA_TYPE_COUNT; i++) {
+			if (counts->freed[i] || snapshot.live[i]) {
+				fprintf(json, "%s\n    \"%s\": { \"allocated\": %zu, \"freed\": %zu, "
+					"\"live\": %zu }", first ? "" : ",", type_name(i),
+					counts->freed[i] + snapshot.live[i], counts->freed[i],
+					snapshot.live[i]);
+				first = false;
+			}
+		}
+		fprintf(json, "\n  },\n");
+		write_json_histogram(json, "allocated_sizes", counts->allocated_sizes);
+		write_json_histogram(json, "freed_sizes", counts->freed_sizes);
+		fprintf(json, "  \"tables\": %zu,\n", snapshot.tables);
+		write_json_histogram(json, "table_sizes", snapshot.table_sizes);
+		write_json_histogram(json, "chain_lengths", snapshot.chain_lengths);
+		fprintf(json, "  \"allocator\": { \"malloc\": %zu, \"calloc\": %zu, "
+			"\"realloc\": %zu, \"free\": %zu }\n}\n",
+			snapshot.allocator.mallocs, snapshot.allocator.callocs,
+			snapshot.allocator.reallocs, snapshot.allocator.frees);
+	}
+}
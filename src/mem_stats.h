@@ -0,0 +1,72 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include "data.h"
+#include "global.h"
+#include <stdio.h>
+
+// mem_stats.h - Felix Guo
+// Counts what the reference counted heap does, for --mem-stats and
+//   Wendy.memStats: containers allocated and freed by what they hold and by
+//   how many values they have room for, and how many are alive now and at
+//   most. The counts are a few additions on each container, so they're
+//   always kept; finding cycles nothing refers to anymore and measuring
+//   tables walks the heap, which only happens when a report is asked for.
+
+// Sizes and lengths are counted in buckets of 0, 1, 2, 3-4, 5-8 and so on,
+//   the last bucket holds everything bigger
+#define MEM_STATS_BUCKETS 16
+
+struct memory;
+
+struct mem_stats {
+	// Indexed by bucket of the number of values the container holds
+	size_t allocated_sizes[MEM_STATS_BUCKETS];
+	size_t freed_sizes[MEM_STATS_BUCKETS];
+	// Indexed by the type of the values referring to the container, see
+	//   container_type
+	size_t freed[DATA_TYPE_COUNT];
+	// Calls to refcnt_free, each drops one reference and may free the container
+	size_t dropped;
+	size_t live_containers;
+	size_t peak_containers;
+	size_t live_bytes;
+	size_t peak_bytes;
+};
+
+// What a report finds by walking the heap
+struct mem_snapshot {
+	struct mem_stats counts;
+	struct allocator_calls allocator;
+	size_t live[DATA_TYPE_COUNT];
+	// Containers only cycles refer to, which memory_destroy frees at exit
+	size_t unreachable;
+	size_t unreachable_bytes;
+	// Tables of variables and table values alive now
+	size_t tables;
+	size_t table_sizes[MEM_STATS_BUCKETS];
+	size_t chain_lengths[MEM_STATS_BUCKETS];
+};
+
+// mem_stats_bucket(n) returns the bucket n is counted in
+static inline size_t mem_stats_bucket(size_t n) {
+	if (n <= 1) {
+		return n;
+	}
+	size_t bucket = 1 + (sizeof(unsigned long) * 8 - __builtin_clzl(n - 1));
+	return bucket < MEM_STATS_BUCKETS ? bucket : MEM_STATS_BUCKETS - 1;
+}
+
+// container_type(values, count) returns the type of the data that refers to
+//   a container holding values, D_EMPTY if it can't tell
+enum data_type container_type(const struct data* values, size_t count);
+
+// mem_stats_snapshot(memory, snapshot) fills snapshot with the counts so far
+//   and what's alive on the heap now
+void mem_stats_snapshot(struct memory* memory, struct mem_snapshot* snapshot);
+
+// mem_stats_report(memory, table, json) writes a snapshot of memory as a
+//   table to table, and as JSON to json, which may be 0
+void mem_stats_report(struct memory* memory, FILE* table, FILE* json);
+
+#endif
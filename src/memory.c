@@ -26,11 +26,15 @@ static inline bool is_at_main(struct memory * memory) {
 	return memory->call_stack_pointer == 1;
 }
 
-void check_memory(struct memory * memory) {
-	// Check stack
+static void check_call_stack(struct memory * memory) {
 	if (memory->call_stack_pointer >= memory->call_stack_size - 1) {
 		resize(memory->call_stack, memory->call_stack_size);
 	}
+}
+
+void check_memory(struct memory * memory) {
+	// Check stack
+	check_call_stack(memory);
 	// Check argstack
 	if (memory->working_stack_pointer >= memory->working_stack_size - 1) {
 		resize(memory->working_stack, memory->working_stack_size);
@@ -67,38 +71,82 @@ struct data *refcnt_malloc_impl(struct memory * memory, void* allocvoid, size_t
 	container_info->next = memory->all_containers_start;
 
 	memory->all_containers_end = container_info;
-	if (get_settings_flag(SETTINGS_TRACE_REFCNT)) {
+
+	struct mem_stats* stats = &memory->stats;
+	stats->allocated_sizes[mem_stats_bucket(count)] += 1;
+	stats->live_containers += 1;
+	stats->live_bytes += sizeof(struct refcnt_container) + count * sizeof(struct data);
+	if (stats->live_containers > stats->peak_containers) {
+		stats->peak_containers = stats->live_containers;
+	}
+	if (stats->live_bytes > stats->peak_bytes) {
+		stats->peak_bytes = stats->live_bytes;
+	}
+	if (memory->settings->flags[SETTINGS_TRACE_REFCNT]) {
 		printf("refcnt malloc %p\n", allocated);
 	}
+	// The block is still returned, the VM stops after the instruction
+	if (memory->max_heap_bytes && stats->live_bytes > memory->max_heap_bytes &&
+		!*memory->error_flag) {
+		error_runtime(memory, memory->line ? *memory->line : 0, MEMORY_HEAP_LIMIT,
+			memory->max_heap_bytes);
+	}
 	// This forces no pointer arithmetic
 	return (struct data*)((unsigned char*)allocated + sizeof(struct refcnt_container));
 }
 
+bool refcnt_reserve(struct memory * memory, size_t count) {
+	if (!memory->max_heap_bytes || memory->stats.live_bytes +
+		sizeof(struct refcnt_container) + count * sizeof(struct data) <= memory->max_heap_bytes) {
+		return true;
+	}
+	error_runtime(memory, memory->line ? *memory->line : 0, MEMORY_HEAP_LIMIT,
+		memory->max_heap_bytes);
+	return false;
+}
+
+bool string_reserve(struct memory * memory, size_t length) {
+	if (!memory->max_heap_bytes ||
+		memory->stats.live_bytes + length + 1 <= memory->max_heap_bytes) {
+		return true;
+	}
+	error_runtime(memory, memory->line ? *memory->line : 0, MEMORY_HEAP_LIMIT,
+		memory->max_heap_bytes);
+	return false;
+}
+
 void refcnt_free(struct memory * memory, struct data *ptr) {
 	struct refcnt_container* container_info =
 		(struct refcnt_container*)((unsigned char*)ptr - sizeof(struct refcnt_container));
 
-	if (get_settings_flag(SETTINGS_TRACE_REFCNT)) {
+	if (memory->settings->flags[SETTINGS_TRACE_REFCNT]) {
 		printf("refcnt free %p, container %p, count %zd before decrement",
 			ptr, container_info, container_info->refs);
 		printf("\n");
 	}
 
 	if (container_info->refs == 0) {
-		error_general("Internal error: refcnt_free on reference with 0 count!");
+		error_general(0, "Internal error: refcnt_free on reference with 0 count!");
 		safe_exit(1);
 		return;
 	}
 
 	container_info->refs -= 1;
+	memory->stats.dropped += 1;
 
 	if (container_info->refs == 0) {
-		if (get_settings_flag(SETTINGS_TRACE_REFCNT)) {
+		if (memory->settings->flags[SETTINGS_TRACE_REFCNT]) {
 			printf("refcnt at 0, looping through %zd to clear\n", container_info->count);
 		}
+		struct mem_stats* stats = &memory->stats;
+		stats->freed[container_type(ptr, container_info->count)] += 1;
+		stats->freed_sizes[mem_stats_bucket(container_info->count)] += 1;
+		stats->live_containers -= 1;
+		stats->live_bytes -= sizeof(struct refcnt_container) +
+			container_info->count * sizeof(struct data);
 		for (size_t i = 0; i < container_info->count; i++) {
 			if (container_info->count < 10 &&
-				get_settings_flag(SETTINGS_TRACE_REFCNT)) {
+				memory->settings->flags[SETTINGS_TRACE_REFCNT]) {
 				printf("loop to %p\n", &ptr[i]);
 			}
 			destroy_data_runtime(memory, &ptr[i]);
@@ -124,11 +172,11 @@ void refcnt_free(struct memory * memory, struct data *ptr) {
 	}
 }
 
-struct data *refcnt_copy(struct data *ptr) {
+struct data *refcnt_copy(struct memory * memory, struct data *ptr) {
 	struct refcnt_container* container_info =
 		(struct refcnt_container*)((unsigned char*)ptr - sizeof(struct refcnt_container));
 	container_info->refs += 1;
-	if (get_settings_flag(SETTINGS_TRACE_REFCNT)) {
+	if (memory->settings->flags[SETTINGS_TRACE_REFCNT]) {
 		printf("refcnt copy %p, count %zd\n",
 			container_info, container_info->refs);
 	}
@@ -144,11 +192,11 @@ struct data* wendy_list_malloc_impl(void* allocvoid, size_t size) {
 
 size_t wendy_list_size(const struct data* list_ref) {
 	if (list_ref->type != D_LIST && list_ref->type != D_CLOSURE) {
-		error_general("wendy_list_size but not D_LIST");
+		error_general(0, "wendy_list_size but not D_LIST");
 	}
 	struct data* list_data = list_ref->value.reference;
 	if (list_data->type != D_LIST_HEADER) {
-		error_general("wendy_list_size but not D_LIST_HEADER");
+		error_general(0, "wendy_list_size but not D_LIST_HEADER");
 	}
 	struct list_header* hdr = (struct list_header*)list_data->value.reference;
 	return hdr->size;
@@ -172,7 +220,7 @@ struct data *create_closure(struct memory * memory) {
 			struct entry* curr = table->buckets[i];
 			while (curr) {
 				closure_list[index++] = make_data(D_IDENTIFIER, data_value_str(curr->key));
-				closure_list[index++] = copy_data(curr->value);
+				closure_list[index++] = copy_data_runtime(memory, curr->value);
 				curr = curr->next;
 			}
 		}
@@ -183,7 +231,7 @@ struct data *create_closure(struct memory * memory) {
 				struct entry* curr = table->buckets[i];
 				while (curr) {
 					closure_list[index++] = make_data(D_IDENTIFIER, data_value_str(curr->key));
-					closure_list[index++] = copy_data(curr->value);
+					closure_list[index++] = copy_data_runtime(memory, curr->value);
 					curr = curr->next;
 				}
 			}
@@ -192,8 +240,14 @@ struct data *create_closure(struct memory * memory) {
 	return closure_list;
 }
 
-struct memory *memory_init(void) {
+struct memory *memory_init(const struct settings* settings,
+	const struct source_table* sources, bool* error_flag) {
 	struct memory *memory = malloc(sizeof(*memory));
+	memory->settings = settings;
+	memory->sources = sources;
+	memory->error_flag = error_flag;
+	memory->line = 0;
+	memory->max_heap_bytes = 0;
 	
 	memory->call_stack_size = INITIAL_STACK_SIZE;
 	memory->working_stack_size = INITIAL_WORKING_STACK_SIZE;
@@ -206,8 +260,10 @@ struct memory *memory_init(void) {
 
 	memory->working_stack_pointer = 0;
 	memory->call_stack_pointer = 0;
+	memory->function_frames = 0;
 	memory->all_containers_start = 0;
 	memory->all_containers_end = 0;
+	memset(&memory->stats, 0, sizeof(memory->stats));
 	return memory;	
 }
 
@@ -240,13 +296,15 @@ void memory_destroy(struct memory* memory) {
 	}
 	safe_free(memory->call_stack);
 
-	if (get_settings_flag(SETTINGS_TRACE_REFCNT)) {
+	if (memory->settings->flags[SETTINGS_TRACE_REFCNT]) {
 		printf("Call/working stack cleared. Now we clear cycles.\n");
 	}
 
 	// Check remaining cycled references
 	struct refcnt_container *start = memory->all_containers_start;
 	struct refcnt_container *next;
+	size_t leftover = 0;
+	size_t leftover_bytes = 0;
 
 	while (start) {
 		// There's no safe way to free the remaining through refcnt_free
@@ -254,13 +312,15 @@ void memory_destroy(struct memory* memory) {
 		//   the owning parent has freed, which leads to bad memory
 		//   reads. The best way is to forcefully free the remaining
 		//   refcnted containers;
-		if (get_settings_flag(SETTINGS_TRACE_REFCNT)) {
+		if (memory->settings->flags[SETTINGS_TRACE_REFCNT]) {
 			printf("Clear leftover.\n");
 		}
 		struct data *ptr = (struct data *)(start + 1);
 		for (size_t i = 0; i < start->count; i++) {
 			destroy_data_runtime_no_ref(memory, &ptr[i]);
 		}
+		leftover += 1;
+		leftover_bytes += sizeof(struct refcnt_container) + start->count * sizeof(struct data);
 		next = start->next;
 		safe_free(start);
 		start = next;
@@ -268,6 +328,10 @@ void memory_destroy(struct memory* memory) {
 			break;
 		}
 	}
+	if (memory->settings->flags[SETTINGS_MEM_STATS]) {
+		fprintf(stderr, "Leftover containers freed after the stacks were cleared: "
+			"%zu (%zu bytes)\n", leftover, leftover_bytes);
+	}
 	free(memory);
 }
 
@@ -278,12 +342,16 @@ void push_frame(struct memory * memory, const char* name, address ret, int line)
 		name,
 		"()"
 	);
+	check_call_stack(memory);
 	struct stack_frame* frame = &memory->call_stack[memory->call_stack_pointer++];
 	frame->fn_name = se_name;
 	frame->ret_addr = ret;
+	// Set before the tables are made, the allocation profiler reads it
+	frame->is_automatic = false;
+	frame->tail_calls = 0;
 	frame->variables = table_create();
 	frame->closure = table_create();
-	frame->is_automatic = false;
+	memory->function_frames++;
 }
 
 void push_auto_frame(struct memory * memory, address ret, const char* type, int line) {
@@ -292,12 +360,14 @@ void push_auto_frame(struct memory * memory, address ret, const char* type, int
 	char* se_name = safe_concat(
 		"autoframe:", type, ">"
 	);
+	check_call_stack(memory);
 	struct stack_frame* frame = &memory->call_stack[memory->call_stack_pointer++];
 	frame->fn_name = se_name;
 	frame->ret_addr = ret;
-	frame->variables = table_create();
 	frame->closure = 0;
 	frame->is_automatic = true;
+	frame->tail_calls = 0;
+	frame->variables = table_create();
 }
 
 void pop_frame(struct memory * memory, bool is_ret, address* ret) {
@@ -311,6 +381,9 @@ void pop_frame(struct memory * memory, bool is_ret, address* ret) {
 		}
 	}
 	// trace now points to the actual frame we want to pop.
+	if (!memory->call_stack[trace].is_automatic) {
+		memory->function_frames--;
+	}
 	if (is_ret) {
 		*ret = stack_frame_destroy(memory, &memory->call_stack[trace]);
 	}
@@ -339,8 +412,13 @@ void print_call_stack(struct memory * memory, FILE* file, int maxlines) {
 	int start = memory->call_stack_pointer - maxlines;
 	if (start < 0 || maxlines < 0) start = 0;
 	for (size_t i = start; i < memory->call_stack_pointer; i++) {
-		fprintf(file, "Frame %zd (return to 0x%X): %s\n", i, memory->call_stack[i].ret_addr,
+		fprintf(file, "Frame %zd (return to 0x%X): %s", i, memory->call_stack[i].ret_addr,
 			memory->call_stack[i].fn_name);
+		if (memory->call_stack[i].tail_calls) {
+			fprintf(file, " [%zd frames elided by tail calls]",
+				memory->call_stack[i].tail_calls);
+		}
+		fprintf(file, "\n");
 		if (memory->call_stack[i].closure) {
 			table_print(file, memory->call_stack[i].closure,   "  C[%s = ", "]");
 		}
@@ -351,7 +429,9 @@ void print_call_stack(struct memory * memory, FILE* file, int maxlines) {
 
 void push_arg(struct memory * memory, struct data t) {
 	memory->working_stack[memory->working_stack_pointer++] = t;
+#ifndef RELEASE
 	check_memory(memory);
+#endif
 }
 
 struct data* top_arg(struct memory * memory, int line) {
@@ -363,6 +443,10 @@ struct data* top_arg(struct memory * memory, int line) {
 }
 
 struct data pop_arg(struct memory * memory, int line) {
+#ifdef RELEASE
+	UNUSED(line);
+	return memory->working_stack[--(memory->working_stack_pointer)];
+#else
 	if (memory->working_stack_pointer != 0) {
 		struct data ret = memory->working_stack[--(memory->working_stack_pointer)];
 		memory->working_stack[memory->working_stack_pointer] = make_data(D_EMPTY, data_value_num(0));
@@ -370,6 +454,7 @@ struct data pop_arg(struct memory * memory, int line) {
 	}
 	error_runtime(memory, line, MEMORY_STACK_UNDERFLOW);
 	return none_data();
+#endif
 }
 
 struct data* push_stack_entry(struct memory * memory, const char* id, int line) {
@@ -4,6 +4,8 @@
 #include "global.h"
 #include "data.h"
 #include "table.h"
+#include "mem_stats.h"
+#include "source.h"
 #include <stdbool.h>
 
 // memory.h - Felix Guo
@@ -12,6 +14,9 @@
 // VM Memory Limits
 #define INITIAL_STACK_SIZE 1024
 #define INITIAL_WORKING_STACK_SIZE 512
+// Room kept above what OP_RESERVE asks for, the VM pushes a few values of its
+//   own when it calls an operator overload or a struct constructor
+#define WORKING_STACK_SLACK 8
 
 typedef unsigned int address;
 
@@ -21,6 +26,8 @@ struct stack_frame {
 	char* fn_name;
 	address ret_addr;
 	bool is_automatic;
+	// Frames replaced by tail calls on the way to this one
+	size_t tail_calls;
 };
 
 struct refcnt_container {
@@ -39,21 +46,38 @@ struct memory {
 	address working_stack_pointer;
 
 	address call_stack_pointer;
+	// Frames on the call stack made by calls, not by blocks
+	address function_frames;
 
 	size_t call_stack_size;
 	size_t working_stack_size;
 
 	struct refcnt_container* all_containers_start;
 	struct refcnt_container* all_containers_end;
+
+	// Settings, source and error flag of the owning VM, for errors raised
+	//   while allocating
+	const struct settings* settings;
+	const struct source_table* sources;
+	bool* error_flag;
+	// Line of the owning VM, for errors raised while allocating
+	const int* line;
+	// Most bytes of refcounted containers held at once, 0 for no limit
+	size_t max_heap_bytes;
+
+	struct mem_stats stats;
 };
 
-struct memory * memory_init(void);
+struct memory * memory_init(const struct settings* settings,
+	const struct source_table* sources, bool* error_flag);
 void memory_destroy(struct memory *);
 
-// push(t) pushes a data t into the working stack
+// push(t) pushes a data t into the working stack, release builds rely on
+//   OP_RESERVE having made room and don't check
 void push_arg(struct memory *, struct data t);
 
-// pop(line) returns the top of the working stack
+// pop(line) returns the top of the working stack, release builds don't check
+//   for underflow
 struct data pop_arg(struct memory *, int line);
 
 // ensure_working_stack_size(n) ensures it can fit another items
@@ -67,12 +91,24 @@ void ensure_working_stack_size(struct memory *, size_t additional);
 		(count) * sizeof(struct data) + sizeof(struct refcnt_container), 1), count)
 struct data *refcnt_malloc_impl(struct memory *, void* allocvoid, size_t count);
 
+// refcnt_reserve(count) raises a runtime error and returns false if a block
+//   of count data would take the refcounted heap over max_heap_bytes, for
+//   callers about to allocate a size the program chose. Any other allocation
+//   over the limit raises the error after it's made.
+bool refcnt_reserve(struct memory * memory, size_t count);
+
+// string_reserve(length) is refcnt_reserve for a string of length chars the
+//   program is building. Strings aren't refcounted so the heap doesn't hold
+//   the ones that are live, only each one made is checked against what's
+//   left of max_heap_bytes.
+bool string_reserve(struct memory * memory, size_t length);
+
 // refcnt_free() reduces the refcount by 1, and frees the heap memory
 //   if the refcount is 0
 void refcnt_free(struct memory * memory, struct data *ptr);
 
 // refcnt_copy() makes a copy of the pointer, increasing refcount by 1
-struct data *refcnt_copy(struct data *ptr);
+struct data *refcnt_copy(struct memory * memory, struct data *ptr);
 
 // wendy_list_malloc is a helper for refcnt allocating space for a wendy
 //   list but also inserting a header
@@ -5,11 +5,14 @@
 #include "codegen.h"
 #include "vm.h"
 #include "imports.h"
+#include "mem_stats.h"
+#include "heap_snapshot.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
 #include <errno.h>
+#include <time.h>
 
 #ifdef __linux__
 #include <pthread.h>
@@ -37,6 +40,12 @@ static struct data native_readFile(struct vm* vm, struct data* args);
 static struct data native_writeFile(struct vm* vm, struct data* args);
 static struct data native_vm_getRefs(struct vm* vm, struct data* args);
 static struct data native_vm_getAt(struct vm* vm, struct data* args);
+static struct data native_vm_memStats(struct vm* vm, struct data* args);
+static struct data native_vm_heapSnapshot(struct vm* vm, struct data* args);
+static struct data native_clock_monotonic(struct vm* vm, struct data* args);
+static struct data native_clock_cpu(struct vm* vm, struct data* args);
+static struct data native_bench_counters(struct vm* vm, struct data* args);
+static struct data native_bench_summary(struct vm* vm, struct data* args);
 static struct data native_process_execute(struct vm* vm, struct data* args);
 static struct data native_pow(struct vm* vm, struct data* args);
 static struct data native_ln(struct vm* vm, struct data* args);
@@ -63,16 +72,21 @@ static struct native_function native_functions[256] = {
 	{ "io_writeFile", 2, native_writeFile },
 	{ "vm_getRefs", 1, native_vm_getRefs },
 	{ "vm_getAt", 2, native_vm_getAt },
+	{ "vm_memStats", 0, native_vm_memStats },
+	{ "vm_heapSnapshot", 1, native_vm_heapSnapshot },
+	{ "clock_monotonic", 0, native_clock_monotonic },
+	{ "clock_cpu", 0, native_clock_cpu },
+	{ "bench_counters", 0, native_bench_counters },
+	{ "bench_summary", 1, native_bench_summary },
 	{ "process_execute", 1, native_process_execute },
 	{ "dispatch", 1, native_dispatch },
 	{ "random_float", 0, native_random_float },
 	{ 0, 0, 0 }
 };
 
-static size_t end_ptr = 0;
 void register_native_call(const char* name, size_t num_args,
     struct data (*function)(struct vm*, struct data*)) {
-
+	size_t end_ptr = 0;
 	while (native_functions[end_ptr].name != NULL) {
 		end_ptr++;
 	}
@@ -122,8 +136,7 @@ static struct data native_getProgramArgs(struct vm* vm, struct data* args) {
 
 static struct data native_getImportedLibraries(struct vm* vm, struct data* args) {
 	UNUSED(args);
-	UNUSED(vm);
-	struct import_node *node = imported_libraries;
+	struct import_node *node = vm->imported_libraries;
 	// Traverse once to find length
 	size_t length = 0;
 	while (node) {
@@ -131,7 +144,7 @@ static struct data native_getImportedLibraries(struct vm* vm, struct data* args)
 		node = node->next;
 	}
 	struct data* library_list = wendy_list_malloc(vm->memory, length);
-	node = imported_libraries;
+	node = vm->imported_libraries;
 	length = 1;
 	while (node) {
 		library_list[length++] =
@@ -166,7 +179,7 @@ static struct data native_log(struct vm* vm, struct data* args) {
 
 static struct data native_exec(struct vm* vm, struct data* args) {
 	char* command = native_to_string(vm, args);
-	if (!get_settings_flag(SETTINGS_SANDBOXED)) {
+	if (!vm->settings.flags[SETTINGS_SANDBOXED]) {
 		return make_data(D_NUMBER, data_value_num(system(command)));
 	}
 	return noneret_data();
@@ -174,7 +187,7 @@ static struct data native_exec(struct vm* vm, struct data* args) {
 
 static struct data native_process_execute(struct vm* vm, struct data* args) {
 	// args[0] should be a command, args[1] should be list!
-	if (get_settings_flag(SETTINGS_SANDBOXED)) {
+	if (vm->settings.flags[SETTINGS_SANDBOXED]) {
 		struct data * result_list = wendy_list_malloc(vm->memory, 2);
 		result_list[1] = make_data(D_NUMBER, data_value_num(0));
 		struct data * output_list = wendy_list_malloc(vm->memory, 0);
@@ -312,7 +325,7 @@ static struct data native_readRaw(struct vm* vm, struct data* args) {
 }
 
 static struct data native_readFile(struct vm* vm, struct data* args) {
-	if (!get_settings_flag(SETTINGS_SANDBOXED)) {
+	if (!vm->settings.flags[SETTINGS_SANDBOXED]) {
 		char* file = native_to_string(vm, args);
 		FILE *f = fopen(file, "rb");
 		fseek(f, 0, SEEK_END);
@@ -329,7 +342,7 @@ static struct data native_readFile(struct vm* vm, struct data* args) {
 }
 
 static struct data native_writeFile(struct vm* vm, struct data* args) {
-	if (!get_settings_flag(SETTINGS_SANDBOXED)) {
+	if (!vm->settings.flags[SETTINGS_SANDBOXED]) {
 		char* file = native_to_string(vm, args);
 		/* Either the content is a string, or it's a array of
 		 * integers that represent the bytes */
@@ -375,7 +388,7 @@ static struct data native_vm_getAt(struct vm* vm, struct data* args) {
 		error_runtime(vm->memory, vm->line, "Passed argument is not a reference type!");
 		return none_data();
 	}
-	struct data result = copy_data(ref.value.reference[(int) index]);
+	struct data result = copy_data_runtime(vm->memory, ref.value.reference[(int) index]);
 	if (is_numeric(result)) {
 		result.type = D_NUMBER;
 	}
@@ -387,6 +400,147 @@ static struct data native_vm_getAt(struct vm* vm, struct data* args) {
 	return result;
 }
 
+static void set_count(struct memory* memory, struct table* table, const char* key, size_t count) {
+	*table_insert(table, key, memory) = make_data(D_NUMBER, data_value_num(count));
+}
+
+static void set_number(struct memory* memory, struct table* table, const char* key, double number) {
+	*table_insert(table, key, memory) = make_data(D_NUMBER, data_value_num(number));
+}
+
+// table_data(memory, table) returns table as a value scripts can use
+static struct data table_data(struct memory* memory, struct table* table) {
+	struct data* storage = refcnt_malloc(memory, 1);
+	storage[0] = make_data(D_TABLE_INTERNAL_POINTER, data_value_ptr((struct data*) table));
+	return make_data(D_TABLE, data_value_ptr(storage));
+}
+
+// set_histogram(memory, table, key, counts) sets key to a list of the counts
+//   in each bucket, up to the last one that isn't 0
+static void set_histogram(struct memory* memory, struct table* table, const char* key,
+		const size_t* counts) {
+	size_t size = MEM_STATS_BUCKETS;
+	while (size > 0 && !counts[size - 1]) {
+		size--;
+	}
+	struct data* list = wendy_list_malloc(memory, size);
+	for (size_t i = 0; i < size; i++) {
+		list[i + 1] = make_data(D_NUMBER, data_value_num(counts[i]));
+	}
+	*table_insert(table, key, memory) = make_data(D_LIST, data_value_ptr(list));
+}
+
+static struct data native_vm_memStats(struct vm* vm, struct data* args) {
+	UNUSED(args);
+	struct mem_snapshot snapshot;
+	mem_stats_snapshot(vm->memory, &snapshot);
+	struct mem_stats* counts = &snapshot.counts;
+	size_t allocated = 0;
+	size_t freed = 0;
+	for (size_t i = 0; i < MEM_STATS_BUCKETS; i++) {
+		allocated += counts->allocated_sizes[i];
+		freed += counts->freed_sizes[i];
+	}
+
+	struct memory* memory = vm->memory;
+	struct table* table = table_create();
+	set_count(memory, table, "allocated", allocated);
+	set_count(memory, table, "freed", freed);
+	set_count(memory, table, "referencesDropped", counts->dropped);
+	set_count(memory, table, "liveContainers", counts->live_containers);
+	set_count(memory, table, "liveBytes", counts->live_bytes);
+	set_count(memory, table, "peakContainers", counts->peak_containers);
+	set_count(memory, table, "peakBytes", counts->peak_bytes);
+	set_count(memory, table, "unreachableContainers", snapshot.unreachable);
+	set_count(memory, table, "unreachableBytes", snapshot.unreachable_bytes);
+	set_count(memory, table, "tables", snapshot.tables);
+	set_count(memory, table, "mallocs", snapshot.allocator.mallocs);
+	set_count(memory, table, "callocs", snapshot.allocator.callocs);
+	set_count(memory, table, "reallocs", snapshot.allocator.reallocs);
+	set_count(memory, table, "frees", snapshot.allocator.frees);
+	set_histogram(memory, table, "allocatedSizes", counts->allocated_sizes);
+	set_histogram(memory, table, "tableSizes", snapshot.table_sizes);
+	set_histogram(memory, table, "chainLengths", snapshot.chain_lengths);
+	return table_data(memory, table);
+}
+
+static struct data native_vm_heapSnapshot(struct vm* vm, struct data* args) {
+	if (!vm->settings.flags[SETTINGS_SANDBOXED]) {
+		char* path = native_to_string(vm, args);
+		return heap_snapshot_save(vm->memory, path) ? true_data() : false_data();
+	}
+	return noneret_data();
+}
+
+// clock_nanoseconds(clock) returns the time on clock in nanoseconds
+static double clock_nanoseconds(clockid_t clock) {
+	struct timespec now;
+	clock_gettime(clock, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static struct data native_clock_monotonic(struct vm* vm, struct data* args) {
+	UNUSED(vm);
+	UNUSED(args);
+	return make_data(D_NUMBER, data_value_num(clock_nanoseconds(CLOCK_MONOTONIC)));
+}
+
+static struct data native_clock_cpu(struct vm* vm, struct data* args) {
+	UNUSED(vm);
+	UNUSED(args);
+	return make_data(D_NUMBER, data_value_num(clock_nanoseconds(CLOCK_PROCESS_CPUTIME_ID)));
+}
+
+static struct data native_bench_counters(struct vm* vm, struct data* args) {
+	UNUSED(args);
+	struct table* table = table_create();
+	set_count(vm->memory, table, "instructions", vm->instructions_run);
+	set_count(vm->memory, table, "allocations", allocation_count());
+	set_count(vm->memory, table, "liveContainers", vm->memory->stats.live_containers);
+	set_count(vm->memory, table, "liveBytes", vm->memory->stats.live_bytes);
+	return table_data(vm->memory, table);
+}
+
+static int by_value(const void* a, const void* b) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return x < y ? -1 : x > y;
+}
+
+static struct data native_bench_summary(struct vm* vm, struct data* args) {
+	if (args[0].type != D_LIST) {
+		error_runtime(vm->memory, vm->line, "Expected a list of numbers to summarize!");
+		return none_data();
+	}
+	size_t count = wendy_list_size(&args[0]);
+	if (count == 0) {
+		error_runtime(vm->memory, vm->line, "Expected a list of numbers to summarize!");
+		return none_data();
+	}
+	double* values = safe_malloc(sizeof(double) * count);
+	double sum = 0;
+	for (size_t i = 0; i < count; i++) {
+		values[i] = native_to_numeric(vm, &args[0].value.reference[i + 1]);
+		sum += values[i];
+	}
+	qsort(values, count, sizeof(double), by_value);
+	double mean = sum / count;
+	double squares = 0;
+	for (size_t i = 0; i < count; i++) {
+		squares += (values[i] - mean) * (values[i] - mean);
+	}
+	struct table* table = table_create();
+	set_count(vm->memory, table, "runs", count);
+	set_number(vm->memory, table, "min", values[0]);
+	set_number(vm->memory, table, "max", values[count - 1]);
+	set_number(vm->memory, table, "median", count % 2 ? values[count / 2] :
+		(values[count / 2 - 1] + values[count / 2]) / 2);
+	set_number(vm->memory, table, "mean", mean);
+	set_number(vm->memory, table, "stddev", count > 1 ? sqrt(squares / (count - 1)) : 0);
+	safe_free(values);
+	return table_data(vm->memory, table);
+}
+
 void native_call(struct vm* vm, char* function_name, int expected_args) {
 	bool found = false;
 	for (int i = 0; ; i++) {
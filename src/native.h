@@ -13,6 +13,8 @@ extern int program_arguments_count;
 
 void native_call(struct vm* vm, char* function_name, int expected_args);
 
+// register_native_call(name, num_args, function) adds to the natives every VM
+//   can call, it must be called before any VM starts running
 void register_native_call(const char* name, size_t num_args,
     struct data (*function)(struct vm*, struct data*));
 
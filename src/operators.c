@@ -1,11 +1,12 @@
 #include "operators.h"
 #include "error.h"
+#include <string.h>
 
 const char* operator_string[] = {
 	OPERATOR_STRING
 };
 
-enum vm_operator token_operator_unary(struct token op) {
+enum vm_operator token_operator_unary(struct compiler_ctx* ctx, struct token op) {
 	switch (op.t_type) {
 		case T_MINUS:
 			return O_NEG;
@@ -17,11 +18,41 @@ enum vm_operator token_operator_unary(struct token op) {
 			return O_SPREAD;
 		default:;
 	}
-	error_compile(op.t_line, op.t_col, OPERATORS_INVALID_UNARY);
+	error_compile(ctx, op.t_line, op.t_col, OPERATORS_INVALID_UNARY);
 	return 0;
 }
 
-enum vm_operator token_operator_binary(struct token op) {
+static bool names_overload(const char* name, const char* type_a,
+		enum vm_operator op, const char* type_b) {
+	size_t len_a = strlen(type_a);
+	size_t len_op = strlen(operator_string[op]);
+	return strncmp(name, type_a, len_a) == 0 &&
+		strncmp(name + len_a, operator_string[op], len_op) == 0 &&
+		streq(name + len_a + len_op, type_b);
+}
+
+bool is_binary_overload(const char* id, const char* type_a, enum vm_operator op,
+		const char* type_b) {
+	size_t prefix_len = strlen(OPERATOR_OVERLOAD_PREFIX);
+	if (strncmp(id, OPERATOR_OVERLOAD_PREFIX, prefix_len) != 0) {
+		return false;
+	}
+	const char* name = id + prefix_len;
+	return names_overload(name, type_a, op, type_b) ||
+		names_overload(name, "any", op, type_b) ||
+		names_overload(name, type_a, op, "any");
+}
+
+bool is_comparison(enum vm_operator op) {
+	switch (op) {
+		case O_LT: case O_GT: case O_LTE: case O_GTE: case O_EQ: case O_NEQ:
+			return true;
+		default:
+			return false;
+	}
+}
+
+enum vm_operator token_operator_binary(struct compiler_ctx* ctx, struct token op) {
 	switch (op.t_type) {
 		case T_PLUS: return O_ADD;
 		case T_MINUS: return O_SUB;
@@ -48,6 +79,6 @@ enum vm_operator token_operator_binary(struct token op) {
 		case T_SAFE_NAVIGATE: return O_SAFE_NAVIGATE;
 		default:;
 	}
-	error_compile(op.t_line, op.t_col, OPERATORS_INVALID_BINARY);
+	error_compile(ctx, op.t_line, op.t_col, OPERATORS_INVALID_BINARY);
 	return 0;
 }
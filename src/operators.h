@@ -23,8 +23,21 @@ enum vm_operator {
 
 extern const char* operator_string[];
 
-enum vm_operator token_operator_binary(struct token op);
+struct compiler_ctx;
 
-enum vm_operator token_operator_unary(struct token op);
+// token_operator_binary(ctx, op) returns the operator for the token op,
+//   reporting an error to ctx if it isn't one
+enum vm_operator token_operator_binary(struct compiler_ctx* ctx, struct token op);
+
+enum vm_operator token_operator_unary(struct compiler_ctx* ctx, struct token op);
+
+// is_binary_overload(id, type_a, op, type_b) returns true if id is the name
+//   of an overload OP_BIN would call for op on values of type_a and type_b,
+//   including the ones declared for <any>
+bool is_binary_overload(const char* id, const char* type_a, enum vm_operator op,
+	const char* type_b);
+
+// is_comparison(op) returns true if op compares its operands, giving a boolean
+bool is_comparison(enum vm_operator op);
 
 #endif
@@ -1,5 +1,10 @@
 #include "optimizer.h"
+#include "compiler.h"
 #include "ast.h"
+#include "infer.h"
+#include "codegen.h"
+#include "imports.h"
+#include "operators.h"
 #include "global.h"
 #include "error.h"
 #include <string.h>
@@ -20,38 +25,65 @@ struct id_node {
 	struct id_node* next;
 };
 
+// Linked list node of operator overload names, folding leaves alone any
+//   operation one of them could apply to
+struct overload_node {
+	char* name;
+	struct overload_node* next;
+};
+
 // struct statement scope block to simulate function calls and checking if identifiers exist.
 struct statement_block {
 	struct id_node* id_list;
+	// Set on the block of a function body, which runs whenever it's called
+	bool is_function;
 	struct statement_block* next;
 };
 
-static struct statement_block* curr_statement_block = 0;
-
 // Forward Declarations
-static void free_id_nodes(struct id_node* node);
-static void free_statement_blocks(struct statement_block* block);
-static struct statement_list* optimize_statement_list(struct statement_list* list);
-static struct statement* optimize_statement(struct statement* state);
-static struct expr* optimize_expr(struct expr* expression);
-static struct expr_list* optimize_expr_list(struct expr_list* list);
-static struct statement_list* scan_statement_list_with_new_block(struct statement_list* list);
-static void scan_statement_list(struct statement_list* list);
-static void scan_statement(struct statement* state);
-static void scan_expr(struct expr* expression);
-static void scan_expr_list(struct expr_list* list);
+static struct statement_list* optimize_statement_list(struct compiler_ctx* ctx, struct statement_list* list);
+static struct statement* optimize_statement(struct compiler_ctx* ctx, struct statement* state);
+static struct expr* optimize_expr(struct compiler_ctx* ctx, struct expr* expression);
+static struct expr_list* optimize_expr_list(struct compiler_ctx* ctx, struct expr_list* list);
+static struct statement_list* scan_statement_list_with_new_block(struct compiler_ctx* ctx, struct statement_list* list);
+static void scan_statement_list(struct compiler_ctx* ctx, struct statement_list* list);
+// Number of times each name is bound or written in part of a unit
+struct binding_count {
+	char* name;
+	int count;
+	struct binding_count* next;
+};
+
+static void scan_statement(struct compiler_ctx* ctx, struct statement* state);
+static void scan_expr(struct compiler_ctx* ctx, struct expr* expression);
+static void scan_expr_list(struct compiler_ctx* ctx, struct expr_list* list);
+static unsigned int next_instruction(uint8_t* bytecode, unsigned int i);
+static struct binding_count* count_bindings(struct compiler_ctx* ctx, struct statement* state,
+	struct statement_list* list);
+static int binding_count_in(struct binding_count* bindings, char* name);
+static void inline_functions(struct compiler_ctx* ctx, struct statement_list* ast);
+static void share_pure_expressions(struct compiler_ctx* ctx, struct statement_list* ast);
+
+// Folded literals belong to the AST, so they point at constant strings
+static inline struct data true_literal(void) {
+	return make_data(D_TRUE, data_value_str_impl("<true>"));
+}
+
+static inline struct data false_literal(void) {
+	return make_data(D_FALSE, data_value_str_impl("<false>"));
+}
 
 static inline bool is_boolean(struct data t) {
 	return t.type == D_TRUE || t.type == D_FALSE;
 }
 
-static struct id_node* find_id_node(char* id, int line, int col) {
+static struct id_node* find_id_node(struct compiler_ctx* ctx, char* id, int line, int col) {
 	UNUSED(line);
 	UNUSED(col);
 	// Search in each block and each list. Returns null if not found for now.
 	// TODO: perform identifier checking here, but will need to add in
 	//   special cases like `this` for OOP
-	struct statement_block* b = curr_statement_block;
+	struct statement_block* b = ctx->optimizer.curr_statement_block;
 	while (b) {
 		struct id_node* n = b->id_list;
 		while (n) {
@@ -65,18 +97,16 @@ static struct id_node* find_id_node(char* id, int line, int col) {
 	return 0;
 }
 
-static void remove_entry(char* id, int line, int col) {
+static void remove_entry(struct compiler_ctx* ctx, char* id, int line, int col) {
 	UNUSED(line);
 	UNUSED(col);
 	// Basic LL Search and Remove
-	struct statement_block* b = curr_statement_block;
+	struct statement_block* b = ctx->optimizer.curr_statement_block;
 	while (b) {
 		struct id_node** n = &b->id_list;
 		while (*n) {
 			if (streq((*n)->id_name, id)) {
-				struct id_node* next = (*n)->next;
-				safe_free(*n);
-				*n = next;
+				*n = (*n)->next;
 				return;
 			}
 			n = &((*n)->next);
@@ -85,150 +115,245 @@ static void remove_entry(char* id, int line, int col) {
 	}
 }
 
-static void add_usage(char* id, int line, int col) {
-	struct id_node* r = find_id_node(id, line, col);
+static void add_usage(struct compiler_ctx* ctx, char* id, int line, int col) {
+	struct id_node* r = find_id_node(ctx, id, line, col);
 	if (r) r->usage_count++;
 }
 
-static void remove_usage(char* id, int line, int col) {
-	struct id_node* r = find_id_node(id, line, col);
+static void remove_usage(struct compiler_ctx* ctx, char* id, int line, int col) {
+	struct id_node* r = find_id_node(ctx, id, line, col);
 	if (r) r->usage_count--;
 }
 
-static int get_usage(char* id, int line, int col) {
-	struct id_node* r = find_id_node(id, line, col);
+static int get_usage(struct compiler_ctx* ctx, char* id, int line, int col) {
+	struct id_node* r = find_id_node(ctx, id, line, col);
 	if (r) return r->usage_count;
 	else return 100;
 }
 
-static struct expr* get_value(char* id, int line, int col) {
-	struct id_node* r = find_id_node(id, line, col);
+static struct expr* get_value(struct compiler_ctx* ctx, char* id, int line, int col) {
+	struct id_node* r = find_id_node(ctx, id, line, col);
 	if (r) return r->value;
 	else return 0;
 }
 
-static int get_modified(char* id, int line, int col) {
-	struct id_node* r = find_id_node(id, line, col);
+static int get_modified(struct compiler_ctx* ctx, char* id, int line, int col) {
+	struct id_node* r = find_id_node(ctx, id, line, col);
 	if (r) return r->modified_count;
 	else return 100;
 }
 
-static void add_modified(char* id, int line, int col) {
-	struct id_node* r = find_id_node(id, line, col);
+static void add_modified(struct compiler_ctx* ctx, char* id, int line, int col) {
+	struct id_node* r = find_id_node(ctx, id, line, col);
 	if (r) r->modified_count++;
 }
 
-void optimize_safe_free_e(struct expr* expression, struct traversal_algorithm* algo) {
-	UNUSED(algo);
+// is_outside_function(ctx, id) returns true if id is bound outside the
+//   function being scanned, where it could change before any call
+static bool is_outside_function(struct compiler_ctx* ctx, char* id) {
+	for (struct statement_block* b = ctx->optimizer.curr_statement_block; b; b = b->next) {
+		for (struct id_node* n = b->id_list; n; n = n->next) {
+			if (streq(n->id_name, id)) {
+				return false;
+			}
+		}
+		if (b->is_function) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Subtrees the optimizer drops stay in the arena until compilation ends, but
+//   identifiers inside them no longer count as usages.
+static void discard_usage_e(struct expr* expression, struct traversal_algorithm* algo) {
+	struct compiler_ctx* ctx = algo->data;
 	if (expression->type == E_LITERAL
 		&& expression->op.lit_expr.type == D_IDENTIFIER) {
-		remove_usage(expression->op.lit_expr.value.string,
+		remove_usage(ctx, expression->op.lit_expr.value.string,
 				expression->line, expression->col);
 	}
-    ast_safe_free_e(expression, algo);
 }
-void optimize_safe_free_el(struct expr_list* ptr, struct traversal_algorithm* algo) {
-    UNUSED(algo);
-    ast_safe_free_el(ptr, algo);
+
+static struct traversal_algorithm discard_usages_impl = TRAVERSAL_ALGO_POST(
+	discard_usage_e, 0, 0, 0);
+
+// The usage counts being updated belong to ctx, so each discard runs with its
+//   own copy of the algorithm.
+static void discard_statement(struct compiler_ctx* ctx, struct statement* state) {
+	struct traversal_algorithm algo = discard_usages_impl;
+	algo.data = ctx;
+	traverse_statement(state, &algo);
 }
 
-void optimize_safe_free_s(struct statement* ptr, struct traversal_algorithm* algo) {
-    UNUSED(algo);
-    ast_safe_free_s(ptr, algo);
+static void discard_expr(struct compiler_ctx* ctx, struct expr* expression) {
+	struct traversal_algorithm algo = discard_usages_impl;
+	algo.data = ctx;
+	traverse_expr(expression, &algo);
 }
 
-void optimize_safe_free_sl(struct statement_list* ptr, struct traversal_algorithm* algo) {
-    UNUSED(algo);
-    ast_safe_free_sl(ptr, algo);
+static bool is_overload_name(const char* id) {
+	return strncmp(id, OPERATOR_OVERLOAD_PREFIX, strlen(OPERATOR_OVERLOAD_PREFIX)) == 0;
+}
+
+static void add_overload(struct compiler_ctx* ctx, const char* name) {
+	for (struct overload_node* n = ctx->optimizer.overloads; n; n = n->next) {
+		if (streq(n->name, name)) {
+			return;
+		}
+	}
+	struct overload_node* node = arena_alloc(&ctx->arena, sizeof(struct overload_node));
+	node->name = arena_strdup(&ctx->arena, name);
+	node->next = ctx->optimizer.overloads;
+	ctx->optimizer.overloads = node;
 }
 
-struct traversal_algorithm optimize_safe_free_impl = TRAVERSAL_ALGO_POST(
-	optimize_safe_free_e,
-	optimize_safe_free_el,
-	optimize_safe_free_s,
-	optimize_safe_free_sl);
+// add_bytecode_overloads(ctx, bytecode, start, size) adds every overload the
+//   compiled code declares, which includes everything it imported itself
+static void add_bytecode_overloads(struct compiler_ctx* ctx, uint8_t* bytecode,
+		unsigned int start, size_t size) {
+	unsigned int i = start;
+	while (i < size) {
+		if (bytecode[i] == OP_DECL) {
+			unsigned int at = i + 1;
+			char* id = get_string(bytecode + at, &at);
+			if (is_overload_name(id)) {
+				add_overload(ctx, id);
+			}
+		}
+		unsigned int next = next_instruction(bytecode, i);
+		if (!next) break;
+		i = next;
+	}
+}
 
-struct statement_list* optimize_ast(struct statement_list* ast) {
-	struct statement_list* result = scan_statement_list_with_new_block(ast);
-	free_statement_blocks(curr_statement_block);
-	return result;
+static void collect_overloads_s(struct statement* state, struct traversal_algorithm* algo) {
+	struct compiler_ctx* ctx = algo->data;
+	if (state->type == S_LET && state->op.let_statement.lvalue &&
+		is_overload_name(state->op.let_statement.lvalue)) {
+		add_overload(ctx, state->op.let_statement.lvalue);
+	}
+	else if (state->type == S_IMPORT && state->op.import_statement.is_file) {
+		// Compiled now rather than during codegen, which uses the cached unit
+		struct import_unit* unit = compile_import_unit(ctx,
+			state->op.import_statement.name, state->src_line);
+		if (unit->bytecode) {
+			add_bytecode_overloads(ctx, unit->bytecode, 0, unit->size);
+		}
+	}
+	else if (state->type == S_IMPORT) {
+		long length = 0;
+		uint8_t* buffer = read_library(ctx, state->op.import_statement.name, &length);
+		if (buffer) {
+			add_bytecode_overloads(ctx, buffer, verify_header(buffer, length), length);
+			safe_free(buffer);
+		}
+	}
+}
+
+static struct traversal_algorithm collect_overloads_impl = TRAVERSAL_ALGO_PRE(
+	0, 0, collect_overloads_s, 0);
+
+bool has_binary_overload(struct compiler_ctx* ctx, const char* type_a,
+		enum vm_operator op, const char* type_b) {
+	for (struct overload_node* n = ctx->optimizer.overloads; n; n = n->next) {
+		if (is_binary_overload(n->name, type_a, op, type_b)) {
+			return true;
+		}
+	}
+	return false;
 }
 
-static void free_statement_block(struct statement_block* block) {
-	if (!block) return;
-	free_id_nodes(curr_statement_block->id_list);
-	safe_free(block);
+bool has_unary_overload(struct compiler_ctx* ctx, enum vm_operator op, const char* type) {
+	char* name = safe_concat(OPERATOR_OVERLOAD_PREFIX, operator_string[op], type);
+	bool result = false;
+	for (struct overload_node* n = ctx->optimizer.overloads; n; n = n->next) {
+		if (streq(n->name, name)) {
+			result = true;
+			break;
+		}
+	}
+	safe_free(name);
+	return result;
 }
 
-void free_statement_blocks(struct statement_block* block) {
-	if (!block) return;
-	free_statement_blocks(block->next);
-	free_statement_block(block);
+struct statement_list* optimize_ast(struct compiler_ctx* ctx, struct statement_list* ast) {
+	ctx->optimizer.overloads = 0;
+	struct traversal_algorithm algo = collect_overloads_impl;
+	algo.data = ctx;
+	traverse_ast(ast, &algo);
+	ctx->optimizer.bindings = count_bindings(ctx, 0, ast);
+	ast = scan_statement_list_with_new_block(ctx, ast);
+	inline_functions(ctx, ast);
+	infer_types(ctx, ast);
+	share_pure_expressions(ctx, ast);
+	return ast;
 }
 
-static void free_id_nodes(struct id_node* node) {
-	if (!node) return;
-	free_id_nodes(node->next);
-	safe_free(node);
+struct statement_list* optimize_unit_ast(struct compiler_ctx* ctx, struct statement_list* ast) {
+	ctx->optimizer.keep_top_level = true;
+	struct statement_list* result = optimize_ast(ctx, ast);
+	ctx->optimizer.keep_top_level = false;
+	return result;
 }
 
-static void add_node(char* id, struct expr* value) {
-	if (!curr_statement_block) {
-		error_general(OPTIMIZER_NO_STATEMENT_BLOCK);
+static void add_node(struct compiler_ctx* ctx, char* id, struct expr* value) {
+	if (!ctx->optimizer.curr_statement_block) {
+		error_general(ctx, OPTIMIZER_NO_STATEMENT_BLOCK);
 		return;
 	}
-	struct id_node* new_node = safe_malloc(sizeof(struct id_node));
+	struct id_node* new_node = arena_alloc(&ctx->arena, sizeof(struct id_node));
 	new_node->id_name = id;
 	new_node->value = value;
 	new_node->modified_count = 0;
 	new_node->usage_count = 0;
-	new_node->next = curr_statement_block->id_list;
-	curr_statement_block->id_list = new_node;
+	new_node->next = ctx->optimizer.curr_statement_block->id_list;
+	ctx->optimizer.curr_statement_block->id_list = new_node;
 }
 
-static void make_new_block(void) {
-	struct statement_block* new_block = safe_malloc(sizeof(struct statement_block));
-	new_block->next = curr_statement_block;
+static void make_new_block(struct compiler_ctx* ctx) {
+	struct statement_block* new_block = arena_alloc(&ctx->arena, sizeof(struct statement_block));
+	new_block->next = ctx->optimizer.curr_statement_block;
 	new_block->id_list = 0;
-	curr_statement_block = new_block;
+	new_block->is_function = false;
+	ctx->optimizer.curr_statement_block = new_block;
 }
 
-static void delete_block(void) {
-	struct statement_block* next = curr_statement_block->next;
-	free_statement_block(curr_statement_block);
-	curr_statement_block = next;
+static void delete_block(struct compiler_ctx* ctx) {
+	ctx->optimizer.curr_statement_block = ctx->optimizer.curr_statement_block->next;
 }
 
-static struct statement_list* scan_optimize_statement_list(struct statement_list* list) {
+static struct statement_list* scan_optimize_statement_list(struct compiler_ctx* ctx, struct statement_list* list) {
 	// We run two passes of optimization for some unknown reason. I added this
 	//   back in the day and I can't remember why :)
-	scan_statement_list(list);
-	list = optimize_statement_list(list);
-	list = optimize_statement_list(list);
+	scan_statement_list(ctx, list);
+	list = optimize_statement_list(ctx, list);
+	list = optimize_statement_list(ctx, list);
 	return list;
 }
-static struct statement_list* scan_statement_list_with_new_block(struct statement_list* list) {
-	make_new_block();
-	list = scan_optimize_statement_list(list);
-	delete_block();
+static struct statement_list* scan_statement_list_with_new_block(struct compiler_ctx* ctx, struct statement_list* list) {
+	make_new_block(ctx);
+	list = scan_optimize_statement_list(ctx, list);
+	delete_block(ctx);
 	return list;
 }
 
 /* OPTIMIZE CODE */
-static struct statement* optimize_statement(struct statement* state) {
+static struct statement* optimize_statement(struct compiler_ctx* ctx, struct statement* state) {
 	if (!state) return 0;
 	switch (state->type) {
 		case S_LET: {
 			state->op.let_statement.rvalue =
-					optimize_expr(state->op.let_statement.rvalue);
-			if (get_usage(state->op.let_statement.lvalue,
+					optimize_expr(ctx, state->op.let_statement.rvalue);
+			bool exported = ctx->optimizer.keep_top_level && !ctx->optimizer.curr_statement_block->next;
+			if (!exported && get_usage(ctx, state->op.let_statement.lvalue,
 					state->src_line,
 					0) == 0 &&
 				state->op.let_statement.rvalue->type == E_LITERAL) {
-				remove_entry(state->op.let_statement.lvalue,
+				remove_entry(ctx, state->op.let_statement.lvalue,
 					state->src_line,
 					0);
-				traverse_statement(state, &optimize_safe_free_impl);
+				discard_statement(ctx, state);
 
 				return 0;
 			}
@@ -241,7 +366,7 @@ static struct statement* optimize_statement(struct statement* state) {
 			break;
 		}
 		case S_EXPR: {
-			state->op.expr_statement = optimize_expr(state->op.expr_statement);
+			state->op.expr_statement = optimize_expr(ctx, state->op.expr_statement);
 			break;
 		}
 		case S_BLOCK: {
@@ -252,53 +377,51 @@ static struct statement* optimize_statement(struct statement* state) {
 		}
 		case S_STRUCT: {
 			state->op.struct_statement.init_fn =
-				optimize_expr(state->op.struct_statement.init_fn);
+				optimize_expr(ctx, state->op.struct_statement.init_fn);
 			state->op.struct_statement.instance_members =
-				optimize_expr_list(state->op.struct_statement.instance_members);
+				optimize_expr_list(ctx, state->op.struct_statement.instance_members);
 			state->op.struct_statement.static_members =
-				optimize_expr_list(state->op.struct_statement.static_members);
+				optimize_expr_list(ctx, state->op.struct_statement.static_members);
 			break;
 		}
 		case S_ENUM: {
 			state->op.enum_statement.values =
-				optimize_expr_list(state->op.enum_statement.values);
+				optimize_expr_list(ctx, state->op.enum_statement.values);
 			break;
 		}
 		case S_IF: {
 			state->op.if_statement.condition =
-				optimize_expr(state->op.if_statement.condition);
+				optimize_expr(ctx, state->op.if_statement.condition);
 			struct expr* condition = state->op.if_statement.condition;
 
 			state->op.if_statement.statement_true =
-				optimize_statement(state->op.if_statement.statement_true);
+				optimize_statement(ctx, state->op.if_statement.statement_true);
 			state->op.if_statement.statement_false =
-				optimize_statement(state->op.if_statement.statement_false);
+				optimize_statement(ctx, state->op.if_statement.statement_false);
 
 			struct statement* run_if_false = state->op.if_statement.statement_false;
 			struct statement* run_if_true = state->op.if_statement.statement_true;
 			if (condition->type == E_LITERAL && condition->op.lit_expr.type == D_TRUE) {
 				// Always going to be true!
-				traverse_statement(run_if_false, &optimize_safe_free_impl);
-				traverse_expr(condition, &optimize_safe_free_impl);
-				safe_free(state);
+				discard_statement(ctx, run_if_false);
+				discard_expr(ctx, condition);
 				return run_if_true;
 			}
 			else if (condition->type == E_LITERAL && condition->op.lit_expr.type == D_FALSE) {
-				traverse_statement(run_if_true, &optimize_safe_free_impl);
-				traverse_expr(condition, &optimize_safe_free_impl);
-				safe_free(state);
+				discard_statement(ctx, run_if_true);
+				discard_expr(ctx, condition);
 				return run_if_false;
 			}
 			break;
 		}
 		case S_LOOP: {
 			state->op.loop_statement.condition =
-				optimize_expr(state->op.loop_statement.condition);
+				optimize_expr(ctx, state->op.loop_statement.condition);
 			state->op.loop_statement.statement_true =
-				optimize_statement(state->op.loop_statement.statement_true);
+				optimize_statement(ctx, state->op.loop_statement.statement_true);
 			if (!state->op.loop_statement.statement_true) {
 				// Empty Body
-				traverse_expr(state->op.loop_statement.condition, &optimize_safe_free_impl);
+				discard_expr(ctx, state->op.loop_statement.condition);
 				return 0;
 			}
 			break;
@@ -308,36 +431,40 @@ static struct statement* optimize_statement(struct statement* state) {
 	return state;
 }
 
-static struct statement_list* optimize_statement_list(struct statement_list* list) {
+static struct statement_list* optimize_statement_list(struct compiler_ctx* ctx, struct statement_list* list) {
 	if (!list) return 0;
-	list->next = optimize_statement_list(list->next);
-	list->elem = optimize_statement(list->elem);
+	list->next = optimize_statement_list(ctx, list->next);
+	list->elem = optimize_statement(ctx, list->elem);
 	if (list->elem) {
 		return list;
 	}
 	else {
 		// No struct statement
-		struct statement_list* next = list->next;
-		safe_free(list);
-		return next;
+		return list->next;
 	}
 }
 
-static struct expr* optimize_expr(struct expr* expression) {
+static struct expr* optimize_expr(struct compiler_ctx* ctx, struct expr* expression) {
 	if (!expression) return 0;
 	switch (expression->type) {
 		case E_LITERAL: {
 			if (expression->op.lit_expr.type == D_IDENTIFIER) {
-				// Is a static, then replace with value if literal
-				if (get_modified(expression->op.lit_expr.value.string,
-					expression->line, expression->col) == 0) {
-					struct expr* value = get_value(expression->op.lit_expr.value.string,
+				// Is a static, then replace with value if literal. Inside a
+				//   function, names from outside only count if nothing
+				//   anywhere writes them, a call can come after any write.
+				char* id = expression->op.lit_expr.value.string;
+				if (get_modified(ctx, id, expression->line, expression->col) == 0 &&
+					(!is_outside_function(ctx, id) ||
+					binding_count_in(ctx->optimizer.bindings, id) <= 1)) {
+					struct expr* value = get_value(ctx, expression->op.lit_expr.value.string,
 						expression->line, expression->col);
-					if (value && value->type == E_LITERAL) {
-						remove_usage(expression->op.lit_expr.value.string,
+					// An identifier isn't a constant, it may change before
+					//   this use
+					if (value && value->type == E_LITERAL &&
+						value->op.lit_expr.type != D_IDENTIFIER) {
+						remove_usage(ctx, expression->op.lit_expr.value.string,
 							expression->line, expression->col);
-						destroy_data(&expression->op.lit_expr);
-						expression->op.lit_expr = copy_data(value->op.lit_expr);
+						expression->op.lit_expr = value->op.lit_expr;
 					}
 				}
 			}
@@ -345,16 +472,17 @@ static struct expr* optimize_expr(struct expr* expression) {
 		}
 		case E_BINARY: {
 			expression->op.bin_expr.left =
-				optimize_expr(expression->op.bin_expr.left);
+				optimize_expr(ctx, expression->op.bin_expr.left);
 			expression->op.bin_expr.right =
-				optimize_expr(expression->op.bin_expr.right);
+				optimize_expr(ctx, expression->op.bin_expr.right);
 
 			struct expr* left = expression->op.bin_expr.left;
 			struct expr* right = expression->op.bin_expr.right;
 			enum vm_operator op = expression->op.bin_expr.vm_operator;
-			struct data possible_optimized;
+			struct data possible_optimized = make_data(D_NUMBER, data_value_num(0));
 			if (left->type == E_LITERAL && left->op.lit_expr.type == D_NUMBER &&
-				right->type == E_LITERAL && right->op.lit_expr.type == D_NUMBER) {
+				right->type == E_LITERAL && right->op.lit_expr.type == D_NUMBER &&
+				!has_binary_overload(ctx, "number", op, "number")) {
 				// Peek Optimization is Available on Numbers
 				// Optimized Reuslt will be on OP
 				bool can_optimize = true;
@@ -368,11 +496,18 @@ static struct expr* optimize_expr(struct expr* expression) {
 						if (b != 0) {
 							possible_optimized.value.number = (int)(a / b);
 						}
+						else {
+							// Left for the VM to report
+							can_optimize = false;
+						}
 						break;
 					case O_DIV:
 						if (b != 0) {
 							possible_optimized.value.number = a / b;
 						}
+						else {
+							can_optimize = false;
+						}
 						break;
 					case O_REM:
 						if (b != 0 && a == floor(a) && b == floor(b)) {
@@ -392,22 +527,22 @@ static struct expr* optimize_expr(struct expr* expression) {
 						possible_optimized.value.number = a + b;
 						break;
 					case O_LT:
-						possible_optimized = a < b ? true_data() : false_data();
+						possible_optimized = a < b ? true_literal() : false_literal();
 						break;
 					case O_GT:
-						possible_optimized = a > b ? true_data() : false_data();
+						possible_optimized = a > b ? true_literal() : false_literal();
 						break;
 					case O_LTE:
-						possible_optimized = a <= b ? true_data() : false_data();
+						possible_optimized = a <= b ? true_literal() : false_literal();
 						break;
 					case O_GTE:
-						possible_optimized = a >= b ? true_data() : false_data();
+						possible_optimized = a >= b ? true_literal() : false_literal();
 						break;
 					case O_EQ:
-						possible_optimized = a == b ? true_data() : false_data();
+						possible_optimized = a == b ? true_literal() : false_literal();
 						break;
 					case O_NEQ:
-						possible_optimized = a != b ? true_data() : false_data();
+						possible_optimized = a != b ? true_literal() : false_literal();
 						break;
 					default:
 						can_optimize = false;
@@ -420,23 +555,22 @@ static struct expr* optimize_expr(struct expr* expression) {
 					}
 					expression->type = E_LITERAL;
 					expression->op.lit_expr = possible_optimized;
-					safe_free(left);
-					safe_free(right);
 					return expression;
 				}
 			}
 			else if (left->type == E_LITERAL && is_boolean(left->op.lit_expr) &&
-				right->type == E_LITERAL && is_boolean(right->op.lit_expr)) {
+				right->type == E_LITERAL && is_boolean(right->op.lit_expr) &&
+				!has_binary_overload(ctx, "bool", op, "bool")) {
 				// Peek Optimization is Available on Booleans
 				bool can_optimize = true;
 				bool a = left->op.lit_expr.type == D_TRUE;
 				bool b = right->op.lit_expr.type == D_TRUE;
 				switch (op) {
 					case O_AND:
-						possible_optimized = a && b ? true_data() : false_data();
+						possible_optimized = a && b ? true_literal() : false_literal();
 						break;
 					case O_OR:
-						possible_optimized = a || b ? true_data() : false_data();
+						possible_optimized = a || b ? true_literal() : false_literal();
 						break;
 					default:
 						can_optimize = false;
@@ -445,8 +579,6 @@ static struct expr* optimize_expr(struct expr* expression) {
 				if (can_optimize) {
 					expression->type = E_LITERAL;
 					expression->op.lit_expr = possible_optimized;
-					safe_free(left);
-					safe_free(right);
 					return expression;
 				}
 			}
@@ -454,74 +586,87 @@ static struct expr* optimize_expr(struct expr* expression) {
 		}
 		case E_UNARY: {
 			expression->op.una_expr.operand =
-				optimize_expr(expression->op.una_expr.operand);
+				optimize_expr(ctx, expression->op.una_expr.operand);
 			enum vm_operator op = expression->op.una_expr.vm_operator;
 			struct expr* operand = expression->op.una_expr.operand;
 			if (op == O_NEG && operand->type == E_LITERAL &&
-				operand->op.lit_expr.type == D_NUMBER) {
+				operand->op.lit_expr.type == D_NUMBER &&
+				!has_unary_overload(ctx, op, "number")) {
 				// Apply here
 				operand->op.lit_expr.value.number *= -1;
-				safe_free(expression);
 				return operand;
 			}
 			if (op == O_NOT && operand->type == E_LITERAL &&
 				(operand->op.lit_expr.type == D_TRUE ||
-				operand->op.lit_expr.type == D_FALSE)) {
+				operand->op.lit_expr.type == D_FALSE) &&
+				!has_unary_overload(ctx, op, "bool")) {
 				// Apply here
 				operand->op.lit_expr =
-					operand->op.lit_expr.type == D_TRUE ? false_data() : true_data();
-				safe_free(expression);
+					operand->op.lit_expr.type == D_TRUE ? false_literal() : true_literal();
 				return operand;
 			}
 			break;
 		}
 		case E_IF: {
 			expression->op.if_expr.condition =
-				optimize_expr(expression->op.if_expr.condition);
+				optimize_expr(ctx, expression->op.if_expr.condition);
 			expression->op.if_expr.expr_true =
-				optimize_expr(expression->op.if_expr.expr_true);
+				optimize_expr(ctx, expression->op.if_expr.expr_true);
 			expression->op.if_expr.expr_false =
-				optimize_expr(expression->op.if_expr.expr_false);
+				optimize_expr(ctx, expression->op.if_expr.expr_false);
 			break;
 		}
 		case E_CALL: {
 			expression->op.call_expr.function =
-				optimize_expr(expression->op.call_expr.function);
+				optimize_expr(ctx, expression->op.call_expr.function);
 			expression->op.call_expr.arguments =
-				optimize_expr_list(expression->op.call_expr.arguments);
+				optimize_expr_list(ctx, expression->op.call_expr.arguments);
 			break;
 		}
 		case E_SUPER_CALL: {
 			expression->op.super_call_expr.arguments =
-				optimize_expr_list(expression->op.super_call_expr.arguments);
+				optimize_expr_list(ctx, expression->op.super_call_expr.arguments);
 			break;
 		}
 		case E_LIST: {
 			expression->op.list_expr.contents =
-				optimize_expr_list(expression->op.list_expr.contents);
+				optimize_expr_list(ctx, expression->op.list_expr.contents);
 			break;
 		}
 		case E_FUNCTION: {
+			// Parameters shadow names outside, and like a name the optimizer
+			//   never saw they're counted as used and written
+			make_new_block(ctx);
+			ctx->optimizer.curr_statement_block->is_function = true;
+			struct expr_list* curr = expression->op.func_expr.parameters;
+			while (curr) {
+				add_node(ctx, curr->elem->op.lit_expr.value.string, 0);
+				struct id_node* parameter = ctx->optimizer.curr_statement_block->id_list;
+				parameter->usage_count = 100;
+				parameter->modified_count = 100;
+				curr = curr->next;
+			}
 			expression->op.func_expr.body =
-				optimize_statement(expression->op.func_expr.body);
+				optimize_statement(ctx, expression->op.func_expr.body);
+			delete_block(ctx);
 			break;
 		}
 		case E_TABLE: {
 			expression->op.table_expr.values =
-				optimize_expr_list(expression->op.table_expr.values);
+				optimize_expr_list(ctx, expression->op.table_expr.values);
 			break;
 		}
 		case E_ASSIGN: {
 			if (expression->op.assign_expr.lvalue->type == E_LITERAL &&
 				expression->op.assign_expr.lvalue->op.lit_expr.type == D_IDENTIFIER) {
 					// Only optimize if not lists
-				if (get_usage(expression->op.assign_expr.lvalue->op.lit_expr.value.string,
+				if (get_usage(ctx, expression->op.assign_expr.lvalue->op.lit_expr.value.string,
 						expression->line, expression->col) == 0) {
-					traverse_expr(expression, &optimize_safe_free_impl);
+					discard_expr(ctx, expression);
 					return 0;
 				}
 				expression->op.assign_expr.rvalue =
-					optimize_expr(expression->op.assign_expr.rvalue);
+					optimize_expr(ctx, expression->op.assign_expr.rvalue);
 			}
 			break;
 		}
@@ -529,42 +674,40 @@ static struct expr* optimize_expr(struct expr* expression) {
 	return expression;
 }
 
-static struct expr_list* optimize_expr_list(struct expr_list* list) {
+static struct expr_list* optimize_expr_list(struct compiler_ctx* ctx, struct expr_list* list) {
 	if (!list) return 0;
-	list->next = optimize_expr_list(list->next);
-	list->elem = optimize_expr(list->elem);
+	list->next = optimize_expr_list(ctx, list->next);
+	list->elem = optimize_expr(ctx, list->elem);
 	if (list->elem) {
 		return list;
 	}
 	else {
 		// No struct statement
-		struct expr_list* next = list->next;
-		safe_free(list);
-		return next;
+		return list->next;
 	}
 }
 
 /* BEGIN SCANNING CODE */
-static void scan_statement(struct statement* state) {
+static void scan_statement(struct compiler_ctx* ctx, struct statement* state) {
 	if (!state) return;
 	switch (state->type) {
 		case S_LET: {
 			// Add Usage
-			add_node(state->op.let_statement.lvalue,
+			add_node(ctx, state->op.let_statement.lvalue,
 				state->op.let_statement.rvalue);
-			scan_expr(state->op.let_statement.rvalue);
+			scan_expr(ctx, state->op.let_statement.rvalue);
 			break;
 		}
 		case S_OPERATION: {
 			enum opcode op = state->op.operation_statement.vm_operator;
 			if (op == OP_RET) {
-				scan_expr(state->op.operation_statement.operand);
+				scan_expr(ctx, state->op.operation_statement.operand);
 			}
 			else if (op == OP_OUTL) {
-				scan_expr(state->op.operation_statement.operand);
+				scan_expr(ctx, state->op.operation_statement.operand);
 			}
 			else {
-				add_modified(state->op.operation_statement.operand->op.lit_expr.value.string,
+				add_modified(ctx, state->op.operation_statement.operand->op.lit_expr.value.string,
 					state->src_line, 0);
 			}
 			break;
@@ -574,62 +717,67 @@ static void scan_statement(struct statement* state) {
 		case S_BYTECODE:
 			break;
 		case S_EXPR: {
-			scan_expr(state->op.expr_statement);
+			scan_expr(ctx, state->op.expr_statement);
 			break;
 		}
 		case S_BLOCK: {
 			state->op.block_statement =
-				scan_optimize_statement_list(state->op.block_statement);
+				scan_optimize_statement_list(ctx, state->op.block_statement);
 			break;
 		}
 		case S_STRUCT: {
-			scan_expr(state->op.struct_statement.init_fn);
-			scan_expr_list(state->op.struct_statement.instance_members);
-			scan_expr_list(state->op.struct_statement.static_members);
+			scan_expr(ctx, state->op.struct_statement.init_fn);
+			scan_expr_list(ctx, state->op.struct_statement.instance_members);
+			scan_expr_list(ctx, state->op.struct_statement.static_members);
 			break;
 		}
 		case S_ENUM: {
-			scan_expr_list(state->op.enum_statement.values);
+			scan_expr_list(ctx, state->op.enum_statement.values);
 			break;
 		}
 		case S_IF: {
-			scan_expr(state->op.if_statement.condition);
-			make_new_block();
-			scan_statement(state->op.if_statement.statement_true);
-			delete_block();
-			make_new_block();
-			scan_statement(state->op.if_statement.statement_false);
-			delete_block();
+			scan_expr(ctx, state->op.if_statement.condition);
+			make_new_block(ctx);
+			scan_statement(ctx, state->op.if_statement.statement_true);
+			delete_block(ctx);
+			make_new_block(ctx);
+			scan_statement(ctx, state->op.if_statement.statement_false);
+			delete_block(ctx);
 			break;
 		}
 		case S_LOOP: {
 			if (state->op.loop_statement.index_var) {
-				add_modified(state->op.loop_statement.index_var,
+				add_modified(ctx, state->op.loop_statement.index_var,
 					state->src_line, 0);
 			}
-			scan_expr(state->op.loop_statement.condition);
-			make_new_block();
-			scan_statement(state->op.loop_statement.statement_true);
-			delete_block();
+			// Blocks inside are optimized as they're scanned, so anything
+			//   the loop writes later has to count before they are
+			for (struct binding_count* b = count_bindings(ctx, state, 0); b; b = b->next) {
+				add_modified(ctx, b->name, state->src_line, 0);
+			}
+			scan_expr(ctx, state->op.loop_statement.condition);
+			make_new_block(ctx);
+			scan_statement(ctx, state->op.loop_statement.statement_true);
+			delete_block(ctx);
 			break;
 		}
 		case S_IMPORT: break;
 	}
 }
 
-static void scan_statement_list(struct statement_list* list) {
+static void scan_statement_list(struct compiler_ctx* ctx, struct statement_list* list) {
 	if (!list) return;
-	scan_statement(list->elem);
-	scan_statement_list(list->next);
+	scan_statement(ctx, list->elem);
+	scan_statement_list(ctx, list->next);
 }
 
-static void scan_expr(struct expr* expression) {
+static void scan_expr(struct compiler_ctx* ctx, struct expr* expression) {
 	if (!expression) return;
 	switch (expression->type) {
 		case E_LITERAL: {
 			if (expression->op.lit_expr.type == D_IDENTIFIER) {
 				// Used!
-				add_usage(expression->op.lit_expr.value.string,
+				add_usage(ctx, expression->op.lit_expr.value.string,
 					expression->line, expression->col);
 			}
 			break;
@@ -638,67 +786,1536 @@ static void scan_expr(struct expr* expression) {
 			if (expression->op.bin_expr.vm_operator == O_MOD_EQUAL) {
 				if (expression->op.bin_expr.left->type == E_LITERAL &&
 					expression->op.bin_expr.left->op.lit_expr.type == D_IDENTIFIER) {
-					add_modified(expression->op.bin_expr.left->op.lit_expr.value.string,
+					add_modified(ctx, expression->op.bin_expr.left->op.lit_expr.value.string,
 						expression->line, expression->col);
 				}
 			}
-			scan_expr(expression->op.bin_expr.left);
-			scan_expr(expression->op.bin_expr.right);
+			scan_expr(ctx, expression->op.bin_expr.left);
+			scan_expr(ctx, expression->op.bin_expr.right);
 			break;
 		}
 		case E_UNARY: {
-			scan_expr(expression->op.una_expr.operand);
+			scan_expr(ctx, expression->op.una_expr.operand);
 			break;
 		}
 		case E_IF: {
-			scan_expr(expression->op.if_expr.condition);
-			scan_expr(expression->op.if_expr.expr_true);
-			scan_expr(expression->op.if_expr.expr_false);
+			scan_expr(ctx, expression->op.if_expr.condition);
+			scan_expr(ctx, expression->op.if_expr.expr_true);
+			scan_expr(ctx, expression->op.if_expr.expr_false);
 			break;
 		}
 		case E_CALL: {
-			scan_expr(expression->op.call_expr.function);
-			scan_expr_list(expression->op.call_expr.arguments);
+			scan_expr(ctx, expression->op.call_expr.function);
+			scan_expr_list(ctx, expression->op.call_expr.arguments);
 			break;
 		}
 		case E_SUPER_CALL: {
-			scan_expr_list(expression->op.super_call_expr.arguments);
+			scan_expr_list(ctx, expression->op.super_call_expr.arguments);
 			break;
 		}
 		case E_LIST: {
-			scan_expr_list(expression->op.list_expr.contents);
+			scan_expr_list(ctx, expression->op.list_expr.contents);
 			break;
 		}
 		case E_FUNCTION: {
-			make_new_block();
+			make_new_block(ctx);
+			ctx->optimizer.curr_statement_block->is_function = true;
 			struct expr_list* curr = expression->op.func_expr.parameters;
 			while (curr) {
-				add_node(curr->elem->op.lit_expr.value.string, 0);
+				add_node(ctx, curr->elem->op.lit_expr.value.string, 0);
 				curr = curr->next;
 			}
-			scan_statement(expression->op.func_expr.body);
-			delete_block();
+			scan_statement(ctx, expression->op.func_expr.body);
+			delete_block(ctx);
 			break;
 		}
 		case E_TABLE: {
-			scan_expr_list(expression->op.table_expr.values);
+			scan_expr_list(ctx, expression->op.table_expr.values);
 			break;
 		}
 		case E_ASSIGN: {
 			if (expression->op.assign_expr.lvalue->type == E_LITERAL &&
 				expression->op.assign_expr.lvalue->op.lit_expr.type == D_IDENTIFIER) {
-				add_modified(expression->op.assign_expr.lvalue->op.lit_expr.value.string,
+				add_modified(ctx, expression->op.assign_expr.lvalue->op.lit_expr.value.string,
 					expression->line, expression->col);
 			}
-			scan_expr(expression->op.assign_expr.lvalue);
-			scan_expr(expression->op.assign_expr.rvalue);
+			scan_expr(ctx, expression->op.assign_expr.lvalue);
+			scan_expr(ctx, expression->op.assign_expr.rvalue);
 			break;
 		}
 	}
 }
 
-static void scan_expr_list(struct expr_list* list) {
+static void scan_expr_list(struct compiler_ctx* ctx, struct expr_list* list) {
 	if (!list) return;
-	scan_expr(list->elem);
-	scan_expr_list(list->next);
+	scan_expr(ctx, list->elem);
+	scan_expr_list(ctx, list->next);
+}
+
+/* BINDING COUNTS */
+
+struct binding_counter {
+	struct compiler_ctx* ctx;
+	struct binding_count* bindings;
+	// Set if an import or inline bytecode could bind any name
+	bool found_import;
+};
+
+static void count_binding(struct binding_counter* counter, char* name) {
+	for (struct binding_count* b = counter->bindings; b; b = b->next) {
+		if (streq(b->name, name)) {
+			b->count++;
+			return;
+		}
+	}
+	struct binding_count* b = arena_alloc(&counter->ctx->arena, sizeof(struct binding_count));
+	b->name = name;
+	b->count = 1;
+	b->next = counter->bindings;
+	counter->bindings = b;
+}
+
+static int binding_count_in(struct binding_count* bindings, char* name) {
+	for (struct binding_count* b = bindings; b; b = b->next) {
+		if (streq(b->name, name)) {
+			return b->count;
+		}
+	}
+	return 0;
+}
+
+static bool is_identifier_expr(struct expr* expression) {
+	return expression && expression->type == E_LITERAL &&
+		expression->op.lit_expr.type == D_IDENTIFIER;
+}
+
+static void count_lvalue(struct binding_counter* counter, struct expr* lvalue) {
+	if (is_identifier_expr(lvalue)) {
+		count_binding(counter, lvalue->op.lit_expr.value.string);
+	}
+	else if (lvalue && lvalue->type == E_LIST) {
+		for (struct expr_list* l = lvalue->op.list_expr.contents; l; l = l->next) {
+			count_lvalue(counter, l->elem);
+		}
+	}
+}
+
+static void count_bindings_e(struct expr* expression, struct traversal_algorithm* algo) {
+	struct binding_counter* counter = algo->data;
+	if (expression->type == E_ASSIGN) {
+		count_lvalue(counter, expression->op.assign_expr.lvalue);
+	}
+	else if (expression->type == E_BINARY &&
+		expression->op.bin_expr.vm_operator == O_MOD_EQUAL) {
+		count_lvalue(counter, expression->op.bin_expr.left);
+	}
+	else if (expression->type == E_FUNCTION) {
+		for (struct expr_list* p = expression->op.func_expr.parameters; p; p = p->next) {
+			count_lvalue(counter, p->elem->type == E_ASSIGN ?
+				p->elem->op.assign_expr.lvalue : p->elem);
+		}
+	}
+}
+
+static void count_bindings_s(struct statement* state, struct traversal_algorithm* algo) {
+	struct binding_counter* counter = algo->data;
+	switch (state->type) {
+		case S_LET:
+			count_binding(counter, state->op.let_statement.lvalue);
+			break;
+		case S_STRUCT:
+			count_binding(counter, state->op.struct_statement.name);
+			break;
+		case S_ENUM:
+			count_binding(counter, state->op.enum_statement.name);
+			break;
+		case S_LOOP:
+			if (state->op.loop_statement.index_var) {
+				count_binding(counter, state->op.loop_statement.index_var);
+			}
+			break;
+		case S_OPERATION:
+			if (state->op.operation_statement.vm_operator != OP_RET &&
+				state->op.operation_statement.vm_operator != OP_OUTL) {
+				count_lvalue(counter, state->op.operation_statement.operand);
+			}
+			break;
+		case S_IMPORT:
+		case S_BYTECODE:
+			counter->found_import = true;
+			break;
+		default: break;
+	}
+}
+
+static struct traversal_algorithm count_bindings_impl = TRAVERSAL_ALGO_PRE(
+	count_bindings_e, 0, count_bindings_s, 0);
+
+// count_bindings(ctx, state, list) counts the names bound or written in state
+//   or list, whichever is given
+static struct binding_count* count_bindings(struct compiler_ctx* ctx, struct statement* state,
+		struct statement_list* list) {
+	struct binding_counter counter = { ctx, 0, false };
+	struct traversal_algorithm algo = count_bindings_impl;
+	algo.data = &counter;
+	if (state) {
+		traverse_statement(state, &algo);
+	}
+	else {
+		traverse_ast(list, &algo);
+	}
+	return counter.bindings;
+}
+
+/* INLINING */
+
+// Largest function body, in expression nodes, that is copied into its callers
+#define INLINE_MAX_NODES 24
+// Largest argument that is copied to each use of its parameter instead of
+//   being evaluated once
+#define INLINE_MAX_RECOMPUTED 5
+
+// Top level function bindings whose calls are replaced by their bodies
+struct inline_candidate {
+	char* name;
+	struct expr* function;
+	struct inline_candidate* next;
+};
+
+struct inline_state {
+	struct compiler_ctx* ctx;
+	// Number of times each name is bound or written anywhere in the unit
+	struct binding_count* bindings;
+	struct inline_candidate* candidates;
+};
+
+static struct expr_list* find_parameter(struct expr* function, char* name) {
+	for (struct expr_list* p = function->op.func_expr.parameters; p; p = p->next) {
+		struct expr* param = p->elem->type == E_ASSIGN ?
+			p->elem->op.assign_expr.lvalue : p->elem;
+		if (streq(param->op.lit_expr.value.string, name)) {
+			return p;
+		}
+	}
+	return 0;
+}
+
+// pure_size(expression, function) returns the number of nodes in expression,
+//   or -1 if it could have side effects besides operators, or refers to a name
+//   that isn't a parameter of function. Any name is allowed if function is 0.
+static int pure_size(struct expr* expression, struct expr* function) {
+	if (!expression) return 0;
+	int a, b, c;
+	switch (expression->type) {
+		case E_LITERAL:
+			if (function && is_identifier_expr(expression) &&
+				!find_parameter(function, expression->op.lit_expr.value.string)) {
+				return -1;
+			}
+			return 1;
+		case E_BINARY:
+			if (expression->op.bin_expr.vm_operator == O_MOD_EQUAL) return -1;
+			a = pure_size(expression->op.bin_expr.left, function);
+			b = pure_size(expression->op.bin_expr.right, function);
+			return a < 0 || b < 0 ? -1 : a + b + 1;
+		case E_UNARY:
+			if (expression->op.una_expr.vm_operator == O_SPREAD) return -1;
+			a = pure_size(expression->op.una_expr.operand, function);
+			return a < 0 ? -1 : a + 1;
+		case E_IF:
+			a = pure_size(expression->op.if_expr.condition, function);
+			b = pure_size(expression->op.if_expr.expr_true, function);
+			c = pure_size(expression->op.if_expr.expr_false, function);
+			return a < 0 || b < 0 || c < 0 ? -1 : a + b + c + 1;
+		case E_LIST: {
+			int size = 1;
+			for (struct expr_list* l = expression->op.list_expr.contents; l; l = l->next) {
+				a = pure_size(l->elem, function);
+				if (a < 0) return -1;
+				size += a;
+			}
+			return size;
+		}
+		default:
+			return -1;
+	}
+}
+
+// returned_size(state, function) is pure_size for the expression a statement
+//   of the function body always returns, -1 if it doesn't always return one
+static int returned_size(struct statement* state, struct expr* function) {
+	if (!state) return -1;
+	switch (state->type) {
+		case S_OPERATION:
+			if (state->op.operation_statement.vm_operator != OP_RET ||
+				!state->op.operation_statement.operand) {
+				return -1;
+			}
+			return pure_size(state->op.operation_statement.operand, function);
+		case S_BLOCK:
+			if (!state->op.block_statement || state->op.block_statement->next) {
+				return -1;
+			}
+			return returned_size(state->op.block_statement->elem, function);
+		case S_IF: {
+			int a = pure_size(state->op.if_statement.condition, function);
+			int b = returned_size(state->op.if_statement.statement_true, function);
+			int c = returned_size(state->op.if_statement.statement_false, function);
+			return a < 0 || b < 0 || c < 0 ? -1 : a + b + c + 1;
+		}
+		default:
+			return -1;
+	}
+}
+
+static bool can_inline_function(struct expr* function) {
+	if (function->type != E_FUNCTION || function->op.func_expr.is_native ||
+		function->op.func_expr.is_struct_init) {
+		return false;
+	}
+	// Default values are evaluated in the callee, only constants are the same
+	//   in the caller
+	for (struct expr_list* p = function->op.func_expr.parameters; p; p = p->next) {
+		if (p->elem->type == E_ASSIGN &&
+			(p->elem->op.assign_expr.rvalue->type != E_LITERAL ||
+			is_identifier_expr(p->elem->op.assign_expr.rvalue))) {
+			return false;
+		}
+	}
+	struct statement* body = function->op.func_expr.body;
+	int size = body && body->type == S_EXPR ?
+		pure_size(body->op.expr_statement, function) :
+		returned_size(body, function);
+	return size > 0 && size <= INLINE_MAX_NODES;
+}
+
+// parameter_uses(expression, name, conditional) counts the uses of name in
+//   expression, uses that might not run are counted in conditional
+static int parameter_uses(struct expr* expression, char* name, int* conditional) {
+	if (!expression) return 0;
+	switch (expression->type) {
+		case E_LITERAL:
+			return is_identifier_expr(expression) &&
+				streq(expression->op.lit_expr.value.string, name);
+		case E_BINARY: {
+			enum vm_operator op = expression->op.bin_expr.vm_operator;
+			int left = parameter_uses(expression->op.bin_expr.left, name, conditional);
+			int right = parameter_uses(expression->op.bin_expr.right, name, conditional);
+			if (op == O_AND || op == O_OR) {
+				*conditional += right;
+			}
+			return left + right;
+		}
+		case E_UNARY:
+			return parameter_uses(expression->op.una_expr.operand, name, conditional);
+		case E_IF: {
+			int branches = parameter_uses(expression->op.if_expr.expr_true, name, conditional) +
+				parameter_uses(expression->op.if_expr.expr_false, name, conditional);
+			*conditional += branches;
+			return parameter_uses(expression->op.if_expr.condition, name, conditional) +
+				branches;
+		}
+		case E_LIST: {
+			int uses = 0;
+			for (struct expr_list* l = expression->op.list_expr.contents; l; l = l->next) {
+				uses += parameter_uses(l->elem, name, conditional);
+			}
+			return uses;
+		}
+		default:
+			return 0;
+	}
+}
+
+static int returned_parameter_uses(struct statement* state, char* name, int* conditional) {
+	switch (state->type) {
+		case S_EXPR:
+			return parameter_uses(state->op.expr_statement, name, conditional);
+		case S_OPERATION:
+			return parameter_uses(state->op.operation_statement.operand, name, conditional);
+		case S_BLOCK:
+			return returned_parameter_uses(state->op.block_statement->elem, name, conditional);
+		case S_IF: {
+			int branches =
+				returned_parameter_uses(state->op.if_statement.statement_true, name, conditional) +
+				returned_parameter_uses(state->op.if_statement.statement_false, name, conditional);
+			*conditional += branches;
+			return parameter_uses(state->op.if_statement.condition, name, conditional) +
+				branches;
+		}
+		default:
+			return 0;
+	}
+}
+
+static bool makes_list(struct expr* expression) {
+	if (!expression) return false;
+	switch (expression->type) {
+		case E_LIST:
+			return true;
+		case E_BINARY:
+			return makes_list(expression->op.bin_expr.left) ||
+				makes_list(expression->op.bin_expr.right);
+		case E_UNARY:
+			return makes_list(expression->op.una_expr.operand);
+		case E_IF:
+			return makes_list(expression->op.if_expr.condition) ||
+				makes_list(expression->op.if_expr.expr_true) ||
+				makes_list(expression->op.if_expr.expr_false);
+		default:
+			return false;
+	}
+}
+
+// Argument each parameter of the inlined function is replaced with
+struct inline_argument {
+	char* name;
+	struct expr* value;
+};
+
+static struct expr* copy_inlined(struct compiler_ctx* ctx, struct expr* expression,
+		struct inline_argument* args, int count) {
+	if (!expression) return 0;
+	if (is_identifier_expr(expression)) {
+		for (int i = 0; i < count; i++) {
+			if (streq(args[i].name, expression->op.lit_expr.value.string)) {
+				return copy_inlined(ctx, args[i].value, 0, 0);
+			}
+		}
+	}
+	struct expr* copy = arena_alloc(&ctx->arena, sizeof(struct expr));
+	*copy = *expression;
+	switch (expression->type) {
+		case E_BINARY:
+			copy->op.bin_expr.left = copy_inlined(ctx, expression->op.bin_expr.left, args, count);
+			copy->op.bin_expr.right = copy_inlined(ctx, expression->op.bin_expr.right, args, count);
+			break;
+		case E_UNARY:
+			copy->op.una_expr.operand = copy_inlined(ctx, expression->op.una_expr.operand, args, count);
+			break;
+		case E_IF:
+			copy->op.if_expr.condition = copy_inlined(ctx, expression->op.if_expr.condition, args, count);
+			copy->op.if_expr.expr_true = copy_inlined(ctx, expression->op.if_expr.expr_true, args, count);
+			copy->op.if_expr.expr_false = copy_inlined(ctx, expression->op.if_expr.expr_false, args, count);
+			break;
+		case E_LIST: {
+			struct expr_list** tail = &copy->op.list_expr.contents;
+			for (struct expr_list* l = expression->op.list_expr.contents; l; l = l->next) {
+				*tail = arena_alloc(&ctx->arena, sizeof(struct expr_list));
+				(*tail)->elem = copy_inlined(ctx, l->elem, args, count);
+				(*tail)->next = 0;
+				tail = &(*tail)->next;
+			}
+			break;
+		}
+		default: break;
+	}
+	return copy;
+}
+
+// copy_returned(ctx, state, args, count) builds the expression a function
+//   body statement returns, statement ifs become if expressions
+static struct expr* copy_returned(struct compiler_ctx* ctx, struct statement* state,
+		struct inline_argument* args, int count) {
+	switch (state->type) {
+		case S_EXPR:
+			return copy_inlined(ctx, state->op.expr_statement, args, count);
+		case S_OPERATION:
+			return copy_inlined(ctx, state->op.operation_statement.operand, args, count);
+		case S_BLOCK:
+			return copy_returned(ctx, state->op.block_statement->elem, args, count);
+		case S_IF: {
+			struct expr* result = arena_alloc(&ctx->arena, sizeof(struct expr));
+			memset(result, 0, sizeof(struct expr));
+			result->type = E_IF;
+			result->line = state->src_line;
+			result->op.if_expr.condition = copy_inlined(ctx,
+				state->op.if_statement.condition, args, count);
+			result->op.if_expr.expr_true = copy_returned(ctx,
+				state->op.if_statement.statement_true, args, count);
+			result->op.if_expr.expr_false = copy_returned(ctx,
+				state->op.if_statement.statement_false, args, count);
+			return result;
+		}
+		default:
+			return 0;
+	}
+}
+
+// inline_call(ctx, call, function) replaces call with the body of function
+//   if the arguments allow it, returns true if it did
+static bool inline_call(struct compiler_ctx* ctx, struct expr* call, struct expr* function) {
+	if (call->op.call_expr.is_safe) {
+		return false;
+	}
+	int count = 0;
+	for (struct expr_list* p = function->op.func_expr.parameters; p; p = p->next) {
+		count++;
+	}
+	struct inline_argument args[count + 1];
+	struct expr_list* arg = call->op.call_expr.arguments;
+	struct statement* body = function->op.func_expr.body;
+	int i = 0;
+	for (struct expr_list* p = function->op.func_expr.parameters; p; p = p->next, i++) {
+		bool has_default = p->elem->type == E_ASSIGN;
+		struct expr* param = has_default ? p->elem->op.assign_expr.lvalue : p->elem;
+		args[i].name = param->op.lit_expr.value.string;
+		if (!arg) {
+			if (!has_default) {
+				return false;
+			}
+			args[i].value = p->elem->op.assign_expr.rvalue;
+			continue;
+		}
+		struct expr* value = arg->elem;
+		arg = arg->next;
+		// Named arguments, spreads and anything with side effects stay calls
+		if (value->type == E_ASSIGN || pure_size(value, 0) < 0) {
+			return false;
+		}
+		int conditional = 0;
+		if (value->type != E_LITERAL &&
+			(returned_parameter_uses(body, args[i].name, &conditional) != 1 ||
+			conditional) &&
+			(makes_list(value) || pure_size(value, 0) > INLINE_MAX_RECOMPUTED)) {
+			// Not evaluated exactly once as it would be before the call, which
+			//   is only fine if computing it again is cheap and gives the same
+			//   value
+			return false;
+		}
+		args[i].value = value;
+	}
+	if (arg) {
+		// Extra arguments land in `arguments`
+		return false;
+	}
+	struct expr* inlined = copy_returned(ctx, body, args, count);
+	if (!inlined) {
+		return false;
+	}
+	*call = *optimize_expr(ctx, inlined);
+	return true;
+}
+
+static struct inline_candidate* find_candidate(struct inline_state* state, char* name) {
+	for (struct inline_candidate* c = state->candidates; c; c = c->next) {
+		if (streq(c->name, name)) {
+			return c;
+		}
+	}
+	return 0;
+}
+
+static void inline_calls_e(struct expr* expression, struct traversal_algorithm* algo) {
+	struct inline_state* state = algo->data;
+	if (expression->type != E_CALL ||
+		!is_identifier_expr(expression->op.call_expr.function)) {
+		return;
+	}
+	struct inline_candidate* candidate = find_candidate(state,
+		expression->op.call_expr.function->op.lit_expr.value.string);
+	if (candidate) {
+		inline_call(state->ctx, expression, candidate->function);
+	}
+}
+
+static struct traversal_algorithm inline_calls_impl = TRAVERSAL_ALGO_POST(
+	inline_calls_e, 0, 0, 0);
+
+static void find_import_s(struct statement* state, struct traversal_algorithm* algo) {
+	if (state->type == S_IMPORT || state->type == S_BYTECODE) {
+		*(bool*) algo->data = true;
+	}
+}
+
+static struct traversal_algorithm find_import_impl = TRAVERSAL_ALGO_PRE(
+	0, 0, find_import_s, 0);
+
+// inline_functions(ctx, ast) replaces calls to small top level functions that
+//   only compute an expression of their parameters with that expression.
+//   Only calls after the binding, with no import in between that could
+//   replace it, are inlined, and the name must be bound nowhere else.
+static void inline_functions(struct compiler_ctx* ctx, struct statement_list* ast) {
+	struct inline_state state = { ctx, count_bindings(ctx, 0, ast), 0 };
+
+	for (struct statement_list* l = ast; l; l = l->next) {
+		struct statement* state_ = l->elem;
+		bool has_import = false;
+		struct traversal_algorithm find = find_import_impl;
+		find.data = &has_import;
+		traverse_statement(state_, &find);
+		if (has_import) {
+			state.candidates = 0;
+		}
+		if (state.candidates) {
+			struct traversal_algorithm inline_algo = inline_calls_impl;
+			inline_algo.data = &state;
+			traverse_statement(state_, &inline_algo);
+		}
+		if (state_->type == S_LET && state_->op.let_statement.rvalue &&
+			binding_count_in(state.bindings, state_->op.let_statement.lvalue) == 1 &&
+			can_inline_function(state_->op.let_statement.rvalue)) {
+			struct inline_candidate* c = arena_alloc(&ctx->arena, sizeof(struct inline_candidate));
+			c->name = state_->op.let_statement.lvalue;
+			c->function = state_->op.let_statement.rvalue;
+			c->next = state.candidates;
+			state.candidates = c;
+		}
+	}
+}
+
+/* LOOP INVARIANT CODE MOTION AND COMMON SUBEXPRESSIONS */
+
+// Expressions computed once into a temporary and read from it after
+struct shared_expr {
+	char* name;
+	struct expr* value;
+	struct shared_expr* next;
+};
+
+// Subexpressions of a statement, gathered to look for repeats
+struct subexpr_list {
+	struct expr** exprs;
+	size_t count;
+	size_t capacity;
+};
+
+struct share_state {
+	struct compiler_ctx* ctx;
+	// Names bound or written in the region the expressions are moved across
+	struct binding_counter writes;
+	struct shared_expr* shared;
+	struct shared_expr** shared_tail;
+	struct subexpr_list found;
+};
+
+// is_shareable(state, expression) returns true if expression can be computed
+//   earlier than where it is without changing the program: it can't fail or
+//   have side effects, no overload applies to it, and no name it reads is
+//   written in the region.
+static bool is_shareable(struct share_state* state, struct expr* expression) {
+	if (!expression) return false;
+	switch (expression->type) {
+		case E_LITERAL:
+			switch (expression->op.lit_expr.type) {
+				case D_IDENTIFIER:
+					// Known types are only given to names no function writes
+					return expression->static_type != ST_UNKNOWN &&
+						!binding_count_in(state->writes.bindings, expression->op.lit_expr.value.string);
+				case D_NUMBER: case D_STRING: case D_TRUE: case D_FALSE:
+					return true;
+				default:
+					return false;
+			}
+		case E_BINARY: {
+			struct expr* left = expression->op.bin_expr.left;
+			struct expr* right = expression->op.bin_expr.right;
+			if (expression->static_type == ST_UNKNOWN) {
+				return false;
+			}
+			switch (expression->op.bin_expr.vm_operator) {
+				case O_MEMBER:
+					// Lists and strings never change size
+					return right->type == E_LITERAL &&
+						right->op.lit_expr.type == D_MEMBER_IDENTIFIER &&
+						is_shareable(state, left);
+				case O_ADD: case O_SUB: case O_MUL: case O_LT: case O_GT:
+				case O_LTE: case O_GTE: case O_EQ: case O_NEQ:
+					break;
+				default:
+					// Division can fail, the rest can't be shared safely or
+					//   aren't worth it
+					return false;
+			}
+			if (left->static_type != right->static_type ||
+				(left->static_type != ST_NUMBER && left->static_type != ST_STRING)) {
+				return false;
+			}
+			return is_shareable(state, left) && is_shareable(state, right);
+		}
+		case E_UNARY:
+			return expression->static_type != ST_UNKNOWN &&
+				(expression->op.una_expr.vm_operator == O_NEG ||
+				expression->op.una_expr.vm_operator == O_NOT) &&
+				is_shareable(state, expression->op.una_expr.operand);
+		default:
+			return false;
+	}
+}
+
+static bool expr_equal(struct expr* a, struct expr* b) {
+	if (!a || !b) return a == b;
+	if (a->type != b->type) return false;
+	switch (a->type) {
+		case E_LITERAL:
+			if (a->op.lit_expr.type != b->op.lit_expr.type) return false;
+			switch (a->op.lit_expr.type) {
+				case D_NUMBER:
+					return a->op.lit_expr.value.number == b->op.lit_expr.value.number;
+				case D_TRUE: case D_FALSE:
+					return true;
+				case D_IDENTIFIER: case D_STRING: case D_MEMBER_IDENTIFIER:
+					return streq(a->op.lit_expr.value.string, b->op.lit_expr.value.string);
+				default:
+					return false;
+			}
+		case E_BINARY:
+			return a->op.bin_expr.vm_operator == b->op.bin_expr.vm_operator &&
+				expr_equal(a->op.bin_expr.left, b->op.bin_expr.left) &&
+				expr_equal(a->op.bin_expr.right, b->op.bin_expr.right);
+		case E_UNARY:
+			return a->op.una_expr.vm_operator == b->op.una_expr.vm_operator &&
+				expr_equal(a->op.una_expr.operand, b->op.una_expr.operand);
+		default:
+			return false;
+	}
+}
+
+// share_expr(state, expression, prefix) moves expression into a temporary,
+//   reusing one that holds an equal expression, and leaves a read of it in
+//   its place
+static void share_expr(struct share_state* state, struct expr* expression,
+		const char* prefix) {
+	struct shared_expr* shared = state->shared;
+	for (; shared; shared = shared->next) {
+		if (expr_equal(shared->value, expression)) {
+			break;
+		}
+	}
+	if (!shared) {
+		struct compiler_ctx* ctx = state->ctx;
+		shared = arena_alloc(&ctx->arena, sizeof(struct shared_expr));
+		char name[30];
+		sprintf(name, LOOP_COUNTER_PREFIX "%s_%zd", prefix, ctx->optimizer.temp_count++);
+		shared->name = arena_strdup(&ctx->arena, name);
+		shared->value = arena_alloc(&ctx->arena, sizeof(struct expr));
+		*shared->value = *expression;
+		shared->next = 0;
+		*state->shared_tail = shared;
+		state->shared_tail = &shared->next;
+	}
+	enum static_type type = expression->static_type;
+	memset(&expression->op, 0, sizeof(expression->op));
+	expression->type = E_LITERAL;
+	expression->op.lit_expr = make_data(D_IDENTIFIER, data_value_str_impl(shared->name));
+	expression->static_type = type;
+	expression->operands_typed = false;
+}
+
+// share_statements(ctx, shared, line, rest) builds the declarations of the
+//   temporaries in shared, followed by rest
+static struct statement_list* share_statements(struct compiler_ctx* ctx,
+		struct shared_expr* shared, int line, struct statement_list* rest) {
+	if (!shared) return rest;
+	struct statement_list* list = arena_alloc(&ctx->arena, sizeof(struct statement_list));
+	struct statement* let = arena_alloc(&ctx->arena, sizeof(struct statement));
+	memset(let, 0, sizeof(struct statement));
+	let->type = S_LET;
+	let->src_line = line;
+	let->op.let_statement.lvalue = shared->name;
+	let->op.let_statement.rvalue = shared->value;
+	list->elem = let;
+	list->next = share_statements(ctx, shared->next, line, rest);
+	return list;
+}
+
+// Called on each expression that could be shared, before its operands,
+//   returns true if its operands shouldn't be visited
+typedef bool (*share_visitor)(struct share_state* state, struct expr* expression);
+
+// visit_shareable(state, expression, visit) calls visit on the operator
+//   expressions that are evaluated with expression, functions are skipped as
+//   their bodies run at another time
+static void visit_shareable(struct share_state* state, struct expr* expression,
+		share_visitor visit) {
+	if (!expression) return;
+	if (expression->type != E_LITERAL && is_shareable(state, expression) &&
+		visit(state, expression)) {
+		return;
+	}
+	switch (expression->type) {
+		case E_BINARY:
+			visit_shareable(state, expression->op.bin_expr.left, visit);
+			visit_shareable(state, expression->op.bin_expr.right, visit);
+			break;
+		case E_UNARY:
+			visit_shareable(state, expression->op.una_expr.operand, visit);
+			break;
+		case E_IF:
+			visit_shareable(state, expression->op.if_expr.condition, visit);
+			visit_shareable(state, expression->op.if_expr.expr_true, visit);
+			visit_shareable(state, expression->op.if_expr.expr_false, visit);
+			break;
+		case E_CALL:
+		case E_SUPER_CALL: {
+			struct expr_list* args = expression->type == E_CALL ?
+				expression->op.call_expr.arguments :
+				expression->op.super_call_expr.arguments;
+			for (; args; args = args->next) {
+				visit_shareable(state, args->elem->type == E_ASSIGN ?
+					args->elem->op.assign_expr.rvalue : args->elem, visit);
+			}
+			break;
+		}
+		case E_LIST:
+			for (struct expr_list* l = expression->op.list_expr.contents; l; l = l->next) {
+				visit_shareable(state, l->elem, visit);
+			}
+			break;
+		case E_TABLE:
+			for (struct expr_list* l = expression->op.table_expr.values; l; l = l->next) {
+				visit_shareable(state, l->elem, visit);
+			}
+			break;
+		case E_ASSIGN:
+			visit_shareable(state, expression->op.assign_expr.rvalue, visit);
+			break;
+		default: break;
+	}
+}
+
+static void visit_shareable_statement(struct share_state* state,
+		struct statement* statement, share_visitor visit) {
+	if (!statement) return;
+	switch (statement->type) {
+		case S_EXPR:
+			visit_shareable(state, statement->op.expr_statement, visit);
+			break;
+		case S_LET:
+			visit_shareable(state, statement->op.let_statement.rvalue, visit);
+			break;
+		case S_OPERATION:
+			if (statement->op.operation_statement.vm_operator == OP_RET ||
+				statement->op.operation_statement.vm_operator == OP_OUTL) {
+				visit_shareable(state, statement->op.operation_statement.operand, visit);
+			}
+			break;
+		case S_IF:
+			visit_shareable(state, statement->op.if_statement.condition, visit);
+			visit_shareable_statement(state, statement->op.if_statement.statement_true, visit);
+			visit_shareable_statement(state, statement->op.if_statement.statement_false, visit);
+			break;
+		case S_BLOCK:
+			for (struct statement_list* l = statement->op.block_statement; l; l = l->next) {
+				visit_shareable_statement(state, l->elem, visit);
+			}
+			break;
+		case S_LOOP:
+			// The container of an iterating loop is only evaluated once
+			if (!statement->op.loop_statement.index_var) {
+				visit_shareable(state, statement->op.loop_statement.condition, visit);
+			}
+			visit_shareable_statement(state, statement->op.loop_statement.statement_true, visit);
+			break;
+		default: break;
+	}
+}
+
+static bool hoist_invariant(struct share_state* state, struct expr* expression) {
+	share_expr(state, expression, "inv");
+	return true;
+}
+
+// hoist_loop_invariants_s hoists out of each loop the expressions that give
+//   the same value on every iteration, inner loops first so their hoisted
+//   expressions can keep moving out
+static void hoist_loop_invariants_s(struct statement* statement, struct traversal_algorithm* algo) {
+	struct compiler_ctx* ctx = algo->data;
+	if (statement->type != S_LOOP || !statement->op.loop_statement.statement_true) {
+		return;
+	}
+	struct share_state state = { ctx, { ctx, 0, false }, 0, 0, { 0, 0, 0 } };
+	state.shared_tail = &state.shared;
+	struct traversal_algorithm writes = count_bindings_impl;
+	writes.data = &state.writes;
+	traverse_statement(statement, &writes);
+	if (state.writes.found_import) {
+		return;
+	}
+	visit_shareable_statement(&state, statement, hoist_invariant);
+	if (!state.shared) {
+		return;
+	}
+	// The loop becomes a block declaring the temporaries, then the loop
+	struct statement* loop = arena_alloc(&ctx->arena, sizeof(struct statement));
+	*loop = *statement;
+	struct statement_list* last = arena_alloc(&ctx->arena, sizeof(struct statement_list));
+	last->elem = loop;
+	last->next = 0;
+	statement->type = S_BLOCK;
+	statement->op.block_statement = share_statements(ctx, state.shared,
+		statement->src_line, last);
+}
+
+static struct traversal_algorithm hoist_loop_invariants_impl = TRAVERSAL_ALGO_POST(
+	0, 0, hoist_loop_invariants_s, 0);
+
+static bool gather_subexpr(struct share_state* state, struct expr* expression) {
+	struct subexpr_list* list = &state->found;
+	if (list->count == list->capacity) {
+		if (list->capacity) {
+			list->capacity *= 2;
+			list->exprs = safe_realloc(list->exprs, list->capacity * sizeof(struct expr*));
+		}
+		else {
+			list->capacity = 8;
+			list->exprs = safe_malloc(list->capacity * sizeof(struct expr*));
+		}
+	}
+	list->exprs[list->count++] = expression;
+	return false;
+}
+
+static int expr_size(struct expr* expression) {
+	switch (expression->type) {
+		case E_BINARY:
+			return expr_size(expression->op.bin_expr.left) +
+				expr_size(expression->op.bin_expr.right) + 1;
+		case E_UNARY:
+			return expr_size(expression->op.una_expr.operand) + 1;
+		default:
+			return 1;
+	}
+}
+
+// share_repeats(ctx, statement) moves the expressions that statement computes
+//   more than once into temporaries, returns their declarations
+static struct statement_list* share_repeats(struct compiler_ctx* ctx, struct statement* statement) {
+	struct share_state state = { ctx, { ctx, 0, false }, 0, 0, { 0, 0, 0 } };
+	state.shared_tail = &state.shared;
+	// Only the target of the statement itself is written after its values
+	//   are computed
+	struct expr* region = 0;
+	switch (statement->type) {
+		case S_EXPR:
+			region = statement->op.expr_statement;
+			if (region->type == E_ASSIGN && is_identifier_expr(region->op.assign_expr.lvalue)) {
+				region = region->op.assign_expr.rvalue;
+			}
+			break;
+		case S_LET:
+			region = statement->op.let_statement.rvalue;
+			break;
+		case S_OPERATION:
+			if (statement->op.operation_statement.vm_operator == OP_RET ||
+				statement->op.operation_statement.vm_operator == OP_OUTL) {
+				region = statement->op.operation_statement.operand;
+			}
+			break;
+		case S_IF:
+			region = statement->op.if_statement.condition;
+			break;
+		default: break;
+	}
+	if (!region) {
+		return 0;
+	}
+	struct traversal_algorithm writes = count_bindings_impl;
+	writes.data = &state.writes;
+	traverse_expr(region, &writes);
+
+	while (true) {
+		state.found.count = 0;
+		visit_shareable(&state, region, gather_subexpr);
+		// The largest repeat is shared first, repeats inside it go with it
+		struct expr* best = 0;
+		int best_size = 0;
+		for (size_t i = 0; i < state.found.count; i++) {
+			int size = expr_size(state.found.exprs[i]);
+			if (size <= best_size) continue;
+			for (size_t j = i + 1; j < state.found.count; j++) {
+				if (expr_equal(state.found.exprs[i], state.found.exprs[j])) {
+					best = state.found.exprs[i];
+					best_size = size;
+					break;
+				}
+			}
+		}
+		if (!best) break;
+		struct expr value = *best;
+		for (size_t i = 0; i < state.found.count; i++) {
+			if (expr_equal(state.found.exprs[i], &value)) {
+				share_expr(&state, state.found.exprs[i], "cse");
+			}
+		}
+	}
+	if (state.found.exprs) {
+		safe_free(state.found.exprs);
+	}
+	return share_statements(ctx, state.shared, statement->src_line, 0);
+}
+
+// share_repeats_in_list(ctx, list, top_level) shares the repeated
+//   subexpressions of each statement in list. Top level temporaries would
+//   outlive the statement and could clash with another unit's, so those
+//   statements are wrapped in a block instead.
+static void share_repeats_in_list(struct compiler_ctx* ctx, struct statement_list* list,
+		bool top_level) {
+	for (; list; list = list->next) {
+		struct statement* statement = list->elem;
+		if (top_level && statement->type == S_LET) {
+			continue;
+		}
+		struct statement_list* lets = share_repeats(ctx, statement);
+		if (!lets) {
+			continue;
+		}
+		struct statement_list* last = lets;
+		while (last->next) {
+			last = last->next;
+		}
+		struct statement_list* after = arena_alloc(&ctx->arena, sizeof(struct statement_list));
+		after->next = 0;
+		if (top_level) {
+			after->elem = arena_alloc(&ctx->arena, sizeof(struct statement));
+			*after->elem = *statement;
+			last->next = after;
+			statement->type = S_BLOCK;
+			statement->op.block_statement = lets;
+		}
+		else {
+			// The statement keeps its place in the list, after its temporaries
+			after->elem = statement;
+			after->next = list->next;
+			last->next = after;
+			list->elem = lets->elem;
+			list->next = lets->next ? lets->next : after;
+			list = after;
+		}
+	}
+}
+
+static void share_repeats_s(struct statement* statement, struct traversal_algorithm* algo) {
+	if (statement->type == S_BLOCK) {
+		share_repeats_in_list(algo->data, statement->op.block_statement, false);
+	}
+}
+
+static struct traversal_algorithm share_repeats_impl = TRAVERSAL_ALGO_POST(
+	0, 0, share_repeats_s, 0);
+
+// share_pure_expressions(ctx, ast) moves loop invariant expressions out of
+//   their loops, then computes repeated expressions of a statement once.
+//   Only expressions whose types are known are moved, so no overload can
+//   apply and they can't fail.
+static void share_pure_expressions(struct compiler_ctx* ctx, struct statement_list* ast) {
+	struct traversal_algorithm algo = hoist_loop_invariants_impl;
+	algo.data = ctx;
+	traverse_ast(ast, &algo);
+
+	algo = share_repeats_impl;
+	algo.data = ctx;
+	traverse_ast(ast, &algo);
+	share_repeats_in_list(ctx, ast, true);
+}
+
+/* BYTECODE OPTIMIZATIONS */
+
+// next_instruction(bytecode, i) returns the position of the instruction
+//   following the one at i, or 0 if the opcode is not recognized
+static unsigned int next_instruction(uint8_t* bytecode, unsigned int i) {
+	enum opcode op = bytecode[i++];
+	switch (op) {
+		case OP_PUSH:
+		case OP_PUSH2:
+		case OP_PUSHB:
+			get_data(bytecode + i, &i);
+			break;
+		case OP_BIN:
+		case OP_BINNUM:
+		case OP_BINSTR:
+		case OP_INDEX:
+		case OP_BRNUM:
+		case OP_UNA:
+			i++;
+			break;
+		case OP_DECL:
+		case OP_DECLW:
+		case OP_WHERE:
+		case OP_STORE:
+		case OP_MEMPTR:
+			get_string(bytecode + i, &i);
+			break;
+		case OP_IMPORT:
+			get_string(bytecode + i, &i);
+			get_address(bytecode + i, &i);
+			break;
+		case OP_SRC:
+		case OP_JMP:
+		case OP_JIF:
+		case OP_MKTBL:
+		case OP_RESERVE:
+			get_address(bytecode + i, &i);
+			break;
+		case OP_NATIVE:
+			get_address(bytecode + i, &i);
+			get_string(bytecode + i, &i);
+			break;
+		case OP_MKREF:
+			i++;
+			get_address(bytecode + i, &i);
+			break;
+		case OP_CALL:
+		case OP_TCALL:
+		case OP_RET:
+		case OP_WRITE:
+		case OP_IN:
+		case OP_OUT:
+		case OP_OUTL:
+		case OP_FRM:
+		case OP_END:
+		case OP_HALT:
+		case OP_ARGCLN:
+		case OP_CLOSURE:
+		case OP_NTHPTR:
+		case OP_INC:
+		case OP_DEC:
+		case OP_DUPTOP:
+		case OP_ROTTWO:
+		case OP_POP:
+			break;
+		default:
+			return 0;
+	}
+	return i;
+}
+
+// Decoded view of a program, one entry per instruction
+struct instruction_index {
+	uint8_t* bytecode;
+	unsigned int* pos;
+	size_t count;
+};
+
+// index_instructions(index, bytecode, size, start) decodes the instructions
+//   from start, returns false if it finds one it doesn't understand
+static bool index_instructions(struct instruction_index* index, uint8_t* bytecode,
+		size_t size, unsigned int start) {
+	index->bytecode = bytecode;
+	index->count = 0;
+	size_t capacity = 256;
+	index->pos = safe_malloc(sizeof(unsigned int) * capacity);
+	for (unsigned int i = start; i < size;) {
+		if (index->count == capacity) {
+			capacity *= 2;
+			index->pos = safe_realloc(index->pos, sizeof(unsigned int) * capacity);
+		}
+		index->pos[index->count++] = i;
+		i = next_instruction(bytecode, i);
+		if (!i) {
+			safe_free(index->pos);
+			return false;
+		}
+	}
+	return true;
+}
+
+// find_instruction(index, at) returns the index of the instruction that
+//   begins at position at, or index->count if none does
+static size_t find_instruction(struct instruction_index* index, unsigned int at) {
+	size_t lo = 0;
+	size_t hi = index->count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (index->pos[mid] < at) lo = mid + 1;
+		else hi = mid;
+	}
+	return (lo < index->count && index->pos[lo] == at) ? lo : index->count;
+}
+
+static enum opcode opcode_at(struct instruction_index* index, size_t k) {
+	return index->bytecode[index->pos[k]];
+}
+
+// pushes(index, k, type, out) returns true if instruction k pushes data of
+//   the given type, which is stored in out
+static bool pushes(struct instruction_index* index, size_t k,
+		enum data_type type, struct data* out) {
+	if (k >= index->count || opcode_at(index, k) != OP_PUSH) {
+		return false;
+	}
+	unsigned int i = index->pos[k] + 1;
+	*out = get_data(index->bytecode + i, &i);
+	return out->type == type;
+}
+
+// A binding of a function or struct by a let that has no effect other than
+//   declaring name, spanning [start, end) in the bytecode.
+struct dead_code_binding {
+	char* name;
+	unsigned int start;
+	unsigned int end;
+	int parent;
+	bool wanted;
+	bool live;
+};
+
+// A reference to a name, owned by the innermost binding it's inside of
+struct dead_code_ref {
+	char* name;
+	int owner;
+	bool processed;
+};
+
+// ends_with_declare(index, k, binding) matches DECL name; WRITE at k and
+//   completes the binding if it does
+static bool ends_with_declare(struct instruction_index* index, size_t k,
+		struct dead_code_binding* binding) {
+	if (k + 1 >= index->count || opcode_at(index, k) != OP_DECL ||
+		opcode_at(index, k + 1) != OP_WRITE) {
+		return false;
+	}
+	binding->name = (char*)index->bytecode + index->pos[k] + 1;
+	binding->end = index->pos[k + 1] + 1;
+	return true;
+}
+
+// match_function_binding(index, k, binding) matches the code generated for
+//   `let name => (...) ...`, beginning with the jump over the body at k
+static bool match_function_binding(struct instruction_index* index, size_t k,
+		struct dead_code_binding* binding) {
+	unsigned int i = index->pos[k] + 1;
+	address body = i + sizeof(address);
+	size_t t = find_instruction(index, get_address(index->bytecode + i, &i));
+	struct data d;
+	if (t == index->count || t <= k ||
+		!pushes(index, t, D_INSTRUCTION_ADDRESS, &d) ||
+		(address) d.value.number != body ||
+		t + 3 >= index->count ||
+		opcode_at(index, t + 1) != OP_CLOSURE ||
+		!pushes(index, t + 2, D_STRING, &d) || !streq(d.value.string, "self")) {
+		return false;
+	}
+	// Parameter names, either none or a list of strings
+	size_t m = t + 3;
+	if (pushes(index, m, D_NUMBER, &d)) {
+		m += (size_t) d.value.number + 1;
+		if (m >= index->count || opcode_at(index, m) != OP_MKREF) {
+			return false;
+		}
+		m++;
+	}
+	else if (pushes(index, m, D_NONE, &d)) {
+		m++;
+	}
+	else {
+		return false;
+	}
+	if (m >= index->count || opcode_at(index, m) != OP_MKREF ||
+		index->bytecode[index->pos[m] + 1] != D_FUNCTION) {
+		return false;
+	}
+	binding->start = index->pos[k];
+	return ends_with_declare(index, m + 1, binding);
+}
+
+// match_struct_binding(index, k, binding) matches the code generated for a
+//   struct statement whose members are all literals or functions
+static bool match_struct_binding(struct instruction_index* index, size_t k,
+		struct dead_code_binding* binding) {
+	struct data d;
+	if (!pushes(index, k, D_STRUCT_HEADER, &d) || d.value.number != 4 ||
+		!pushes(index, k + 1, D_STRUCT_NAME, &d)) {
+		return false;
+	}
+	size_t m = k + 2;
+	while (m < index->count) {
+		switch (opcode_at(index, m)) {
+			case OP_MKREF: {
+				if (index->bytecode[index->pos[m] + 1] == D_STRUCT) {
+					binding->start = index->pos[k];
+					return ends_with_declare(index, m + 1, binding);
+				}
+				m++;
+				break;
+			}
+			case OP_PUSH:
+			case OP_MKTBL:
+			case OP_CLOSURE: {
+				m++;
+				break;
+			}
+			case OP_JMP: {
+				// Skip over a member function's body
+				unsigned int i = index->pos[m] + 1;
+				size_t t = find_instruction(index,
+					get_address(index->bytecode + i, &i));
+				if (t == index->count || t <= m) {
+					return false;
+				}
+				m = t;
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+	return false;
+}
+
+// referenced_name(index, k) returns the identifier instruction k refers to, or
+//   0 if it does not refer to one
+static char* referenced_name(struct instruction_index* index, size_t k) {
+	enum opcode op = opcode_at(index, k);
+	if (op == OP_WHERE) {
+		return (char*)index->bytecode + index->pos[k] + 1;
+	}
+	struct data d;
+	if (pushes(index, k, D_IDENTIFIER, &d) ||
+		pushes(index, k, D_NAMED_ARGUMENT_NAME, &d)) {
+		return d.value.string;
+	}
+	return 0;
+}
+
+// relocate(removed, count, a) maps an address from before the removal of the
+//   given ranges to after
+static address relocate(struct dead_code_binding** removed, size_t count,
+		address a) {
+	address shift = 0;
+	for (size_t i = 0; i < count && removed[i]->start < a; i++) {
+		if (removed[i]->end <= a) {
+			shift += removed[i]->end - removed[i]->start;
+		}
+		else {
+			return removed[i]->start - shift;
+		}
+	}
+	return a - shift;
+}
+
+// eliminate_dead_bindings(bytecode, size, start) drops function and struct
+//   bindings whose names are never referenced from live code. Operator
+//   overloads are looked up by name at runtime so they are always kept.
+static size_t eliminate_dead_bindings(uint8_t* bytecode, size_t size,
+		unsigned int start) {
+	struct instruction_index index;
+	if (!index_instructions(&index, bytecode, size, start)) {
+		// Something we don't understand, leave the program alone.
+		return size;
+	}
+
+	// Find bindings, in order of where they start
+	size_t binding_count = 0;
+	struct dead_code_binding* bindings =
+		safe_malloc(sizeof(struct dead_code_binding) * (index.count + 1));
+	for (size_t k = 0; k < index.count; k++) {
+		struct dead_code_binding* b = &bindings[binding_count];
+		if ((opcode_at(&index, k) == OP_JMP && match_function_binding(&index, k, b)) ||
+			match_struct_binding(&index, k, b)) {
+			b->parent = -1;
+			b->live = false;
+			b->wanted = strncmp(b->name, OPERATOR_OVERLOAD_PREFIX,
+				strlen(OPERATOR_OVERLOAD_PREFIX)) == 0;
+			binding_count++;
+		}
+	}
+
+	// Assign parents and references to the innermost enclosing binding
+	int* open = safe_malloc(sizeof(int) * (binding_count + 1));
+	int open_count = 0;
+	size_t next_binding = 0;
+	size_t ref_count = 0;
+	struct dead_code_ref* refs =
+		safe_malloc(sizeof(struct dead_code_ref) * (index.count + 1));
+	for (size_t k = 0; k < index.count; k++) {
+		unsigned int p = index.pos[k];
+		while (open_count && bindings[open[open_count - 1]].end <= p) {
+			open_count--;
+		}
+		while (next_binding < binding_count &&
+				bindings[next_binding].start == p) {
+			bindings[next_binding].parent =
+				open_count ? open[open_count - 1] : -1;
+			open[open_count++] = next_binding++;
+		}
+		char* name = referenced_name(&index, k);
+		if (name) {
+			refs[ref_count].name = name;
+			refs[ref_count].owner = open_count ? open[open_count - 1] : -1;
+			refs[ref_count].processed = false;
+			ref_count++;
+		}
+	}
+
+	// Propagate liveness from references in live code
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t r = 0; r < ref_count; r++) {
+			if (refs[r].processed ||
+				(refs[r].owner >= 0 && !bindings[refs[r].owner].live)) {
+				continue;
+			}
+			refs[r].processed = true;
+			for (size_t b = 0; b < binding_count; b++) {
+				if (!bindings[b].wanted && streq(bindings[b].name, refs[r].name)) {
+					bindings[b].wanted = true;
+				}
+			}
+		}
+		for (size_t b = 0; b < binding_count; b++) {
+			int parent = bindings[b].parent;
+			if (!bindings[b].live && bindings[b].wanted &&
+				(parent < 0 || bindings[parent].live)) {
+				bindings[b].live = true;
+				changed = true;
+			}
+		}
+	}
+
+	// Outermost dead bindings are removed, which covers nested ones
+	struct dead_code_binding** removed =
+		safe_malloc(sizeof(struct dead_code_binding*) * (binding_count + 1));
+	size_t removed_count = 0;
+	for (size_t b = 0; b < binding_count; b++) {
+		int parent = bindings[b].parent;
+		if (!bindings[b].live && (parent < 0 || bindings[parent].live)) {
+			removed[removed_count++] = &bindings[b];
+		}
+	}
+
+	if (removed_count) {
+		// Patch addresses in the code that stays, then compact it.
+		size_t r = 0;
+		for (size_t k = 0; k < index.count; k++) {
+			unsigned int p = index.pos[k];
+			while (r < removed_count && removed[r]->end <= p) r++;
+			if (r < removed_count && removed[r]->start <= p) continue;
+
+			unsigned int i = p + 1;
+			switch (opcode_at(&index, k)) {
+				case OP_IMPORT:
+					get_string(bytecode + i, &i);
+					// fallthrough
+				case OP_JMP:
+				case OP_JIF: {
+					unsigned int loc = i;
+					address a = get_address(bytecode + i, &i);
+					write_address_at_buffer(relocate(removed, removed_count, a),
+						bytecode, loc);
+					break;
+				}
+				case OP_PUSH: {
+					struct data d = get_data(bytecode + i, &i);
+					if (d.type == D_INSTRUCTION_ADDRESS) {
+						d.value.number = relocate(removed, removed_count,
+							(address) d.value.number);
+						write_data_at_buffer(d, bytecode, p + 1);
+					}
+					break;
+				}
+				default: break;
+			}
+		}
+		size_t w = removed[0]->start;
+		for (r = 0; r < removed_count; r++) {
+			size_t from = removed[r]->end;
+			size_t to = r + 1 < removed_count ? removed[r + 1]->start : size;
+			memmove(bytecode + w, bytecode + from, to - from);
+			w += to - from;
+		}
+		size = w;
+	}
+
+	safe_free(removed);
+	safe_free(refs);
+	safe_free(open);
+	safe_free(bindings);
+	safe_free(index.pos);
+	return size;
+}
+
+// jump_target(index, k) returns the instruction jump k lands on, following
+//   jumps that land on other jumps, or index->count if it isn't one
+static size_t jump_target(struct instruction_index* index, size_t k) {
+	size_t target = k;
+	// A chain longer than the program loops forever, leave it alone
+	for (size_t hops = 0; hops <= index->count; hops++) {
+		unsigned int i = index->pos[target] + 1;
+		size_t next = find_instruction(index, get_address(index->bytecode + i, &i));
+		if (next == index->count || opcode_at(index, next) != OP_JMP) {
+			return next;
+		}
+		target = next;
+	}
+	return index->count;
+}
+
+// peephole(bytecode, size, start) points jumps that land on another jump at
+//   its destination, borrows the left operands of binary operations, then
+//   fuses the most frequent pairs of instructions into superinstructions. All
+//   of them keep every instruction where it was.
+static void peephole(uint8_t* bytecode, size_t size, unsigned int start) {
+	struct instruction_index index;
+	if (!index_instructions(&index, bytecode, size, start)) {
+		return;
+	}
+	for (size_t k = 0; k < index.count; k++) {
+		enum opcode op = opcode_at(&index, k);
+		if (op != OP_JMP && op != OP_JIF) {
+			continue;
+		}
+		// A jif over the end of a loop's body ends up at the loop head, the
+		//   VM checks its limits on every backward branch so that's fine
+		size_t target = jump_target(&index, k);
+		if (target != index.count) {
+			write_address_at_buffer(index.pos[target], bytecode, index.pos[k] + 1);
+		}
+	}
+	// A variable pushed right before a binary operation is its left operand,
+	//   which the operation only reads, so it's borrowed instead of copied
+	for (size_t k = 0; k + 1 < index.count; k++) {
+		uint8_t* code = bytecode + index.pos[k];
+		if (code[0] != OP_PUSH || code[1] != D_IDENTIFIER) {
+			continue;
+		}
+		switch (opcode_at(&index, k + 1)) {
+			case OP_BIN:
+			case OP_BINNUM:
+			case OP_BINSTR:
+			case OP_INDEX:
+				code[0] = OP_PUSHB;
+				break;
+			default: break;
+		}
+	}
+	// Pairs were picked by how often they run back to back over the tests
+	for (size_t k = 0; k + 1 < index.count; k++) {
+		uint8_t* code = bytecode + index.pos[k];
+		enum opcode next = opcode_at(&index, k + 1);
+		enum opcode fused = code[0];
+		switch (code[0]) {
+			case OP_PUSH:
+				if (next == OP_PUSH || next == OP_PUSHB) fused = OP_PUSH2;
+				break;
+			case OP_DECL:
+				if (next == OP_WRITE) fused = OP_DECLW;
+				break;
+			case OP_WHERE:
+				if (next == OP_WRITE) fused = OP_STORE;
+				break;
+			case OP_BINNUM:
+				if (next == OP_JIF && is_comparison(code[1])) fused = OP_BRNUM;
+				break;
+			default: break;
+		}
+		if (fused != code[0]) {
+			code[0] = fused;
+			// The second one is part of this one now
+			k++;
+		}
+	}
+	safe_free(index.pos);
+}
+
+size_t optimize_bytecode(uint8_t* bytecode, size_t size) {
+	unsigned int start = 0;
+	if (size > strlen(WENDY_VM_HEADER) + 1 &&
+		streq(WENDY_VM_HEADER, (char*)bytecode)) {
+		start = strlen(WENDY_VM_HEADER) + 1;
+	}
+	size = eliminate_dead_bindings(bytecode, size, start);
+	peephole(bytecode, size, start);
+	return size;
 }
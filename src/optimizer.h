@@ -7,6 +7,29 @@
 // Includes two different types of optimization algorithms, one to prune down
 //   AST and another to optimize bytecode instructions/
 
-struct statement_list* optimize_ast(struct statement_list* ast);
+// optimize_ast(ctx, ast) folds constants, propagates bindings that never
+//   change and drops dead code. Operations on literals are only folded when
+//   neither the unit nor anything it imports overloads them.
+struct statement_list* optimize_ast(struct compiler_ctx* ctx, struct statement_list* ast);
+
+// optimize_unit_ast(ctx, ast) is optimize_ast for a separately compiled unit,
+//   whose top level bindings are kept since importers may use them
+struct statement_list* optimize_unit_ast(struct compiler_ctx* ctx, struct statement_list* ast);
+
+// has_binary_overload(ctx, type_a, op, type_b) returns true if the unit being
+//   optimized by ctx, or anything it imports, overloads op for values of
+//   type_a and type_b
+bool has_binary_overload(struct compiler_ctx* ctx, const char* type_a,
+	enum vm_operator op, const char* type_b);
+
+// has_unary_overload(ctx, op, type) is has_binary_overload for unary op
+bool has_unary_overload(struct compiler_ctx* ctx, enum vm_operator op, const char* type);
+
+// optimize_bytecode(bytecode, size) runs link time optimizations over the
+//   bytecode of a whole program, including everything it imported, and
+//   returns the new size. Top level function and struct bindings that are
+//   never referenced are dropped, jumps to jumps go straight to the end of
+//   the chain, and common instruction pairs become superinstructions.
+size_t optimize_bytecode(uint8_t* bytecode, size_t size);
 
 #endif
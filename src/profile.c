@@ -0,0 +1,198 @@
+#include "profile.h"
+#include "global.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// One call path: a function called from the path of its parent
+struct profile_node {
+	char* name;
+	struct profile_node* parent;
+	struct profile_node* children;
+	struct profile_node* next;
+	size_t calls;
+	uint64_t self_ns;
+	uint64_t total_ns;
+	// When the call running on this path started
+	uint64_t entered_ns;
+};
+
+// Every call path of one function added together
+struct profile_entry {
+	const char* name;
+	size_t calls;
+	uint64_t self_ns;
+	uint64_t total_ns;
+};
+
+static uint64_t now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static struct profile_node* node_create(const char* name, struct profile_node* parent) {
+	struct profile_node* node = safe_calloc(1, sizeof(struct profile_node));
+	node->name = safe_strdup(name);
+	node->parent = parent;
+	return node;
+}
+
+static void node_destroy(struct profile_node* node) {
+	struct profile_node* child = node->children;
+	while (child) {
+		struct profile_node* next = child->next;
+		node_destroy(child);
+		child = next;
+	}
+	safe_free(node->name);
+	safe_free(node);
+}
+
+struct profiler* profiler_create(void) {
+	struct profiler* profiler = safe_malloc(sizeof(struct profiler));
+	profiler->root = node_create("main", 0);
+	profiler->root->calls = 1;
+	profiler->current = profiler->root;
+	profiler->last_ns = now_ns();
+	profiler->root->entered_ns = profiler->last_ns;
+	return profiler;
+}
+
+void profiler_enter(struct profiler* profiler, const char* name) {
+	uint64_t now = now_ns();
+	struct profile_node* caller = profiler->current;
+	caller->self_ns += now - profiler->last_ns;
+	struct profile_node* node = caller->children;
+	while (node && !streq(node->name, name)) {
+		node = node->next;
+	}
+	if (!node) {
+		node = node_create(name, caller);
+		node->next = caller->children;
+		caller->children = node;
+	}
+	node->calls += 1;
+	node->entered_ns = now;
+	profiler->current = node;
+	profiler->last_ns = now;
+}
+
+void profiler_exit(struct profiler* profiler) {
+	struct profile_node* node = profiler->current;
+	if (!node->parent) {
+		// The top level runs until the report
+		return;
+	}
+	uint64_t now = now_ns();
+	node->self_ns += now - profiler->last_ns;
+	node->total_ns += now - node->entered_ns;
+	profiler->current = node->parent;
+	profiler->last_ns = now;
+}
+
+// is_outermost(node) returns true if no caller on the path of node is the
+//   same function, so a recursive function's total time is only counted once
+static bool is_outermost(struct profile_node* node) {
+	for (struct profile_node* p = node->parent; p; p = p->parent) {
+		if (streq(p->name, node->name)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void add_entries(struct profile_node* node, struct profile_entry** entries,
+		size_t* count, size_t* capacity) {
+	size_t i = 0;
+	while (i < *count && !streq((*entries)[i].name, node->name)) {
+		i++;
+	}
+	if (i == *count) {
+		if (*count == *capacity) {
+			*capacity *= 2;
+			*entries = safe_realloc(*entries, sizeof(struct profile_entry) * *capacity);
+		}
+		(*entries)[i] = (struct profile_entry) { node->name, 0, 0, 0 };
+		*count += 1;
+	}
+	(*entries)[i].calls += node->calls;
+	(*entries)[i].self_ns += node->self_ns;
+	if (is_outermost(node)) {
+		(*entries)[i].total_ns += node->total_ns;
+	}
+	for (struct profile_node* child = node->children; child; child = child->next) {
+		add_entries(child, entries, count, capacity);
+	}
+}
+
+static int by_self_time(const void* a, const void* b) {
+	const struct profile_entry* x = a;
+	const struct profile_entry* y = b;
+	if (x->self_ns != y->self_ns) {
+		return x->self_ns < y->self_ns ? 1 : -1;
+	}
+	return strcmp(x->name, y->name);
+}
+
+static void write_folded(struct profile_node* node, FILE* folded) {
+	uint64_t self_us = node->self_ns / 1000;
+	if (self_us) {
+		// Path is written from the top level down
+		size_t depth = 0;
+		for (struct profile_node* p = node; p; p = p->parent) {
+			depth++;
+		}
+		struct profile_node** path = safe_malloc(sizeof(struct profile_node*) * depth);
+		size_t i = depth;
+		for (struct profile_node* p = node; p; p = p->parent) {
+			path[--i] = p;
+		}
+		for (i = 0; i < depth; i++) {
+			fprintf(folded, "%s%s", i ? ";" : "", path[i]->name);
+		}
+		fprintf(folded, " %llu\n", (unsigned long long) self_us);
+		safe_free(path);
+	}
+	for (struct profile_node* child = node->children; child; child = child->next) {
+		write_folded(child, folded);
+	}
+}
+
+void profiler_report(struct profiler* profiler, FILE* summary, FILE* folded) {
+	while (profiler->current->parent) {
+		profiler_exit(profiler);
+	}
+	uint64_t now = now_ns();
+	struct profile_node* root = profiler->root;
+	root->self_ns += now - profiler->last_ns;
+	root->total_ns = now - root->entered_ns;
+	profiler->last_ns = now;
+
+	size_t count = 0;
+	size_t capacity = 16;
+	struct profile_entry* entries = safe_malloc(sizeof(struct profile_entry) * capacity);
+	add_entries(root, &entries, &count, &capacity);
+	qsort(entries, count, sizeof(struct profile_entry), by_self_time);
+
+	double total_ms = root->total_ns / 1e6;
+	fprintf(summary, "Profile: %.3f ms\n", total_ms);
+	fprintf(summary, "%12s %8s %12s %10s  %s\n",
+		"self ms", "self %", "total ms", "calls", "function");
+	for (size_t i = 0; i < count; i++) {
+		fprintf(summary, "%12.3f %7.1f%% %12.3f %10zu  %s\n",
+			entries[i].self_ns / 1e6,
+			total_ms ? entries[i].self_ns / 1e4 / total_ms : 0,
+			entries[i].total_ns / 1e6, entries[i].calls, entries[i].name);
+	}
+	safe_free(entries);
+
+	if (folded) {
+		write_folded(root, folded);
+	}
+}
+
+void profiler_destroy(struct profiler* profiler) {
+	node_destroy(profiler->root);
+	safe_free(profiler);
+}
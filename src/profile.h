@@ -0,0 +1,44 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// profile.h - Felix Guo
+// Attributes the time a program runs to the Wendy functions it calls, for
+//   --profile. Time is kept per call path, from the top level down through
+//   every call made, so it can be written out both as a table per function
+//   and as folded stacks for flame graphs. Automatic frames belong to the
+//   function they're in.
+
+struct profile_node;
+
+struct profiler {
+	struct profile_node* root;
+	// The call path running now
+	struct profile_node* current;
+	// When the time since was last added to current
+	uint64_t last_ns;
+};
+
+// profiler_create() starts timing the top level of a program
+struct profiler* profiler_create(void);
+
+// profiler_enter(profiler, name) starts timing a call to the function name
+//   made from the one running now
+void profiler_enter(struct profiler* profiler, const char* name);
+
+// profiler_exit(profiler) stops timing the function running now, and goes
+//   back to the one that called it
+void profiler_exit(struct profiler* profiler);
+
+// profiler_report(profiler, summary, folded) stops timing, writes a table of
+//   the self time, total time and calls of each function to summary, and
+//   writes folded stacks with the self time of each call path in
+//   microseconds to folded, which may be 0
+void profiler_report(struct profiler* profiler, FILE* summary, FILE* folded);
+
+// profiler_destroy(profiler) frees the profiler and everything it timed
+void profiler_destroy(struct profiler* profiler);
+
+#endif
@@ -1,4 +1,5 @@
 #include "scanner.h"
+#include "compiler.h"
 #include "error.h"
 #include "global.h"
 #include "execpath.h"
@@ -6,46 +7,36 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-static size_t source_len;
-static size_t current; // is used to keep track of source current
-static size_t start;
-static char* source;
-static struct token* tokens;
-static size_t tokens_alloc_size;
-static size_t t_curr; // t_curr is used to keep track of addToken
-static size_t line;
-static size_t col;
+static bool scan_token(struct compiler_ctx* ctx);
+static void add_token(struct compiler_ctx* ctx, enum token_type type);
+static void add_token_with_value(struct compiler_ctx* ctx, enum token_type type, union token_data val);
 
-static bool scan_token(void);
-static void add_token(enum token_type type);
-static void add_token_with_value(enum token_type type, union token_data val);
-
-static bool is_at_end(void) {
-	return current >= source_len;
+static bool is_at_end(struct compiler_ctx* ctx) {
+	return ctx->scanner.current >= ctx->scanner.source_len;
 }
 
-static bool match(char expected) {
-	if (is_at_end()) return false;
-	if (source[current] != expected) return false;
-	col++;
-	current++;
+static bool match(struct compiler_ctx* ctx, char expected) {
+	if (is_at_end(ctx)) return false;
+	if (ctx->scanner.source[ctx->scanner.current] != expected) return false;
+	ctx->scanner.col++;
+	ctx->scanner.current++;
 	return true;
 }
 
-static char peek(void) {
-	if (is_at_end()) return '\0';
-	return source[current];
+static char peek(struct compiler_ctx* ctx) {
+	if (is_at_end(ctx)) return '\0';
+	return ctx->scanner.source[ctx->scanner.current];
 }
 
-static char advance(void) {
-	current++;
-	col++;
-	return source[current - 1];
+static char advance(struct compiler_ctx* ctx) {
+	ctx->scanner.current++;
+	ctx->scanner.col++;
+	return ctx->scanner.source[ctx->scanner.current - 1];
 }
 
-static char peek_next(void) {
-	if(current + 1 >= source_len) return '\0';
-	return source[current + 1];
+static char peek_next(struct compiler_ctx* ctx) {
+	if(ctx->scanner.current + 1 >= ctx->scanner.source_len) return '\0';
+	return ctx->scanner.source[ctx->scanner.current + 1];
 }
 
 static bool is_alpha(char c) {
@@ -62,95 +53,47 @@ static bool is_alpha_numeric(char c) {
 	return is_alpha(c) || is_digit(c);
 }
 
-// handle_import() imports the string contents of the given file, otherwise
-//   leaves it for code_gen
-static void handle_import(void) {
-	add_token(T_REQ);
-	// we scan a string
-	// t_curr points to space after REQ
-	start = current;
-	while(!scan_token()) {
-		start = current;
-	}
-	if (tokens[t_curr - 1].t_type == T_STRING) {
-		int str_loc = t_curr - 1;
-		char* path = tokens[str_loc].t_data.string;
-		long length = 0;
-
-		char* buffer;
-		FILE * f = fopen(path, "r");
-		if (f) {
-			fseek (f, 0, SEEK_END);
-			length = ftell (f);
-			fseek (f, 0, SEEK_SET);
-			// + 2 for null terminator and newline
-			buffer = safe_malloc(length + 2);
-			buffer[0] = '\n';
-			if (buffer) {
-				fread(buffer + 1, 1, length, f);
-				buffer[length] = '\0'; // fread doesn't add a null terminator!
-				int newlen = source_len + strlen(buffer);
-				source = safe_realloc(source, newlen + 1);
-				size_t o_source_len = source_len;
-				source_len = newlen;
-				// at this point, we inset the buffer into the source
-				// current should be the next item, we move it down buffer bytes
-				memmove(&source[current + strlen(buffer)],
-						&source[current], o_source_len - current + 1);
-				memcpy(&source[current], buffer, strlen(buffer));
-			}
-			safe_free(buffer);
-			fclose (f);
-		}
-		else {
-			error_lexer(line, col, SCAN_REQ_FILE_READ_ERR);
-		}
-	}
-}
-
-static void handle_obj_type(void) {
-	while (peek() != '>' && !is_at_end()) {
-		if (peek() == '\n') line++;
-		advance();
+static void handle_obj_type(struct compiler_ctx* ctx) {
+	while (peek(ctx) != '>' && !is_at_end(ctx)) {
+		if (peek(ctx) == '\n') ctx->scanner.line++;
+		advance(ctx);
 	}
-	if (is_at_end()) {
-		error_lexer(line, col, SCAN_EXPECTED_TOKEN, ">");
+	if (is_at_end(ctx)) {
+		error_lexer(ctx, ctx->scanner.line, ctx->scanner.col, SCAN_EXPECTED_TOKEN, ">");
 		return;
 	}
 	// The closing >
-	advance();
+	advance(ctx);
 
 	// Trim the surrounding quotes.
-	int s_length = current - 2 - start;
-	char value[s_length + 1]; // + 1 for null terminator
-
-	memcpy(value, &source[start + 1], s_length);
-	value[s_length] = '\0';
+	int s_length = ctx->scanner.current - 2 - ctx->scanner.start;
+	char* value = arena_strndup(&ctx->arena,
+		&ctx->scanner.source[ctx->scanner.start + 1], s_length);
 
-	add_token_with_value(T_OBJ_TYPE, make_data_str(value));
+	add_token_with_value(ctx, T_OBJ_TYPE, make_data_str(value));
 }
 
-static void handle_string(char endChar) {
-	while (peek() != endChar && !is_at_end()) {
-		if (peek() == '\n') line++;
-		if (peek() == '\\') advance();
-		advance();
+static void handle_string(struct compiler_ctx* ctx, char endChar) {
+	while (peek(ctx) != endChar && !is_at_end(ctx)) {
+		if (peek(ctx) == '\n') ctx->scanner.line++;
+		if (peek(ctx) == '\\') advance(ctx);
+		advance(ctx);
 	}
 
 	// Unterminated string.
-	if (is_at_end()) {
-		error_lexer(line, col, SCAN_UNTERMINATED_STRING);
+	if (is_at_end(ctx)) {
+		error_lexer(ctx, ctx->scanner.line, ctx->scanner.col, SCAN_UNTERMINATED_STRING);
 		return;
 	}
 
 	// The closing ".
-	advance();
+	advance(ctx);
 
 	// Trim the surrounding quotes.
-	size_t s_length = current - 2 - start;
-	char value[s_length + 1]; // + 1 for null terminator
-	memcpy(value, &source[start + 1], s_length);
-	value[s_length] = '\0';
+	size_t s_length = ctx->scanner.current - 2 - ctx->scanner.start;
+	// Escapes only ever shorten the string, so they're resolved in place
+	char* value = arena_strndup(&ctx->arena,
+		&ctx->scanner.source[ctx->scanner.start + 1], s_length);
 	size_t s = 0;
 	for (size_t i = 0; i < s_length; i++) {
 		if (value[i] == '\\' && i != s_length - 1) {
@@ -179,218 +122,215 @@ static void handle_string(char endChar) {
 		}
 	}
 	value[s] = 0;
-	add_token_with_value(T_STRING, make_data_str(value));
+	add_token_with_value(ctx, T_STRING, make_data_str(value));
 }
 
 // identifier() processes the next identifier and also handles wendyScript
 //   keywords
-static void identifier(void) {
-	while (is_alpha_numeric(peek())) advance();
-
-	char text[current - start + 1];
-	memcpy(text, &source[start], current - start);
-	text[current - start] = '\0';
-
-	if (streq(text, "and"))       { add_token(T_AND); }
-	else if (streq(text, "else")) { add_token(T_ELSE); }
-	else if (streq(text, "false")){ add_token(T_FALSE); }
-	else if (streq(text, "if"))   { add_token(T_IF); }
-	else if (streq(text, "or"))   { add_token(T_OR); }
-	else if (streq(text, "true")) { add_token(T_TRUE); }
-
-	else if (streq(text, "let"))  { add_token(T_LET); }
-	else if (streq(text, "break")){ add_token(T_BREAK); }
-	else if (streq(text, "continue")) { add_token(T_CONTINUE); }
-	else if (streq(text, "for"))  { add_token(T_LOOP); }
-	else if (streq(text, "none")) { add_token(T_NONE); }
-	else if (streq(text, "in"))   { add_token(T_IN); }
-	else if (streq(text, "init"))   { add_token(T_INIT); }
-
-	else if (streq(text, "ret"))  { add_token(T_RET); }
-	else if (streq(text, "import"))   {
-		handle_import();
-	}
+static void identifier(struct compiler_ctx* ctx) {
+	while (is_alpha_numeric(peek(ctx))) advance(ctx);
+
+	char text[ctx->scanner.current - ctx->scanner.start + 1];
+	memcpy(text, &ctx->scanner.source[ctx->scanner.start], ctx->scanner.current - ctx->scanner.start);
+	text[ctx->scanner.current - ctx->scanner.start] = '\0';
+
+	if (streq(text, "and"))       { add_token(ctx, T_AND); }
+	else if (streq(text, "else")) { add_token(ctx, T_ELSE); }
+	else if (streq(text, "false")){ add_token(ctx, T_FALSE); }
+	else if (streq(text, "if"))   { add_token(ctx, T_IF); }
+	else if (streq(text, "or"))   { add_token(ctx, T_OR); }
+	else if (streq(text, "true")) { add_token(ctx, T_TRUE); }
+
+	else if (streq(text, "let"))  { add_token(ctx, T_LET); }
+	else if (streq(text, "break")){ add_token(ctx, T_BREAK); }
+	else if (streq(text, "continue")) { add_token(ctx, T_CONTINUE); }
+	else if (streq(text, "for"))  { add_token(ctx, T_LOOP); }
+	else if (streq(text, "none")) { add_token(ctx, T_NONE); }
+	else if (streq(text, "in"))   { add_token(ctx, T_IN); }
+	else if (streq(text, "init"))   { add_token(ctx, T_INIT); }
+
+	else if (streq(text, "ret"))  { add_token(ctx, T_RET); }
+	else if (streq(text, "import"))   { add_token(ctx, T_REQ); }
 	else if (streq(text, "native"))   {
-		add_token(T_NATIVE);
+		add_token(ctx, T_NATIVE);
 	}
-	else if (streq(text, "inc"))  { add_token(T_INC); }
-	else if (streq(text, "dec"))  { add_token(T_DEC); }
-	else if (streq(text, "input"))    { add_token(T_INPUT); }
+	else if (streq(text, "inc"))  { add_token(ctx, T_INC); }
+	else if (streq(text, "dec"))  { add_token(ctx, T_DEC); }
+	else if (streq(text, "input"))    { add_token(ctx, T_INPUT); }
 	else if (streq(text, "struct")) {
-		add_token(T_STRUCT);
+		add_token(ctx, T_STRUCT);
 	}
 	else if (streq(text, "enum")) {
-		add_token(T_ENUM);
+		add_token(ctx, T_ENUM);
 	}
-	else { add_token(T_IDENTIFIER); }
+	else { add_token(ctx, T_IDENTIFIER); }
 }
 
 // handle_number() processes the next number
-static void handle_number(void) {
-	while (is_digit(peek())) advance();
+static void handle_number(struct compiler_ctx* ctx) {
+	while (is_digit(peek(ctx))) advance(ctx);
 
 	// Look for a fractional part.
-	if (peek() == '.' && is_digit(peek_next())) {
+	if (peek(ctx) == '.' && is_digit(peek_next(ctx))) {
 		// Consume the "."
-		advance();
-		while (is_digit(peek())) advance();
+		advance(ctx);
+		while (is_digit(peek(ctx))) advance(ctx);
 	}
 
-	char num_s[current - start + 1];
-	memcpy(num_s, &source[start], current-start);
-	num_s[current - start] = '\0';
+	char num_s[ctx->scanner.current - ctx->scanner.start + 1];
+	memcpy(num_s, &ctx->scanner.source[ctx->scanner.start], ctx->scanner.current-ctx->scanner.start);
+	num_s[ctx->scanner.current - ctx->scanner.start] = '\0';
 	double num = strtod(num_s, NULL);
-	add_token_with_value(T_NUMBER, make_data_num(num));
+	add_token_with_value(ctx, T_NUMBER, make_data_num(num));
 }
 
-static bool ignore_next = false;
-static bool scan_token(void) {
-	char c = advance();
+static bool scan_token(struct compiler_ctx* ctx) {
+	char c = advance(ctx);
 	switch(c) {
-		case '(': add_token(T_LEFT_PAREN); break;
-		case ')': add_token(T_RIGHT_PAREN); break;
-		case '[': add_token(T_LEFT_BRACK); break;
-		case ']': add_token(T_RIGHT_BRACK); break;
-		case '{': add_token(T_LEFT_BRACE); break;
-		case '}': add_token(T_RIGHT_BRACE); break;
-		case '&': add_token(T_AND); break;
-		case '|': add_token(T_OR); break;
+		case '(': add_token(ctx, T_LEFT_PAREN); break;
+		case ')': add_token(ctx, T_RIGHT_PAREN); break;
+		case '[': add_token(ctx, T_LEFT_BRACK); break;
+		case ']': add_token(ctx, T_RIGHT_BRACK); break;
+		case '{': add_token(ctx, T_LEFT_BRACE); break;
+		case '}': add_token(ctx, T_RIGHT_BRACE); break;
+		case '&': add_token(ctx, T_AND); break;
+		case '|': add_token(ctx, T_OR); break;
 		case '?':
-			if (match(':')) {
-				add_token(T_ELVIS);
+			if (match(ctx, ':')) {
+				add_token(ctx, T_ELVIS);
 			}
-			else if (match('.')) {
-				add_token(T_SAFE_NAVIGATE);
+			else if (match(ctx, '.')) {
+				add_token(ctx, T_SAFE_NAVIGATE);
 			}
-			else if (match('(')) {
-				add_token(T_SAFE_CALL);
+			else if (match(ctx, '(')) {
+				add_token(ctx, T_SAFE_CALL);
 			}
 			else {
-				add_token(T_IF);
+				add_token(ctx, T_IF);
 			}
 			break;
-		case '~': add_token(T_TILDE); break;
-		case ',': add_token(T_COMMA); break;
+		case '~': add_token(ctx, T_TILDE); break;
+		case ',': add_token(ctx, T_COMMA); break;
 		case '.':
 			/* Match two dots to get ... */
-			if (match('.') && match('.')) {
-				add_token(T_DOT_DOT_DOT);
+			if (match(ctx, '.') && match(ctx, '.')) {
+				add_token(ctx, T_DOT_DOT_DOT);
 			}
 			else {
-				add_token(T_DOT);
+				add_token(ctx, T_DOT);
 			}
 			break;
 		case '-':
-			if (match('=')) {
-				add_token(T_ASSIGN_MINUS);
+			if (match(ctx, '=')) {
+				add_token(ctx, T_ASSIGN_MINUS);
 			}
-			else if (match('-')) {
-				add_token(T_DEC);
+			else if (match(ctx, '-')) {
+				add_token(ctx, T_DEC);
 			}
-			else if (match('>')) {
-				add_token(T_RANGE_OP);
+			else if (match(ctx, '>')) {
+				add_token(ctx, T_RANGE_OP);
 			}
 			else {
-				add_token(T_MINUS);
+				add_token(ctx, T_MINUS);
 			}
 			break;
 		case '+':
-			if (match('=')) {
-				add_token(T_ASSIGN_PLUS);
+			if (match(ctx, '=')) {
+				add_token(ctx, T_ASSIGN_PLUS);
 			}
-			else if (match('+')) {
-				add_token(T_INC);
+			else if (match(ctx, '+')) {
+				add_token(ctx, T_INC);
 			}
 			else {
-				add_token(T_PLUS);
+				add_token(ctx, T_PLUS);
 			}
 			break;
-		case '\\': add_token(match('=') ? T_ASSIGN_INTSLASH : T_INTSLASH); break;
+		case '\\': add_token(ctx, match(ctx, '=') ? T_ASSIGN_INTSLASH : T_INTSLASH); break;
 		case '%':
-			if (match('=')) {
-				add_token(T_MOD_EQUAL);
+			if (match(ctx, '=')) {
+				add_token(ctx, T_MOD_EQUAL);
 			}
 			else {
-				add_token(T_PERCENT);
+				add_token(ctx, T_PERCENT);
 			}
 			break;
-		case '@': add_token(T_AT); break;
-		case ';': add_token(T_SEMICOLON); break;
-		case ':': add_token(T_COLON); break;
+		case '@': add_token(ctx, T_AT); break;
+		case ';': add_token(ctx, T_SEMICOLON); break;
+		case ':': add_token(ctx, T_COLON); break;
 		case '#':
-			if (match(':')) {
-				add_token(T_LAMBDA);
+			if (match(ctx, ':')) {
+				add_token(ctx, T_LAMBDA);
 			}
-			else if (match('#')) {
-				add_token(T_DEBUG);
-				ignore_next = true;
+			else if (match(ctx, '#')) {
+				add_token(ctx, T_DEBUG);
+				ctx->scanner.ignore_next = true;
 			}
-			else if (match('!')) {
+			else if (match(ctx, '!')) {
 				// Shebang
-				while (peek() != '\n' && !is_at_end()) advance();
-				col = 1;
+				while (peek(ctx) != '\n' && !is_at_end(ctx)) advance(ctx);
+				ctx->scanner.col = 1;
 			}
 			else {
-				add_token(T_LOOP);
+				add_token(ctx, T_LOOP);
 			}
 			break;
-		case '*': add_token(match('=') ? T_ASSIGN_STAR : T_STAR); break;
-		case '!': add_token(match('=') ? T_NOT_EQUAL : T_NOT); break;
+		case '*': add_token(ctx, match(ctx, '=') ? T_ASSIGN_STAR : T_STAR); break;
+		case '!': add_token(ctx, match(ctx, '=') ? T_NOT_EQUAL : T_NOT); break;
 		case '=':
-			if (match('=')) {
-				add_token(T_EQUAL_EQUAL);
+			if (match(ctx, '=')) {
+				add_token(ctx, T_EQUAL_EQUAL);
 			}
-			else if (match('>')) {
-				add_token(T_DEFFN);
+			else if (match(ctx, '>')) {
+				add_token(ctx, T_DEFFN);
 			}
 			else {
-				add_token(T_EQUAL);
+				add_token(ctx, T_EQUAL);
 			}
 			break;
 		case '<':
-			if (match('=')) {
-				add_token(T_LESS_EQUAL);
+			if (match(ctx, '=')) {
+				add_token(ctx, T_LESS_EQUAL);
 			}
-			else if (is_alpha(peek())) {
-				handle_obj_type();
+			else if (is_alpha(peek(ctx))) {
+				handle_obj_type(ctx);
 			}
-			else if (match('<')) {
-				add_token(T_LET);
+			else if (match(ctx, '<')) {
+				add_token(ctx, T_LET);
 			}
 			else {
-				add_token(T_LESS);
+				add_token(ctx, T_LESS);
 			}
 			break;
 		case '>':
-			if (match('=')) {
-				add_token(T_GREATER_EQUAL);
+			if (match(ctx, '=')) {
+				add_token(ctx, T_GREATER_EQUAL);
 			}
-			else if (match('>')) {
-				add_token(T_INPUT);
+			else if (match(ctx, '>')) {
+				add_token(ctx, T_INPUT);
 			}
 			else {
-				add_token(T_GREATER);
+				add_token(ctx, T_GREATER);
 			}
 			break;
 		case '/':
-			if (match('/')) {
+			if (match(ctx, '/')) {
 				// A comment goes until the end of the line.
-				while (peek() != '\n' && !is_at_end()) advance();
-				col = 1;
+				while (peek(ctx) != '\n' && !is_at_end(ctx)) advance(ctx);
+				ctx->scanner.col = 1;
 			}
-			else if (match('>')) {
-				add_token(T_RET);
+			else if (match(ctx, '>')) {
+				add_token(ctx, T_RET);
 			}
-			else if (match('=')) {
-				add_token(T_ASSIGN_SLASH);
+			else if (match(ctx, '=')) {
+				add_token(ctx, T_ASSIGN_SLASH);
 			}
-			else if (match('*')) {
-				while(!(match('*') && match('/'))) {
-					if(advance() == '\n') line++;
+			else if (match(ctx, '*')) {
+				while(!(match(ctx, '*') && match(ctx, '/'))) {
+					if(advance(ctx) == '\n') ctx->scanner.line++;
 				}
 			}
 			else {
-				add_token(T_SLASH);
+				add_token(ctx, T_SLASH);
 			}
 			break;
 		case ' ':
@@ -399,77 +339,87 @@ static bool scan_token(void) {
 			// Ignore whitespace. and commas
 			return false;
 		case '\n':
-			if (!ignore_next) line++;
-			else ignore_next = false;
-			col = 1;
+			if (!ctx->scanner.ignore_next) ctx->scanner.line++;
+			else ctx->scanner.ignore_next = false;
+			ctx->scanner.col = 1;
 			return false;
-		case '"': handle_string('"'); break;
-		case '$': add_token(T_DOLLAR_SIGN); break;
-		case '^': add_token(T_CARET); break;
-		case '\'': handle_string('\''); break;
+		case '"': handle_string(ctx, '"'); break;
+		case '$': add_token(ctx, T_DOLLAR_SIGN); break;
+		case '^': add_token(ctx, T_CARET); break;
+		case '\'': handle_string(ctx, '\''); break;
 		default:
 			if (is_digit(c)) {
-				handle_number();
+				handle_number(ctx);
 			}
 			else if (is_alpha(c)) {
-				identifier();
+				identifier(ctx);
 			}
 			else {
-				error_lexer(line, col, SCAN_UNEXPECTED_CHARACTER, c);
+				error_lexer(ctx, ctx->scanner.line, ctx->scanner.col, SCAN_UNEXPECTED_CHARACTER, c);
 			}
 			break;
 	}
 	return true;
 }
 
-int scan_tokens(char* source_, struct token** destination, size_t* alloc_size) {
-	source_len = strlen(source_);
-	source = safe_malloc(source_len + 1);
-	strcpy(source, source_);
+int scan_tokens(struct compiler_ctx* ctx, char* source_, struct token** destination, size_t* alloc_size) {
+	return scan_tokens_from_line(ctx, source_, destination, alloc_size, 1);
+}
 
-	tokens_alloc_size = source_len;
-	tokens = safe_malloc(tokens_alloc_size * sizeof(struct token));
-	t_curr = 0;
-	current = 0;
-	line = 1;
-	col = 1;
-	while (!is_at_end()) {
-		start = current;
-		scan_token();
+int scan_tokens_from_line(struct compiler_ctx* ctx, char* source_, struct token** destination,
+		size_t* alloc_size, size_t first_line) {
+	ctx->scanner.source = source_;
+	ctx->scanner.source_len = strlen(source_);
+
+	// Most tokens span several characters, the list grows if that's wrong
+	ctx->scanner.tokens_alloc_size = ctx->scanner.source_len / 4 + 16;
+	ctx->scanner.tokens = arena_alloc(&ctx->arena,
+		ctx->scanner.tokens_alloc_size * sizeof(struct token));
+	ctx->scanner.t_curr = 0;
+	ctx->scanner.current = 0;
+	ctx->scanner.line = first_line;
+	ctx->scanner.col = 1;
+	ctx->scanner.ignore_next = false;
+	while (!is_at_end(ctx)) {
+		ctx->scanner.start = ctx->scanner.current;
+		scan_token(ctx);
 	}
-	*destination = tokens;
-	*alloc_size = tokens_alloc_size;
-	safe_free(source);
-	return t_curr;
+	*destination = ctx->scanner.tokens;
+	*alloc_size = ctx->scanner.tokens_alloc_size;
+	ctx->scanner.source = 0;
+	return ctx->scanner.t_curr;
 }
 
-static void add_token(enum token_type type) {
-	char val[current - start + 1];
-	memcpy(val, &source[start], current - start);
-	val[current - start] = '\0';
-	add_token_with_value(type, make_data_str(val));
+static void add_token(struct compiler_ctx* ctx, enum token_type type) {
+	char* val = arena_strndup(&ctx->arena, &ctx->scanner.source[ctx->scanner.start],
+		ctx->scanner.current - ctx->scanner.start);
+	add_token_with_value(ctx, type, make_data_str(val));
 }
 
-static void add_token_with_value(enum token_type type, union token_data val) {
+static void add_token_with_value(struct compiler_ctx* ctx, enum token_type type, union token_data val) {
+	struct token new_t;
 	if (type == T_NONE) {
-        tokens[t_curr++] = none_token();
-        safe_free(val.string);
+        new_t = none_token();
     }
 	else if (type == T_TRUE) {
-        tokens[t_curr++] = true_token();
-        safe_free(val.string);
+        new_t = true_token();
     }
 	else if (type == T_FALSE) {
-        tokens[t_curr++] = false_token();
-        safe_free(val.string);
+        new_t = false_token();
     }
 	else {
-		struct token new_t = { type, line, col, val };
-		tokens[t_curr++] = new_t;
+		new_t = make_token(type, val);
 	}
-	if (t_curr == tokens_alloc_size) {
-		tokens_alloc_size += 200;
-		tokens = safe_realloc(tokens, tokens_alloc_size * sizeof(struct token));
+	new_t.t_line = ctx->scanner.line;
+	new_t.t_col = ctx->scanner.col;
+	ctx->scanner.tokens[ctx->scanner.t_curr++] = new_t;
+	if (ctx->scanner.t_curr == ctx->scanner.tokens_alloc_size) {
+		// The old list stays in the arena, doubling keeps that waste bounded
+		ctx->scanner.tokens_alloc_size *= 2;
+		struct token* tokens = arena_alloc(&ctx->arena,
+			ctx->scanner.tokens_alloc_size * sizeof(struct token));
+		memcpy(tokens, ctx->scanner.tokens, ctx->scanner.t_curr * sizeof(struct token));
+		ctx->scanner.tokens = tokens;
 	}
 }
 
@@ -2,13 +2,21 @@
 #define SCANNER_H
 
 #include "token.h"
+#include "compiler.h"
 
 // scanner.h - Felix Guo
 // This module tokenizes a string of text input and converts it to a list of
 //   tokens, which are passed into [AST] to create a syntax tree.
 
-// scan_tokens(source) creates a list of tokens from the source
-int scan_tokens(char* source_, struct token** destination, size_t* alloc_size);
+// scan_tokens(ctx, source) creates a list of tokens from the source, the list
+//   and its strings live in the arena of ctx
+int scan_tokens(struct compiler_ctx* ctx, char* source_, struct token** destination, size_t* alloc_size);
+
+// scan_tokens_from_line(ctx, source, destination, alloc_size, first_line)
+//   is scan_tokens but numbers lines starting at first_line, which lets
+//   separately compiled units carry their own source line encoding
+int scan_tokens_from_line(struct compiler_ctx* ctx, char* source_, struct token** destination,
+	size_t* alloc_size, size_t first_line);
 
 // print_token_list() prints the list of tokens
 void print_token_list(struct token* tokens, size_t size);
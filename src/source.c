@@ -2,84 +2,132 @@
 #include "global.h"
 #include <string.h>
 
-static char* buffer = 0;
-static char** source_lines = 0;
-static int max_lines;
-static char* source_name;
-static bool source_accurate = false;
-
-void init_source(FILE* file, const char* name, long length, bool accurate) {
-	if (!file) return;
-	source_accurate = accurate;
-	source_name = safe_malloc(sizeof(char) * (strlen(name) + 1));
-	strcpy(source_name, name);
-	buffer = safe_malloc(sizeof(char) * (length + 1));
-	fread(buffer, sizeof(char), length, file);
-	buffer[length] = '\0';
-
+static void split_lines(struct source_unit* unit) {
 	int lines = 1;
-	for (int i = 0; buffer[i]; i++) {
-		if (buffer[i] == '\n') {
+	for (int i = 0; unit->buffer[i]; i++) {
+		if (unit->buffer[i] == '\n') {
 			// Newline Encountered
 			lines++;
 		}
 	}
 
-	max_lines = lines;
-	source_lines = safe_malloc(sizeof(char*) * max_lines);
+	unit->max_lines = lines;
+	unit->lines = safe_malloc(sizeof(char*) * lines);
 	int line = 0;
 	int line_size = 0;
-	char* line_start = buffer;
+	char* line_start = unit->buffer;
 	for (int i = 0;; i++) {
 		line_size++;
-		if (buffer[i] == '\n' || buffer[i] == 0) {
-			source_lines[line] = safe_malloc(sizeof(char) * line_size);
-			strncpy(source_lines[line], line_start, line_size);
-			source_lines[line][line_size - 1] = 0;
-			line_start = buffer + i + 1;
+		if (unit->buffer[i] == '\n' || unit->buffer[i] == 0) {
+			unit->lines[line] = safe_malloc(sizeof(char) * line_size);
+			strncpy(unit->lines[line], line_start, line_size);
+			unit->lines[line][line_size - 1] = 0;
+			line_start = unit->buffer + i + 1;
 			line++;
 			line_size = 0;
 		}
-		if (!buffer[i]) break;
+		if (!unit->buffer[i]) break;
+	}
+}
+
+static const struct source_unit* unit_of(const struct source_table* sources, int line) {
+	int unit = line >> SOURCE_UNIT_SHIFT;
+	if (unit < 0 || unit >= sources->unit_count) {
+		return &sources->units[0];
+	}
+	return &sources->units[unit];
+}
+
+void init_source(struct source_table* sources, FILE* file, const char* name,
+	long length, bool accurate) {
+	memset(sources, 0, sizeof(*sources));
+	sources->unit_count = 1;
+	if (!file) return;
+	sources->accurate = accurate;
+	struct source_unit* main_unit = &sources->units[0];
+	main_unit->name = safe_strdup(name);
+	main_unit->buffer = safe_malloc(sizeof(char) * (length + 1));
+	fread(main_unit->buffer, sizeof(char), length, file);
+	main_unit->buffer[length] = '\0';
+	split_lines(main_unit);
+}
+
+int add_source_unit(struct source_table* sources, const char* name,
+	const char* buffer) {
+	if (sources->unit_count == MAX_SOURCE_UNITS) {
+		// Out of encodings for the unit
+		return -1;
 	}
+	struct source_unit* unit = &sources->units[sources->unit_count];
+	unit->name = safe_strdup(name);
+	unit->buffer = safe_strdup(buffer);
+	split_lines(unit);
+	return sources->unit_count++ << SOURCE_UNIT_SHIFT;
 }
 
-bool is_source_accurate() {
-	return source_accurate;
+bool is_source_accurate(const struct source_table* sources) {
+	return sources->accurate;
 }
-bool is_valid_line_num(int line) {
+
+bool is_valid_line_num(const struct source_table* sources, int line) {
 	// line is 1 indexed
-	return line <= max_lines;
+	return source_line_number(line) <= unit_of(sources, line)->max_lines;
+}
+
+int source_line_number(int line) {
+	return line & SOURCE_LINE_MASK;
+}
+
+bool has_source(const struct source_table* sources) {
+	return sources->units[0].buffer;
+}
+
+bool has_source_at(const struct source_table* sources, int line) {
+	return unit_of(sources, line)->buffer;
 }
 
-bool has_source() {
-	return buffer;
+char* get_source_name(const struct source_table* sources) {
+	return sources->units[0].name;
 }
 
-char* get_source_name() {
-	return source_name;
+char* get_source_name_at(const struct source_table* sources, int line) {
+	return unit_of(sources, line)->name;
 }
 
-char* get_source_line(int line) {
-	if (line >= max_lines) {
+char* get_source_line(const struct source_table* sources, int line) {
+	const struct source_unit* unit = unit_of(sources, line);
+	line = source_line_number(line);
+	if (line >= unit->max_lines) {
 		return "";
 	}
-	return source_lines[line - 1];
+	return unit->lines[line - 1];
+}
+
+char* get_source_buffer(const struct source_table* sources) {
+	return sources->units[0].buffer;
 }
 
-char* get_source_buffer() {
-	return buffer;
+char* get_source_buffer_at(const struct source_table* sources, int line) {
+	return unit_of(sources, line)->buffer;
 }
 
-void free_source() {
-	if (!buffer) return;
-	safe_free(buffer);
-	safe_free(source_name);
-	for (int i = 0; i < max_lines; i++) {
-		if (source_lines[i]) {
-			safe_free(source_lines[i]);
+int source_unit_count(const struct source_table* sources) {
+	return sources->unit_count;
+}
+
+void free_source(struct source_table* sources) {
+	for (int u = 0; u < sources->unit_count; u++) {
+		struct source_unit* unit = &sources->units[u];
+		if (!unit->buffer) continue;
+		safe_free(unit->buffer);
+		safe_free(unit->name);
+		for (int i = 0; i < unit->max_lines; i++) {
+			if (unit->lines[i]) {
+				safe_free(unit->lines[i]);
+			}
 		}
+		safe_free(unit->lines);
+		unit->buffer = 0;
 	}
-	safe_free(source_lines);
+	sources->unit_count = 1;
 }
-
@@ -7,33 +7,80 @@
 // source.h - Felix Guo
 // Manages source file input if available.
 
-// init_source(file) given a file pointer, initializes the source module 
+// Lines handed out by the compiler encode which source unit they belong to
+//   in the bits above SOURCE_UNIT_SHIFT; unit 0 is the main source.
+#define SOURCE_UNIT_SHIFT 24
+#define SOURCE_LINE_MASK ((1 << SOURCE_UNIT_SHIFT) - 1)
+#define MAX_SOURCE_UNITS 128
+
+struct source_unit {
+	char* name;
+	char* buffer;
+	char** lines;
+	int max_lines;
+};
+
+// The text of a program for reporting errors against. Unit 0 is the main
+//   source, every other unit is a file that was imported and compiled
+//   separately. Whoever compiles or runs the program owns the table and
+//   hands it to the compiler context and VM.
+struct source_table {
+	struct source_unit units[MAX_SOURCE_UNITS];
+	int unit_count;
+	bool accurate;
+};
+
+// init_source(sources, file) given a file pointer, initializes the table 
 //   provide 0 as the file pointer if there is no source file supplied
-void init_source(FILE* file, const char* name, long length, bool accurate);
+void init_source(struct source_table* sources, FILE* file, const char* name,
+	long length, bool accurate);
+
+// add_source_unit(sources, name, buffer) registers the text of a separately
+//   compiled file and returns the value its line numbers should be offset by,
+//   or -1 if the table already holds MAX_SOURCE_UNITS
+int add_source_unit(struct source_table* sources, const char* name,
+	const char* buffer);
 
 // has_source() returns true if there is a source file, false if there isn't
-bool has_source(void);
+bool has_source(const struct source_table* sources);
+
+// has_source_at(line) returns true if the unit of the encoded line has source
+bool has_source_at(const struct source_table* sources, int line);
+
+// source_line_number(line) strips the unit encoding from a line
+int source_line_number(int line);
 
 // get_line(line) returns a pointer to a null terminated line of the source
 //   file
-char* get_source_line(int line);
+char* get_source_line(const struct source_table* sources, int line);
 
 // get_buffer() returns a pointer to the buffer holding the contents of the
 //   source file
-char* get_source_buffer(void);
+char* get_source_buffer(const struct source_table* sources);
+
+// get_source_buffer_at(line) returns the text of the unit of the encoded
+//   line, or 0 if it has none
+char* get_source_buffer_at(const struct source_table* sources, int line);
+
+// source_unit_count() returns how many source units have been registered,
+//   the main source included
+int source_unit_count(const struct source_table* sources);
 
 // get_source_name() returns the name loaded as the source.
-char* get_source_name(void);
+char* get_source_name(const struct source_table* sources);
+
+// get_source_name_at(line) returns the name of the unit of the encoded line
+char* get_source_name_at(const struct source_table* sources, int line);
 
 // is_valid_line_num(line) returns true if it's within the range and false
 //   otherwise.
-bool is_valid_line_num(int line);
+bool is_valid_line_num(const struct source_table* sources, int line);
 
 // is_source_accurate() returns true if the source was directly loaded and 
 //   false otherwise.
-bool is_source_accurate(void);
+bool is_source_accurate(const struct source_table* sources);
 
-// free_source() clears all memory used by the source module.
-void free_source(void);
+// free_source(sources) clears all memory used by the table.
+void free_source(struct source_table* sources);
 
 #endif
@@ -10,47 +10,23 @@ const char* token_string[] = {
 	FOREACH_TOKEN(STRING)
 };
 
-static int line;
-static int col;
-
-void set_make_token_param(int l, int c) {
-	line = l;
-	col = c;
-}
-
 struct token none_token() {
 	struct token t = make_token(T_NONE, make_data_str("<none>"));
-	t.t_line = line;
-	t.t_col = col;
 	return t;
 }
 
-struct token copy_token(struct token old) {
-	struct token t = old;
-	if (t.t_type != T_NUMBER) {
-		t.t_data.string = safe_strdup(t.t_data.string);
-    }
-    return t;
-}
-
 struct token true_token() {
 	struct token t = make_token(T_TRUE, make_data_str("<true>"));
-	t.t_line = line;
-	t.t_col = col;
 	return t;
 }
 
 struct token false_token() {
 	struct token t = make_token(T_FALSE, make_data_str("<false>"));
-	t.t_line = line;
-	t.t_col = col;
 	return t;
 }
 
 struct token empty_token() {
 	struct token t = make_token(T_EMPTY, make_data_str(""));
-	t.t_line = line;
-	t.t_col = col;
 	return t;
 }
 
@@ -65,7 +41,7 @@ union token_data make_data_num(double i) {
 	return d;
 }
 
-union token_data make_data_str_impl(char* s) {
+union token_data make_data_str(char* s) {
 	union token_data d;
 	d.string = s;
 	return d;
@@ -139,16 +115,3 @@ int precedence(struct token op) {
 			return 0;
 	}
 }
-
-inline void destroy_token(struct token l) {
-	if (l.t_type != T_NUMBER) {
-        safe_free(l.t_data.string);
-    }
-}
-
-void free_token_list(struct token* l, size_t s) {
-	for (size_t i = 0; i < s; i++) {
-        destroy_token(l[i]);
-	}
-	safe_free(l);
-}
@@ -7,7 +7,8 @@
 
 // token.h - Felix Guo
 // This module provides utilities for creating and manipulating tokens for the
-//   [scanner].
+//   [scanner]. Tokens don't own their strings, the scanner places them in the
+//   arena of the compilation they belong to.
 
 #define FOREACH_TOKEN(OP) \
 	OP(T_EMPTY) \
@@ -108,12 +109,8 @@ struct token make_token(enum token_type t, union token_data d);
 // make_data_int(i) makes a data union with the integer provided
 union token_data make_data_num(double i);
 
-// makeDataStr(s) makes a data union with the string provided
-#define make_data_str(s) make_data_str_impl(safe_strdup((s)))
-union token_data make_data_str_impl(char* s);
-
-// makes a deep copy
-struct token copy_token(struct token old);
+// make_data_str(s) makes a data union referring to the string provided
+union token_data make_data_str(char* s);
 
 // none_token() returns a none token
 struct token none_token(void);
@@ -137,14 +134,4 @@ unsigned int print_token_inline(const struct token* t, FILE* buf);
 // precedence(op) returns the precedece of the enum vm_operator
 int precedence(struct token op);
 
-// set_make_token_param(l, c) sets the line and column of the current state of
-//   the scanner
-void set_make_token_param(int l, int c);
-
-// destroys_token(t) frees all memory associated with the token
-void destroy_token(struct token t);
-
-// free_token_list(l) frees the token list and associated strings
-void free_token_list(struct token* l, size_t s);
-
 #endif
@@ -9,12 +9,18 @@
 #include "imports.h"
 #include "table.h"
 #include "struct.h"
+#include "profile.h"
+#include "vm_stats.h"
+#include "vm_trace.h"
+#include "alloc_profile.h"
+#include "heap_snapshot.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <time.h>
 
 // Forward Declarations
 static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a, struct data b);
@@ -22,23 +28,147 @@ static struct data eval_uniop(struct vm * vm, enum vm_operator op, struct data a
 static struct data type_of(struct data a);
 static char* type_of_str(struct data a);
 static struct data size_of(struct data a);
-static struct data value_of(struct data a);
-static struct data char_of(struct data a);
+static struct data value_of(struct vm* vm, struct data a);
+static struct data char_of(struct vm* vm, struct data a);
 
-struct vm *vm_init() {
+struct vm *vm_init(const struct settings* settings, const struct source_table* sources) {
 	struct vm* vm = safe_malloc(sizeof(*vm));
 	srand(time(NULL));
 	vm->bytecode = 0;
 	vm->instruction_ptr = 0;
 	vm->bytecode_size = 0;
 	vm->last_pushed_identifier = 0;
+	vm->instructions_run = 0;
+	vm->profiler = 0;
+	vm->stats = 0;
+	vm->alloc_profiler = 0;
+	vm->trace = 0;
 	vm->line = 0;
-	vm->memory = memory_init();
+	vm->settings = *settings;
+	vm->sources = sources;
+	vm->error_flag = false;
+	vm->imported_libraries = 0;
+	memset(vm->quick_overloads, 0, sizeof(vm->quick_overloads));
+	memset(&vm->limits, 0, sizeof(vm->limits));
+	vm->limit_check_at = SIZE_MAX;
+	vm->call_depth_limit = SIZE_MAX;
+	vm->run_started = 0;
+	vm->cpu_started = 0;
+	vm->memory = memory_init(&vm->settings, sources, &vm->error_flag);
+	vm->memory->line = &vm->line;
 	return vm;
 }
 
+void vm_set_limits(struct vm* vm, const struct vm_limits* limits) {
+	vm->limits = *limits;
+	vm->memory->max_heap_bytes = limits->heap_bytes;
+	vm->call_depth_limit = limits->call_depth ? limits->call_depth : SIZE_MAX;
+}
+
+bool vm_limits_option(struct vm_limits* limits, const char* option, const char* value) {
+	if (streq("--max-instructions", option)) {
+		limits->instructions = strtoull(value, 0, 10);
+	}
+	else if (streq("--max-time", option)) {
+		limits->seconds = atof(value);
+	}
+	else if (streq("--max-cpu", option)) {
+		limits->cpu_seconds = atof(value);
+	}
+	else if (streq("--max-heap", option)) {
+		// Takes a K, M or G suffix
+		char* unit;
+		double bytes = strtod(value, &unit);
+		switch (*unit) {
+			case 'G': case 'g': bytes *= 1024;
+			// fallthrough
+			case 'M': case 'm': bytes *= 1024;
+			// fallthrough
+			case 'K': case 'k': bytes *= 1024;
+		}
+		limits->heap_bytes = bytes;
+	}
+	else if (streq("--max-depth", option)) {
+		limits->call_depth = strtoull(value, 0, 10);
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+static double limit_clock(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Once a clock is limited, backward branches and calls read it about this often
+#define LIMIT_CLOCK_INTERVAL 4096
+
+// within_budget(vm) raises a runtime error and returns false if the run has
+//   gone over its instruction or time limits, otherwise it sets when to look
+//   again
+static bool within_budget(struct vm* vm) {
+	const struct vm_limits* limits = &vm->limits;
+	if (vm->instructions_run < vm->limit_check_at) {
+		return true;
+	}
+	if (limits->instructions && vm->instructions_run >= limits->instructions) {
+		error_runtime(vm->memory, vm->line, VM_INSTRUCTION_LIMIT, limits->instructions);
+		return false;
+	}
+	if (limits->seconds &&
+		limit_clock(CLOCK_MONOTONIC) - vm->run_started >= limits->seconds) {
+		error_runtime(vm->memory, vm->line, VM_TIME_LIMIT, limits->seconds);
+		return false;
+	}
+	if (limits->cpu_seconds &&
+		limit_clock(CLOCK_THREAD_CPUTIME_ID) - vm->cpu_started >= limits->cpu_seconds) {
+		error_runtime(vm->memory, vm->line, VM_CPU_TIME_LIMIT, limits->cpu_seconds);
+		return false;
+	}
+	vm->limit_check_at = limits->instructions ? limits->instructions : SIZE_MAX;
+	if ((limits->seconds || limits->cpu_seconds) &&
+		vm->instructions_run + LIMIT_CLOCK_INTERVAL < vm->limit_check_at) {
+		vm->limit_check_at = vm->instructions_run + LIMIT_CLOCK_INTERVAL;
+	}
+	return true;
+}
+
+// within_limits(vm) is within_budget for a call, which also has to stay
+//   under the call depth limit
+static bool within_limits(struct vm* vm) {
+	if (vm->memory->function_frames >= vm->call_depth_limit) {
+		error_runtime(vm->memory, vm->line, VM_CALL_DEPTH_LIMIT, vm->limits.call_depth);
+		return false;
+	}
+	return within_budget(vm);
+}
+
+// may_jump(vm, addr) returns false once jumping back to addr takes the run
+//   over a limit. Every branch that can jump back asks, loops always take
+//   one and the optimizer moves their back edge onto whichever it threads.
+static inline bool may_jump(struct vm* vm, address addr) {
+	return addr >= vm->instruction_ptr || vm->instructions_run < vm->limit_check_at ||
+		within_budget(vm);
+}
+
 void vm_destroy(struct vm * vm) {
 	memory_destroy(vm->memory);
+	free_imported_libraries_ll(&vm->imported_libraries);
+	if (vm->profiler) {
+		profiler_destroy(vm->profiler);
+	}
+	if (vm->stats) {
+		vm_stats_destroy(vm->stats);
+	}
+	if (vm->alloc_profiler) {
+		alloc_profiler_destroy(vm->alloc_profiler);
+	}
+	if (vm->trace) {
+		vm_trace_destroy(vm->trace);
+	}
 	safe_free(vm);
 }
 
@@ -74,6 +204,131 @@ static char* get_binary_overload_name(enum vm_operator op, struct data a, struct
 	return fn_name;
 }
 
+// run_binary(vm, op, a, b, borrowed) calls the overload for a op b if one is
+//   declared, returning true after pushing its arguments so the caller can
+//   jump to the call. Otherwise it pushes the result and destroys a and b.
+//   A borrowed a isn't destroyed, and is copied if it's passed on.
+static bool run_binary(struct vm* vm, enum vm_operator op, struct data a, struct data b,
+		bool borrowed) {
+	struct data any_d = any_data();
+	char* a_and_b = get_binary_overload_name(op, a, b);
+	char* any_a = get_binary_overload_name(op, any_d, b);
+	char* any_b = get_binary_overload_name(op, a, any_d);
+	destroy_data_runtime(vm->memory, &any_d);
+	char* fn_name = first_that(vm->memory, _id_exist, a_and_b, any_a, any_b);
+	bool is_call = fn_name;
+	if (vm->stats) {
+		vm->stats->overload_lookups += 1;
+		vm->stats->overload_hits += is_call;
+	}
+	if (is_call) {
+		push_arg(vm->memory, make_data(D_END_OF_ARGUMENTS, data_value_num(0)));
+		push_arg(vm->memory, b);
+		push_arg(vm->memory, borrowed ? copy_data_runtime(vm->memory, a) : a);
+		push_arg(vm->memory, copy_data_runtime(vm->memory, *get_address_of_id(vm->memory, fn_name, true, NULL)));
+	}
+	else {
+		push_arg(vm->memory, eval_binop(vm, op, a, b));
+		if (!borrowed) {
+			destroy_data_runtime(vm->memory, &a);
+		}
+		destroy_data_runtime(vm->memory, &b);
+	}
+	safe_free(a_and_b);
+	safe_free(any_a);
+	safe_free(any_b);
+	return is_call;
+}
+
+// Operand types each quick_kind applies to, in the order OP_BIN pops them
+static const char* quick_types[QUICK_KIND_COUNT][2] = {
+	[QUICK_NUMBER] = { "number", "number" },
+	[QUICK_STRING] = { "string", "string" },
+	[QUICK_INDEX] = { "list", "number" },
+};
+
+// note_overload(vm, id) dequickens every shape that id overloads, id is any
+//   name being declared
+static void note_overload(struct vm* vm, const char* id) {
+	for (int k = 0; k < QUICK_KIND_COUNT; k++) {
+		for (enum vm_operator op = O_ADD; op <= O_SAFE_NAVIGATE; op++) {
+			if (is_binary_overload(id, quick_types[k][0], op, quick_types[k][1])) {
+				vm->quick_overloads[k] |= 1u << op;
+			}
+		}
+	}
+}
+
+// quick_kind_of(quick) returns the shape the specialized opcode quick handles
+static enum quick_kind quick_kind_of(enum opcode quick) {
+	switch (quick) {
+		case OP_BINNUM: return QUICK_NUMBER;
+		case OP_BINSTR: return QUICK_STRING;
+		case OP_INDEX: return QUICK_INDEX;
+		default:
+			wendy_assert(false, "%s is not a specialized opcode", opcode_string[quick]);
+			return QUICK_KIND_COUNT;
+	}
+}
+
+// quickened_opcode(vm, op, a, b) returns the specialized form of OP_BIN for
+//   op on a and b, or OP_BIN if there isn't one or it has been overloaded
+static enum opcode quickened_opcode(struct vm* vm, enum vm_operator op,
+		struct data a, struct data b) {
+	enum opcode quick = specialized_opcode(op, a.type, b.type);
+	if (quick != OP_BIN &&
+		(vm->quick_overloads[quick_kind_of(quick)] & (1u << op))) {
+		return OP_BIN;
+	}
+	return quick;
+}
+
+static struct data binnum(struct vm* vm, enum vm_operator op, struct data a, struct data b) {
+	double x = a.value.number;
+	double y = b.value.number;
+	switch (op) {
+		case O_ADD: return make_data(D_NUMBER, data_value_num(x + y));
+		case O_SUB: return make_data(D_NUMBER, data_value_num(x - y));
+		case O_MUL: return make_data(D_NUMBER, data_value_num(x * y));
+		case O_LT: return x < y ? true_data() : false_data();
+		case O_GT: return x > y ? true_data() : false_data();
+		case O_LTE: return x <= y ? true_data() : false_data();
+		case O_GTE: return x >= y ? true_data() : false_data();
+		case O_EQ: return x == y ? true_data() : false_data();
+		case O_NEQ: return x != y ? true_data() : false_data();
+		default: return eval_binop(vm, op, a, b);
+	}
+}
+
+static struct data binstr(struct vm* vm, enum vm_operator op, struct data a, struct data b) {
+	if (op == O_ADD) {
+		size_t len_a = strlen(a.value.string);
+		size_t len_b = strlen(b.value.string);
+		if (!string_reserve(vm->memory, len_a + len_b)) {
+			return none_data();
+		}
+		struct data result = make_data(D_STRING, data_value_size(len_a + len_b));
+		memcpy(result.value.string, a.value.string, len_a);
+		memcpy(result.value.string + len_a, b.value.string, len_b + 1);
+		return result;
+	}
+	else if (op == O_EQ || op == O_NEQ) {
+		return (op == O_EQ) == streq(a.value.string, b.value.string) ?
+			true_data() : false_data();
+	}
+	return eval_binop(vm, op, a, b);
+}
+
+static struct data index_list(struct vm* vm, struct data a, struct data b) {
+	int index = (int)floor(b.value.number);
+	if (index >= 0 && (size_t) index < wendy_list_size(&a)) {
+		// Add 1 to offset because of the header.
+		return copy_data_runtime(vm->memory, a.value.reference[index + 1]);
+	}
+	// Out of range, let the generic path report it
+	return eval_binop(vm, O_SUBSCRIPT, a, b);
+}
+
 static char* get_unary_overload_name(enum vm_operator op, struct data a) {
 	char* type_a = type_of_str(a);
 	char* fn_name = safe_concat(OPERATOR_OVERLOAD_PREFIX,
@@ -88,7 +343,7 @@ static char* get_print_overload_name(struct data a) {
 }
 
 address vm_load_code(struct vm* vm, uint8_t* new_bytecode, size_t size, bool append) {
-	if (get_settings_flag(SETTINGS_DRY_RUN)) {
+	if (vm->settings.flags[SETTINGS_DRY_RUN]) {
 		return 0;
 	}
 	// Verify Header
@@ -99,6 +354,7 @@ address vm_load_code(struct vm* vm, uint8_t* new_bytecode, size_t size, bool app
 			safe_free(vm->bytecode);
 		}
 		vm->bytecode = new_bytecode;
+		vm->bytecode_size = size;
 		start_at = verify_header(vm->bytecode, size);
 	}
 	else {
@@ -128,8 +384,14 @@ address vm_load_code(struct vm* vm, uint8_t* new_bytecode, size_t size, bool app
 }
 
 void vm_run_instruction(struct vm* vm, enum opcode op) {
+	// Set when the left operand of the binary operation about to run is
+	//   borrowed from a variable by OP_PUSHB
+	bool borrowed = false;
 	switch (op) {
-		case OP_PUSH: {
+		case OP_PUSH:
+		case OP_PUSH2:
+		case OP_PUSHB:
+		vm_push: {
 			struct data t = get_data(vm->bytecode + vm->instruction_ptr, &vm->instruction_ptr);
 			// t will never be a reference type
 			struct data d;
@@ -143,54 +405,110 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 						error_runtime(vm->memory, vm->line, MEMORY_ID_NOT_FOUND, t.value.string);
 						break;
 					}
-					d = copy_data(*value);
+					d = op == OP_PUSHB ? *value : copy_data_runtime(vm->memory, *value);
 				}
 			}
 			else {
-				d = copy_data(t);
+				d = copy_data_runtime(vm->memory, t);
 			}
 			vm->last_pushed_identifier = t.value.string;
 			push_arg(vm->memory, d);
+			if (op == OP_PUSH2) {
+				// Run the push after it too, which may be an OP_PUSHB
+				op = vm->bytecode[vm->instruction_ptr++];
+				goto vm_push;
+			}
+			if (op == OP_PUSHB) {
+				// Run the operation after it, which reads the value in place
+				borrowed = true;
+				op = vm->bytecode[vm->instruction_ptr++];
+				if (op == OP_BIN) {
+					goto vm_bin;
+				}
+				goto vm_binspecial;
+			}
 			break;
 		}
-		case OP_BIN: {
+		case OP_BIN:
+		vm_bin: {
+			address site = vm->instruction_ptr - 1;
 			enum vm_operator op = vm->bytecode[vm->instruction_ptr++];
 			struct data a = pop_arg(vm->memory, vm->line);
 			struct data b = pop_arg(vm->memory, vm->line);
-			struct data any_d = any_data();
-			char* a_and_b = get_binary_overload_name(op, a, b);
-			char* any_a = get_binary_overload_name(op, any_d, b);
-			char* any_b = get_binary_overload_name(op, a, any_d);
-			destroy_data_runtime(vm->memory, &any_d);
-			char* fn_name = first_that(vm->memory, _id_exist, a_and_b, any_a, any_b);
-			if (fn_name) {
-				push_arg(vm->memory, make_data(D_END_OF_ARGUMENTS, data_value_num(0)));
-				push_arg(vm->memory, b);
-				push_arg(vm->memory, a);
-				push_arg(vm->memory, copy_data(*get_address_of_id(vm->memory, fn_name, true, NULL)));
-				safe_free(a_and_b);
-				safe_free(any_a);
-				safe_free(any_b);
+			enum opcode quick = quickened_opcode(vm, op, a, b);
+			if (run_binary(vm, op, a, b, borrowed)) {
 				goto wendy_vm_call;
 			}
+			if (quick == OP_BINNUM && is_comparison(op) &&
+				vm->bytecode[vm->instruction_ptr] == OP_JIF) {
+				quick = OP_BRNUM;
+			}
+			if (quick != OP_BIN && !vm->error_flag) {
+				// Next time this site runs it skips straight to the fast path
+				vm->bytecode[site] = quick;
+			}
+			break;
+		}
+		case OP_BINNUM:
+		case OP_BINSTR:
+		case OP_INDEX:
+		case OP_BRNUM:
+		vm_binspecial: {
+			bool branches = op == OP_BRNUM;
+			enum opcode op_code = branches ? OP_BINNUM : op;
+			address site = vm->instruction_ptr - 1;
+			enum vm_operator op = vm->bytecode[vm->instruction_ptr++];
+			struct data a = pop_arg(vm->memory, vm->line);
+			struct data b = pop_arg(vm->memory, vm->line);
+			if (quickened_opcode(vm, op, a, b) != op_code) {
+				// Operands changed shape or an overload was declared since
+				vm->bytecode[site] = OP_BIN;
+				if (run_binary(vm, op, a, b, borrowed)) {
+					goto wendy_vm_call;
+				}
+				break;
+			}
+			struct data result;
+			if (op_code == OP_BINNUM) {
+				result = binnum(vm, op, a, b);
+			}
+			else if (op_code == OP_BINSTR) {
+				result = binstr(vm, op, a, b);
+			}
+			else {
+				result = index_list(vm, a, b);
+			}
+			if (branches) {
+				// Branch on the comparison like the JIF after it
+				vm->instruction_ptr++;
+				address addr = get_address(&vm->bytecode[vm->instruction_ptr], &vm->instruction_ptr);
+				if (result.type == D_FALSE && may_jump(vm, addr)) {
+					vm->instruction_ptr = addr;
+				}
+				destroy_data_runtime(vm->memory, &result);
+			}
 			else {
-				push_arg(vm->memory, eval_binop(vm, op, a, b));
+				push_arg(vm->memory, result);
+			}
+			if (!borrowed) {
 				destroy_data_runtime(vm->memory, &a);
-				destroy_data_runtime(vm->memory, &b);
 			}
-			safe_free(a_and_b);
-			safe_free(any_a);
-			safe_free(any_b);
+			destroy_data_runtime(vm->memory, &b);
 			break;
 		}
 		case OP_UNA: {
 			enum vm_operator op = vm->bytecode[vm->instruction_ptr++];
 			struct data a = pop_arg(vm->memory, vm->line);
 			char* fn_name = get_unary_overload_name(op, a);
-			if (id_exist(vm->memory, fn_name, true)) {
+			bool is_call = id_exist(vm->memory, fn_name, true);
+			if (vm->stats) {
+				vm->stats->overload_lookups += 1;
+				vm->stats->overload_hits += is_call;
+			}
+			if (is_call) {
 				push_arg(vm->memory, make_data(D_END_OF_ARGUMENTS, data_value_num(0)));
 				push_arg(vm->memory, a);
-				push_arg(vm->memory, copy_data(*get_address_of_id(vm->memory, fn_name, true, NULL)));
+				push_arg(vm->memory, copy_data_runtime(vm->memory, *get_address_of_id(vm->memory, fn_name, true, NULL)));
 				safe_free(fn_name);
 				goto wendy_vm_call;
 			}
@@ -215,18 +533,25 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 			native_call(vm, name, args);
 			break;
 		}
-		case OP_DECL: {
+		case OP_DECL:
+		case OP_DECLW: {
 			char *id = get_string(vm->bytecode + vm->instruction_ptr, &vm->instruction_ptr);
 			if (id_exist_local_frame_ignore_closure(vm->memory, id)) {
 				error_runtime(vm->memory, vm->line, VM_VAR_DECLARED_ALREADY, id);
 				return;
 			}
+			note_overload(vm, id);
 			struct data* result = push_stack_entry(vm->memory, id, vm->line);
 			push_arg(vm->memory, make_data(D_INTERNAL_POINTER, data_value_ptr(result)));
 			vm->last_pushed_identifier = id;
+			if (op == OP_DECLW) {
+				vm->instruction_ptr++;
+				goto vm_write;
+			}
 			break;
 		}
-		case OP_WHERE: {
+		case OP_WHERE:
+		case OP_STORE: {
 			char* id = get_string(vm->bytecode + vm->instruction_ptr, &vm->instruction_ptr);
 			vm->last_pushed_identifier = id;
 			struct data* result = get_address_of_id(vm->memory, id, true, NULL);
@@ -237,22 +562,31 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 			push_arg(vm->memory, make_data(D_INTERNAL_POINTER,
 				data_value_ptr(result)
 			));
+			if (op == OP_STORE) {
+				vm->instruction_ptr++;
+				goto vm_write;
+			}
 			break;
 		}
 		case OP_IMPORT: {
 			char* name = get_string(vm->bytecode + vm->instruction_ptr, &vm->instruction_ptr);
 			address a = get_address(vm->bytecode + vm->instruction_ptr, &vm->instruction_ptr);
-			if (has_already_imported_library(name)) {
+			if (has_already_imported_library(vm->imported_libraries, name)) {
 				vm->instruction_ptr = a;
 			}
 			else {
-				add_imported_library(name);
+				add_imported_library(&vm->imported_libraries, name);
 			}
 			break;
 		}
 		case OP_ARGCLN: {
-			// TODO: 128 limit here seems a bit arbitrary and we
-			struct data* extra_args = wendy_list_malloc(vm->memory, 128);
+			// At most everything down to the end of the arguments is extra
+			size_t extra = vm->memory->working_stack_pointer - 1;
+			while (vm->memory->working_stack[extra].type != D_END_OF_ARGUMENTS) {
+				extra -= 1;
+			}
+			struct data* extra_args = wendy_list_malloc(vm->memory,
+				vm->memory->working_stack_pointer - 1 - extra);
 			size_t count = 0;
 			while (top_arg(vm->memory, vm->line)->type != D_END_OF_ARGUMENTS) {
 				if (top_arg(vm->memory, vm->line)->type == D_NAMED_ARGUMENT_NAME) {
@@ -289,6 +623,9 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 			if (trace == 0) {
 				goto VM_OP_HALT;
 			}
+			if (vm->profiler) {
+				profiler_exit(vm->profiler);
+			}
 			pop_frame(vm->memory, true, &vm->instruction_ptr);
 			break;
 		}
@@ -308,11 +645,12 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 		}
 		case OP_DUPTOP: {
 			struct data* top = top_arg(vm->memory, vm->line);
-			push_arg(vm->memory, copy_data(*top));
+			push_arg(vm->memory, copy_data_runtime(vm->memory, *top));
 			break;
 		}
 		case OP_POP: {
-			pop_arg(vm->memory, vm->line);
+			struct data top = pop_arg(vm->memory, vm->line);
+			destroy_data_runtime(vm->memory, &top);
 			break;
 		}
 		case OP_ROTTWO: {
@@ -405,6 +743,10 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 				storage[0] = list_header_data(list_size, list_size);
 			}
 
+			if (has_spread && !refcnt_reserve(vm->memory, size + additional_space)) {
+				refcnt_free(vm->memory, storage);
+				break;
+			}
 			if (has_spread) {
 				struct data* new_storage =
 					refcnt_malloc(vm->memory, size + additional_space);
@@ -414,7 +756,7 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 						struct data spread = storage[i].value.reference[0];
 						if (spread.type == D_LIST) {
 							for (size_t k = 0; k < wendy_list_size(&spread); k++) {
-								new_storage[j++] = copy_data(spread.value.reference[k + 1]);
+								new_storage[j++] = copy_data_runtime(vm->memory, spread.value.reference[k + 1]);
 							}
 						}
 						else if (spread.type == D_RANGE) {
@@ -484,8 +826,8 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 					goto nthptr_cleanup;
 				}
 				struct data *internal = refcnt_malloc(vm->memory, 2);
-				internal[0] = copy_data(list);
-				internal[1] = copy_data(number); // which is a range
+				internal[0] = copy_data_runtime(vm->memory, list);
+				internal[1] = copy_data_runtime(vm->memory, number); // which is a range
 				push_arg(vm->memory, make_data(D_LIST_RANGE_LVALUE,
 					data_value_ptr(internal)));
 			}
@@ -550,7 +892,9 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 		}
 		case OP_JMP: {
 			address addr = get_address(&vm->bytecode[vm->instruction_ptr], &vm->instruction_ptr);
-			vm->instruction_ptr = addr;
+			if (may_jump(vm, addr)) {
+				vm->instruction_ptr = addr;
+			}
 			break;
 		}
 		case OP_JIF: {
@@ -560,13 +904,14 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 			if (top.type != D_TRUE && top.type != D_FALSE) {
 				error_runtime(vm->memory, vm->line, VM_COND_EVAL_NOT_BOOL);
 			}
-			if (top.type == D_FALSE) {
+			if (top.type == D_FALSE && may_jump(vm, addr)) {
 				vm->instruction_ptr = addr;
 			}
 			destroy_data_runtime(vm->memory, &top);
 			break;
 		}
 		case OP_CALL:
+		case OP_TCALL:
 		wendy_vm_call: {
 			struct data top = pop_arg(vm->memory, vm->line);
 			if (top.type != D_FUNCTION && top.type != D_STRUCT && top.type != D_STRUCT_FUNCTION) {
@@ -574,7 +919,15 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 				destroy_data_runtime(vm->memory, &top);
 				break;
 			}
-			struct data boundName = top.value.reference[2];
+			if ((vm->instructions_run >= vm->limit_check_at ||
+				vm->memory->function_frames >= vm->call_depth_limit) && !within_limits(vm)) {
+				destroy_data_runtime(vm->memory, &top);
+				break;
+			}
+			// Structs keep their name before their tables, functions after their
+			//   address and closure
+			struct data boundName = top.type == D_STRUCT ?
+				top.value.reference[1] : top.value.reference[2];
 			char* function_disp = safe_malloc((128 + strlen(boundName.value.string)) * sizeof(char));
 			function_disp[0] = 0;
 			if (boundName.value.string && streq(boundName.value.string, "self")) {
@@ -583,7 +936,29 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 			else {
 				sprintf(function_disp, "%s:0x%X", boundName.value.string, vm->instruction_ptr);
 			}
-			push_frame(vm->memory, function_disp, vm->instruction_ptr, vm->line);
+			// A tail call returns straight to the caller's caller, the frame
+			//   it replaces only remains as a count in stack traces
+			address return_to = vm->instruction_ptr;
+			size_t tail_calls = 0;
+			if (op == OP_TCALL) {
+				size_t trace = vm->memory->call_stack_pointer - 1;
+				while (vm->memory->call_stack[trace].is_automatic) {
+					trace -= 1;
+				}
+				if (trace != 0) {
+					tail_calls = vm->memory->call_stack[trace].tail_calls + 1;
+					pop_frame(vm->memory, true, &return_to);
+					if (vm->profiler) {
+						profiler_exit(vm->profiler);
+					}
+				}
+			}
+			if (vm->profiler) {
+				profiler_enter(vm->profiler, streq(boundName.value.string, "self") ?
+					"anonymous" : boundName.value.string);
+			}
+			push_frame(vm->memory, function_disp, return_to, vm->line);
+			vm->memory->call_stack[vm->memory->call_stack_pointer - 1].tail_calls = tail_calls;
 			safe_free(function_disp);
 
 			if (top.type == D_STRUCT) {
@@ -598,7 +973,7 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 
 				// Better Exist
 				wendy_assert(table_exist(static_table, "init"), "struct static table has no init!");
-				top = copy_data(*table_find(static_table, "init"));
+				top = copy_data_runtime(vm->memory, *table_find(static_table, "init"));
 
 				if (top.type != D_FUNCTION) {
 					error_runtime(vm->memory, vm->line, VM_STRUCT_CONSTRUCTOR_NOT_A_FUNCTION);
@@ -654,7 +1029,7 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 						struct data spread = og_spread.value.reference[0];
 						if (spread.type == D_LIST) {
 							for (size_t k = 0; k < wendy_list_size(&spread); k++) {
-								vm->memory->working_stack[new_ptr--] = copy_data(spread.value.reference[k + 1]);
+								vm->memory->working_stack[new_ptr--] = copy_data_runtime(vm->memory, spread.value.reference[k + 1]);
 							}
 						}
 						else if (spread.type == D_RANGE) {
@@ -708,17 +1083,30 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 					destroy_data_runtime(vm->memory, &top);
 					break;
 				}
-				*push_closure_entry(vm->memory, list_data[i].value.string, vm->line) = copy_data(list_data[i + 1]);
+				*push_closure_entry(vm->memory, list_data[i].value.string, vm->line) = copy_data_runtime(vm->memory, list_data[i + 1]);
 			}
 
 			// At this point, we put `top` back into the stack, so no need to destroy it
 			if (strcmp(boundName.value.string, "self") != 0) {
-				*push_stack_entry(vm->memory, "self", vm->line) = copy_data(top);
+				*push_stack_entry(vm->memory, "self", vm->line) = copy_data_runtime(vm->memory, top);
 			}
 			*push_stack_entry(vm->memory, boundName.value.string, vm->line) = top;
+
+			// Make room for the whole body instead of leaving it to a dispatch
+			if (vm->bytecode[vm->instruction_ptr] == OP_RESERVE) {
+				vm->instruction_ptr += 1;
+				goto vm_reserve;
+			}
 			break;
 		}
-		case OP_WRITE: {
+		case OP_RESERVE:
+		vm_reserve: {
+			address depth = get_address(&vm->bytecode[vm->instruction_ptr], &vm->instruction_ptr);
+			ensure_working_stack_size(vm->memory, depth + WORKING_STACK_SLACK);
+			break;
+		}
+		case OP_WRITE:
+		vm_write: {
 			struct data ptr = pop_arg(vm->memory, vm->line);
 			if (ptr.type != D_INTERNAL_POINTER && ptr.type != D_LIST_RANGE_LVALUE) {
 				error_runtime(vm->memory, vm->line, VM_INTERNAL_ERROR, "WRITE on non-pointer");
@@ -780,14 +1168,14 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 					int i = 0;
 					for (int k = start; k != end; start < end ? k++ : k--) {
 						destroy_data_runtime(vm->memory, &list_data[k + 1]);
-						list_data[k + 1] = copy_data(value_data[i + 1]);
+						list_data[k + 1] = copy_data_runtime(vm->memory, value_data[i + 1]);
 						i++;
 					}
 				}
 				else {
 					for (int k = start; k != end; start < end ? k++ : k--) {
 						destroy_data_runtime(vm->memory, &list_data[k + 1]);
-						list_data[k + 1] = copy_data(value);
+						list_data[k + 1] = copy_data_runtime(vm->memory, value);
 					}
 				}
 			write_list_range_lvalue_cleanup:
@@ -803,7 +1191,7 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 				if (id_exist(vm->memory, fn_name, true)) {
 					push_arg(vm->memory, make_data(D_END_OF_ARGUMENTS, data_value_num(0)));
 					push_arg(vm->memory, t);
-					push_arg(vm->memory, copy_data(*get_address_of_id(vm->memory, fn_name, true, NULL)));
+					push_arg(vm->memory, copy_data_runtime(vm->memory, *get_address_of_id(vm->memory, fn_name, true, NULL)));
 					safe_free(fn_name);
 					/* This i-- allows the overloaded function to return
 						* a string / object and have that be the printed
@@ -825,7 +1213,7 @@ void vm_run_instruction(struct vm* vm, enum opcode op) {
 				if (id_exist(vm->memory, fn_name, true)) {
 					push_arg(vm->memory, make_data(D_END_OF_ARGUMENTS, data_value_num(0)));
 					push_arg(vm->memory, t);
-					push_arg(vm->memory, copy_data(*get_address_of_id(vm->memory, fn_name, true, NULL)));
+					push_arg(vm->memory, copy_data_runtime(vm->memory, *get_address_of_id(vm->memory, fn_name, true, NULL)));
 					safe_free(fn_name);
 					/* This i-- allows the overloaded function to return
 						* a string / object and have that be the printed
@@ -880,20 +1268,89 @@ void vm_set_instruction_pointer(struct vm* vm, address start) {
 	vm->instruction_ptr = start;
 }
 
-void vm_run(struct vm *vm) {
-	if (get_settings_flag(SETTINGS_DRY_RUN)) {
-		return;
+// pushed_type(vm, at, type) sets type to the type of the value the push at at
+//   leaves on the working stack, returns the address after it or 0 if the push
+//   will fail
+static address pushed_type(struct vm* vm, address at, enum data_type* type) {
+	at += 1;
+	struct data t = get_data(vm->bytecode + at, &at);
+	*type = t.type;
+	if (t.type == D_IDENTIFIER) {
+		if (streq(t.value.string, "time")) {
+			*type = D_NUMBER;
+			return at;
+		}
+		struct data* value = get_address_of_id(vm->memory, t.value.string, true, NULL);
+		if (!value) {
+			return 0;
+		}
+		*type = value->type;
+	}
+	return at;
+}
+
+// count_binop(vm, stats, at) counts the operator and operand types of the
+//   binary operation that dispatching the instruction at at runs, if any.
+//   Pushes fused with what follows them run it in the same dispatch, so the
+//   operands are followed through them.
+static void count_binop(struct vm* vm, struct vm_stats* stats, address at) {
+	struct memory* memory = vm->memory;
+	address sp = memory->working_stack_pointer;
+	enum data_type left = sp > 0 ? memory->working_stack[sp - 1].type : D_EMPTY;
+	enum data_type right = sp > 1 ? memory->working_stack[sp - 2].type : D_EMPTY;
+	forever {
+		enum opcode op = vm->bytecode[at];
+		switch (op) {
+			case OP_BIN:
+			case OP_BINNUM:
+			case OP_BINSTR:
+			case OP_INDEX:
+			case OP_BRNUM:
+				stats->binops[vm->bytecode[at + 1]][left][right] += 1;
+				return;
+			case OP_PUSH2:
+			case OP_PUSHB:
+				right = left;
+				at = pushed_type(vm, at, &left);
+				if (!at) {
+					return;
+				}
+				break;
+			default:
+				return;
+		}
 	}
+}
+
+// run_loop(vm, stats, trace) dispatches instructions until the program
+//   halts, returns out of the frame it started in or fails. vm_run calls it
+//   with stats and trace only when counting or tracing, so the compiler
+//   drops both from the other copy.
+static inline void run_loop(struct vm* vm, struct vm_stats* stats, struct vm_trace* trace) {
 	size_t starting_stack_pointer = vm->memory->call_stack_pointer;
+	enum opcode last_op = OP_HALT;
 	for (;;) {
-		reset_error_flag();
+		vm->error_flag = false;
 		enum opcode op = vm->bytecode[vm->instruction_ptr];
-		if (get_settings_flag(SETTINGS_TRACE_VM)) {
+		if (vm->settings.flags[SETTINGS_TRACE_VM]) {
 			// This branch could slow down the VM but the CPU should branch
 			// predict after one or two iterations.
 			printf(BLU "<+%04X>: " RESET "%s\n", vm->instruction_ptr, opcode_string[op]);
 		}
+		if (trace) {
+			vm_trace_record(trace, vm->instruction_ptr, op, vm->line,
+				vm->memory->working_stack_pointer, vm->memory->call_stack_pointer);
+		}
+		if (stats) {
+			stats->opcodes[op] += 1;
+			if (last_op != OP_HALT) {
+				stats->pairs[last_op][op] += 1;
+			}
+			last_op = op;
+			count_binop(vm, stats, vm->instruction_ptr);
+		}
 		vm->instruction_ptr += 1;
+		vm->instructions_run += 1;
 		if (op == OP_HALT) return;
 		vm_run_instruction(vm, op);
 
@@ -902,19 +1359,50 @@ void vm_run(struct vm *vm) {
 			return;
 		}
 
-		if (get_error_flag()) {
+		if (vm->error_flag) {
 			clear_working_stack(vm->memory);
 			break;
 		}
+
+		if (heap_snapshot_requested) {
+			heap_snapshot_take_requested(vm->memory);
+		}
 	}
 }
 
+void vm_run(struct vm *vm) {
+	if (vm->settings.flags[SETTINGS_DRY_RUN]) {
+		return;
+	}
+	if (vm->settings.flags[SETTINGS_PROFILE] && !vm->profiler) {
+		vm->profiler = profiler_create();
+	}
+	if (vm->settings.flags[SETTINGS_VM_STATS] && !vm->stats) {
+		vm->stats = vm_stats_create();
+	}
+	if (vm->limits.instructions || vm->limits.seconds || vm->limits.cpu_seconds) {
+		vm->run_started = limit_clock(CLOCK_MONOTONIC);
+		vm->cpu_started = limit_clock(CLOCK_THREAD_CPUTIME_ID);
+		vm->limit_check_at = 0;
+	}
+	// Only what the program does is attributed, not compiling it
+	struct alloc_profiler* outer_alloc_profiler = active_alloc_profiler;
+	active_alloc_profiler = vm->alloc_profiler;
+	if (vm->stats || vm->trace) {
+		run_loop(vm, vm->stats, vm->trace);
+	}
+	else {
+		run_loop(vm, 0, 0);
+	}
+	active_alloc_profiler = outer_alloc_profiler;
+}
+
 static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a, struct data b) {
 	if (op == O_ELVIS) {
 		if (a.type == D_NONE) {
-			return copy_data(b);
+			return copy_data_runtime(vm->memory, b);
 		}
-		return copy_data(a);
+		return copy_data_runtime(vm->memory, a);
 	}
 	if (op == O_SUBSCRIPT) {
 		// Array Reference, or String
@@ -967,7 +1455,7 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 			// Add 1 to offset because of the header.
 			int offset = floor(b.value.number) + 1;
 			struct data* list_data = a.value.reference;
-			return copy_data(list_data[offset]);
+			return copy_data_runtime(vm->memory, list_data[offset]);
 		}
 		else {
 			int start = range_start(b);
@@ -1003,7 +1491,7 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 			int n = 1;
 			for (int i = start; i != end;
 				start < end ? i++ : i--) {
-				new_subarray[n++] = copy_data(a.value.reference[i + 1]);
+				new_subarray[n++] = copy_data_runtime(vm->memory, a.value.reference[i + 1]);
 			}
 			return make_data(D_LIST, data_value_ptr(new_subarray));
 		}
@@ -1023,7 +1511,7 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 		if (a.type == D_TABLE) {
 			struct table* table = (struct table*) a.value.reference[0].value.reference;
 			if (table_exist(table, b.value.string)) {
-				struct data result = copy_data(*table_find(table, b.value.string));
+				struct data result = copy_data_runtime(vm->memory, *table_find(table, b.value.string));
 				if (result.type == D_FUNCTION) {
 					// Hack because OP_CALL will send a reference to the table as the
 					//   first argument
@@ -1036,7 +1524,7 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 			// Either will be allowed to look through static parameters.
 			struct data* ptr = struct_get_field(vm, a, b.value.string);
 			if (ptr) {
-				struct data result = copy_data(*ptr);
+				struct data result = copy_data_runtime(vm->memory, *ptr);
 				if (result.type == D_FUNCTION) {
 					// Hack because OP_CALL will send a reference to the table as the
 					//   first argument
@@ -1052,10 +1540,10 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 			return type_of(a);
 		}
 		else if (streq("val", b.value.string)) {
-			return value_of(a);
+			return value_of(vm, a);
 		}
 		else if (streq("char", b.value.string)) {
-			return char_of(a);
+			return char_of(vm, a);
 		}
 		else if (a.type == D_TABLE && streq("keys", b.value.string)) {
 			struct table* table = (struct table*) a.value.reference[0].value.reference;
@@ -1076,11 +1564,11 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 		}
 		else if ((a.type == D_FUNCTION || a.type == D_STRUCT_FUNCTION) &&
 			streq("closure", b.value.string)) {
-			return copy_data(a.value.reference[1]);
+			return copy_data_runtime(vm->memory, a.value.reference[1]);
 		}
 		else if ((a.type == D_FUNCTION || a.type == D_STRUCT_FUNCTION) &&
 			streq("params", b.value.string)) {
-			return copy_data(a.value.reference[3]);
+			return copy_data_runtime(vm->memory, a.value.reference[3]);
 		}
 		else if (a.type == D_NONERET) {
 			error_runtime(vm->memory, vm->line, VM_NOT_A_STRUCT_MAYBE_FORGOT_RET_THIS);
@@ -1227,10 +1715,10 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 					struct data* new_list = wendy_list_malloc(vm->memory, new_size);
 					size_t n = 1; // first is the header
 					for (size_t i = 0; i < size_a; i++) {
-						new_list[n++] = copy_data(a.value.reference[i + 1]);
+						new_list[n++] = copy_data_runtime(vm->memory, a.value.reference[i + 1]);
 					}
 					for (size_t i = 0; i < size_b; i++) {
-						new_list[n++] = copy_data(b.value.reference[i + 1]);
+						new_list[n++] = copy_data_runtime(vm->memory, b.value.reference[i + 1]);
 					}
 					return make_data(D_LIST, data_value_ptr(new_list));
 				}
@@ -1241,7 +1729,7 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 		else if (a.type == D_LIST) {
 			if (op == O_ADD) {
 				if (b.type == D_NONERET) {
-					return copy_data(a);
+					return copy_data_runtime(vm->memory, a);
 				}
 				// list + element
 				size_t size_a = wendy_list_size(&a);
@@ -1249,9 +1737,9 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 				struct data* new_list = wendy_list_malloc(vm->memory, size_a + 1);
 				size_t n = 1;
 				for (size_t i = 0; i < size_a; i++) {
-					new_list[n++] = copy_data(a.value.reference[i + 1]);
+					new_list[n++] = copy_data_runtime(vm->memory, a.value.reference[i + 1]);
 				}
-				new_list[n++] = copy_data(b);
+				new_list[n++] = copy_data_runtime(vm->memory, b);
 				return make_data(D_LIST, data_value_ptr(new_list));
 			}
 			else if (op == O_MUL && b.type == D_NUMBER) {
@@ -1265,11 +1753,14 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 			        return none_data();
 				}
 				size_t new_size = size_a * times;
+				if (!refcnt_reserve(vm->memory, new_size + 1)) {
+					return none_data();
+				}
 				struct data* new_list = wendy_list_malloc(vm->memory, new_size);
 				// Copy all Elements n times
 				size_t n = 1;
 				for (size_t i = 0; i < new_size; i++) {
-					new_list[n++] = copy_data(a.value.reference[(i % size_a) + 1]);
+					new_list[n++] = copy_data_runtime(vm->memory, a.value.reference[(i % size_a) + 1]);
 				}
 				return make_data(D_LIST, data_value_ptr(new_list));
 			}
@@ -1282,14 +1773,14 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 
 			if (op == O_ADD) {
 				if (a.type == D_NONERET) {
-					return copy_data(b);
+					return copy_data_runtime(vm->memory, b);
 				}
 				// element + list
 				struct data* new_list = wendy_list_malloc(vm->memory, size_b + 1);
 				size_t n = 1;
-				new_list[n++] = copy_data(a);
+				new_list[n++] = copy_data_runtime(vm->memory, a);
 				for (size_t i = 0; i < size_b; i++) {
-					new_list[n++] = copy_data(b.value.reference[i + 1]);
+					new_list[n++] = copy_data_runtime(vm->memory, b.value.reference[i + 1]);
 				}
 				return make_data(D_LIST, data_value_ptr(new_list));
 			}
@@ -1304,11 +1795,14 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 			        return none_data();
 				}
 				size_t new_size = size_b * times;
+				if (!refcnt_reserve(vm->memory, new_size + 1)) {
+					return none_data();
+				}
 				struct data* new_list = wendy_list_malloc(vm->memory, new_size);
 				// Copy all Elements n times
 				size_t n = 1;
 				for (size_t i = 0; i < new_size; i++) {
-					new_list[n++] = copy_data(b.value.reference[(i % size_b) + 1]);
+					new_list[n++] = copy_data_runtime(vm->memory, b.value.reference[(i % size_b) + 1]);
 				}
 				return make_data(D_LIST, data_value_ptr(new_list));
 			}
@@ -1343,6 +1837,9 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 				total_len += strlen(b.value.string);
 			}
 
+			if (!string_reserve(vm->memory, total_len)) {
+				return none_data();
+			}
 			struct data result = make_data(D_STRING, data_value_size(total_len));
 			size_t length = 0;
 			if (a.type == D_NUMBER) {
@@ -1369,7 +1866,7 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 				times = (int) a.value.number;
 				if (times < 0) {
 					error_runtime(vm->memory, vm->line, VM_STRING_DUPLICATION_NEGATIVE);
-					return copy_data(b);
+					return copy_data_runtime(vm->memory, b);
 				}
 				size = times * strlen(b.value.string) + 1;
 				string = b.value.string;
@@ -1378,11 +1875,14 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 				times = (int) b.value.number;
 				if (times < 0) {
 					error_runtime(vm->memory, vm->line, VM_STRING_DUPLICATION_NEGATIVE);
-					return copy_data(b);
+					return copy_data_runtime(vm->memory, b);
 				}
 				size = times * strlen(a.value.string) + 1;
 				string = a.value.string;
 			}
+			if (!string_reserve(vm->memory, size)) {
+				return none_data();
+			}
 			result = safe_malloc(size * sizeof(char));
 			result[0] = 0;
 			for (int i = 0; i < times; i++) {
@@ -1433,23 +1933,23 @@ static struct data eval_binop(struct vm * vm, enum vm_operator op, struct data a
 	return none_data();
 }
 
-static struct data value_of(struct data a) {
+static struct data value_of(struct vm* vm, struct data a) {
 	if (a.type == D_STRING && strlen(a.value.string) == 1) {
 		return make_data(D_NUMBER, data_value_num(a.value.string[0]));
 	}
 	else {
-		return copy_data(a);
+		return copy_data_runtime(vm->memory, a);
 	}
 }
 
-static struct data char_of(struct data a) {
+static struct data char_of(struct vm* vm, struct data a) {
 	if (a.type == D_NUMBER && a.value.number >= 0 && a.value.number <= 127) {
 		struct data res = make_data(D_STRING, data_value_str(" "));
 		res.value.string[0] = (char)a.value.number;
 		return res;
 	}
 	else {
-		return copy_data(a);
+		return copy_data_runtime(vm->memory, a);
 	}
 }
 
@@ -1525,7 +2025,7 @@ static struct data eval_uniop(struct vm * vm, enum vm_operator op, struct data a
 			struct data* new_a = wendy_list_malloc(vm->memory, list_size);
 			int n = 1;
 			for (size_t i = 0; i < list_size; i++) {
-				new_a[n++] = copy_data(a.value.reference[i + 1]);
+				new_a[n++] = copy_data_runtime(vm->memory, a.value.reference[i + 1]);
 			}
 			return make_data(D_LIST, data_value_ptr(new_a));
 		}
@@ -1556,7 +2056,7 @@ static struct data eval_uniop(struct vm * vm, enum vm_operator op, struct data a
 			return none_data();
 		}
 		struct data *storage = refcnt_malloc(vm->memory, 1);
-		*storage = copy_data(a);
+		*storage = copy_data_runtime(vm->memory, a);
 		return make_data(D_SPREAD, data_value_ptr(storage));
 	}
 	else {
@@ -1566,5 +2066,6 @@ static struct data eval_uniop(struct vm * vm, enum vm_operator op, struct data a
 }
 
 void print_current_bytecode(struct vm * vm) {
-	print_bytecode(vm->bytecode, vm->bytecode_size, stdout);
+	print_bytecode(vm->bytecode, vm->bytecode_size,
+		vm->settings.flags[SETTINGS_REPL], vm->sources, stdout);
 }
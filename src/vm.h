@@ -5,23 +5,86 @@
 #include "memory.h"
 #include "operators.h"
 #include "codegen.h"
+#include "imports.h"
 #include <stdint.h>
 
+struct profiler;
+struct vm_stats;
+struct alloc_profiler;
+struct vm_trace;
+
 // vm.h - Felix Guo
 // Executes a stream of bytecode based on instructions in [codegen] by
 //   interfacing with [memory]
 
+// Operand shapes an OP_BIN site can be quickened for, to OP_BINNUM, OP_BINSTR
+//   and OP_INDEX respectively
+enum quick_kind {
+	QUICK_NUMBER,
+	QUICK_STRING,
+	QUICK_INDEX,
+	QUICK_KIND_COUNT
+};
+
+// Resource ceilings for running untrusted programs, set by --max-instructions,
+//   --max-time, --max-cpu, --max-heap and --max-depth. 0 leaves one unlimited.
+//   Going over one is a runtime error.
+struct vm_limits {
+    size_t instructions;
+    // Seconds of wall clock and of this thread's CPU time, from vm_run
+    double seconds;
+    double cpu_seconds;
+    // Bytes of refcounted containers held at once, a string being built has
+    //   to fit in what's left
+    size_t heap_bytes;
+    // Calls on the call stack, counting the top level, blocks don't count
+    size_t call_depth;
+};
+
 struct vm {
     int line;
     address instruction_ptr;
     uint8_t* bytecode;
     size_t bytecode_size;
     char* last_pushed_identifier;
+    // Instructions dispatched so far, superinstructions count once
+    size_t instructions_run;
+    // Times calls with --profile, 0 otherwise
+    struct profiler* profiler;
+    // Counts what runs with --vm-stats, 0 otherwise
+    struct vm_stats* stats;
+    // Attributes allocations with --alloc-profile, 0 otherwise
+    struct alloc_profiler* alloc_profiler;
+    // Records each instruction with --trace-ring, 0 otherwise
+    struct vm_trace* trace;
+
+    // Copied from whoever created the VM
+    struct settings settings;
+    // Runtime errors are reported against this
+    const struct source_table* sources;
+    // Set once a runtime error is reported, cleared before each instruction
+    bool error_flag;
+    struct vm_limits limits;
+    // Backward jumps and calls check the limits once instructions_run gets
+    //   here, or the calls on the call stack get to call_depth_limit
+    size_t limit_check_at;
+    size_t call_depth_limit;
+    // From when vm_run started, against limits.seconds and cpu_seconds
+    double run_started;
+    double cpu_started;
+    // Libraries loaded by OP_IMPORT in this VM
+    struct import_node* imported_libraries;
+    // For each quick_kind, a bit per operator that has been overloaded for
+    //   that shape at some point. Quickened sites skip overload lookup, so
+    //   they only run while their bit is clear.
+    uint32_t quick_overloads[QUICK_KIND_COUNT];
 
     struct memory* memory;
 };
 
-struct vm *vm_init(void);
+// vm_init(settings, sources) creates a VM with a copy of settings that
+//   reports runtime errors against sources
+struct vm *vm_init(const struct settings* settings, const struct source_table* sources);
 void vm_destroy(struct vm * vm);
 
 address vm_load_code(struct vm* vm, uint8_t* bytecode, size_t size, bool append);
@@ -30,6 +93,13 @@ void vm_run_instruction(struct vm* vm, enum opcode op);
 void vm_run(struct vm * vm);
 void vm_cleanup_if_repl(struct vm* vm);
 
+// vm_set_limits(vm, limits) applies limits to the runs after
+void vm_set_limits(struct vm* vm, const struct vm_limits* limits);
+
+// vm_limits_option(limits, option, value) sets the limit for the command line
+//   option with its value, returns false if option isn't one of them
+bool vm_limits_option(struct vm_limits* limits, const char* option, const char* value);
+
 // print_current_bytecode() prints the current executing bytecode
 void print_current_bytecode(struct vm * vm);
 #endif
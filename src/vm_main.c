@@ -6,6 +6,8 @@
 #include "vm.h"
 #include "data.h"
 #include "imports.h"
+#include "source.h"
+#include "heap_snapshot.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -22,9 +24,21 @@ void invalid_usage(void) {
 	printf("    --trace-refcnt    : traces each ref-count action.\n");
 	printf("    -v, --verbose     : displays information about memory state on error.\n");
 	printf("    --sandbox         : runs the VM in sandboxed mode, ie. no file access and no native execution calls.\n");
+	printf("    --max-instructions <n>: stops the program with an error after n instructions.\n");
+	printf("    --max-time <s>    : stops the program with an error after s seconds.\n");
+	printf("    --max-cpu <s>     : stops the program with an error after s seconds of CPU time.\n");
+	printf("    --max-heap <bytes>: stops the program with an error when its lists, structs and closures take more than bytes, or a string it builds doesn't fit in what's left, which takes a K, M or G suffix. Strings the program holds aren't counted.\n");
+	printf("    --max-depth <n>   : stops the program with an error when a call is made with n calls on the call stack, counting the top level.\n");
 	safe_exit(1);
 }
 
+// Set by --max-instructions, --max-time, --max-cpu, --max-heap and --max-depth
+static struct vm_limits limits;
+// Set by every other option, the VM takes a copy
+static struct settings settings;
+// No source is loaded, runtime errors only show line numbers
+static struct source_table sources;
+
 // The first non-valid option is typically the file name / source string.
 // The other non-valid options are the arguments.
 // Returns true if user prompted for help.
@@ -33,21 +47,25 @@ bool process_options(char** options, int len, char** source) {
 	bool has_encountered_invalid = false;
 	*source = NULL;
 	for (i = 0; i < len; i++) {
+		if (i + 1 < len && vm_limits_option(&limits, options[i], options[i + 1])) {
+			i++;
+			continue;
+		}
 		if (streq("-v", options[i]) ||
 			streq("--verbose", options[i])) {
-			set_settings_flag(SETTINGS_VERBOSE);
+			settings.flags[SETTINGS_VERBOSE] = true;
 		}
 		else if (streq("--nogc", options[i])) {
-			set_settings_flag(SETTINGS_NOGC);
+			settings.flags[SETTINGS_NOGC] = true;
 		}
 		else if (streq("--trace-vm", options[i])) {
-			set_settings_flag(SETTINGS_TRACE_VM);
+			settings.flags[SETTINGS_TRACE_VM] = true;
 		}
 		else if (streq("--trace-refcnt", options[i])) {
-			set_settings_flag(SETTINGS_TRACE_REFCNT);
+			settings.flags[SETTINGS_TRACE_REFCNT] = true;
 		}
 		else if (streq("--sandbox", options[i])) {
-			set_settings_flag(SETTINGS_SANDBOXED);
+			settings.flags[SETTINGS_SANDBOXED] = true;
 		}
 		else if (streq("-h", options[i]) ||
 				 streq("--help", options[i])) {
@@ -70,6 +88,7 @@ bool process_options(char** options, int len, char** source) {
 
 int main(int argc, char** argv) {
 	determine_endianness();
+	settings = get_default_settings();
 	char *option_result;
 	if (process_options(&argv[1], argc - 1, &option_result)) {
 		// User asked for -h / --help
@@ -78,7 +97,7 @@ int main(int argc, char** argv) {
 	if (!option_result) {
 		invalid_usage();
 	}
-	set_settings_flag(SETTINGS_STRICT_ERROR);
+	settings.flags[SETTINGS_STRICT_ERROR] = true;
 	// FILE READ MODE
 	long length = 0;
 	FILE* file = fopen(option_result, "r");
@@ -108,10 +127,13 @@ int main(int argc, char** argv) {
 	fread(bytecode_stream, sizeof(uint8_t), length, file);
 	fclose(file);
 
-	struct vm* vm = vm_init();
+	heap_snapshot_install_signal();
+	init_source(&sources, 0, "", 0, false);
+	struct vm* vm = vm_init(&settings, &sources);
+	vm_set_limits(vm, &limits);
 	push_frame(vm->memory, "main", 0, 0);
 
-	vm_set_instruction_pointer(vm, vm_load_code(vm, bytecode_stream, size, get_settings_flag(SETTINGS_REPL)));
+	vm_set_instruction_pointer(vm, vm_load_code(vm, bytecode_stream, size, settings.flags[SETTINGS_REPL]));
 	vm_run(vm);
 
 	vm_destroy(vm);
@@ -120,7 +142,6 @@ int main(int argc, char** argv) {
 	}
 
 	safe_free(bytecode_stream);
-	free_imported_libraries_ll();
 	check_leak();
 	return 0;
 }
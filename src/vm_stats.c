@@ -0,0 +1,131 @@
+#include "vm_stats.h"
+#include "global.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Only the most frequent are shown in the table, the JSON has everything
+#define VM_STATS_TABLE_ROWS 20
+
+struct count_entry {
+	size_t count;
+	size_t index;
+};
+
+struct vm_stats* vm_stats_create(void) {
+	return safe_calloc(1, sizeof(struct vm_stats));
+}
+
+void vm_stats_destroy(struct vm_stats* stats) {
+	safe_free(stats);
+}
+
+static int by_count(const void* a, const void* b) {
+	const struct count_entry* x = a;
+	const struct count_entry* y = b;
+	if (x->count != y->count) {
+		return x->count < y->count ? 1 : -1;
+	}
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// nonzero_counts(counts, n, found) returns the counts that aren't 0 with
+//   where they are in counts, most frequent first
+// effects: allocates memory, caller must free
+static struct count_entry* nonzero_counts(const size_t* counts, size_t n, size_t* found) {
+	struct count_entry* entries = safe_malloc(sizeof(struct count_entry) * (n + 1));
+	*found = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (counts[i]) {
+			entries[*found].count = counts[i];
+			entries[*found].index = i;
+			*found += 1;
+		}
+	}
+	qsort(entries, *found, sizeof(struct count_entry), by_count);
+	return entries;
+}
+
+static const char* type_name(size_t type) {
+	// Skip the D_
+	return data_string[type] + 2;
+}
+
+static void write_pair(FILE* file, size_t index) {
+	fprintf(file, "%s %s", opcode_string[index / OPCODE_COUNT],
+		opcode_string[index % OPCODE_COUNT]);
+}
+
+static void write_binop(FILE* file, size_t index) {
+	size_t b = index % DATA_TYPE_COUNT;
+	size_t a = index / DATA_TYPE_COUNT % DATA_TYPE_COUNT;
+	size_t op = index / DATA_TYPE_COUNT / DATA_TYPE_COUNT;
+	fprintf(file, "%s %s %s", type_name(a), operator_string[op], type_name(b));
+}
+
+static void write_table(FILE* table, const char* title, struct count_entry* entries,
+		size_t found, size_t total, void (*write_name)(FILE*, size_t)) {
+	fprintf(table, "%s\n", title);
+	fprintf(table, "%14s %7s  %s\n", "count", "%", "");
+	for (size_t i = 0; i < found && i < VM_STATS_TABLE_ROWS; i++) {
+		fprintf(table, "%14zu %6.2f%%  ", entries[i].count,
+			total ? 100.0 * entries[i].count / total : 0);
+		write_name(table, entries[i].index);
+		fprintf(table, "\n");
+	}
+}
+
+static void write_json(FILE* json, const char* key, struct count_entry* entries,
+		size_t found, void (*write_name)(FILE*, size_t)) {
+	fprintf(json, "  \"%s\": {", key);
+	for (size_t i = 0; i < found; i++) {
+		fprintf(json, "%s\n    \"", i ? "," : "");
+		write_name(json, entries[i].index);
+		fprintf(json, "\": %zu", entries[i].count);
+	}
+	fprintf(json, "\n  },\n");
+}
+
+static void write_opcode_name(FILE* file, size_t index) {
+	fprintf(file, "%s", opcode_string[index]);
+}
+
+void vm_stats_report(struct vm_stats* stats, FILE* table, FILE* json) {
+	size_t instructions = 0;
+	for (size_t i = 0; i < OPCODE_COUNT; i++) {
+		instructions += stats->opcodes[i];
+	}
+	size_t binops = 0;
+	const size_t* binop_counts = &stats->binops[0][0][0];
+	size_t binop_size = OPERATOR_COUNT * DATA_TYPE_COUNT * DATA_TYPE_COUNT;
+	for (size_t i = 0; i < binop_size; i++) {
+		binops += binop_counts[i];
+	}
+
+	size_t opcodes_found, pairs_found, binops_found;
+	struct count_entry* opcodes = nonzero_counts(stats->opcodes, OPCODE_COUNT, &opcodes_found);
+	struct count_entry* pairs = nonzero_counts(&stats->pairs[0][0],
+		OPCODE_COUNT * OPCODE_COUNT, &pairs_found);
+	struct count_entry* binop_entries = nonzero_counts(binop_counts, binop_size, &binops_found);
+
+	fprintf(table, "VM Stats: %zu instructions\n", instructions);
+	write_table(table, "Opcodes", opcodes, opcodes_found, instructions, write_opcode_name);
+	write_table(table, "Opcode pairs", pairs, pairs_found, instructions, write_pair);
+	write_table(table, "Operand types of binary operators",
+		binop_entries, binops_found, binops, write_binop);
+	fprintf(table, "Overload lookups: %zu, found: %zu (%.2f%%)\n",
+		stats->overload_lookups, stats->overload_hits,
+		stats->overload_lookups ?
+			100.0 * stats->overload_hits / stats->overload_lookups : 0);
+
+	if (json) {
+		fprintf(json, "{\n  \"instructions\": %zu,\n", instructions);
+		write_json(json, "opcodes", opcodes, opcodes_found, write_opcode_name);
+		write_json(json, "pairs", pairs, pairs_found, write_pair);
+		write_json(json, "binops", binop_entries, binops_found, write_binop);
+		fprintf(json, "  \"overload_lookups\": %zu,\n  \"overload_hits\": %zu\n}\n",
+			stats->overload_lookups, stats->overload_hits);
+	}
+	safe_free(opcodes);
+	safe_free(pairs);
+	safe_free(binop_entries);
+}
@@ -0,0 +1,44 @@
+#ifndef VM_STATS_H
+#define VM_STATS_H
+
+#include "codegen.h"
+#include "data.h"
+#include "operators.h"
+#include <stdio.h>
+
+// vm_stats.h - Felix Guo
+// Counts what the VM runs for --vm-stats: each opcode, each opcode followed
+//   by another, the operand types of each binary operator and how often
+//   looking for an operator overload finds one. The VM counts opcodes and
+//   operands in a copy of its dispatch loop that runs when the flag is set,
+//   so the usual loop pays nothing for them. Overload lookups are counted
+//   where they happen, they are slow already.
+
+#define COUNT_ONE(x) + 1
+enum {
+	OPCODE_COUNT = 0 FOREACH_OPCODE(COUNT_ONE),
+	OPERATOR_COUNT = O_SAFE_NAVIGATE + 1
+};
+#undef COUNT_ONE
+
+struct vm_stats {
+	size_t opcodes[OPCODE_COUNT];
+	// Indexed by an opcode, then the one dispatched right after it
+	size_t pairs[OPCODE_COUNT][OPCODE_COUNT];
+	// Indexed by operator, then the types of its left and right operands
+	size_t binops[OPERATOR_COUNT][DATA_TYPE_COUNT][DATA_TYPE_COUNT];
+	size_t overload_lookups;
+	size_t overload_hits;
+};
+
+// vm_stats_create() returns a set of counters at zero
+struct vm_stats* vm_stats_create(void);
+
+// vm_stats_report(stats, table, json) writes the most frequent of each count
+//   as a table to table, and all of them as JSON to json, which may be 0
+void vm_stats_report(struct vm_stats* stats, FILE* table, FILE* json);
+
+// vm_stats_destroy(stats) frees the counters
+void vm_stats_destroy(struct vm_stats* stats);
+
+#endif
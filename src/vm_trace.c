@@ -0,0 +1,151 @@
+#include "vm_trace.h"
+#include "global.h"
+#include "source.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+uint64_t vm_trace_now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+#ifndef _WIN32
+static size_t mapped_size(struct vm_trace* trace) {
+	return sizeof(struct vm_trace_header) +
+		(trace->mask + 1) * sizeof(struct vm_trace_record);
+}
+
+struct vm_trace* vm_trace_create(const char* path, size_t capacity, bool timestamps) {
+	size_t rounded = 1;
+	while (rounded < capacity) {
+		rounded <<= 1;
+	}
+	struct vm_trace* trace = safe_calloc(1, sizeof(struct vm_trace));
+	trace->path = safe_strdup(path);
+	trace->mask = rounded - 1;
+	trace->timestamps = timestamps;
+	trace->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (trace->fd < 0 || ftruncate(trace->fd, mapped_size(trace)) != 0) {
+		fprintf(stderr, "Error opening %s to write the VM trace.\n", path);
+		if (trace->fd >= 0) {
+			close(trace->fd);
+		}
+		safe_free(trace->path);
+		safe_free(trace);
+		return 0;
+	}
+	void* map = mmap(0, mapped_size(trace), PROT_READ | PROT_WRITE, MAP_SHARED,
+		trace->fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Error mapping %s to write the VM trace.\n", path);
+		close(trace->fd);
+		safe_free(trace->path);
+		safe_free(trace);
+		return 0;
+	}
+	trace->header = map;
+	trace->records = (struct vm_trace_record*)(trace->header + 1);
+	memcpy(trace->header->magic, VM_TRACE_MAGIC, sizeof(trace->header->magic));
+	trace->header->record_size = sizeof(struct vm_trace_record);
+	trace->header->flags = timestamps ? VM_TRACE_TIMESTAMPS : 0;
+	trace->header->capacity = rounded;
+	trace->start = vm_trace_now();
+	return trace;
+}
+
+// write_all(fd, buffer, size, offset) writes all of buffer at offset,
+//   returns false if it couldn't
+static bool write_all(int fd, const void* buffer, size_t size, off_t offset) {
+	const char* bytes = buffer;
+	while (size) {
+		ssize_t written = pwrite(fd, bytes, size, offset);
+		if (written <= 0) {
+			return false;
+		}
+		bytes += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+bool vm_trace_write_code(struct vm_trace* trace, uint8_t* bytecode, size_t size,
+	const struct source_table* sources) {
+	uint64_t offset = mapped_size(trace);
+	bool ok = write_all(trace->fd, bytecode, size, offset);
+	uint64_t sources_offset = offset + size;
+	uint64_t sources_size = 0;
+	for (int u = 0; ok && u < source_unit_count(sources); u++) {
+		int line = u << SOURCE_UNIT_SHIFT;
+		const char* name = get_source_name_at(sources, line);
+		const char* text = get_source_buffer_at(sources, line);
+		if (!name) name = "";
+		if (!text) text = "";
+		ok = write_all(trace->fd, name, strlen(name) + 1, sources_offset + sources_size);
+		sources_size += strlen(name) + 1;
+		ok = ok && write_all(trace->fd, text, strlen(text) + 1, sources_offset + sources_size);
+		sources_size += strlen(text) + 1;
+	}
+	if (!ok) {
+		fprintf(stderr, "Error writing the bytecode to the VM trace %s.\n", trace->path);
+		return false;
+	}
+	trace->header->bytecode_offset = offset;
+	trace->header->bytecode_size = size;
+	trace->header->sources_offset = sources_offset;
+	trace->header->sources_size = sources_size;
+	return true;
+}
+
+void vm_trace_finish(struct vm_trace* trace, uint8_t* bytecode, size_t size,
+	const struct source_table* sources) {
+	if (!vm_trace_write_code(trace, bytecode, size, sources)) {
+		return;
+	}
+	uint64_t kept = trace->next < trace->mask + 1 ? trace->next : trace->mask + 1;
+	fprintf(stderr, "VM trace of the last %llu of %llu instructions written to %s\n",
+		(unsigned long long) kept, (unsigned long long) trace->next, trace->path);
+}
+
+void vm_trace_destroy(struct vm_trace* trace) {
+	munmap(trace->header, mapped_size(trace));
+	close(trace->fd);
+	safe_free(trace->path);
+	safe_free(trace);
+}
+#else
+struct vm_trace* vm_trace_create(const char* path, size_t capacity, bool timestamps) {
+	UNUSED(capacity);
+	UNUSED(timestamps);
+	fprintf(stderr, "Error opening %s, VM traces need mmap.\n", path);
+	return 0;
+}
+
+bool vm_trace_write_code(struct vm_trace* trace, uint8_t* bytecode, size_t size,
+	const struct source_table* sources) {
+	UNUSED(trace);
+	UNUSED(bytecode);
+	UNUSED(size);
+	UNUSED(sources);
+	return false;
+}
+
+void vm_trace_finish(struct vm_trace* trace, uint8_t* bytecode, size_t size,
+	const struct source_table* sources) {
+	UNUSED(trace);
+	UNUSED(bytecode);
+	UNUSED(size);
+	UNUSED(sources);
+}
+
+void vm_trace_destroy(struct vm_trace* trace) {
+	UNUSED(trace);
+}
+#endif
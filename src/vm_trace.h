@@ -0,0 +1,106 @@
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// vm_trace.h - Felix Guo
+// Records every instruction the VM dispatches for --trace-ring, as fixed
+//   size binary records in a ring buffer mapped from a file, so a long run
+//   can be traced at close to full speed and the last instructions it ran
+//   are on disk even if it crashes. tools/trace_decode reads the file back
+//   and disassembles it.
+//
+// The file is a vm_trace_header, then capacity records, then the bytecode
+//   the VM had loaded and the text of every source unit, each as its name,
+//   a null, its text and a null. The code is written once the program is
+//   loaded, before it runs, and again when the run finishes to take in what
+//   imports added, until then bytecode_offset is 0. The record written n-th
+//   is at n % capacity, the oldest kept is max(0, written - capacity).
+
+#define VM_TRACE_MAGIC "WTRACE1"
+// Records kept by default, about 24 MB of file
+#define VM_TRACE_DEFAULT_CAPACITY (1 << 20)
+
+// Set in vm_trace_header.flags when records have timestamps
+#define VM_TRACE_TIMESTAMPS 1
+
+struct source_table;
+
+struct vm_trace_header {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t flags;
+	uint64_t capacity;
+	uint64_t written;
+	uint64_t bytecode_offset;
+	uint64_t bytecode_size;
+	uint64_t sources_offset;
+	uint64_t sources_size;
+};
+
+struct vm_trace_record {
+	uint32_t pc;
+	// The line as the VM encodes it, with the source unit in the high bits
+	uint32_t line;
+	uint32_t stack_depth;
+	uint16_t call_depth;
+	uint8_t opcode;
+	uint8_t reserved;
+	// Nanoseconds since the trace started, 0 without timestamps
+	uint64_t time;
+};
+
+struct vm_trace {
+	char* path;
+	int fd;
+	struct vm_trace_header* header;
+	struct vm_trace_record* records;
+	// capacity - 1, capacity is a power of two
+	uint64_t mask;
+	uint64_t next;
+	bool timestamps;
+	uint64_t start;
+};
+
+// vm_trace_create(path, capacity, timestamps) creates the file at path
+//   with room for capacity records, rounded up to a power of two, and maps
+//   it in. Returns 0 and prints why if it couldn't.
+struct vm_trace* vm_trace_create(const char* path, size_t capacity, bool timestamps);
+
+// vm_trace_now() returns a monotonic time in nanoseconds
+uint64_t vm_trace_now(void);
+
+// vm_trace_record(trace, pc, opcode, line, stack_depth, call_depth) adds a
+//   record for the instruction about to run, over the oldest one if full
+static inline void vm_trace_record(struct vm_trace* trace, uint32_t pc, uint8_t opcode,
+		int line, size_t stack_depth, size_t call_depth) {
+	struct vm_trace_record* record = &trace->records[trace->next & trace->mask];
+	record->pc = pc;
+	record->line = line;
+	record->stack_depth = stack_depth;
+	record->call_depth = call_depth;
+	record->opcode = opcode;
+	record->reserved = 0;
+	record->time = trace->timestamps ? vm_trace_now() - trace->start : 0;
+	// Kept up to date in the file so a crash leaves it readable
+	trace->header->written = ++trace->next;
+}
+
+// vm_trace_write_code(trace, bytecode, size, sources) writes the bytecode
+//   the records refer to and the source in sources after the records, over
+//   any written before. Returns false and prints why if it couldn't.
+bool vm_trace_write_code(struct vm_trace* trace, uint8_t* bytecode, size_t size,
+	const struct source_table* sources);
+
+// vm_trace_finish(trace, bytecode, size, sources) writes the code as it is
+//   at the end of the run and reports the trace, call it before the source
+//   is freed
+void vm_trace_finish(struct vm_trace* trace, uint8_t* bytecode, size_t size,
+	const struct source_table* sources);
+
+// vm_trace_destroy(trace) unmaps and closes the file
+void vm_trace_destroy(struct vm_trace* trace);
+
+#endif
@@ -0,0 +1,4 @@
+// Helper for file_import.in, compiled as its own unit.
+let greeting = "hello from a unit";
+let twice => (x) x * 2;
+"unit body ran";
@@ -0,0 +1,373 @@
+/*
+ * Heap Snapshot Analyzer
+ * By: Felix Guo
+ * Reads a heap snapshot written by Wendy.heapSnapshot or on SIGUSR2, whose
+ *   format is described in src/heap_snapshot.h, and reports what keeps the
+ *   heap alive: the containers retaining the most through the dominator
+ *   tree, the roots they hang from, and the reference cycles.
+ *
+ * eg: ./heap-analyze wendy-1234-1.heap [rows]
+ *   rows is how many entries each table shows, 20 by default.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+struct Edge {
+	int to;
+	string label;
+};
+
+struct Node {
+	string id;
+	string type;
+	size_t values = 0;
+	size_t bytes = 0;
+	size_t refs = 0;
+	vector<Edge> out;
+	// Roots referring to this node
+	vector<string> roots;
+};
+
+// Node 0 is a made up root that refers to everything the program does
+struct Heap {
+	vector<Node> nodes;
+	unordered_map<string, int> index;
+};
+
+static bool readHeap(const char* filename, Heap& heap) {
+	ifstream file(filename);
+	string line;
+	if (!getline(file, line) || line != "wendy-heap 1") {
+		cerr << filename << " is not a Wendy heap snapshot." << endl;
+		return false;
+	}
+	heap.nodes.push_back(Node());
+	heap.nodes[0].id = "<roots>";
+	heap.nodes[0].type = "ROOT";
+	vector<pair<string, Edge>> edges;
+	vector<pair<string, string>> roots;
+	while (getline(file, line)) {
+		istringstream fields(line);
+		string kind;
+		fields >> kind;
+		if (kind == "node") {
+			Node node;
+			fields >> node.id >> node.type >> node.values >> node.bytes >> node.refs;
+			heap.index[node.id] = heap.nodes.size();
+			heap.nodes.push_back(node);
+		}
+		else if (kind == "edge") {
+			string from, to, label;
+			fields >> from >> to;
+			fields.get();
+			getline(fields, label);
+			edges.push_back({ from + " " + to, { 0, label } });
+		}
+		else if (kind == "root") {
+			string to, depth, function, name;
+			fields >> to >> depth >> function;
+			fields.get();
+			getline(fields, name);
+			string where = depth == "-" ? "<stack>[" + name + "]" :
+				function + "#" + depth + " " + name;
+			roots.push_back({ to, where });
+		}
+	}
+	for (auto& edge : edges) {
+		istringstream ends(edge.first);
+		string from, to;
+		ends >> from >> to;
+		auto f = heap.index.find(from);
+		auto t = heap.index.find(to);
+		if (f == heap.index.end() || t == heap.index.end()) continue;
+		edge.second.to = t->second;
+		heap.nodes[f->second].out.push_back(edge.second);
+	}
+	for (auto& root : roots) {
+		auto t = heap.index.find(root.first);
+		if (t == heap.index.end()) continue;
+		Node& target = heap.nodes[t->second];
+		if (target.roots.empty()) {
+			heap.nodes[0].out.push_back({ t->second, root.second });
+		}
+		target.roots.push_back(root.second);
+	}
+	return true;
+}
+
+// Reverse postorder of the nodes reachable from the made up root
+static vector<int> reversePostorder(const Heap& heap) {
+	vector<int> order;
+	vector<char> seen(heap.nodes.size(), 0);
+	vector<pair<int, size_t>> stack;
+	stack.push_back({ 0, 0 });
+	seen[0] = 1;
+	while (!stack.empty()) {
+		auto& top = stack.back();
+		const Node& node = heap.nodes[top.first];
+		if (top.second < node.out.size()) {
+			int next = node.out[top.second++].to;
+			if (!seen[next]) {
+				seen[next] = 1;
+				stack.push_back({ next, 0 });
+			}
+		}
+		else {
+			order.push_back(top.first);
+			stack.pop_back();
+		}
+	}
+	reverse(order.begin(), order.end());
+	return order;
+}
+
+// Immediate dominators by Cooper, Harvey and Kennedy's iterative algorithm,
+//   -1 for nodes the roots can't reach
+static vector<int> dominators(const Heap& heap, const vector<int>& order) {
+	size_t n = heap.nodes.size();
+	vector<int> position(n, -1);
+	for (size_t i = 0; i < order.size(); i++) {
+		position[order[i]] = i;
+	}
+	vector<vector<int>> predecessors(n);
+	for (int from : order) {
+		for (auto& edge : heap.nodes[from].out) {
+			predecessors[edge.to].push_back(from);
+		}
+	}
+	vector<int> idom(n, -1);
+	idom[0] = 0;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t i = 1; i < order.size(); i++) {
+			int node = order[i];
+			int result = -1;
+			for (int pred : predecessors[node]) {
+				if (idom[pred] == -1) continue;
+				if (result == -1) {
+					result = pred;
+					continue;
+				}
+				int a = pred, b = result;
+				while (a != b) {
+					while (position[a] > position[b]) a = idom[a];
+					while (position[b] > position[a]) b = idom[b];
+				}
+				result = a;
+			}
+			if (idom[node] != result) {
+				idom[node] = result;
+				changed = true;
+			}
+		}
+	}
+	return idom;
+}
+
+// Shortest way to each node from a root, written like Wendy code
+static vector<string> paths(const Heap& heap) {
+	vector<string> path(heap.nodes.size());
+	vector<char> seen(heap.nodes.size(), 0);
+	vector<int> queue = { 0 };
+	seen[0] = 1;
+	for (size_t i = 0; i < queue.size(); i++) {
+		int from = queue[i];
+		for (auto& edge : heap.nodes[from].out) {
+			if (seen[edge.to]) continue;
+			seen[edge.to] = 1;
+			if (from == 0) {
+				path[edge.to] = edge.label;
+			}
+			else if (!edge.label.empty() && edge.label[0] == '[') {
+				path[edge.to] = path[from] + edge.label;
+			}
+			else {
+				path[edge.to] = path[from] + "." + edge.label;
+			}
+			queue.push_back(edge.to);
+		}
+	}
+	return path;
+}
+
+// Strongly connected components by Tarjan's algorithm, without recursion
+static vector<vector<int>> components(const Heap& heap) {
+	size_t n = heap.nodes.size();
+	vector<int> index(n, -1), low(n, 0);
+	vector<char> onStack(n, 0);
+	vector<int> stack;
+	vector<vector<int>> result;
+	int counter = 0;
+	for (size_t start = 1; start < n; start++) {
+		if (index[start] != -1) continue;
+		vector<pair<int, size_t>> calls = { { (int) start, 0 } };
+		index[start] = low[start] = counter++;
+		stack.push_back(start);
+		onStack[start] = 1;
+		while (!calls.empty()) {
+			int node = calls.back().first;
+			size_t& next = calls.back().second;
+			if (next < heap.nodes[node].out.size()) {
+				int to = heap.nodes[node].out[next++].to;
+				if (index[to] == -1) {
+					index[to] = low[to] = counter++;
+					stack.push_back(to);
+					onStack[to] = 1;
+					calls.push_back({ to, 0 });
+				}
+				else if (onStack[to]) {
+					low[node] = min(low[node], index[to]);
+				}
+				continue;
+			}
+			calls.pop_back();
+			if (!calls.empty()) {
+				int parent = calls.back().first;
+				low[parent] = min(low[parent], low[node]);
+			}
+			if (low[node] == index[node]) {
+				vector<int> component;
+				int member;
+				do {
+					member = stack.back();
+					stack.pop_back();
+					onStack[member] = 0;
+					component.push_back(member);
+				} while (member != node);
+				bool isCycle = component.size() > 1;
+				for (auto& edge : heap.nodes[node].out) {
+					isCycle = isCycle || edge.to == node;
+				}
+				if (isCycle) {
+					result.push_back(component);
+				}
+			}
+		}
+	}
+	return result;
+}
+
+static string describe(const Node& node) {
+	return node.type + " " + node.id;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		cerr << "usage: heap-analyze <snapshot> [rows]" << endl;
+		return 1;
+	}
+	size_t rows = argc > 2 ? stoul(argv[2]) : 20;
+	Heap heap;
+	if (!readHeap(argv[1], heap)) {
+		return 1;
+	}
+	size_t n = heap.nodes.size();
+	vector<int> order = reversePostorder(heap);
+	vector<int> idom = dominators(heap, order);
+	vector<string> path = paths(heap);
+
+	// Retained size is a node and everything it dominates, children come
+	//   after their dominator in reverse postorder
+	vector<size_t> retained(n, 0), retainedCount(n, 0);
+	for (size_t i = 0; i < n; i++) {
+		retained[i] = heap.nodes[i].bytes;
+		retainedCount[i] = i ? 1 : 0;
+	}
+	for (size_t i = order.size(); i-- > 1;) {
+		int node = order[i];
+		retained[idom[node]] += retained[node];
+		retainedCount[idom[node]] += retainedCount[node];
+	}
+
+	size_t totalBytes = 0;
+	unordered_map<string, pair<size_t, size_t>> byType;
+	for (size_t i = 1; i < n; i++) {
+		totalBytes += heap.nodes[i].bytes;
+		byType[heap.nodes[i].type].first += 1;
+		byType[heap.nodes[i].type].second += heap.nodes[i].bytes;
+	}
+	size_t unreachable = 0, unreachableBytes = 0;
+	for (size_t i = 1; i < n; i++) {
+		if (idom[i] == -1) {
+			unreachable += 1;
+			unreachableBytes += heap.nodes[i].bytes;
+		}
+	}
+	printf("Heap: %zu containers, %zu bytes\n", n - 1, totalBytes);
+	printf("Reachable from roots: %zu containers, %zu bytes\n",
+		retainedCount[0], retained[0]);
+	printf("Unreachable, kept alive by cycles: %zu containers, %zu bytes\n",
+		unreachable, unreachableBytes);
+	printf("%12s %14s  %s\n", "containers", "bytes", "type");
+	vector<pair<string, pair<size_t, size_t>>> types(byType.begin(), byType.end());
+	sort(types.begin(), types.end(), [](const pair<string, pair<size_t, size_t>>& a,
+			const pair<string, pair<size_t, size_t>>& b) {
+		return a.second.second > b.second.second;
+	});
+	for (auto& type : types) {
+		printf("%12zu %14zu  %s\n", type.second.first, type.second.second, type.first.c_str());
+	}
+
+	// Nodes dominated by nothing but the roots, the top of what each root holds
+	vector<int> top;
+	vector<int> retainers;
+	for (size_t i = 1; i < n; i++) {
+		if (idom[i] == 0) top.push_back(i);
+		if (idom[i] != -1) retainers.push_back(i);
+	}
+	auto byRetained = [&](int a, int b) { return retained[a] > retained[b]; };
+	sort(top.begin(), top.end(), byRetained);
+	sort(retainers.begin(), retainers.end(), byRetained);
+
+	printf("\nRoots retaining the most\n");
+	printf("%14s %12s  %s\n", "retained", "containers", "root");
+	for (size_t i = 0; i < top.size() && i < rows; i++) {
+		const Node& node = heap.nodes[top[i]];
+		string names = node.roots.empty() ? path[top[i]] + " (also reachable elsewhere)" : node.roots[0];
+		if (node.roots.size() > 1) {
+			names += " and " + to_string(node.roots.size() - 1) + " more";
+		}
+		printf("%14zu %12zu  %s = %s\n", retained[top[i]], retainedCount[top[i]],
+			names.c_str(), describe(node).c_str());
+	}
+
+	printf("\nLargest retainers (dominators)\n");
+	printf("%14s %12s %10s  %s\n", "retained", "containers", "self", "container");
+	for (size_t i = 0; i < retainers.size() && i < rows; i++) {
+		const Node& node = heap.nodes[retainers[i]];
+		printf("%14zu %12zu %10zu  %s at %s\n", retained[retainers[i]],
+			retainedCount[retainers[i]], node.bytes, describe(node).c_str(),
+			path[retainers[i]].c_str());
+	}
+
+	vector<vector<int>> cycles = components(heap);
+	vector<size_t> cycleBytes(cycles.size(), 0);
+	for (size_t i = 0; i < cycles.size(); i++) {
+		for (int member : cycles[i]) cycleBytes[i] += heap.nodes[member].bytes;
+	}
+	vector<size_t> cycleOrder(cycles.size());
+	for (size_t i = 0; i < cycles.size(); i++) cycleOrder[i] = i;
+	sort(cycleOrder.begin(), cycleOrder.end(),
+		[&](size_t a, size_t b) { return cycleBytes[a] > cycleBytes[b]; });
+	printf("\nCycles: %zu\n", cycles.size());
+	printf("%14s %12s %10s  %s\n", "bytes", "containers", "reachable", "one member");
+	for (size_t i = 0; i < cycleOrder.size() && i < rows; i++) {
+		const vector<int>& cycle = cycles[cycleOrder[i]];
+		int member = cycle[0];
+		bool reachable = idom[member] != -1;
+		printf("%14zu %12zu %10s  %s%s%s\n", cycleBytes[cycleOrder[i]], cycle.size(),
+			reachable ? "yes" : "no", describe(heap.nodes[member]).c_str(),
+			reachable ? " at " : "", reachable ? path[member].c_str() : "");
+	}
+	return 0;
+}
@@ -0,0 +1,309 @@
+/*
+ * VM Trace Decoder
+ * By: Felix Guo
+ * Prints the instructions recorded by wendy --trace-ring, oldest first, with
+ *   their disassembly and source line. The file format is described in
+ *   src/vm_trace.h. A trace from a run that crashed only has the code loaded
+ *   before it started, instructions from imports after that show just their
+ *   opcode and line, as does every instruction if the trace has no code.
+ *
+ * eg: ./trace-decode run.trace [--function name] [--range lo-hi] [--last n]
+ *   --function keeps the instructions in the body of functions named name,
+ *     main for the top level. --range keeps those with an address from lo
+ *     to hi inclusive, in hex with 0x or decimal. --last keeps the last n
+ *     that match.
+ */
+
+#include "../../src/codegen.h"
+#include "../../src/global.h"
+#include "../../src/source.h"
+#include "../../src/vm_stats.h"
+#include "../../src/vm_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct function {
+	char* name;
+	address start;
+	address end;
+};
+
+struct program {
+	uint8_t* bytecode;
+	size_t size;
+	// Disassembly of the instruction at each address, 0 between them
+	char** text;
+	// Innermost function around each address, -1 for the top level
+	int* owner;
+	// Source line each address was compiled from, the VM's own line goes
+	//   stale across returns
+	int* lines;
+	struct function* functions;
+	size_t function_count;
+	// Text and lines of each source unit
+	char** unit_names;
+	char*** unit_lines;
+	int* unit_line_counts;
+	int unit_count;
+};
+
+static void usage(void) {
+	fprintf(stderr, "usage: trace-decode <trace> [--function name] [--range lo-hi] [--last n]\n");
+	exit(1);
+}
+
+static char* disassemble(uint8_t* bytecode, unsigned int* i) {
+	char* text = 0;
+	size_t length = 0;
+	FILE* buffer = open_memstream(&text, &length);
+	print_instruction(bytecode, i, buffer);
+	fclose(buffer);
+	return text;
+}
+
+// find_functions(program) finds every function body, compiled as a jump
+//   over the body followed by a push of its address, and names it by the
+//   declaration it's made for
+static void find_functions(struct program* program) {
+	size_t capacity = 16;
+	program->functions = malloc(sizeof(struct function) * capacity);
+	for (unsigned int i = 0; i < program->size; i++) {
+		if (!program->text[i] || program->bytecode[i] != OP_PUSH) continue;
+		unsigned int end = i + 1;
+		struct data pushed = get_data(program->bytecode + end, &end);
+		if (pushed.type != D_INSTRUCTION_ADDRESS || pushed.value.number >= i) {
+			continue;
+		}
+		if (program->function_count == capacity) {
+			capacity *= 2;
+			program->functions = realloc(program->functions, sizeof(struct function) * capacity);
+		}
+		struct function* function = &program->functions[program->function_count++];
+		function->start = pushed.value.number;
+		function->end = i;
+		function->name = "anonymous";
+		// The function is built with OP_MKREF then maybe declared
+		for (unsigned int j = end; j < program->size; j++) {
+			if (!program->text[j]) continue;
+			if (program->bytecode[j] == OP_MKREF && program->bytecode[j + 1] == D_FUNCTION) {
+				for (j = j + 1; j < program->size && !program->text[j]; j++);
+				if (j < program->size && (program->bytecode[j] == OP_DECL ||
+						program->bytecode[j] == OP_DECLW)) {
+					function->name = (char*) program->bytecode + j + 1;
+				}
+				break;
+			}
+		}
+	}
+	// Bodies nest, the one starting last around an address is innermost
+	program->owner = malloc(sizeof(int) * program->size);
+	for (size_t i = 0; i < program->size; i++) {
+		program->owner[i] = -1;
+	}
+	for (size_t f = 0; f < program->function_count; f++) {
+		struct function* function = &program->functions[f];
+		for (address a = function->start; a < function->end && a < program->size; a++) {
+			int current = program->owner[a];
+			if (current == -1 || program->functions[current].start <= function->start) {
+				program->owner[a] = f;
+			}
+		}
+	}
+}
+
+static void split_sources(struct program* program, char* sources, size_t size) {
+	size_t capacity = 4;
+	program->unit_names = malloc(sizeof(char*) * capacity);
+	program->unit_lines = malloc(sizeof(char**) * capacity);
+	program->unit_line_counts = malloc(sizeof(int) * capacity);
+	char* at = sources;
+	while (at < sources + size) {
+		if (program->unit_count == (int) capacity) {
+			capacity *= 2;
+			program->unit_names = realloc(program->unit_names, sizeof(char*) * capacity);
+			program->unit_lines = realloc(program->unit_lines, sizeof(char**) * capacity);
+			program->unit_line_counts = realloc(program->unit_line_counts, sizeof(int) * capacity);
+		}
+		int u = program->unit_count++;
+		program->unit_names[u] = at;
+		at += strlen(at) + 1;
+		char* text = at;
+		at += strlen(at) + 1;
+		int lines = 1;
+		for (char* c = text; *c; c++) {
+			lines += *c == '\n';
+		}
+		program->unit_lines[u] = malloc(sizeof(char*) * lines);
+		program->unit_line_counts[u] = lines;
+		program->unit_lines[u][0] = text;
+		int line = 1;
+		for (char* c = text; *c; c++) {
+			if (*c == '\n') {
+				*c = 0;
+				program->unit_lines[u][line++] = c + 1;
+			}
+		}
+	}
+}
+
+static void load_program(struct program* program, FILE* file, struct vm_trace_header* header) {
+	memset(program, 0, sizeof(struct program));
+	if (!header->bytecode_offset) {
+		return;
+	}
+	program->size = header->bytecode_size;
+	program->bytecode = malloc(program->size + 1);
+	char* sources = malloc(header->sources_size + 1);
+	fseek(file, header->bytecode_offset, SEEK_SET);
+	if (fread(program->bytecode, 1, program->size, file) != program->size) {
+		fprintf(stderr, "The bytecode in the trace is cut short.\n");
+		exit(1);
+	}
+	fseek(file, header->sources_offset, SEEK_SET);
+	if (fread(sources, 1, header->sources_size, file) != header->sources_size) {
+		fprintf(stderr, "The source in the trace is cut short.\n");
+		exit(1);
+	}
+	program->text = calloc(program->size + 1, sizeof(char*));
+	program->lines = calloc(program->size + 1, sizeof(int));
+	// Jumping over a function body returns to the line before it
+	int* resume_line = malloc(sizeof(int) * (program->size + 1));
+	for (size_t a = 0; a <= program->size; a++) {
+		resume_line[a] = -1;
+	}
+	int line = 0;
+	unsigned int i = 0;
+	if (program->size > strlen(WENDY_VM_HEADER) &&
+		streq((char*) program->bytecode, WENDY_VM_HEADER)) {
+		i = strlen(WENDY_VM_HEADER) + 1;
+	}
+	while (i < program->size) {
+		unsigned int at = i;
+		if (resume_line[at] != -1) {
+			line = resume_line[at];
+		}
+		if (program->bytecode[at] == OP_SRC || program->bytecode[at] == OP_JMP) {
+			unsigned int operand = at + 1;
+			address a = get_address(program->bytecode + operand, &operand);
+			if (program->bytecode[at] == OP_SRC) {
+				line = a;
+			}
+			else if (a > at && a < program->size && resume_line[a] == -1) {
+				resume_line[a] = line;
+			}
+		}
+		program->lines[at] = line;
+		program->text[at] = disassemble(program->bytecode, &i);
+	}
+	free(resume_line);
+	find_functions(program);
+	split_sources(program, sources, header->sources_size);
+}
+
+static const char* function_name(struct program* program, address pc) {
+	if (!program->owner || pc >= program->size || program->owner[pc] == -1) {
+		return "main";
+	}
+	return program->functions[program->owner[pc]].name;
+}
+
+static void print_record(struct program* program, struct vm_trace_record* record,
+		uint64_t index, bool timestamps) {
+	printf("%10llu ", (unsigned long long) index);
+	if (timestamps) {
+		printf("%12.3fus ", record->time / 1000.0);
+	}
+	printf("%4u %5u <+%04X>: ", record->call_depth, record->stack_depth, record->pc);
+	if (!program->text || record->pc >= program->size || !program->text[record->pc]) {
+		printf("%10s ", record->opcode < OPCODE_COUNT ? opcode_string[record->opcode] : "?");
+		printf("| line %d\n", source_line_number(record->line));
+		return;
+	}
+	int width = printf("%s", program->text[record->pc]);
+	while (width++ < 40) {
+		putchar(' ');
+	}
+	int unit = program->lines[record->pc] >> SOURCE_UNIT_SHIFT;
+	int line = source_line_number(program->lines[record->pc]);
+	printf("| %s ", function_name(program, record->pc));
+	if (unit < program->unit_count && line > 0 && line <= program->unit_line_counts[unit]) {
+		printf("%s:%d %s\n", program->unit_names[unit], line,
+			program->unit_lines[unit][line - 1]);
+	}
+	else {
+		printf("line %d\n", line);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		usage();
+	}
+	determine_endianness();
+	char* function = 0;
+	unsigned long low = 0;
+	unsigned long high = (unsigned long) -1;
+	unsigned long long last = 0;
+	for (int i = 2; i < argc; i++) {
+		if (i + 1 == argc) {
+			usage();
+		}
+		if (streq(argv[i], "--function")) {
+			function = argv[++i];
+		}
+		else if (streq(argv[i], "--range")) {
+			char* end;
+			low = strtoul(argv[++i], &end, 0);
+			if (*end != '-') {
+				usage();
+			}
+			high = strtoul(end + 1, 0, 0);
+		}
+		else if (streq(argv[i], "--last")) {
+			last = strtoull(argv[++i], 0, 0);
+		}
+		else {
+			usage();
+		}
+	}
+	FILE* file = fopen(argv[1], "rb");
+	struct vm_trace_header header;
+	if (!file || fread(&header, sizeof(header), 1, file) != 1 ||
+		memcmp(header.magic, VM_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.record_size != sizeof(struct vm_trace_record)) {
+		fprintf(stderr, "%s is not a Wendy VM trace.\n", argv[1]);
+		return 1;
+	}
+	uint64_t kept = header.written < header.capacity ? header.written : header.capacity;
+	uint64_t first = header.written - kept;
+	struct vm_trace_record* records = malloc(sizeof(struct vm_trace_record) * header.capacity);
+	if (fread(records, sizeof(struct vm_trace_record), header.capacity, file) != header.capacity) {
+		fprintf(stderr, "The records in %s are cut short.\n", argv[1]);
+		return 1;
+	}
+	struct program program;
+	load_program(&program, file, &header);
+	fclose(file);
+	if (!header.bytecode_offset) {
+		printf("The trace has no bytecode, showing opcodes only.\n");
+	}
+	printf("%llu instructions run, the last %llu kept.\n",
+		(unsigned long long) header.written, (unsigned long long) kept);
+
+	// Matches are found first so --last can count back from the end
+	uint64_t* matches = malloc(sizeof(uint64_t) * (kept + 1));
+	uint64_t match_count = 0;
+	for (uint64_t n = first; n < header.written; n++) {
+		struct vm_trace_record* record = &records[n & (header.capacity - 1)];
+		if (record->pc < low || record->pc > high) continue;
+		if (function && !streq(function, function_name(&program, record->pc))) continue;
+		matches[match_count++] = n;
+	}
+	uint64_t from = last && last < match_count ? match_count - last : 0;
+	for (uint64_t m = from; m < match_count; m++) {
+		print_record(&program, &records[matches[m] & (header.capacity - 1)], matches[m],
+			header.flags & VM_TRACE_TIMESTAMPS);
+	}
+	return 0;
+}